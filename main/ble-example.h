@@ -54,6 +54,12 @@ void
 gatt_svr_register_cb(struct ble_gatt_register_ctxt *ctxt, void *arg);
 int
 gatt_svr_init(void);
+void
+gatt_svr_notify_event(const uint8_t *pframe, uint8_t len);
+void
+gatt_svr_conn_established(uint16_t conn_handle);
+void
+gatt_svr_conn_closed(uint16_t conn_handle);
 
 #ifdef __cplusplus
 }
@@ -8,13 +8,14 @@
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/entropy.h"
 #include "mbedtls/pk.h"
+#include "mbedtls/asn1.h"
 #include "crypto.h"
 #include "secrets.h"
 
 static const char *TAG = "CRYPTO";
 
 secure_payload_t
-create_signed_payload(void)
+create_signed_payload(uint32_t timestamp)
 {
   secure_payload_t payload = { 0 };
   int ret;
@@ -22,15 +23,22 @@ create_signed_payload(void)
   mbedtls_entropy_context entropy;
   mbedtls_ctr_drbg_context ctr_drbg;
   unsigned char hash[32];
+  unsigned char der[MBEDTLS_ECDSA_MAX_LEN];
   size_t sig_len;
+  unsigned char *p;
+  const unsigned char *end;
+  size_t len;
+  mbedtls_mpi r, s;
 
   // Initialize contexts
   mbedtls_ecdsa_init(&ctx);
   mbedtls_entropy_init(&entropy);
   mbedtls_ctr_drbg_init(&ctr_drbg);
+  mbedtls_mpi_init(&r);
+  mbedtls_mpi_init(&s);
 
-  // Get current timestamp
-  payload.timestamp = 0; //(uint32_t) time(NULL);
+  // Replay counter from the caller, signed as it is sent (little endian)
+  payload.timestamp = timestamp;
 
   do {
     // Seed the RNG
@@ -70,15 +78,15 @@ create_signed_payload(void)
     mbedtls_sha256((unsigned char *) &payload.timestamp, sizeof(payload.timestamp), hash, 0);
 
     // Sign the hash
-    ret = mbedtls_ecdsa_write_signature(&ctx,                      // ECDSA context
-                                        MBEDTLS_MD_SHA256,         // Hash algorithm
-                                        hash,                      // Input hash
-                                        sizeof(hash),              // Hash length
-                                        payload.signature,         // Output signature buffer
-                                        sizeof(payload.signature), // Signature buffer size
-                                        &sig_len,                  // Actual signature length
-                                        mbedtls_ctr_drbg_random,   // RNG function
-                                        &ctr_drbg                  // RNG context
+    ret = mbedtls_ecdsa_write_signature(&ctx,                    // ECDSA context
+                                        MBEDTLS_MD_SHA256,       // Hash algorithm
+                                        hash,                    // Input hash
+                                        sizeof(hash),            // Hash length
+                                        der,                     // Output signature buffer
+                                        sizeof(der),             // Signature buffer size
+                                        &sig_len,                // Actual signature length
+                                        mbedtls_ctr_drbg_random, // RNG function
+                                        &ctr_drbg                // RNG context
     );
 
     if (ret != 0) {
@@ -86,11 +94,35 @@ create_signed_payload(void)
       break;
     }
 
+    // The signature is sent as r and s, 32 bytes each (big endian), not DER
+    p   = der;
+    end = der + sig_len;
+    ret = mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE);
+    if (0 == ret) {
+      ret = mbedtls_asn1_get_mpi(&p, end, &r);
+    }
+    if (0 == ret) {
+      ret = mbedtls_asn1_get_mpi(&p, end, &s);
+    }
+    if (0 == ret) {
+      ret = mbedtls_mpi_write_binary(&r, payload.signature, 32);
+    }
+    if (0 == ret) {
+      ret = mbedtls_mpi_write_binary(&s, payload.signature + 32, 32);
+    }
+
+    if (ret != 0) {
+      ESP_LOGE(TAG, "Failed to convert signature: -0x%04x", -ret);
+      break;
+    }
+
     ESP_LOGI(TAG, "Timestamp signed successfully: %lu", (unsigned long) payload.timestamp);
 
   } while (0);
 
   // Cleanup
+  mbedtls_mpi_free(&r);
+  mbedtls_mpi_free(&s);
   mbedtls_ecdsa_free(&ctx);
   mbedtls_entropy_free(&entropy);
   mbedtls_ctr_drbg_free(&ctr_drbg);
@@ -6,10 +6,13 @@
 // Structure to hold the signed timestamp
 typedef struct {
     uint32_t timestamp;
-    uint8_t signature[64];  // ECDSA P-256 signature is 64 bytes
+    uint8_t signature[64];  // ECDSA P-256 signature, r and s (32 bytes each, big endian)
 } __attribute__((packed)) secure_payload_t;
 
-// Function to create a signed payload
-secure_payload_t create_signed_payload(void);
+// Function to create a signed payload. The timestamp is what the gateway
+// checks for replays (vscp-ble-verify.h): it must be new for each payload,
+// payloads far below the newest one it has verified are dropped. Use a
+// counter kept over restarts or the time once it is set, not a constant.
+secure_payload_t create_signed_payload(uint32_t timestamp);
 
 #endif // ESP32_CRYPTO_H
@@ -26,6 +26,15 @@
 #include "services/gatt/ble_svc_gatt.h"
 #include "ble-example.h"
 #include "services/ans/ble_svc_ans.h"
+#include "sdkconfig.h"
+#include "esp_timer.h"
+#include <freertos/FreeRTOS.h>
+#include <vscp.h>
+#include "vscp-ble.h"
+#include "vscp-ble-cfg.h"
+#if CONFIG_VSCP_BLE_PROFILER
+#include "vscp-ble-prof.h"
+#endif
 
 /*** Maximum number of characteristics with the notify flag ***/
 #define MAX_NOTIFY 5
@@ -44,6 +53,77 @@ static uint8_t gatt_svr_dsc_val;
 static const ble_uuid128_t gatt_svr_dsc_uuid =
   BLE_UUID128_INIT(0x01, 0x01, 0x01, 0x01, 0x12, 0x12, 0x12, 0x12, 0x23, 0x23, 0x23, 0x23, 0x34, 0x34, 0x34, 0x34);
 
+/*
+ * VSCP event, holds the last frame sent and is notified for each new one.
+ * Written by the sending task and read by the host task, under
+ * gatt_svr_ev_mux.
+ */
+static uint8_t gatt_svr_ev_val[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+static uint8_t gatt_svr_ev_len;
+static portMUX_TYPE gatt_svr_ev_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t gatt_svr_ev_val_handle;
+static const ble_uuid128_t gatt_svr_ev_uuid =
+  BLE_UUID128_INIT(0x01, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11, 0x22, 0x22, 0x22, 0x22, 0x33, 0x33, 0x33, 0x33);
+
+/*
+ * Register block access. A write selects a run of registers and reads or
+ * writes it, a following read returns the result. Long writes and long
+ * reads move a whole run in one operation.
+ *
+ *   write  op, page MSB, page LSB, reg, count        (op = 0x01, read)
+ *          op, page MSB, page LSB, reg, data...      (op = 0x02, write)
+ *   read   op, status, page MSB, page LSB, reg, count, data...
+ *
+ * Status is a VSCP error code. After a block write the data is the
+ * registers read back. Each connection has its own result. The count is
+ * one byte, so a run is at most 255 registers.
+ */
+#define GATT_SVR_REG_OP_READ   0x01
+#define GATT_SVR_REG_OP_WRITE  0x02
+#define GATT_SVR_REG_HDR_SIZE  4
+#define GATT_SVR_REG_RSP_SIZE  6
+#define GATT_SVR_REG_MAX_COUNT 0xff
+#if CONFIG_EXAMPLE_ENCRYPTION
+#define GATT_SVR_REG_FLAGS                                                                                             \
+  (BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_READ_ENC | BLE_GATT_CHR_F_WRITE_ENC)
+#else
+#define GATT_SVR_REG_FLAGS (BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE)
+#endif
+static uint16_t gatt_svr_reg_val_handle;
+static const ble_uuid128_t gatt_svr_reg_uuid =
+  BLE_UUID128_INIT(0x03, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11, 0x22, 0x22, 0x22, 0x22, 0x33, 0x33, 0x33, 0x33);
+
+#if CONFIG_VSCP_BLE_PROFILER
+/*
+ * Profiler record (see vscp-ble-prof.h), read only. The stack calls back
+ * for each part of a long read, so the parts are cut from a copy taken
+ * for the first part.
+ */
+static uint16_t gatt_svr_prof_val_handle;
+static const ble_uuid128_t gatt_svr_prof_uuid =
+  BLE_UUID128_INIT(0x02, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11, 0x22, 0x22, 0x22, 0x22, 0x33, 0x33, 0x33, 0x33);
+#endif
+
+/*
+ * State kept for each open connection.
+ */
+typedef struct gatt_svr_conn {
+  uint16_t conn_handle; /* BLE_HS_CONN_HANDLE_NONE if the slot is free */
+  /*
+   * Connect to first encrypted read. Tells a bonded central that resumes
+   * encryption from one that pairs again.
+   */
+  bool timing_pending; /* Waiting for the first encrypted read */
+  int64_t connect_us;
+  uint8_t reg_rsp[GATT_SVR_REG_RSP_SIZE + GATT_SVR_REG_MAX_COUNT]; /* Result of the last register request */
+  uint16_t reg_len;
+#if CONFIG_VSCP_BLE_PROFILER
+  uint8_t prof_rec[VSCP_BLE_PROF_RECORD_MAX_SIZE]; /* Record being read */
+  uint16_t prof_len; /* Zero until the first part of a read */
+#endif
+} gatt_svr_conn_t;
+static gatt_svr_conn_t gatt_svr_conns[CONFIG_BT_NIMBLE_MAX_CONNECTIONS];
+
 static int
 gatt_svc_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
 
@@ -72,6 +152,29 @@ static const struct ble_gatt_svc_def gatt_svr_svcs[] = {
                                                          0, /* No more descriptors in this characteristic */
                                                        } },
         },
+        {
+          /*** VSCP events, subscribe to get each frame as it is sent ***/
+          .uuid       = &gatt_svr_ev_uuid.u,
+          .access_cb  = gatt_svc_access,
+          .flags      = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+          .val_handle = &gatt_svr_ev_val_handle,
+        },
+        {
+          /*** VSCP register block read and write ***/
+          .uuid       = &gatt_svr_reg_uuid.u,
+          .access_cb  = gatt_svc_access,
+          .flags      = GATT_SVR_REG_FLAGS,
+          .val_handle = &gatt_svr_reg_val_handle,
+        },
+#if CONFIG_VSCP_BLE_PROFILER
+        {
+          /*** Heap, stack and task profile ***/
+          .uuid       = &gatt_svr_prof_uuid.u,
+          .access_cb  = gatt_svc_access,
+          .flags      = BLE_GATT_CHR_F_READ,
+          .val_handle = &gatt_svr_prof_val_handle,
+        },
+#endif
         {
           0, /* No more characteristics in this service. */
         } },
@@ -101,6 +204,205 @@ gatt_svr_write(struct os_mbuf *om, uint16_t min_len, uint16_t max_len, void *dst
   return 0;
 }
 
+static gatt_svr_conn_t *
+gatt_svr_conn_find(uint16_t conn_handle)
+{
+  for (int i = 0; i < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; i++) {
+    if (gatt_svr_conns[i].conn_handle == conn_handle) {
+      return &gatt_svr_conns[i];
+    }
+  }
+
+  return NULL;
+}
+
+void
+gatt_svr_conn_closed(uint16_t conn_handle)
+{
+  gatt_svr_conn_t *pc;
+
+  if (BLE_HS_CONN_HANDLE_NONE == conn_handle) {
+    return;
+  }
+
+  pc = gatt_svr_conn_find(conn_handle);
+  if (NULL != pc) {
+    memset(pc, 0, sizeof(gatt_svr_conn_t));
+    pc->conn_handle = BLE_HS_CONN_HANDLE_NONE;
+  }
+}
+
+/**
+ * Runs a register block request and stages the result for the next read
+ * on the same connection.
+ **/
+static int
+gatt_svr_reg_request(uint16_t conn_handle, struct os_mbuf *om)
+{
+  uint8_t req[GATT_SVR_REG_HDR_SIZE + GATT_SVR_REG_MAX_COUNT];
+  gatt_svr_conn_t *pc = gatt_svr_conn_find(conn_handle);
+  uint16_t len;
+  uint16_t page;
+  uint16_t count;
+  uint8_t *pdata;
+  int rv;
+  int rc;
+
+  if ((BLE_HS_CONN_HANDLE_NONE == conn_handle) || (NULL == pc)) {
+    return BLE_ATT_ERR_UNLIKELY;
+  }
+  pdata = pc->reg_rsp + GATT_SVR_REG_RSP_SIZE;
+
+  rc = gatt_svr_write(om, GATT_SVR_REG_HDR_SIZE + 1, sizeof(req), req, &len);
+  if (rc != 0) {
+    return rc;
+  }
+
+  page = ((uint16_t) req[1] << 8) | req[2];
+
+  switch (req[0]) {
+    case GATT_SVR_REG_OP_READ:
+      count = req[GATT_SVR_REG_HDR_SIZE];
+      rv    = vscp_ble_cfg_read_block(page, req[3], pdata, count);
+      break;
+
+    case GATT_SVR_REG_OP_WRITE:
+      count = len - GATT_SVR_REG_HDR_SIZE;
+      rv    = vscp_ble_cfg_write_block(page, req[3], req + GATT_SVR_REG_HDR_SIZE, count, NULL);
+      if (VSCP_ERROR_SUCCESS == rv) {
+        /* Read back what is now in the registers */
+        vscp_ble_cfg_read_block(page, req[3], pdata, count);
+      }
+      break;
+
+    default:
+      return BLE_ATT_ERR_REQ_NOT_SUPPORTED;
+  }
+
+  if (VSCP_ERROR_SUCCESS != rv) {
+    count = 0;
+  }
+
+  pc->reg_rsp[0] = req[0];
+  pc->reg_rsp[1] = (uint8_t) rv;
+  pc->reg_rsp[2] = req[1];
+  pc->reg_rsp[3] = req[2];
+  pc->reg_rsp[4] = req[3];
+  pc->reg_rsp[5] = (uint8_t) count;
+  pc->reg_len    = GATT_SVR_REG_RSP_SIZE + count;
+
+  return 0;
+}
+
+/*
+ * Appends the last frame sent. The frame is copied out under the lock so
+ * that the mbuf is not grown with the lock held.
+ */
+static int
+gatt_svr_ev_read(struct os_mbuf *om)
+{
+  uint8_t val[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t len;
+  int rc;
+
+  taskENTER_CRITICAL(&gatt_svr_ev_mux);
+  len = gatt_svr_ev_len;
+  memcpy(val, gatt_svr_ev_val, len);
+  taskEXIT_CRITICAL(&gatt_svr_ev_mux);
+
+  rc = os_mbuf_append(om, val, len);
+  return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+/*
+ * Appends the result of the last register request on the connection.
+ */
+static int
+gatt_svr_reg_read(uint16_t conn_handle, struct os_mbuf *om)
+{
+  gatt_svr_conn_t *pc = gatt_svr_conn_find(conn_handle);
+  int rc;
+
+  if ((BLE_HS_CONN_HANDLE_NONE == conn_handle) || (NULL == pc)) {
+    /* Read by the stack, there is no request to answer */
+    return 0;
+  }
+
+  rc = os_mbuf_append(om, pc->reg_rsp, pc->reg_len);
+  return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+
+#if CONFIG_VSCP_BLE_PROFILER
+/*
+ * Appends the profiler record. The read at offset zero takes a copy of
+ * the latest record and the Read Blob requests that follow are served
+ * from it, so that the parts make up one sample. The stack cuts the part
+ * at the offset from the whole value.
+ */
+static int
+gatt_svr_prof_read(uint16_t conn_handle, uint16_t offset, struct os_mbuf *om)
+{
+  uint8_t rec[VSCP_BLE_PROF_RECORD_MAX_SIZE];
+  gatt_svr_conn_t *pc = gatt_svr_conn_find(conn_handle);
+  size_t len;
+  int rc;
+
+  if ((BLE_HS_CONN_HANDLE_NONE == conn_handle) || (NULL == pc)) {
+    /* Read by the stack, no read sequence to keep */
+    len = vscp_ble_prof_get(rec, sizeof(rec));
+    rc  = os_mbuf_append(om, rec, len);
+    return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+  }
+
+  /* A Read Blob without a read at offset zero gets a copy too */
+  if ((0 == offset) || (0 == pc->prof_len)) {
+    pc->prof_len = vscp_ble_prof_get(pc->prof_rec, sizeof(pc->prof_rec));
+  }
+
+  rc = os_mbuf_append(om, pc->prof_rec, pc->prof_len);
+  return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
+#endif
+
+/*
+ * Logs the time from connect to the first read on an encrypted link.
+ */
+static void
+gatt_svr_conn_timing_read(uint16_t conn_handle)
+{
+  gatt_svr_conn_t *pc = gatt_svr_conn_find(conn_handle);
+  struct ble_gap_conn_desc desc;
+
+  if ((NULL == pc) || !pc->timing_pending) {
+    return;
+  }
+  if ((0 != ble_gap_conn_find(conn_handle, &desc)) || !desc.sec_state.encrypted) {
+    return;
+  }
+
+  pc->timing_pending = false;
+  MODLOG_DFLT(INFO,
+              "first encrypted read %lld ms after connect; conn_handle=%d bonded=%d\n",
+              (long long) ((esp_timer_get_time() - pc->connect_us) / 1000),
+              conn_handle,
+              desc.sec_state.bonded);
+}
+
+void
+gatt_svr_conn_established(uint16_t conn_handle)
+{
+  gatt_svr_conn_t *pc;
+
+  /* A handle is not reused before its disconnect, this is a guard */
+  gatt_svr_conn_closed(conn_handle);
+  pc = gatt_svr_conn_find(BLE_HS_CONN_HANDLE_NONE);
+  if (NULL != pc) {
+    pc->conn_handle    = conn_handle;
+    pc->connect_us     = esp_timer_get_time();
+    pc->timing_pending = true;
+  }
+}
+
 /**
  * Access callback whenever a characteristic/descriptor is read or written to.
  * Here reads and writes need to be handled.
@@ -122,6 +424,7 @@ gatt_svc_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_acce
     case BLE_GATT_ACCESS_OP_READ_CHR:
       if (conn_handle != BLE_HS_CONN_HANDLE_NONE) {
         MODLOG_DFLT(INFO, "Characteristic read; conn_handle=%d attr_handle=%d\n", conn_handle, attr_handle);
+        gatt_svr_conn_timing_read(conn_handle);
       }
       else {
         MODLOG_DFLT(INFO, "Characteristic read by NimBLE stack; attr_handle=%d\n", attr_handle);
@@ -131,6 +434,17 @@ gatt_svc_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_acce
         rc = os_mbuf_append(ctxt->om, &gatt_svr_chr_val, sizeof(gatt_svr_chr_val));
         return rc == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
       }
+      if (attr_handle == gatt_svr_ev_val_handle) {
+        return gatt_svr_ev_read(ctxt->om);
+      }
+      if (attr_handle == gatt_svr_reg_val_handle) {
+        return gatt_svr_reg_read(conn_handle, ctxt->om);
+      }
+#if CONFIG_VSCP_BLE_PROFILER
+      if (attr_handle == gatt_svr_prof_val_handle) {
+        return gatt_svr_prof_read(conn_handle, ctxt->offset, ctxt->om);
+      }
+#endif
       goto unknown;
 
     case BLE_GATT_ACCESS_OP_WRITE_CHR:
@@ -149,6 +463,9 @@ gatt_svc_access(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_acce
                     "all subscribed peers.\n");
         return rc;
       }
+      if (attr_handle == gatt_svr_reg_val_handle) {
+        return gatt_svr_reg_request(conn_handle, ctxt->om);
+      }
       goto unknown;
 
     case BLE_GATT_ACCESS_OP_READ_DSC:
@@ -215,6 +532,22 @@ gatt_svr_register_cb(struct ble_gatt_register_ctxt *ctxt, void *arg)
   }
 }
 
+void
+gatt_svr_notify_event(const uint8_t *pframe, uint8_t len)
+{
+  if (len > sizeof(gatt_svr_ev_val)) {
+    len = sizeof(gatt_svr_ev_val);
+  }
+
+  taskENTER_CRITICAL(&gatt_svr_ev_mux);
+  memcpy(gatt_svr_ev_val, pframe, len);
+  gatt_svr_ev_len = len;
+  taskEXIT_CRITICAL(&gatt_svr_ev_mux);
+
+  /* Notifies all subscribed peers with the new value */
+  ble_gatts_chr_updated(gatt_svr_ev_val_handle);
+}
+
 int
 gatt_svr_init(void)
 {
@@ -237,5 +570,9 @@ gatt_svr_init(void)
   /* Setting a value for the read-only descriptor */
   gatt_svr_dsc_val = 0x99;
 
+  for (int i = 0; i < CONFIG_BT_NIMBLE_MAX_CONNECTIONS; i++) {
+    gatt_svr_conns[i].conn_handle = BLE_HS_CONN_HANDLE_NONE;
+  }
+
   return 0;
 }
@@ -27,11 +27,20 @@
 #include "esp_log.h"
 #include "esp_mac.h"
 #include "nvs_flash.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
+#if CONFIG_VSCP_BLE_DEEP_SLEEP
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "nvs.h"
+#include "soc/soc_caps.h"
+#endif
 
 /* FreeRTOS APIs */
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 
 /* NimBLE stack APIs */
 #include "host/ble_hs.h"
@@ -53,6 +62,26 @@
 #include "esp_random.h"
 #include "ble-example.h"
 
+// NimBLE bond store (RAM tables, written through to NVS with BT_NIMBLE_NVS_PERSIST)
+void
+ble_store_config_init(void);
+
+#include <vscp.h>
+#include "vscp-ble.h"
+#include "vscp-ble-adv.h"
+#include "vscp-ble-cfg.h"
+#include "vscp-ble-sleep.h"
+#include "vscp-ble-adapt.h"
+#include "vscp-ble-queue.h"
+#include "vscp-ble-pool.h"
+#include "vscp-ble-periodic.h"
+#if CONFIG_VSCP_BLE_DM
+#include "vscp-ble-dm.h"
+#endif
+#if CONFIG_VSCP_BLE_PROFILER
+#include "vscp-ble-prof.h"
+#endif
+
 #include <bh1750.h>
 
 TaskHandle_t numGenHandler = NULL;
@@ -66,195 +95,594 @@ static uint8_t own_addr_type;
 // Private variables
 static uint8_t own_addr_type;
 static uint8_t addr_val[6] = { 0 };
-static uint8_t esp_uri[]   = {
-  BLE_GAP_URI_PREFIX_HTTPS, '/', '/', 'e', 's', 'p', 'r', 'e', 's', 's', 'i', 'f', '.', 'c', 'o', 'm'
+
+// VSCP BLE encoder state and pre-serialized advertising data
+static vscp_ble_ctx_t s_vscp_ctx;
+static vscp_ble_adv_t s_adv;
+
+// Advertising state (template, periodic train, adaptive control and the
+// current sample) is used from both the host task and the event generator
+static SemaphoreHandle_t s_adv_lock;
+
+// Outgoing events. Producers queue, update_advertising_data takes the
+// highest priority event for each update.
+static vscp_ble_queue_t s_queue;
+static vscp_ble_queue_item_t s_queue_items[CONFIG_VSCP_BLE_QUEUE_SIZE];
+static portMUX_TYPE s_queue_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Events are built in fixed blocks, never on the heap
+static vscp_ble_pool_t s_pool;
+static vscp_ble_pool_block_t s_pool_blocks[CONFIG_VSCP_BLE_POOL_SIZE];
+static portMUX_TYPE s_pool_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Demo sample (counter as CLASS1.DATA, I/O value, integer data coding)
+static uint32_t s_counter = 0;
+static uint8_t s_sample[5];
+
+#if CONFIG_VSCP_BLE_ADV_STATS
+// Advertising update statistics
+static struct {
+  int64_t m_sample_us;       // Time the current sample was taken
+  bool m_bSamplePending;     // Current sample not yet handed to the controller
+  uint32_t m_updates;        // Advert data updates handed to the controller
+  uint32_t m_failures;       // Failed updates (encode or HCI)
+  uint32_t m_samples;        // Samples handed to the controller
+  int64_t m_cpu_sum_us;      // Total time spent in update_advertising_data
+  uint32_t m_cpu_max_us;     // Worst case time spent in update_advertising_data
+  int64_t m_latency_sum_us;  // Total sample to controller latency
+  uint32_t m_latency_max_us; // Worst case sample to controller latency
+} s_adv_stats;
+#endif
+
+#if CONFIG_VSCP_BLE_ADAPTIVE_ADV
+// The Kconfig ranges allow equal loads and are not applied to a hand
+// edited sdkconfig
+#if CONFIG_VSCP_BLE_ADAPTIVE_REPEAT_MIN > CONFIG_VSCP_BLE_ADAPTIVE_REPEAT_MAX
+#error "CONFIG_VSCP_BLE_ADAPTIVE_REPEAT_MIN is above CONFIG_VSCP_BLE_ADAPTIVE_REPEAT_MAX"
+#endif
+#if CONFIG_VSCP_BLE_ADAPTIVE_LOAD_LOW >= CONFIG_VSCP_BLE_ADAPTIVE_LOAD_HIGH
+#error "CONFIG_VSCP_BLE_ADAPTIVE_LOAD_LOW must be below CONFIG_VSCP_BLE_ADAPTIVE_LOAD_HIGH"
+#endif
+
+// Adaptive advertising. The shortest interval is taken from the
+// configuration registers at each update.
+static vscp_ble_adapt_t s_adapt;
+static vscp_ble_adapt_limits_t s_adapt_limits = {
+  .m_itvl_max_ms = CONFIG_VSCP_BLE_ADAPTIVE_ITVL_MAX_MS,
+  .m_repeat_min  = CONFIG_VSCP_BLE_ADAPTIVE_REPEAT_MIN,
+  .m_repeat_max  = CONFIG_VSCP_BLE_ADAPTIVE_REPEAT_MAX,
+  .m_load_low    = CONFIG_VSCP_BLE_ADAPTIVE_LOAD_LOW,
+  .m_load_high   = CONFIG_VSCP_BLE_ADAPTIVE_LOAD_HIGH,
 };
+static uint32_t s_listen_reports; // Adverts heard in the current listen window
+#endif
+
+#if CONFIG_VSCP_BLE_ACK
+// Rolling index of the frame on air and number of bursts cut short by a gateway ack
+static uint8_t s_adv_index;
+static uint32_t s_acked;
+#endif
+
+#if CONFIG_VSCP_BLE_PERIODIC_ADV
+// Periodic advertising. Frames rotate through the train payload.
+#define PERIODIC_INSTANCE 0
+// Receive window widening a synchronised gateway needs on each side of
+// a train, 32 us plus 50 ppm sleep clock accuracy at both ends
+#define PERIODIC_WIDENING_US (32 + (CONFIG_VSCP_BLE_PERIODIC_ITVL_MS / 10))
+static vscp_ble_periodic_t s_periodic;
+// The host refuses periodic data longer than its extended advertising data
+// size. The train needs room for at least the largest frame.
+#if CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE < VSCP_BLE_PERIODIC_MAX_SIZE
+#define PERIODIC_DATA_SIZE CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE
+#else
+#define PERIODIC_DATA_SIZE VSCP_BLE_PERIODIC_MAX_SIZE
+#endif
+#if PERIODIC_DATA_SIZE < (VSCP_BLE_PERIODIC_FRAME_MAX_SIZE + 2)
+#error "CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE is too small for a VSCP BLE frame, raise it to 251"
+#endif
+static uint8_t s_periodic_buf[PERIODIC_DATA_SIZE];
+static uint16_t s_periodic_len;
+// Set when the train and the extended adverts pointing to it run. Until
+// then the generator retries periodic_advertise(). Guarded by s_adv_lock.
+static bool s_bPeriodicActive;
+#endif
+
+#if CONFIG_VSCP_BLE_DM
+// Decision matrix actions
+#define DM_ACTION_NOOP   0 // Do nothing
+#define DM_ACTION_SAMPLE 1 // Take a sample and send it now
+
+// Decision matrix, only used from the host task. It is compiled again
+// when the configuration generation changes.
+static vscp_ble_dm_t s_dm;
+static uint8_t s_dm_rows[VSCP_BLE_CFG_DM_PAGES * VSCP_BLE_CFG_PAGE_SIZE];
+static uint32_t s_dm_generation;
+static bool s_bDmCompiled;
+#endif
+
+// Listen to the channel after each advert update
+#define VSCP_BLE_LISTEN                                                                                                \
+  (CONFIG_VSCP_BLE_ADAPTIVE_ADV || CONFIG_VSCP_BLE_ACK || CONFIG_VSCP_BLE_DM || CONFIG_VSCP_BLE_TIMESTAMP)
+
+#if CONFIG_VSCP_BLE_DEEP_SLEEP
+// State that survives deep sleep. Chips without RTC memory (ESP32-C2)
+// keep it in NVS over deep sleep instead.
+#if SOC_RTC_MEM_SUPPORTED
+static RTC_DATA_ATTR vscp_ble_sleep_retained_t s_rtc;
+#else
+static vscp_ble_sleep_retained_t s_rtc;
+#endif
+static vscp_ble_sleep_state_t s_sleep_state = VSCP_BLE_SLEEP_STATE_BOOT;
+
+// The duty cycle is driven from the host task and the budget timer
+static SemaphoreHandle_t s_sleep_lock;
+
+static void
+sleep_dispatch(vscp_ble_sleep_event_t ev);
+#endif
+
+// Pairing input waiting for the console. The host task only queues the
+// request, passkey_task() waits for the user and injects the answer.
+typedef struct passkey_req {
+  uint16_t m_conn_handle; // Connection being paired
+  uint8_t m_action;       // BLE_SM_IOACT_NUMCMP or BLE_SM_IOACT_INPUT
+  uint32_t m_numcmp;      // Number to compare (NUMCMP)
+} passkey_req_t;
+
+static QueueHandle_t s_passkey_queue;
 
 // ----------------------------------------------------------------------------
 
 ///////////////////////////////////////////////////////////////////////////////
-// start_advertising
+// log_phase
+//
+// Logs the time since the application started for a startup phase.
 //
 
 static void
-start_advertising(void)
-{
-  /* Local variables */
-  int rc = 0;
-  const char *name;
-  struct ble_hs_adv_fields adv_fields  = { 0 };
-  struct ble_hs_adv_fields rsp_fields  = { 0 };
-  struct ble_gap_adv_params adv_params = { 0 };
-
-  // Set advertising flags
-  adv_fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
-
-  // Set device name
-  name                        = ble_svc_gap_device_name();
-  adv_fields.name             = (uint8_t *) name;
-  adv_fields.name_len         = strlen(name);
-  adv_fields.name_is_complete = 1;
-
-  // Set device tx power
-  adv_fields.tx_pwr_lvl            = BLE_HS_ADV_TX_PWR_LVL_AUTO;
-  adv_fields.tx_pwr_lvl_is_present = 1;
-
-  // Set device appearance
-  adv_fields.appearance            = BLE_GAP_APPEARANCE_GENERIC_TAG;
-  adv_fields.appearance_is_present = 1;
-
-  // Set device LE role
-  adv_fields.le_role            = BLE_GAP_LE_ROLE_PERIPHERAL;
-  adv_fields.le_role_is_present = 1;
-
-  // Set advertisement fields
-  rc = ble_gap_adv_set_fields(&adv_fields);
-  if (rc != 0) {
-    ESP_LOGE(TAG, "failed to set advertising data, error code: %d", rc);
+log_phase(const char *phase)
+{
+  ESP_LOGI(TAG, "startup: %s at %" PRId64 " us", phase, esp_timer_get_time());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// adv_get_itvl
+//
+// Advertising interval in milliseconds.
+//
+
+static uint16_t
+adv_get_itvl(void)
+{
+#if CONFIG_VSCP_BLE_ADAPTIVE_ADV
+  return s_adapt.m_itvl_ms;
+#else
+  return vscp_ble_cfg_get_adv_itvl();
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// adv_get_repeat
+//
+// Advertising events per update, zero to advertise continuously.
+//
+
+static uint8_t
+adv_get_repeat(void)
+{
+#if CONFIG_VSCP_BLE_ADAPTIVE_ADV
+  return s_adapt.m_repeat;
+#else
+  return vscp_ble_cfg_get_adv_repeat();
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// event_new
+//
+// Builds an event in a pool block. Safe to call from any task.
+//
+
+static vscpEvent *
+event_new(uint16_t head, uint16_t vscp_class, uint16_t vscp_type, const uint8_t *pdata, uint8_t size)
+{
+  vscpEvent *pev;
+
+  taskENTER_CRITICAL(&s_pool_mux);
+  pev = vscp_ble_pool_new_event(&s_pool, head, vscp_class, vscp_type, pdata, size);
+  taskEXIT_CRITICAL(&s_pool_mux);
+
+  // Capture time, sent as a delta to the gateway time base
+  if (NULL != pev) {
+    int64_t now = esp_timer_get_time();
+
+    pev->timestamp = (uint32_t) now;
+#if CONFIG_VSCP_BLE_TIMESTAMP
+    vscp_ble_expire_time_base(&s_vscp_ctx, (uint64_t) now);
+#endif
+  }
+
+  return pev;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// event_release
+//
+
+static void
+event_release(vscpEvent *pev)
+{
+  if (NULL == pev) {
     return;
   }
 
-  // Set device address
-  rsp_fields.device_addr            = addr_val;
-  rsp_fields.device_addr_type       = own_addr_type;
-  rsp_fields.device_addr_is_present = 1;
+  taskENTER_CRITICAL(&s_pool_mux);
+  vscp_ble_pool_release(&s_pool, pev);
+  taskEXIT_CRITICAL(&s_pool_mux);
+}
 
-  // Set URI
-  rsp_fields.uri     = esp_uri;
-  rsp_fields.uri_len = sizeof(esp_uri);
+///////////////////////////////////////////////////////////////////////////////
+// send_event
+//
+// Queues an event for sending. Ownership of the event is always taken
+// over, also when it can not be queued.
+//
 
-  // Set scan response fields
-  rc = ble_gap_adv_rsp_set_fields(&rsp_fields);
-  if (rc != 0) {
-    ESP_LOGE(TAG, "failed to set scan response data, error code: %d", rc);
+static int
+send_event(vscpEvent *pev)
+{
+  vscpEvent *pshed;
+  uint8_t level = vscp_ble_queue_level(pev);
+  int rv;
+
+  taskENTER_CRITICAL(&s_queue_mux);
+  rv = vscp_ble_queue_push(&s_queue, pev, &pshed);
+  taskEXIT_CRITICAL(&s_queue_mux);
+
+  // Lower priority event dropped to make room
+  event_release(pshed);
+
+  if (VSCP_ERROR_SUCCESS != rv) {
+    ESP_LOGW(TAG, "Event queue full, class=%u type=%u dropped", pev->vscp_class, pev->vscp_type);
+    event_release(pev);
+    return rv;
+  }
+
+  // Alarms do not wait for the next update
+  if ((VSCP_BLE_QUEUE_LEVEL_ALARM == level) && (NULL != numGenHandler)) {
+    xTaskNotifyGive(numGenHandler);
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// take_sample
+//
+
+static void
+take_sample(void)
+{
+  vscpEvent *pev;
+
+  // float temperature = read_temperature();
+  // printf("Temperature: %.2f°C\n", temperature);
+
+  xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+
+  s_counter++;
+
+  s_sample[0] = 0x60;
+  s_sample[1] = (s_counter >> 24) & 0xff;
+  s_sample[2] = (s_counter >> 16) & 0xff;
+  s_sample[3] = (s_counter >> 8) & 0xff;
+  s_sample[4] = s_counter & 0xff;
+
+  // Example event: CLASS1.DATA, I/O value
+  pev = event_new(VSCP_PRIORITY_NORMAL, 15, 1, s_sample, sizeof(s_sample));
+  if (NULL == pev) {
+    xSemaphoreGiveRecursive(s_adv_lock);
+    ESP_LOGE(TAG, "Failed to allocate event");
     return;
   }
 
-  // Set non-connectable and general discoverable mode to be a beacon
-  adv_params.conn_mode = BLE_GAP_CONN_MODE_NON;
-  adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+#if CONFIG_VSCP_BLE_ADV_STATS
+  s_adv_stats.m_sample_us      = esp_timer_get_time();
+  s_adv_stats.m_bSamplePending = true;
+#endif
+
+  xSemaphoreGiveRecursive(s_adv_lock);
 
-  // Start advertising
-  rc = ble_gap_adv_start(own_addr_type, NULL, BLE_HS_FOREVER, &adv_params, NULL, NULL);
-  if (rc != 0) {
-    ESP_LOGE(TAG, "failed to start advertising, error code: %d", rc);
+  send_event(pev);
+}
+
+#if CONFIG_VSCP_BLE_ADV_STATS
+
+///////////////////////////////////////////////////////////////////////////////
+// adv_stats_update
+//
+// Accounts one call to update_advertising_data that started at start_us.
+// Latency is the time from sample to the data being handed to the
+// controller, it goes on air within one advertising interval after that.
+//
+
+static void
+adv_stats_update(int64_t start_us, bool bOk)
+{
+  int64_t now     = esp_timer_get_time();
+  uint32_t cpu_us = (uint32_t) (now - start_us);
+
+  if (!bOk) {
+    s_adv_stats.m_failures++;
     return;
   }
-  ESP_LOGI(TAG, "advertising started!");
+
+  s_adv_stats.m_updates++;
+  s_adv_stats.m_cpu_sum_us += cpu_us;
+  if (cpu_us > s_adv_stats.m_cpu_max_us) {
+    s_adv_stats.m_cpu_max_us = cpu_us;
+  }
+
+  if (s_adv_stats.m_bSamplePending) {
+    uint32_t latency_us          = (uint32_t) (now - s_adv_stats.m_sample_us);
+    s_adv_stats.m_bSamplePending = false;
+    s_adv_stats.m_samples++;
+    s_adv_stats.m_latency_sum_us += latency_us;
+    if (latency_us > s_adv_stats.m_latency_max_us) {
+      s_adv_stats.m_latency_max_us = latency_us;
+    }
+  }
+
+  if (0 == (s_adv_stats.m_updates % CONFIG_VSCP_BLE_ADV_STATS_LOG_INTERVAL)) {
+    ESP_LOGI(TAG,
+             "adv stats: updates=%" PRIu32 " failures=%" PRIu32 " cpu avg=%" PRId64 " max=%" PRIu32
+             " us latency avg=%" PRId64 " max=%" PRIu32 " us pool used=%u max=%u failures=%" PRIu32,
+             s_adv_stats.m_updates,
+             s_adv_stats.m_failures,
+             s_adv_stats.m_cpu_sum_us / s_adv_stats.m_updates,
+             s_adv_stats.m_cpu_max_us,
+             s_adv_stats.m_samples ? (s_adv_stats.m_latency_sum_us / s_adv_stats.m_samples) : 0,
+             s_adv_stats.m_latency_max_us,
+             s_pool.m_used,
+             s_pool.m_high_water,
+             s_pool.m_failures);
+  }
 }
 
+#endif
+
+#if CONFIG_VSCP_BLE_PERIODIC_ADV
+
 ///////////////////////////////////////////////////////////////////////////////
-// gap_init
+// periodic_set_data
+//
+// Builds the next train payload from the frame rotation and hands it to
+// the controller. Logs the gateway listen time when the payload length
+// changes.
 //
 
 static int
-gap_init(void)
+periodic_set_data(void)
 {
-  /* Local variables */
-  int rc = 0;
+  struct os_mbuf *om;
+  uint16_t len;
+  uint16_t permille;
+  int rc;
+#if MYNEWT_VAL(BLE_PERIODIC_ADV_ENH)
+  struct ble_gap_periodic_adv_set_data_params data_params = { 0 };
+#endif
+
+  len = vscp_ble_periodic_build(&s_periodic, s_periodic_buf, sizeof(s_periodic_buf));
 
-  /* Initialize GAP service */
-  ble_svc_gap_init();
+  om = os_msys_get_pkthdr(len, 0);
+  if (NULL == om) {
+    return BLE_HS_ENOMEM;
+  }
 
-  /* Set GAP device name */
-  rc = ble_svc_gap_device_name_set("VSCP");
+  rc = os_mbuf_append(om, s_periodic_buf, len);
   if (rc != 0) {
-    ESP_LOGE(TAG, "failed to set device name to %s, error code: %d", "VSCP", rc);
+    os_mbuf_free_chain(om);
     return rc;
   }
 
-  /* Set GAP device appearance */
-  rc = ble_svc_gap_device_appearance_set(BLE_GAP_APPEARANCE_GENERIC_TAG);
+#if MYNEWT_VAL(BLE_PERIODIC_ADV_ENH)
+  // New data id so synchronised gateways do not drop the train as a duplicate
+  data_params.update_did = 1;
+  rc                     = ble_gap_periodic_adv_set_data(PERIODIC_INSTANCE, om, &data_params);
+#else
+  rc = ble_gap_periodic_adv_set_data(PERIODIC_INSTANCE, om);
+#endif
   if (rc != 0) {
-    ESP_LOGE(TAG, "failed to set device appearance, error code: %d", rc);
     return rc;
   }
-  return rc;
+
+  if (len != s_periodic_len) {
+    s_periodic_len = len;
+    permille       = vscp_ble_periodic_listen_permille(CONFIG_VSCP_BLE_PERIODIC_ITVL_MS, len, PERIODIC_WIDENING_US);
+    ESP_LOGI(TAG,
+             "periodic: train %u bytes, %" PRIu32 " us on air, gateway listens %u.%u%% of the time",
+             len,
+             vscp_ble_periodic_train_us(len),
+             permille / 10,
+             permille % 10);
+  }
+
+  return 0;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
-// update_advertising_data
+// periodic_advertise
+//
+// Starts the periodic train and the extended adverts that point to it.
+// The extended adverts carry flags and name from the advertising
+// template, the frames go in the train. A failed start leaves the train
+// stopped and s_bPeriodicActive cleared so that the next call starts
+// over.
 //
 
 static void
-update_advertising_data(void)
+periodic_advertise(void)
 {
-  static uint32_t counter              = 0;
-  char name_data[12]                   = { 0 };
-  uint8_t binary_data[22]              = { 0 };
-  struct ble_hs_adv_fields adv_fields  = { 0 };
-  struct ble_hs_adv_fields rsp_fields  = { 0 };
-  struct ble_gap_adv_params adv_params = { 0 };
+  struct ble_gap_ext_adv_params ext_params          = { 0 };
+  struct ble_gap_periodic_adv_params periodic_params = { 0 };
+  struct os_mbuf *om;
+  int rc;
+#if MYNEWT_VAL(BLE_PERIODIC_ADV_ENH)
+  struct ble_gap_periodic_adv_start_params start_params = { 0 };
+#endif
 
-  // float temperature = read_temperature();
-  // printf("Temperature: %.2f°C\n", temperature);
+  if (s_bPeriodicActive && ble_gap_ext_adv_active(PERIODIC_INSTANCE)) {
+    return;
+  }
+  s_bPeriodicActive = false;
+
+  // Non connectable, non scannable extended adverts
+  ext_params.own_addr_type = own_addr_type;
+  ext_params.primary_phy   = BLE_HCI_LE_PHY_1M;
+  ext_params.secondary_phy = BLE_HCI_LE_PHY_1M;
+  ext_params.sid           = PERIODIC_INSTANCE;
+  ext_params.tx_power      = 127; // Controller default
+  ext_params.itvl_min      = BLE_GAP_ADV_ITVL_MS(vscp_ble_cfg_get_adv_itvl());
+  ext_params.itvl_max      = BLE_GAP_ADV_ITVL_MS(vscp_ble_cfg_get_adv_itvl());
+
+  rc = ble_gap_ext_adv_configure(PERIODIC_INSTANCE, &ext_params, NULL, ble_gap_event, NULL);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "error configuring extended advertising; rc=%d", rc);
+    return;
+  }
+
+  // Flags and name, the frame position is just after them
+  om = os_msys_get_pkthdr(s_adv.m_frame_pos - 2, 0);
+  if (NULL == om) {
+    ESP_LOGE(TAG, "no mbuf for extended advertising data");
+    return;
+  }
 
-  /* Advertise two flags:
-   *     o Discoverability in forthcoming advertisement (general)
-   *     o BLE-only (BR/EDR unsupported).
-   */
-  // adv_fields.flags = BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP;
-  // ESP_LOGI(TAG, "Advertising data set");
-
-  counter++;
-  // if (runner % 2 == 0) {
-
-  // snprintf(name_data, sizeof(name_data), "Count: %d", counter++);
-  sprintf(name_data, "VSCP");
-  adv_fields.name             = (uint8_t *) name_data;
-  adv_fields.name_len         = 4; // strlen(name_data); 1 - 10
-  adv_fields.name_is_complete = 1;
-  //}
-  // else {
-
-  // Example binary data
-  binary_data[0] = 0xFF; // Company identifier (lower byte)
-  binary_data[1] = 0xFF; // Company identifier (upper byte)
-  binary_data[2] = counter & 0xff;
-  binary_data[3] = (counter >> 8) & 0xff;
-  binary_data[4] = (counter >> 16) & 0xff;
-  binary_data[5] = (counter >> 24) & 0xff;
-
-  adv_fields.mfg_data     = binary_data;
-  adv_fields.mfg_data_len = 6;
-  // sizeof(binary_data);
-  // }
-
-  int rc = ble_gap_adv_set_fields(&adv_fields);
+  rc = os_mbuf_append(om, s_adv.m_buf, s_adv.m_frame_pos - 2);
+  if (0 == rc) {
+    rc = ble_gap_ext_adv_set_data(PERIODIC_INSTANCE, om);
+  }
+  else {
+    os_mbuf_free_chain(om);
+  }
   if (rc != 0) {
-    ESP_LOGE(TAG, "Error setting advertisement data; rc=%d", rc);
+    ESP_LOGE(TAG, "error setting extended advertising data; rc=%d", rc);
+    return;
   }
 
-  sprintf(name_data, "VSCP");
-  rsp_fields.name             = (uint8_t *) name_data;
-  rsp_fields.name_len         = 4;
-  rsp_fields.name_is_complete = 1;
+  periodic_params.itvl_min = BLE_GAP_PERIODIC_ITVL_MS(CONFIG_VSCP_BLE_PERIODIC_ITVL_MS);
+  periodic_params.itvl_max = BLE_GAP_PERIODIC_ITVL_MS(CONFIG_VSCP_BLE_PERIODIC_ITVL_MS);
 
-  // Set device address
-  rsp_fields.device_addr            = addr_val;
-  rsp_fields.device_addr_type       = own_addr_type;
-  rsp_fields.device_addr_is_present = 1;
+  rc = ble_gap_periodic_adv_configure(PERIODIC_INSTANCE, &periodic_params);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "error configuring periodic advertising; rc=%d", rc);
+    return;
+  }
 
-  // Set URI
-  // rsp_fields.uri     = esp_uri;
-  // rsp_fields.uri_len = sizeof(esp_uri);
+  rc = periodic_set_data();
+  if (rc != 0) {
+    ESP_LOGE(TAG, "error setting periodic advertising data; rc=%d", rc);
+    return;
+  }
 
-  /* Set scan response fields */
-  rc = ble_gap_adv_rsp_set_fields(&rsp_fields);
+#if MYNEWT_VAL(BLE_PERIODIC_ADV_ENH)
+  start_params.include_adi = 1;
+  rc                       = ble_gap_periodic_adv_start(PERIODIC_INSTANCE, &start_params);
+#else
+  rc = ble_gap_periodic_adv_start(PERIODIC_INSTANCE);
+#endif
   if (rc != 0) {
-    ESP_LOGE(TAG, "failed to set scan response data, error code: %d", rc);
+    ESP_LOGE(TAG, "error starting periodic advertising; rc=%d", rc);
+    return;
+  }
+
+  rc = ble_gap_ext_adv_start(PERIODIC_INSTANCE, 0, 0);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "error starting extended advertising; rc=%d", rc);
+    ble_gap_periodic_adv_stop(PERIODIC_INSTANCE);
     return;
   }
+
+  s_bPeriodicActive = true;
+  ESP_LOGI(TAG, "periodic advertising started, interval %d ms", CONFIG_VSCP_BLE_PERIODIC_ITVL_MS);
 }
 
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
-// ble_store_config_init
+// update_advertising_data
+//
+// Encodes the highest priority queued event straight into the raw
+// advertising data template and hands it to the controller. Flags and
+// name are part of the template and are never touched here. The frame
+// is also notified to subscribed GATT peers. With nothing queued the
+// current advert is left as it is.
 //
 
 static void
-ble_store_config_init(void)
+update_advertising_data(void)
 {
-  ;
+  vscpEvent *pev;
+  int rc;
+#if CONFIG_VSCP_BLE_ADV_STATS
+  int64_t start_us = esp_timer_get_time();
+#endif
+
+  taskENTER_CRITICAL(&s_queue_mux);
+  pev = vscp_ble_queue_pop(&s_queue);
+  taskEXIT_CRITICAL(&s_queue_mux);
+
+  if (NULL == pev) {
+    return;
+  }
+
+  xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+
+  rc = vscp_ble_adv_set_event(&s_adv, &s_vscp_ctx, pev);
+  event_release(pev);
+  if (rc < 0) {
+    ESP_LOGE(TAG, "Failed to encode advertisement frame");
+#if CONFIG_VSCP_BLE_ADV_STATS
+    adv_stats_update(start_us, false);
+#endif
+    xSemaphoreGiveRecursive(s_adv_lock);
+    return;
+  }
+
+#if !CONFIG_VSCP_BLE_BEACON_ONLY
+  gatt_svr_notify_event(s_adv.m_buf + s_adv.m_frame_pos, s_adv.m_len - s_adv.m_frame_pos);
+#endif
+
+#if CONFIG_VSCP_BLE_PERIODIC_ADV
+  // The frame joins the rotation, the train goes out at the periodic interval
+  vscp_ble_periodic_add(&s_periodic,
+                        s_adv.m_buf + s_adv.m_frame_pos,
+                        s_adv.m_len - s_adv.m_frame_pos,
+                        CONFIG_VSCP_BLE_PERIODIC_REPEAT);
+  if (!s_bPeriodicActive) {
+    // Not started yet, periodic_advertise sets the data
+    rc = 0;
+  }
+  else {
+    rc = periodic_set_data();
+  }
+#else
+  rc = ble_gap_adv_set_data(s_adv.m_buf, s_adv.m_len);
+#endif
+  if (rc != 0) {
+    ESP_LOGE(TAG, "Error setting advertisement data; rc=%d", rc);
+  }
+#if CONFIG_VSCP_BLE_ACK
+  else {
+    s_adv_index = s_adv.m_buf[s_adv.m_frame_pos + VSCP_BLE_FRAME_POS_HEAD] & 0x07;
+  }
+#endif
+
+#if CONFIG_VSCP_BLE_ADV_STATS
+  adv_stats_update(start_us, (0 == rc));
+#endif
+
+  xSemaphoreGiveRecursive(s_adv_lock);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -306,25 +734,376 @@ print_conn_desc(struct ble_gap_conn_desc *desc)
 static void
 std_advertise(void)
 {
+#if CONFIG_VSCP_BLE_PERIODIC_ADV
+  xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+
+  // Set advertisement data
+  update_advertising_data();
+  periodic_advertise();
+
+  xSemaphoreGiveRecursive(s_adv_lock);
+#else
   struct ble_gap_adv_params adv_params;
+  struct ble_hs_adv_fields rsp_fields = { 0 };
+  uint16_t itvl;
+  int32_t duration = BLE_HS_FOREVER;
   int rc;
 
+  xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+  itvl = adv_get_itvl();
+
   // Set advertisement data
   update_advertising_data();
 
+  // Scan response holds name and device address and does not change
+  rsp_fields.name             = (uint8_t *) "VSCP";
+  rsp_fields.name_len         = 4;
+  rsp_fields.name_is_complete = 1;
+
+  rsp_fields.device_addr            = addr_val;
+  rsp_fields.device_addr_type       = own_addr_type;
+  rsp_fields.device_addr_is_present = 1;
+
+  rc = ble_gap_adv_rsp_set_fields(&rsp_fields);
+  if (rc != 0) {
+    xSemaphoreGiveRecursive(s_adv_lock);
+    ESP_LOGE(TAG, "failed to set scan response data, error code: %d", rc);
+    return;
+  }
+
   // Begin advertising.
   memset(&adv_params, 0, sizeof adv_params);
 
+#if CONFIG_VSCP_BLE_BEACON_ONLY
   adv_params.conn_mode = BLE_GAP_CONN_MODE_NON; // Non connectable
+#else
+  adv_params.conn_mode = BLE_GAP_CONN_MODE_UND; // Connectable, GATT services
+#endif
   adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN; // General discoverable
   // Set sensible defaults if the following is not set
-  adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(20);
-  adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(20);
-  rc = ble_gap_adv_start(own_addr_type, NULL, /*200 */ BLE_HS_FOREVER, &adv_params, ble_gap_event, NULL);
+  adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(itvl);
+  adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(itvl);
+
+#if CONFIG_VSCP_BLE_DEEP_SLEEP
+  // Short burst, ends with BLE_GAP_EVENT_ADV_COMPLETE
+  duration = CONFIG_VSCP_BLE_DEEP_SLEEP_BURST_MS;
+#else
+  // A limited number of advertising events per update keeps the channel
+  // free in dense sites. Each event is delayed by a random 0-10 ms
+  // (advDelay) by the controller, so allow for the mean of that.
+  if (adv_get_repeat()) {
+    duration = adv_get_repeat() * (itvl + 5);
+  }
+#endif
+  rc = ble_gap_adv_start(own_addr_type, NULL, duration, &adv_params, ble_gap_event, NULL);
+  xSemaphoreGiveRecursive(s_adv_lock);
   if (rc != 0) {
     ESP_LOGE(TAG, "error enabling advertisement; rc=%d\n", rc);
     return;
   }
+#endif
+}
+
+#if VSCP_BLE_LISTEN
+
+///////////////////////////////////////////////////////////////////////////////
+// channel_listen
+//
+// Listens to the channel for a short while. Adverts heard are handled
+// in ble_gap_event.
+//
+
+static void
+channel_listen(void)
+{
+  struct ble_gap_disc_params disc_params = { 0 };
+  int rc;
+
+  if (ble_gap_disc_active()) {
+    return;
+  }
+
+  // Passive, scan all the time during the window and report duplicates
+  disc_params.itvl              = BLE_GAP_SCAN_ITVL_MS(30);
+  disc_params.window            = BLE_GAP_SCAN_WIN_MS(30);
+  disc_params.passive           = 1;
+  disc_params.filter_duplicates = 0;
+
+#if CONFIG_VSCP_BLE_ADAPTIVE_ADV
+  s_listen_reports = 0;
+#endif
+  rc = ble_gap_disc(own_addr_type, CONFIG_VSCP_BLE_LISTEN_MS, &disc_params, ble_gap_event, NULL);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "error starting channel listen; rc=%d", rc);
+  }
+}
+
+#endif
+
+#if CONFIG_VSCP_BLE_ADAPTIVE_ADV
+
+///////////////////////////////////////////////////////////////////////////////
+// adapt_update
+//
+// Feeds the load seen in the last listen window to the control. A new
+// interval or repetition count takes effect at the next advert burst.
+//
+
+static void
+adapt_update(void)
+{
+  uint32_t load = (s_listen_reports * 1000) / CONFIG_VSCP_BLE_LISTEN_MS;
+
+  if (load > UINT16_MAX) {
+    load = UINT16_MAX;
+  }
+
+  xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+  s_adapt_limits.m_itvl_min_ms = vscp_ble_cfg_get_adv_itvl();
+  if (vscp_ble_adapt_update(&s_adapt, &s_adapt_limits, (uint16_t) load)) {
+    ESP_LOGI(TAG,
+             "adaptive adv: load=%" PRIu32 "/s interval=%u ms repeat=%u",
+             load,
+             s_adapt.m_itvl_ms,
+             s_adapt.m_repeat);
+  }
+  xSemaphoreGiveRecursive(s_adv_lock);
+}
+
+#endif
+
+#if CONFIG_VSCP_BLE_ACK
+
+///////////////////////////////////////////////////////////////////////////////
+// ack_check
+//
+// Stops the current advert burst early when a gateway acknowledgement
+// for the frame on air is heard.
+//
+
+static void
+ack_check(const uint8_t *pdata, uint8_t len)
+{
+  const uint8_t *pframe;
+  uint8_t framelen;
+
+  pframe = vscp_ble_adv_find_frame(pdata, len, &framelen);
+  if (NULL == pframe) {
+    return;
+  }
+
+  // The next update restarts advertising
+  xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+  if ((vscp_ble_ack_check(&s_vscp_ctx, pframe, framelen, s_adv_index) > 0) && ble_gap_adv_active() &&
+      (0 == ble_gap_adv_stop())) {
+    s_acked++;
+    ESP_LOGD(TAG, "frame %u acknowledged, burst stopped (%" PRIu32 ")", s_adv_index, s_acked);
+  }
+  xSemaphoreGiveRecursive(s_adv_lock);
+}
+
+#endif
+
+#if CONFIG_VSCP_BLE_TIMESTAMP
+
+///////////////////////////////////////////////////////////////////////////////
+// time_check
+//
+// Takes the time base from a gateway time base frame. Events captured
+// after this are stamped against it.
+//
+
+static void
+time_check(const uint8_t *pdata, uint8_t len)
+{
+  const uint8_t *pframe;
+  uint8_t framelen;
+  uint8_t id;
+  uint64_t time_ms;
+  uint64_t ref;
+
+  pframe = vscp_ble_adv_find_frame(pdata, len, &framelen);
+  if ((NULL == pframe) || (VSCP_ERROR_SUCCESS != vscp_ble_frame_to_time(&id, &time_ms, pframe, framelen))) {
+    return;
+  }
+
+  // Only gateways using our manufacturer code
+  if ((pframe[VSCP_BLE_FRAME_POS_MANUFACTURER] + (pframe[VSCP_BLE_FRAME_POS_MANUFACTURER + 1] << 8)) !=
+      s_vscp_ctx.m_manufacturer) {
+    return;
+  }
+
+  // The first copy heard is closest to when the gateway sent it
+  ref = atomic_load_explicit(&s_vscp_ctx.m_time_ref, memory_order_relaxed);
+  if ((ref & VSCP_BLE_TIME_VALID) && (VSCP_BLE_TIME_ID(ref) == id)) {
+    return;
+  }
+
+  vscp_ble_set_time_base(&s_vscp_ctx, id, time_ms, (uint64_t) esp_timer_get_time());
+  ESP_LOGD(TAG, "time base %u: %" PRIu64 " ms", id, time_ms);
+}
+
+#endif
+
+#if CONFIG_VSCP_BLE_DM
+
+///////////////////////////////////////////////////////////////////////////////
+// dm_action
+//
+// Called for each decision matrix row that matches a heard event.
+//
+
+static void
+dm_action(const uint8_t *prow, const vscpEvent *pev, void *arg)
+{
+  switch (prow[VSCP_BLE_DM_POS_ACTION]) {
+    case DM_ACTION_NOOP:
+      break;
+
+    case DM_ACTION_SAMPLE:
+      take_sample();
+      xTaskNotifyGive(numGenHandler);
+      break;
+
+    default:
+      ESP_LOGD(TAG, "dm: unknown action %u", prow[VSCP_BLE_DM_POS_ACTION]);
+      break;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// dm_check
+//
+// Runs a heard VSCP frame through the decision matrix. The matrix is
+// compiled again first if the registers have changed.
+//
+
+static void
+dm_check(const uint8_t *pdata, uint8_t len)
+{
+  const uint8_t *pframe;
+  uint8_t framelen;
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t data[VSCP_BLE_FRAME_MAX_DATA_SIZE];
+  vscpEvent ev = { 0 };
+  uint32_t generation;
+
+  pframe = vscp_ble_adv_find_frame(pdata, len, &framelen);
+  if ((NULL == pframe) || (framelen > sizeof(frame))) {
+    return;
+  }
+
+  // Only nodes using our manufacturer code
+  if ((pframe[VSCP_BLE_FRAME_POS_MANUFACTURER] + (pframe[VSCP_BLE_FRAME_POS_MANUFACTURER + 1] << 8)) !=
+      s_vscp_ctx.m_manufacturer) {
+    return;
+  }
+
+  memcpy(frame, pframe, framelen);
+  ev.pdata = data;
+  if (vscp_ble_frame_to_ev(&s_vscp_ctx, &ev, frame, framelen) < 0) {
+    return;
+  }
+
+  generation = vscp_ble_cfg_get_generation();
+  if (!s_bDmCompiled || (generation != s_dm_generation)) {
+    for (uint16_t i = 0; i < VSCP_BLE_CFG_DM_PAGES; i++) {
+      vscp_ble_cfg_read_block(VSCP_BLE_CFG_PAGE_DM + i,
+                              0,
+                              s_dm_rows + (i * VSCP_BLE_CFG_PAGE_SIZE),
+                              VSCP_BLE_CFG_PAGE_SIZE);
+    }
+    vscp_ble_dm_compile(&s_dm, s_dm_rows, sizeof(s_dm_rows) / VSCP_BLE_DM_ROW_SIZE);
+    s_dm_generation = generation;
+    s_bDmCompiled   = true;
+  }
+
+  vscp_ble_dm_match(&s_dm, &ev, vscp_ble_cfg_get_zone(), vscp_ble_cfg_get_subzone(), dm_action, NULL);
+}
+
+#endif
+
+#if !CONFIG_VSCP_BLE_BEACON_ONLY
+
+///////////////////////////////////////////////////////////////////////////////
+// passkey_task
+//
+// Waits for console input on behalf of the security manager so that the
+// host task keeps serving adverts and other connections meanwhile. A link
+// that went away while waiting just makes ble_sm_inject_io() fail.
+//
+
+static void
+passkey_task(void *params)
+{
+  passkey_req_t req;
+  struct ble_sm_io pkey;
+  int key;
+  int rc;
+
+  while (true) {
+    if (pdTRUE != xQueueReceive(s_passkey_queue, &req, portMAX_DELAY)) {
+      continue;
+    }
+
+    memset(&pkey, 0, sizeof(pkey));
+    pkey.action = req.m_action;
+    key         = 0;
+
+    if (BLE_SM_IOACT_NUMCMP == req.m_action) {
+      ESP_LOGI(TAG, "Passkey on device's display: %" PRIu32, req.m_numcmp);
+      ESP_LOGI(TAG, "Accept or reject the passkey through console in this format -> key Y or key N");
+      if (scli_receive_key(&key)) {
+        pkey.numcmp_accept = key;
+      }
+      else {
+        pkey.numcmp_accept = 0;
+        ESP_LOGE(TAG, "Timeout! Rejecting the key");
+      }
+    }
+    else {
+      ESP_LOGI(TAG, "Enter the passkey through console in this format-> key 123456");
+      if (scli_receive_key(&key)) {
+        pkey.passkey = key;
+      }
+      else {
+        pkey.passkey = 0;
+        ESP_LOGE(TAG, "Timeout! Passing 0 as the key");
+      }
+    }
+
+    rc = ble_sm_inject_io(req.m_conn_handle, &pkey);
+    ESP_LOGI(TAG, "ble_sm_inject_io result: %d (conn_handle=%d)", rc, req.m_conn_handle);
+  }
+}
+
+#endif
+
+///////////////////////////////////////////////////////////////////////////////
+// passkey_request
+//
+// Hand a pairing input request over to passkey_task(). Called from the
+// host task, never blocks. If the request can not be queued pairing is
+// answered with a reject right away.
+//
+
+static void
+passkey_request(uint16_t conn_handle, uint8_t action, uint32_t numcmp)
+{
+  passkey_req_t req     = { .m_conn_handle = conn_handle, .m_action = action, .m_numcmp = numcmp };
+  struct ble_sm_io pkey = { 0 };
+  int rc;
+
+  if ((NULL != s_passkey_queue) && (pdTRUE == xQueueSend(s_passkey_queue, &req, 0))) {
+    return;
+  }
+
+  ESP_LOGE(TAG, "Pairing input busy, rejecting conn_handle=%d", conn_handle);
+  pkey.action        = action;
+  pkey.numcmp_accept = 0;
+  pkey.passkey       = 0;
+  rc                 = ble_sm_inject_io(conn_handle, &pkey);
+  ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -364,6 +1143,9 @@ ble_gap_event(struct ble_gap_event *event, void *arg)
         rc = ble_gap_conn_find(event->connect.conn_handle, &desc);
         assert(rc == 0);
         print_conn_desc(&desc);
+#if !CONFIG_VSCP_BLE_BEACON_ONLY
+        gatt_svr_conn_established(event->connect.conn_handle);
+#endif
       }
       ESP_LOGI(TAG, "\n");
 
@@ -378,9 +1160,17 @@ ble_gap_event(struct ble_gap_event *event, void *arg)
       ESP_LOGI(TAG, "disconnect; reason=%d ", event->disconnect.reason);
       print_conn_desc(&event->disconnect.conn);
       ESP_LOGI(TAG, "\n");
+#if !CONFIG_VSCP_BLE_BEACON_ONLY
+      gatt_svr_conn_closed(event->disconnect.conn.conn_handle);
+#endif
 
-      // Connection terminated; resume advertising.
-      std_advertise();
+      // Connection terminated; resume advertising unless the event
+      // generator already has
+      xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+      if (!ble_gap_adv_active()) {
+        std_advertise();
+      }
+      xSemaphoreGiveRecursive(s_adv_lock);
 
       return 0;
 
@@ -395,7 +1185,14 @@ ble_gap_event(struct ble_gap_event *event, void *arg)
 
     case BLE_GAP_EVENT_ADV_COMPLETE:
       ESP_LOGI(TAG, "advertise complete; reason=%d", event->adv_complete.reason);
-      std_advertise();
+#if CONFIG_VSCP_BLE_DEEP_SLEEP
+      sleep_dispatch(VSCP_BLE_SLEEP_EV_ADV_DONE);
+#else
+      // With a repetition count the burst is over, the next update restarts it
+      if (0 == adv_get_repeat()) {
+        std_advertise();
+      }
+#endif
 
       return 0;
 
@@ -442,8 +1239,10 @@ ble_gap_event(struct ble_gap_event *event, void *arg)
     case BLE_GAP_EVENT_REPEAT_PAIRING:
       /*
        * We already have a bond with the peer, but it is attempting to
-       * establish a new secure link.  This app sacrifices security for
-       * convenience: just throw away the old bond and accept the new link.
+       * establish a new secure link. A peer that still has its keys
+       * resumes encryption and never gets here, this is one that has lost
+       * them. This app sacrifices security for convenience: just throw
+       * away the old bond and accept the new link.
        */
 
       // Delete the old bond.
@@ -460,7 +1259,6 @@ ble_gap_event(struct ble_gap_event *event, void *arg)
     case BLE_GAP_EVENT_PASSKEY_ACTION:
       ESP_LOGI(TAG, "PASSKEY_ACTION_EVENT started");
       struct ble_sm_io pkey = { 0 };
-      int key               = 0;
 
       if (event->passkey.params.action == BLE_SM_IOACT_DISP) {
         pkey.action  = event->passkey.params.action;
@@ -470,18 +1268,8 @@ ble_gap_event(struct ble_gap_event *event, void *arg)
         ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
       }
       else if (event->passkey.params.action == BLE_SM_IOACT_NUMCMP) {
-        ESP_LOGI(TAG, "Passkey on device's display: %" PRIu32, event->passkey.params.numcmp);
-        ESP_LOGI(TAG, "Accept or reject the passkey through console in this format -> key Y or key N");
-        pkey.action = event->passkey.params.action;
-        if (scli_receive_key(&key)) {
-          pkey.numcmp_accept = key;
-        }
-        else {
-          pkey.numcmp_accept = 0;
-          ESP_LOGE(TAG, "Timeout! Rejecting the key");
-        }
-        rc = ble_sm_inject_io(event->passkey.conn_handle, &pkey);
-        ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
+        // Answered from passkey_task() once the user has confirmed
+        passkey_request(event->passkey.conn_handle, event->passkey.params.action, event->passkey.params.numcmp);
       }
       else if (event->passkey.params.action == BLE_SM_IOACT_OOB) {
         static uint8_t tem_oob[16] = { 0 };
@@ -493,17 +1281,8 @@ ble_gap_event(struct ble_gap_event *event, void *arg)
         ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
       }
       else if (event->passkey.params.action == BLE_SM_IOACT_INPUT) {
-        ESP_LOGI(TAG, "Enter the passkey through console in this format-> key 123456");
-        pkey.action = event->passkey.params.action;
-        if (scli_receive_key(&key)) {
-          pkey.passkey = key;
-        }
-        else {
-          pkey.passkey = 0;
-          ESP_LOGE(TAG, "Timeout! Passing 0 as the key");
-        }
-        rc = ble_sm_inject_io(event->passkey.conn_handle, &pkey);
-        ESP_LOGI(TAG, "ble_sm_inject_io result: %d", rc);
+        // Answered from passkey_task() once the user has entered the key
+        passkey_request(event->passkey.conn_handle, event->passkey.params.action, 0);
       }
       return 0;
 
@@ -518,6 +1297,30 @@ ble_gap_event(struct ble_gap_event *event, void *arg)
       event->authorize.out_response = BLE_GAP_AUTHORIZE_REJECT;
       return 0;
 
+#if VSCP_BLE_LISTEN
+    case BLE_GAP_EVENT_DISC:
+#if CONFIG_VSCP_BLE_ADAPTIVE_ADV
+      // Every advert heard counts, also duplicates
+      s_listen_reports++;
+#endif
+#if CONFIG_VSCP_BLE_ACK
+      ack_check(event->disc.data, event->disc.length_data);
+#endif
+#if CONFIG_VSCP_BLE_DM
+      dm_check(event->disc.data, event->disc.length_data);
+#endif
+#if CONFIG_VSCP_BLE_TIMESTAMP
+      time_check(event->disc.data, event->disc.length_data);
+#endif
+      return 0;
+
+    case BLE_GAP_EVENT_DISC_COMPLETE:
+#if CONFIG_VSCP_BLE_ADAPTIVE_ADV
+      adapt_update();
+#endif
+      return 0;
+#endif
+
 #if MYNEWT_VAL(BLE_POWER_CONTROL)
     case BLE_GAP_EVENT_TRANSMIT_POWER:
       ESP_LOGI(TAG,
@@ -565,7 +1368,7 @@ handle_on_sync(void)
 {
   int rc;
 
-  ESP_LOGI(TAG, "NimBLE Host Sync");
+  log_phase("host sync");
 
   // Make sure we have proper identity address set (public preferred)
   rc = ble_hs_util_ensure_addr(0);
@@ -579,15 +1382,209 @@ handle_on_sync(void)
   }
 
   // Printing ADDR
-  uint8_t addr_val[6] = { 0 };
-  rc                  = ble_hs_id_copy_addr(own_addr_type, addr_val, NULL);
+  rc = ble_hs_id_copy_addr(own_addr_type, addr_val, NULL);
+  if (rc != 0) {
+    ESP_LOGE(TAG, "error reading device address; rc=%d\n", rc);
+    return;
+  }
 
   ESP_LOGI(TAG, "Device Address: " MACSTR "", MAC2STR(addr_val));
 
-  // Begin advertising.
+  // Node identity is set up once. A provisioned GUID has precedence
+  // over the one derived from the identity address. A derived GUID is
+  // stored so that it also shows up in the GUID registers.
+  uint8_t guid[16];
+  if (VSCP_ERROR_SUCCESS != vscp_ble_cfg_get_guid(guid)) {
+    vscp_ble_guid_from_addr(guid, addr_val);
+    vscp_ble_cfg_set_guid(guid);
+  }
+  vscp_ble_set_guid(&s_vscp_ctx, guid);
+  ESP_LOGI(TAG, "Node id: 0x%04X", s_vscp_ctx.m_nodeid);
+
+  // Flags and name are written to the advertising template once. After a
+  // host reset this runs again while the event generator is active.
+  xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+  vscp_ble_adv_init(&s_adv, BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP, "VSCP");
+#if CONFIG_VSCP_BLE_PERIODIC_ADV
+  vscp_ble_periodic_init(&s_periodic);
+#endif
+
+#if CONFIG_VSCP_BLE_DEEP_SLEEP
+  xSemaphoreGiveRecursive(s_adv_lock);
+
+  // Sample, advertise burst and sleep
+  sleep_dispatch(VSCP_BLE_SLEEP_EV_SYNC);
+#else
+#if CONFIG_VSCP_BLE_ADAPTIVE_ADV
+  s_adapt_limits.m_itvl_min_ms = vscp_ble_cfg_get_adv_itvl();
+  vscp_ble_adapt_init(&s_adapt, &s_adapt_limits);
+#endif
+
+  // Begin advertising with a real frame, then let the event generator run
+  take_sample();
   std_advertise();
+  xSemaphoreGiveRecursive(s_adv_lock);
+  xTaskNotifyGive(numGenHandler);
+#endif
+  log_phase("first advert");
+}
+
+#if CONFIG_VSCP_BLE_DEEP_SLEEP
+
+///////////////////////////////////////////////////////////////////////////////
+// sleep_retained_load
+//
+// Without RTC memory the retained state is read back from NVS after a
+// wakeup from deep sleep. After power on it is left for
+// vscp_ble_sleep_retained_init() to reset.
+//
+
+static void
+sleep_retained_load(void)
+{
+#if !SOC_RTC_MEM_SUPPORTED
+  nvs_handle_t handle;
+  size_t len = sizeof(s_rtc);
+
+  if (ESP_SLEEP_WAKEUP_UNDEFINED == esp_sleep_get_wakeup_cause()) {
+    return;
+  }
+
+  if (ESP_OK == nvs_open(VSCP_BLE_CFG_NVS_NAMESPACE, NVS_READONLY, &handle)) {
+    if ((ESP_OK != nvs_get_blob(handle, VSCP_BLE_SLEEP_NVS_KEY, &s_rtc, &len)) || (sizeof(s_rtc) != len)) {
+      s_rtc.m_magic = 0;
+    }
+    nvs_close(handle);
+  }
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sleep_retained_save
+//
+// Without RTC memory the retained state is written to NVS before deep
+// sleep, one small flash write per duty cycle.
+//
+
+static void
+sleep_retained_save(void)
+{
+#if !SOC_RTC_MEM_SUPPORTED
+  nvs_handle_t handle;
+  esp_err_t err;
+
+  err = nvs_open(VSCP_BLE_CFG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (ESP_OK == err) {
+    err = nvs_set_blob(handle, VSCP_BLE_SLEEP_NVS_KEY, &s_rtc, sizeof(s_rtc));
+    if (ESP_OK == err) {
+      err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+  }
+
+  if (ESP_OK != err) {
+    ESP_LOGE(TAG, "Failed to save retained state; err=%d", err);
+  }
+#endif
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// enter_deep_sleep
+//
+
+static void
+enter_deep_sleep(void)
+{
+  // Keep sequencing state over sleep
+  s_rtc.m_frame_seq = vscp_ble_get_sequence(&s_vscp_ctx);
+  s_rtc.m_sequence  = s_counter;
+  sleep_retained_save();
+
+  // Pending configuration changes would be lost
+  vscp_ble_cfg_flush();
+
+  esp_sleep_enable_timer_wakeup(CONFIG_VSCP_BLE_DEEP_SLEEP_PERIOD_MS * 1000ULL);
+#if CONFIG_VSCP_BLE_DEEP_SLEEP_WAKE_GPIO >= 0
+#if SOC_GPIO_SUPPORT_DEEPSLEEP_WAKEUP
+  esp_deep_sleep_enable_gpio_wakeup(BIT(CONFIG_VSCP_BLE_DEEP_SLEEP_WAKE_GPIO), ESP_GPIO_WAKEUP_GPIO_HIGH);
+#elif SOC_PM_SUPPORT_EXT0_WAKEUP
+  esp_sleep_enable_ext0_wakeup(CONFIG_VSCP_BLE_DEEP_SLEEP_WAKE_GPIO, 1);
+#endif
+#endif
+
+  ESP_LOGI(TAG,
+           "Deep sleep; wake=%" PRIu32 " wake-to-adv=%" PRIu32 " us (max %" PRIu32 " us)",
+           s_rtc.m_wake_count,
+           s_rtc.m_wake_to_adv_us,
+           s_rtc.m_wake_to_adv_max_us);
+
+  esp_deep_sleep_start();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sleep_dispatch
+//
+// Runs the duty cycle state machine and acts on the state entered. Called
+// from the host task and the budget timer, the lock makes each transition
+// and its action one step so deep sleep is entered once.
+//
+
+static void
+sleep_dispatch(vscp_ble_sleep_event_t ev)
+{
+  vscp_ble_sleep_state_t state;
+
+  // Recursive as entering a state may dispatch the next event
+  xSemaphoreTakeRecursive(s_sleep_lock, portMAX_DELAY);
+
+  state = vscp_ble_sleep_next(s_sleep_state, ev);
+  if (state == s_sleep_state) {
+    xSemaphoreGiveRecursive(s_sleep_lock);
+    return;
+  }
+  s_sleep_state = state;
+
+  switch (state) {
+    case VSCP_BLE_SLEEP_STATE_SAMPLE:
+      take_sample();
+      s_rtc.m_last_size = sizeof(s_sample);
+      memcpy(s_rtc.m_last_data, s_sample, sizeof(s_sample));
+      sleep_dispatch(VSCP_BLE_SLEEP_EV_SAMPLE_DONE);
+      break;
+
+    case VSCP_BLE_SLEEP_STATE_ADVERTISE:
+      std_advertise();
+      // esp_timer starts with the application so this excludes the ROM bootloader
+      vscp_ble_sleep_record_startup(&s_rtc, (uint32_t) esp_timer_get_time());
+      break;
+
+    case VSCP_BLE_SLEEP_STATE_SLEEP:
+      if (VSCP_BLE_SLEEP_EV_TIMEOUT == ev) {
+        s_rtc.m_budget_overruns++;
+        ESP_LOGW(TAG, "Awake time budget exceeded");
+      }
+      enter_deep_sleep();
+      break;
+
+    default:
+      break;
+  }
+
+  xSemaphoreGiveRecursive(s_sleep_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sleep_budget_cb
+//
+
+static void
+sleep_budget_cb(void *arg)
+{
+  sleep_dispatch(VSCP_BLE_SLEEP_EV_TIMEOUT);
 }
 
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // main_host_task
 //
@@ -613,17 +1610,73 @@ main_host_task(void *param)
 void
 eventGenerator(void *params)
 {
-  // Prevent advertising updates for a while to allow
-  // the system to be initialized
-  vTaskDelay(2000 / portTICK_PERIOD_MS);
+#if CONFIG_VSCP_BLE_PROFILER
+  int64_t prof_us = 0;
+#endif
+
+  // Wait for the host to sync. The first advert is set up there.
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
   while (true) {
+    // Up to 10% jitter so that nodes started together do not send
+    // their advert bursts in lock step. A queued alarm wakes the task
+    // early and is sent right away.
     uint32_t rNum = esp_random();
+    if (0 == ulTaskNotifyTake(pdTRUE, (1000 + (rNum % 100)) / portTICK_PERIOD_MS)) {
+      take_sample();
+    }
+#if CONFIG_VSCP_BLE_PERIODIC_ADV
+    // The train runs all the time, only its payload changes. A train
+    // that failed to start (BLE_HS_ENOMEM and the like) is started again.
+    xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
     update_advertising_data();
-    vTaskDelay(1000 / portTICK_PERIOD_MS);
+    if (!s_bPeriodicActive) {
+      periodic_advertise();
+    }
+    xSemaphoreGiveRecursive(s_adv_lock);
+#else
+    xSemaphoreTakeRecursive(s_adv_lock, portMAX_DELAY);
+    if (ble_gap_adv_active() && (0 == adv_get_repeat())) {
+      update_advertising_data();
+    }
+    else {
+      // Each update gets a burst of its own. A frame set into a running
+      // burst could miss the air if the burst ends before its next event.
+      if (ble_gap_adv_active()) {
+        ble_gap_adv_stop();
+      }
+      std_advertise();
+    }
+    xSemaphoreGiveRecursive(s_adv_lock);
+#endif
+
+#if VSCP_BLE_LISTEN
+    // Measure channel load and pick up gateway acknowledgements
+    channel_listen();
+#endif
+
+    // Write back configuration changes when due
+    vscp_ble_cfg_poll();
+
+#if CONFIG_VSCP_BLE_PROFILER
+    if ((esp_timer_get_time() - prof_us) >= (CONFIG_VSCP_BLE_PROFILER_PERIOD_MS * 1000LL)) {
+      prof_us = esp_timer_get_time();
+      vscp_ble_prof_sample();
+    }
+#endif
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cb_fetch_encryption_key
+//
+
+void
+vscp_ble_cb_fetch_encryption_key(uint8_t *pkey)
+{
+  vscp_ble_cfg_get_key(pkey);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // ble_host_config_init
 //
@@ -634,18 +1687,34 @@ ble_host_config_init(void)
   /* Set host callbacks */
   ble_hs_cfg.reset_cb          = handle_on_reset;
   ble_hs_cfg.sync_cb           = handle_on_sync;
+#if !CONFIG_VSCP_BLE_BEACON_ONLY
   ble_hs_cfg.gatts_register_cb = gatt_svr_register_cb;
+#endif
   ble_hs_cfg.store_status_cb   = ble_store_util_status_rr;
 
   ble_hs_cfg.sm_io_cap = CONFIG_EXAMPLE_IO_TYPE;
-
+#if CONFIG_EXAMPLE_USE_SC
   ble_hs_cfg.sm_sc = 1;
+#else
+  ble_hs_cfg.sm_sc = 0;
+#endif
+#if CONFIG_EXAMPLE_MITM
+  ble_hs_cfg.sm_mitm = 1;
+#endif
+
+  /* Bonded centrals resume encryption with the stored LTK on reconnect
+     instead of pairing again */
+#if CONFIG_EXAMPLE_BONDING
+  ble_hs_cfg.sm_bonding = 1;
+  ble_hs_cfg.sm_our_key_dist |= BLE_SM_PAIR_KEY_DIST_ENC;
+  ble_hs_cfg.sm_their_key_dist |= BLE_SM_PAIR_KEY_DIST_ENC;
+#endif
 
   /* Stores the IRK */
   ble_hs_cfg.sm_our_key_dist |= BLE_SM_PAIR_KEY_DIST_ID;
   ble_hs_cfg.sm_their_key_dist |= BLE_SM_PAIR_KEY_DIST_ID;
 
-  /* Initialize the BLE store configuration */
+  /* Bond store, persisted in NVS */
   ble_store_config_init();
 }
 
@@ -675,7 +1744,9 @@ app_main(void)
 {
   int rc;
 
-  // Initialize NVS — it is used to store PHY calibration data
+  log_phase("app_main");
+
+  // Initialize NVS — it is used to store PHY calibration data and node configuration
   esp_err_t ret = nvs_flash_init();
   if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
     ESP_ERROR_CHECK(nvs_flash_erase());
@@ -683,36 +1754,68 @@ app_main(void)
   }
   ESP_ERROR_CHECK(ret);
 
+  // Node configuration and registers (one pass load from NVS)
+  vscp_ble_cfg_init();
+  s_vscp_ctx.m_manufacturer = vscp_ble_cfg_get_manufacturer();
+  s_vscp_ctx.m_bEncryption  = vscp_ble_cfg_get_encryption();
+  log_phase("config loaded");
+
+  vscp_ble_queue_init(&s_queue, s_queue_items, CONFIG_VSCP_BLE_QUEUE_SIZE, CONFIG_VSCP_BLE_QUEUE_ALARM_RESERVE);
+  vscp_ble_pool_init(&s_pool, s_pool_blocks, CONFIG_VSCP_BLE_POOL_SIZE);
+
+  s_adv_lock = xSemaphoreCreateRecursiveMutex();
+  assert(NULL != s_adv_lock);
+
+#if CONFIG_VSCP_BLE_DEEP_SLEEP
+  s_sleep_lock = xSemaphoreCreateRecursiveMutex();
+  assert(NULL != s_sleep_lock);
+
+  // Restore sequencing state if this is a wakeup from deep sleep
+  sleep_retained_load();
+  if (vscp_ble_sleep_retained_init(&s_rtc)) {
+    vscp_ble_set_sequence(&s_vscp_ctx, s_rtc.m_frame_seq);
+    s_counter = s_rtc.m_sequence;
+  }
+
+  // Never stay awake longer than the budget
+  const esp_timer_create_args_t budget_args = { .callback = sleep_budget_cb, .name = "sleep budget" };
+  esp_timer_handle_t budget_timer;
+  ESP_ERROR_CHECK(esp_timer_create(&budget_args, &budget_timer));
+  ESP_ERROR_CHECK(esp_timer_start_once(budget_timer, CONFIG_VSCP_BLE_DEEP_SLEEP_BUDGET_MS * 1000ULL));
+#endif
+
   ret = nimble_port_init();
   if (ret != ESP_OK) {
     ESP_LOGE(TAG, "Failed to init nimble %d ", ret);
     return;
   }
-
-  // GAP service initialization
-  // rc = gap_init();
-  // if (rc != 0) {
-  //   ESP_LOGE(TAG, "failed to initialize GAP service, error code: %d", rc);
-  //   return;
-  // }
+  log_phase("nimble init");
 
   // NimBLE host configuration initialization
   ble_host_config_init();
 
-  ble_hs_cfg.sm_io_cap = CONFIG_EXAMPLE_IO_TYPE;
-  ble_hs_cfg.sm_sc     = 0;
-
+#if !CONFIG_VSCP_BLE_BEACON_ONLY
+  // GAP, GATT, ANS and the VSCP service. A beacon is never connected to
+  // so all of this is skipped there.
   rc = gatt_svr_init();
   assert(rc == 0);
 
+  // Pairing input is waited for here, not in the host task
+  s_passkey_queue = xQueueCreate(CONFIG_BT_NIMBLE_MAX_CONNECTIONS, sizeof(passkey_req_t));
+  assert(NULL != s_passkey_queue);
+  xTaskCreate(&passkey_task, "passkey", 3 * 1024, NULL, 1, NULL);
+#endif
+
   // Set the default device name.
   rc = ble_svc_gap_device_name_set("nimble-ble-vscp");
   assert(rc == 0);
 
-  // XXX Need to have template for store
-  ble_store_config_init();
+#if !CONFIG_VSCP_BLE_DEEP_SLEEP
+  // In deep sleep mode everything is driven from the duty cycle state machine.
+  // Created before the host is started as it is notified on sync.
+  xTaskCreate(&eventGenerator, "main Task", 4 * 1024, NULL, 2, &numGenHandler);
+#endif
 
   nimble_port_freertos_init(main_host_task);
-
-  xTaskCreate(&eventGenerator, "main Task", 4 * 1024, NULL, 2, &numGenHandler);
+  log_phase("host started");
 }
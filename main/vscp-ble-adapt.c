@@ -0,0 +1,109 @@
+/*!
+  @file vscp-ble-adapt.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vscp-ble-adapt.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_adapt_init
+//
+
+void
+vscp_ble_adapt_init(vscp_ble_adapt_t *padapt, const vscp_ble_adapt_limits_t *plimits)
+{
+  if ((NULL == padapt) || (NULL == plimits)) {
+    return;
+  }
+
+  padapt->m_itvl_ms = plimits->m_itvl_min_ms;
+  padapt->m_repeat  = plimits->m_repeat_max;
+  padapt->m_load    = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_adapt_update
+//
+
+int
+vscp_ble_adapt_update(vscp_ble_adapt_t *padapt, const vscp_ble_adapt_limits_t *plimits, uint16_t load)
+{
+  uint32_t itvl;
+  uint32_t repeat;
+  uint32_t avg;
+
+  if ((NULL == padapt) || (NULL == plimits)) {
+    return 0;
+  }
+
+  itvl   = padapt->m_itvl_ms;
+  repeat = padapt->m_repeat;
+
+  // Exponential moving average of the load
+  padapt->m_load -= (padapt->m_load >> VSCP_BLE_ADAPT_LOAD_SHIFT);
+  padapt->m_load += (((uint32_t) load * VSCP_BLE_ADAPT_LOAD_SCALE) >> VSCP_BLE_ADAPT_LOAD_SHIFT);
+  avg = padapt->m_load / VSCP_BLE_ADAPT_LOAD_SCALE;
+
+  if (avg > plimits->m_load_high) {
+    // Busy: back off multiplicatively, send fewer copies
+    itvl += itvl / 2;
+    if (repeat > plimits->m_repeat_min) {
+      repeat--;
+    }
+  }
+  else if (avg < plimits->m_load_low) {
+    // Quiet: creep back towards low latency, send more copies
+    itvl -= (itvl >= 16) ? (itvl / 8) : 1;
+    if (repeat < plimits->m_repeat_max) {
+      repeat++;
+    }
+  }
+
+  if (itvl > plimits->m_itvl_max_ms) {
+    itvl = plimits->m_itvl_max_ms;
+  }
+  if (itvl < plimits->m_itvl_min_ms) {
+    itvl = plimits->m_itvl_min_ms;
+  }
+  if (repeat < plimits->m_repeat_min) {
+    repeat = plimits->m_repeat_min;
+  }
+  if (repeat > plimits->m_repeat_max) {
+    repeat = plimits->m_repeat_max;
+  }
+
+  if ((itvl == padapt->m_itvl_ms) && (repeat == padapt->m_repeat)) {
+    return 0;
+  }
+
+  padapt->m_itvl_ms = (uint16_t) itvl;
+  padapt->m_repeat  = (uint8_t) repeat;
+  return 1;
+}
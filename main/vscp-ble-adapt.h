@@ -0,0 +1,98 @@
+
+/*!
+  @file vscp-ble-adapt.h
+  @brief Adaptive advertising interval and repetition count.
+
+  A node that listens to the channel for a short while now and then
+  knows how many adverts per second it hears. This observed load is
+  smoothed and used to widen the advertising interval when the channel
+  is busy (fewer collisions) and to narrow it again when the channel is
+  quiet (lower delivery latency). The repetition count moves in the
+  opposite direction to keep delivery probability up on a quiet channel
+  without adding to the load on a busy one.
+
+  The control law is a pure function of the current state, the configured
+  limits and the observed load.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_ADAPT_H
+#define VSCP_BLE_ADAPT_H
+
+#include <stdint.h>
+
+/*!
+  Limits for the adaptive control
+*/
+typedef struct vscp_ble_adapt_limits {
+  uint16_t m_itvl_min_ms; // Shortest advertising interval
+  uint16_t m_itvl_max_ms; // Longest advertising interval
+  uint8_t m_repeat_min;   // Fewest advertising events per update
+  uint8_t m_repeat_max;   // Most advertising events per update
+  uint16_t m_load_low;    // Heard adverts/s below which the channel is quiet
+  uint16_t m_load_high;   // Heard adverts/s above which the channel is busy
+} vscp_ble_adapt_limits_t;
+
+/*!
+  Adaptive control state
+*/
+typedef struct vscp_ble_adapt {
+  uint16_t m_itvl_ms; // Current advertising interval
+  uint8_t m_repeat;   // Current advertising events per update
+  uint32_t m_load;    // Smoothed load, adverts/s scaled by VSCP_BLE_ADAPT_LOAD_SCALE
+} vscp_ble_adapt_t;
+
+#define VSCP_BLE_ADAPT_LOAD_SCALE 16 // Fixed point scale of m_load
+#define VSCP_BLE_ADAPT_LOAD_SHIFT 2  // Smoothing, new sample weighs 1/4
+
+/*!
+  @brief Initialize the adaptive control state.
+  @param padapt Pointer to control state.
+  @param plimits Pointer to limits.
+
+  @note Starts at the shortest interval and the highest repetition count,
+  that is as if the channel was quiet.
+*/
+void
+vscp_ble_adapt_init(vscp_ble_adapt_t *padapt, const vscp_ble_adapt_limits_t *plimits);
+
+/*!
+  @brief Feed an observed channel load to the control.
+  @param padapt Pointer to control state.
+  @param plimits Pointer to limits.
+  @param load Number of adverts per second heard during the last listen window.
+  @return Non zero if the interval or repetition count changed.
+
+  @note On a busy channel the interval grows by 50% and the repetition
+  count drops by one. On a quiet channel the interval shrinks by 1/8 (at
+  least 1 ms) and the repetition count grows by one. Everything stays
+  within the limits.
+*/
+int
+vscp_ble_adapt_update(vscp_ble_adapt_t *padapt, const vscp_ble_adapt_limits_t *plimits, uint16_t load);
+
+#endif // VSCP_BLE_ADAPT_H
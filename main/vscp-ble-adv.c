@@ -0,0 +1,140 @@
+/*!
+  @file vscp-ble-adv.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+#include "vscp-ble.h"
+#include "vscp-ble-adv.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_adv_init
+//
+
+int
+vscp_ble_adv_init(vscp_ble_adv_t *padv, uint8_t flags, const char *name)
+{
+  uint8_t pos = 0;
+  size_t name_len;
+  size_t name_max;
+
+  // Check pointer
+  if (NULL == padv) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memset(padv, 0, sizeof(vscp_ble_adv_t));
+
+  // Flags
+  padv->m_buf[pos++] = 2;
+  padv->m_buf[pos++] = VSCP_BLE_AD_TYPE_FLAGS;
+  padv->m_buf[pos++] = flags;
+
+  // Name (whatever room is left when a full frame is in place)
+  name_len = (NULL != name) ? strlen(name) : 0;
+  name_max = VSCP_BLE_ADV_MAX_SIZE - pos - 2 - (2 + VSCP_BLE_FRAME_MIN_SIZE);
+  if (name_len) {
+    uint8_t type = VSCP_BLE_AD_TYPE_NAME_FULL;
+    if (name_len > name_max) {
+      name_len = name_max;
+      type     = VSCP_BLE_AD_TYPE_NAME_SHORT;
+    }
+    padv->m_buf[pos++] = (uint8_t) (name_len + 1);
+    padv->m_buf[pos++] = type;
+    memcpy(padv->m_buf + pos, name, name_len);
+    pos += (uint8_t) name_len;
+  }
+
+  // Manufacturer specific data header. The length is set when a frame is encoded.
+  padv->m_buf[pos++] = 1;
+  padv->m_buf[pos++] = VSCP_BLE_AD_TYPE_MFG_DATA;
+
+  padv->m_frame_pos = pos;
+  padv->m_len       = pos;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_adv_set_event
+//
+
+int
+vscp_ble_adv_set_event(vscp_ble_adv_t *padv, vscp_ble_ctx_t *ctx, vscpEvent *pev)
+{
+  int rv;
+
+  // Check pointers
+  if ((NULL == padv) || (NULL == ctx) || (NULL == pev)) {
+    return -1;
+  }
+
+  rv = vscp_ble_ev_to_frame(ctx, padv->m_buf + padv->m_frame_pos, VSCP_BLE_ADV_MAX_SIZE - padv->m_frame_pos, pev);
+  if (rv < 0) {
+    return -1;
+  }
+
+  // Manufacturer AD length covers the type byte and the frame
+  padv->m_buf[padv->m_frame_pos - 2] = (uint8_t) (rv + 1);
+  padv->m_len                        = padv->m_frame_pos + (uint8_t) rv;
+
+  return padv->m_len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_adv_find_frame
+//
+
+const uint8_t *
+vscp_ble_adv_find_frame(const uint8_t *pdata, uint8_t len, uint8_t *plen)
+{
+  uint8_t pos = 0;
+
+  // Check pointers
+  if ((NULL == pdata) || (NULL == plen)) {
+    return NULL;
+  }
+
+  // Each AD structure is length, type, payload. Length covers type and payload.
+  while ((pos + 1) < len) {
+    uint8_t ad_len = pdata[pos];
+    if ((0 == ad_len) || ((pos + 1 + ad_len) > len)) {
+      return NULL; // End of significant part or malformed
+    }
+    if (VSCP_BLE_AD_TYPE_MFG_DATA == pdata[pos + 1]) {
+      *plen = ad_len - 1;
+      return pdata + pos + 2;
+    }
+    pos += 1 + ad_len;
+  }
+
+  return NULL;
+}
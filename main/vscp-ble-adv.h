@@ -0,0 +1,110 @@
+
+/*!
+  @file vscp-ble-adv.h
+  @brief Raw advertising data builder for VSCP BLE frames.
+
+  Holds a pre-serialized legacy advertising payload (31 bytes) where
+  the flags and the device name AD structures are written once and the
+  manufacturer specific AD structure, which carries the VSCP frame, is
+  located at a fixed offset at the end of the payload. Each advert update
+  encodes the VSCP event directly into the template which then can be
+  handed to the controller with ble_gap_adv_set_data().
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  Template layout
+  ---------------
+
+  | Flags AD | 3 bytes | 0x02, 0x01, flags |
+  | Name AD | 2 + n bytes | n + 1, 0x09 (complete) or 0x08 (shortened), name |
+  | Manufacturer AD | 2 + frame bytes | frame size + 1, 0xFF, VSCP BLE frame |
+*/
+
+#ifndef VSCP_BLE_ADV_H
+#define VSCP_BLE_ADV_H
+
+#include <stdint.h>
+
+#include <vscp.h>
+#include "vscp-ble.h"
+
+#define VSCP_BLE_ADV_MAX_SIZE 31 // Legacy advertising payload
+
+// AD types (Bluetooth Core Specification Supplement, Part A)
+#define VSCP_BLE_AD_TYPE_FLAGS      0x01
+#define VSCP_BLE_AD_TYPE_NAME_SHORT 0x08
+#define VSCP_BLE_AD_TYPE_NAME_FULL  0x09
+#define VSCP_BLE_AD_TYPE_MFG_DATA   0xFF
+
+/*!
+  Raw advertising data template
+*/
+typedef struct vscp_ble_adv {
+  uint8_t m_buf[VSCP_BLE_ADV_MAX_SIZE]; // Serialized AD structures
+  uint8_t m_frame_pos;                  // Offset of the VSCP frame in m_buf
+  uint8_t m_len;                        // Number of valid bytes in m_buf
+} vscp_ble_adv_t;
+
+/*!
+  @brief Initialize the advertising data template.
+  @param padv Pointer to the template.
+  @param flags Advertising flags (BLE_HS_ADV_F_*).
+  @param name Device name. Names that do not fit together with a
+    VSCP_BLE_FRAME_MIN_SIZE frame are truncated and advertised as a
+    shortened name. NULL or an empty string leaves out the name.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+
+  @note The manufacturer AD structure is empty after initialization and is
+  filled in by vscp_ble_adv_set_event().
+*/
+int
+vscp_ble_adv_init(vscp_ble_adv_t *padv, uint8_t flags, const char *name);
+
+/*!
+  @brief Encode a VSCP event into the manufacturer AD structure of the template.
+  @param padv Pointer to the template.
+  @param ctx Pointer to the VSCP BLE context used for encoding.
+  @param pev Pointer to the VSCP event.
+  @return The total number of valid bytes in the template, or -1 on error.
+
+  @note Only events that fit in the advertising packet (eight data bytes or
+  less) can be encoded. The flags and name part of the template is left untouched.
+*/
+int
+vscp_ble_adv_set_event(vscp_ble_adv_t *padv, vscp_ble_ctx_t *ctx, vscpEvent *pev);
+
+/*!
+  @brief Find the VSCP frame in received advertising data.
+  @param pdata Pointer to the advertising data (AD structures).
+  @param len Length of the advertising data.
+  @param plen Pointer that receives the length of the frame.
+  @return Pointer to the frame (payload of the first manufacturer AD
+    structure), or NULL if there is none or the data is malformed.
+*/
+const uint8_t *
+vscp_ble_adv_find_frame(const uint8_t *pdata, uint8_t len, uint8_t *plen);
+
+#endif // VSCP_BLE_ADV_H
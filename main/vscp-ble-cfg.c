@@ -0,0 +1,539 @@
+/*!
+  @file vscp-ble-cfg.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+
+#include <freertos/FreeRTOS.h>
+
+#include <vscp.h>
+#include "vscp-ble-cfg.h"
+
+static const char *TAG = "VSCP-CFG";
+
+// RAM shadow of the persisted configuration
+static vscp_ble_cfg_data_t s_cfg;
+
+// Copy of the shadow that is written to flash (outside of the lock)
+static vscp_ble_cfg_data_t s_cfg_flush;
+
+// Selected register page (not persisted)
+static uint16_t s_page = 0;
+
+// Incremented on each change of the shadow
+static uint32_t s_generation = 0;
+
+// Write coalescing state
+static bool s_dirty             = false;
+static int64_t s_first_write_us = 0; // Time of oldest unflushed write
+static int64_t s_last_write_us  = 0; // Time of newest unflushed write
+
+static portMUX_TYPE s_cfg_mux = portMUX_INITIALIZER_UNLOCKED;
+
+///////////////////////////////////////////////////////////////////////////////
+// set_defaults
+//
+
+static void
+set_defaults(vscp_ble_cfg_data_t *pcfg)
+{
+  memset(pcfg, 0, sizeof(vscp_ble_cfg_data_t));
+
+  pcfg->m_version = VSCP_BLE_CFG_VERSION;
+
+  pcfg->m_regs[0][VSCP_BLE_REG_ADV_ITVL]         = (VSCP_BLE_CFG_DEFAULT_ADV_ITVL >> 8) & 0xff;
+  pcfg->m_regs[0][VSCP_BLE_REG_ADV_ITVL + 1]     = VSCP_BLE_CFG_DEFAULT_ADV_ITVL & 0xff;
+  pcfg->m_regs[0][VSCP_BLE_REG_MANUFACTURER]     = (VSCP_BLE_CFG_DEFAULT_MANUFACTURER >> 8) & 0xff;
+  pcfg->m_regs[0][VSCP_BLE_REG_MANUFACTURER + 1] = VSCP_BLE_CFG_DEFAULT_MANUFACTURER & 0xff;
+  pcfg->m_regs[0][VSCP_BLE_REG_ADV_REPEAT]       = VSCP_BLE_CFG_DEFAULT_ADV_REPEAT;
+  pcfg->m_regs[0][VSCP_BLE_REG_ZONE]             = VSCP_BLE_CFG_DEFAULT_ZONE;
+  pcfg->m_regs[0][VSCP_BLE_REG_SUBZONE]          = VSCP_BLE_CFG_DEFAULT_ZONE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// mark_dirty
+//
+// Must be called with s_cfg_mux held
+//
+
+static void
+mark_dirty(void)
+{
+  int64_t now = esp_timer_get_time();
+
+  s_generation++;
+
+  if (!s_dirty) {
+    s_dirty          = true;
+    s_first_write_us = now;
+  }
+  s_last_write_us = now;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_init
+//
+
+int
+vscp_ble_cfg_init(void)
+{
+  nvs_handle_t handle;
+  size_t len = sizeof(vscp_ble_cfg_data_t);
+  esp_err_t err;
+
+  set_defaults(&s_cfg);
+
+  err = nvs_open(VSCP_BLE_CFG_NVS_NAMESPACE, NVS_READONLY, &handle);
+  if (ESP_ERR_NVS_NOT_FOUND == err) {
+    ESP_LOGI(TAG, "No stored configuration, using defaults");
+    return VSCP_ERROR_SUCCESS;
+  }
+  if (ESP_OK != err) {
+    ESP_LOGE(TAG, "Failed to open NVS namespace; err=%d", err);
+    return VSCP_ERROR_ERROR;
+  }
+
+  // One pass: the whole configuration is one blob
+  err = nvs_get_blob(handle, VSCP_BLE_CFG_NVS_KEY, &s_cfg_flush, &len);
+  nvs_close(handle);
+
+  if ((ESP_OK == err) && (sizeof(vscp_ble_cfg_data_t) == len) && (VSCP_BLE_CFG_VERSION == s_cfg_flush.m_version)) {
+    memcpy(&s_cfg, &s_cfg_flush, sizeof(vscp_ble_cfg_data_t));
+    ESP_LOGI(TAG, "Configuration loaded");
+  }
+  else if ((ESP_OK == err) && (1 == s_cfg_flush.m_version) && (offsetof(vscp_ble_cfg_data_t, m_regs[1]) == len)) {
+    // Version 1 only had page 0 and no zone registers, the layout is
+    // otherwise the same. The registers added in version 2 keep their
+    // defaults and the upgraded blob is written back.
+    memcpy(&s_cfg, &s_cfg_flush, len);
+    s_cfg.m_version                       = VSCP_BLE_CFG_VERSION;
+    s_cfg.m_regs[0][VSCP_BLE_REG_ZONE]    = VSCP_BLE_CFG_DEFAULT_ZONE;
+    s_cfg.m_regs[0][VSCP_BLE_REG_SUBZONE] = VSCP_BLE_CFG_DEFAULT_ZONE;
+    taskENTER_CRITICAL(&s_cfg_mux);
+    mark_dirty();
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    ESP_LOGI(TAG, "Configuration loaded and upgraded to version %d", VSCP_BLE_CFG_VERSION);
+  }
+  else if ((ESP_OK == err) || (ESP_ERR_NVS_INVALID_LENGTH == err)) {
+    ESP_LOGW(TAG, "Stored configuration has another layout, using defaults");
+  }
+  else if (ESP_ERR_NVS_NOT_FOUND != err) {
+    ESP_LOGE(TAG, "Failed to read configuration; err=%d", err);
+    return VSCP_ERROR_ERROR;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_read_reg
+//
+
+uint8_t
+vscp_ble_cfg_read_reg(uint16_t page, uint8_t reg)
+{
+  if (reg < VSCP_BLE_CFG_PAGE_SIZE) {
+    return (page < VSCP_BLE_CFG_PAGES) ? s_cfg.m_regs[page][reg] : 0;
+  }
+
+  switch (reg) {
+    case VSCP_BLE_STDREG_PAGE_MSB:
+      return (s_page >> 8) & 0xff;
+
+    case VSCP_BLE_STDREG_PAGE_LSB:
+      return s_page & 0xff;
+
+    default:
+      if ((reg >= VSCP_BLE_STDREG_GUID) && (reg < (VSCP_BLE_STDREG_GUID + 16))) {
+        return s_cfg.m_guid[reg - VSCP_BLE_STDREG_GUID];
+      }
+      break;
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_write_reg
+//
+
+int
+vscp_ble_cfg_write_reg(uint16_t page, uint8_t reg, uint8_t val)
+{
+  if (reg < VSCP_BLE_CFG_PAGE_SIZE) {
+    if (page >= VSCP_BLE_CFG_PAGES) {
+      return VSCP_ERROR_INDEX_OOB;
+    }
+    taskENTER_CRITICAL(&s_cfg_mux);
+    if (s_cfg.m_regs[page][reg] != val) {
+      s_cfg.m_regs[page][reg] = val;
+      mark_dirty();
+    }
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  switch (reg) {
+    case VSCP_BLE_STDREG_PAGE_MSB:
+      s_page = (s_page & 0x00ff) | ((uint16_t) val << 8);
+      return VSCP_ERROR_SUCCESS;
+
+    case VSCP_BLE_STDREG_PAGE_LSB:
+      s_page = (s_page & 0xff00) | val;
+      return VSCP_ERROR_SUCCESS;
+
+    default:
+      break;
+  }
+
+  // Standard registers are read only
+  return VSCP_ERROR_NOT_SUPPORTED;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_read_block
+//
+
+int
+vscp_ble_cfg_read_block(uint16_t page, uint8_t reg, uint8_t *pbuf, uint16_t count)
+{
+  uint16_t paged = 0;
+
+  if (NULL == pbuf) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == count) || ((reg + count) > 0x100)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  // Paged part of the run as one snapshot
+  if (reg < VSCP_BLE_CFG_PAGE_SIZE) {
+    paged = VSCP_BLE_CFG_PAGE_SIZE - reg;
+    if (paged > count) {
+      paged = count;
+    }
+    if (page < VSCP_BLE_CFG_PAGES) {
+      taskENTER_CRITICAL(&s_cfg_mux);
+      memcpy(pbuf, &s_cfg.m_regs[page][reg], paged);
+      taskEXIT_CRITICAL(&s_cfg_mux);
+    }
+    else {
+      memset(pbuf, 0, paged);
+    }
+  }
+
+  for (uint16_t i = paged; i < count; i++) {
+    pbuf[i] = vscp_ble_cfg_read_reg(page, (uint8_t) (reg + i));
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_write_block
+//
+
+int
+vscp_ble_cfg_write_block(uint16_t page, uint8_t reg, const uint8_t *pbuf, uint16_t count, uint16_t *pwritten)
+{
+  uint16_t paged = 0;
+  int rv         = VSCP_ERROR_SUCCESS;
+  uint16_t i;
+
+  if (NULL != pwritten) {
+    *pwritten = 0;
+  }
+
+  if (NULL == pbuf) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == count) || ((reg + count) > 0x100)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  // Paged part of the run in one go, so it is flushed as a whole
+  if (reg < VSCP_BLE_CFG_PAGE_SIZE) {
+    if (page >= VSCP_BLE_CFG_PAGES) {
+      return VSCP_ERROR_INDEX_OOB;
+    }
+    paged = VSCP_BLE_CFG_PAGE_SIZE - reg;
+    if (paged > count) {
+      paged = count;
+    }
+    taskENTER_CRITICAL(&s_cfg_mux);
+    if (memcmp(&s_cfg.m_regs[page][reg], pbuf, paged)) {
+      memcpy(&s_cfg.m_regs[page][reg], pbuf, paged);
+      mark_dirty();
+    }
+    taskEXIT_CRITICAL(&s_cfg_mux);
+  }
+
+  for (i = paged; i < count; i++) {
+    rv = vscp_ble_cfg_write_reg(page, (uint8_t) (reg + i), pbuf[i]);
+    if (VSCP_ERROR_SUCCESS != rv) {
+      break;
+    }
+  }
+
+  if (NULL != pwritten) {
+    *pwritten = i;
+  }
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_page
+//
+
+uint16_t
+vscp_ble_cfg_get_page(void)
+{
+  return s_page;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_adv_itvl
+//
+
+uint16_t
+vscp_ble_cfg_get_adv_itvl(void)
+{
+  uint16_t itvl = ((uint16_t) s_cfg.m_regs[0][VSCP_BLE_REG_ADV_ITVL] << 8) + s_cfg.m_regs[0][VSCP_BLE_REG_ADV_ITVL + 1];
+
+  // 20 ms is the shortest legacy advertising interval
+  return (itvl < 20) ? 20 : itvl;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_adv_repeat
+//
+
+uint8_t
+vscp_ble_cfg_get_adv_repeat(void)
+{
+  return s_cfg.m_regs[0][VSCP_BLE_REG_ADV_REPEAT];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_zone
+//
+
+uint8_t
+vscp_ble_cfg_get_zone(void)
+{
+  return s_cfg.m_regs[0][VSCP_BLE_REG_ZONE];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_subzone
+//
+
+uint8_t
+vscp_ble_cfg_get_subzone(void)
+{
+  return s_cfg.m_regs[0][VSCP_BLE_REG_SUBZONE];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_generation
+//
+
+uint32_t
+vscp_ble_cfg_get_generation(void)
+{
+  return s_generation;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_manufacturer
+//
+
+uint16_t
+vscp_ble_cfg_get_manufacturer(void)
+{
+  return ((uint16_t) s_cfg.m_regs[0][VSCP_BLE_REG_MANUFACTURER] << 8) + s_cfg.m_regs[0][VSCP_BLE_REG_MANUFACTURER + 1];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_encryption
+//
+
+int
+vscp_ble_cfg_get_encryption(void)
+{
+  return (s_cfg.m_regs[0][VSCP_BLE_REG_FLAGS] & VSCP_BLE_REG_FLAG_ENCRYPTION) ? 1 : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_guid
+//
+
+int
+vscp_ble_cfg_get_guid(uint8_t *pguid)
+{
+  static const uint8_t empty[16] = { 0 };
+
+  if (NULL == pguid) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memcpy(pguid, s_cfg.m_guid, 16);
+  return memcmp(pguid, empty, 16) ? VSCP_ERROR_SUCCESS : VSCP_ERROR_ERROR;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_set_guid
+//
+
+int
+vscp_ble_cfg_set_guid(const uint8_t *pguid)
+{
+  if (NULL == pguid) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  taskENTER_CRITICAL(&s_cfg_mux);
+  if (memcmp(s_cfg.m_guid, pguid, 16)) {
+    memcpy(s_cfg.m_guid, pguid, 16);
+    mark_dirty();
+  }
+  taskEXIT_CRITICAL(&s_cfg_mux);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_get_key
+//
+
+int
+vscp_ble_cfg_get_key(uint8_t *pkey)
+{
+  if (NULL == pkey) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  taskENTER_CRITICAL(&s_cfg_mux);
+  memcpy(pkey, s_cfg.m_key, 16);
+  taskEXIT_CRITICAL(&s_cfg_mux);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_set_key
+//
+
+int
+vscp_ble_cfg_set_key(const uint8_t *pkey)
+{
+  if (NULL == pkey) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  taskENTER_CRITICAL(&s_cfg_mux);
+  if (memcmp(s_cfg.m_key, pkey, 16)) {
+    memcpy(s_cfg.m_key, pkey, 16);
+    mark_dirty();
+  }
+  taskEXIT_CRITICAL(&s_cfg_mux);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_poll
+//
+
+int
+vscp_ble_cfg_poll(void)
+{
+  int64_t now = esp_timer_get_time();
+  bool due;
+
+  taskENTER_CRITICAL(&s_cfg_mux);
+  due = s_dirty && (((now - s_last_write_us) >= (CONFIG_VSCP_BLE_CFG_FLUSH_IDLE_MS * 1000LL)) ||
+                    ((now - s_first_write_us) >= (CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS * 1000LL)));
+  taskEXIT_CRITICAL(&s_cfg_mux);
+
+  return due ? vscp_ble_cfg_flush() : VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_cfg_flush
+//
+
+int
+vscp_ble_cfg_flush(void)
+{
+  nvs_handle_t handle;
+  esp_err_t err;
+
+  // Take a consistent copy and clear the dirty state. Writes done while
+  // flash is written mark the shadow dirty again.
+  taskENTER_CRITICAL(&s_cfg_mux);
+  if (!s_dirty) {
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    return VSCP_ERROR_SUCCESS;
+  }
+  memcpy(&s_cfg_flush, &s_cfg, sizeof(vscp_ble_cfg_data_t));
+  s_dirty = false;
+  taskEXIT_CRITICAL(&s_cfg_mux);
+
+  err = nvs_open(VSCP_BLE_CFG_NVS_NAMESPACE, NVS_READWRITE, &handle);
+  if (ESP_OK == err) {
+    err = nvs_set_blob(handle, VSCP_BLE_CFG_NVS_KEY, &s_cfg_flush, sizeof(vscp_ble_cfg_data_t));
+    if (ESP_OK == err) {
+      err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+  }
+
+  if (ESP_OK != err) {
+    ESP_LOGE(TAG, "Failed to write configuration; err=%d", err);
+    // Try again on next poll
+    taskENTER_CRITICAL(&s_cfg_mux);
+    mark_dirty();
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    return VSCP_ERROR_ERROR;
+  }
+
+  ESP_LOGI(TAG, "Configuration written");
+  return VSCP_ERROR_SUCCESS;
+}
@@ -0,0 +1,276 @@
+
+/*!
+  @file vscp-ble-cfg.h
+  @brief Persistent node configuration and VSCP registers.
+
+  Node configuration (GUID, manufacturer code, advertising interval, keys)
+  and the VSCP Level I register space are kept in an in-RAM shadow that
+  is loaded from NVS in one pass at boot. Reads are served from the
+  shadow. Writes only update the shadow and mark it dirty, the shadow is
+  then written back to flash as one blob when the node has been idle
+  for a while or when the oldest pending write reaches its deadline.
+  This coalesces bursts of register writes into a single flash write.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+
+  Register map
+  ------------
+
+  Registers 0x00-0x7F are paged, registers 0x80-0xFF are the VSCP
+  standard registers and are the same on all pages.
+
+  | 0x00-0x01 | page 0 | Advertising interval in milliseconds (big endian) |
+  | 0x02-0x03 | page 0 | Bluetooth manufacturer code (big endian) |
+  | 0x04 | page 0 | Flags, bit 0 = encrypt frames |
+  | 0x05 | page 0 | Advertising events per update, 0 = advertise continuously |
+  | 0x06 | page 0 | Zone (decision matrix), 0xFF = all |
+  | 0x07 | page 0 | Sub-zone (decision matrix), 0xFF = all |
+  | 0x00-0x7F | pages 1-4 | Decision matrix, 16 rows of 8 bytes per page |
+  | 0x92-0x93 | std | Page select (MSB, LSB) |
+  | 0xD0-0xDF | std | GUID (read only) |
+*/
+
+#ifndef VSCP_BLE_CFG_H
+#define VSCP_BLE_CFG_H
+
+#include <stdint.h>
+
+#define VSCP_BLE_CFG_NVS_NAMESPACE "vscp"
+#define VSCP_BLE_CFG_NVS_KEY       "cfg"
+
+#define VSCP_BLE_CFG_VERSION   2   // Stored blob layout version
+#define VSCP_BLE_CFG_PAGE_SIZE 128 // Paged registers (0x00-0x7F) per page
+#define VSCP_BLE_CFG_PAGES     5   // Number of register pages kept in the shadow
+
+#define VSCP_BLE_CFG_PAGE_DM  1 // First decision matrix page
+#define VSCP_BLE_CFG_DM_PAGES 4 // Decision matrix pages
+
+// Page 0 registers
+#define VSCP_BLE_REG_ADV_ITVL     0x00 // 2 bytes
+#define VSCP_BLE_REG_MANUFACTURER 0x02 // 2 bytes
+#define VSCP_BLE_REG_FLAGS        0x04 // 1 byte
+#define VSCP_BLE_REG_ADV_REPEAT   0x05 // 1 byte
+#define VSCP_BLE_REG_ZONE         0x06 // 1 byte
+#define VSCP_BLE_REG_SUBZONE      0x07 // 1 byte
+
+#define VSCP_BLE_REG_FLAG_ENCRYPTION 0x01
+
+// Standard registers
+#define VSCP_BLE_STDREG_PAGE_MSB 0x92
+#define VSCP_BLE_STDREG_PAGE_LSB 0x93
+#define VSCP_BLE_STDREG_GUID     0xD0 // 16 bytes
+
+// Defaults used when nothing is stored in NVS
+#define VSCP_BLE_CFG_DEFAULT_ADV_ITVL     20     // ms
+#define VSCP_BLE_CFG_DEFAULT_MANUFACTURER 0xFFFF // Test id
+#define VSCP_BLE_CFG_DEFAULT_ADV_REPEAT   0      // Continuous
+#define VSCP_BLE_CFG_DEFAULT_ZONE         0xFF   // All zones
+
+/*!
+  Persisted node configuration. Stored as one NVS blob.
+*/
+typedef struct vscp_ble_cfg_data {
+  uint16_t m_version;                                         // VSCP_BLE_CFG_VERSION
+  uint8_t m_guid[16];                                         // Node GUID (all zero = not set)
+  uint8_t m_key[16];                                          // AES-128 frame encryption key
+  uint8_t m_regs[VSCP_BLE_CFG_PAGES][VSCP_BLE_CFG_PAGE_SIZE]; // Paged register shadow
+} vscp_ble_cfg_data_t;
+
+/*!
+  @brief Load the configuration from NVS into the RAM shadow.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+
+  @note NVS must be initialized before this function is called. If no
+  configuration is stored, or the stored layout is of another version,
+  defaults are used.
+*/
+int
+vscp_ble_cfg_init(void);
+
+/*!
+  @brief Read a register from the shadow.
+  @param page Register page (only used for registers 0x00-0x7F).
+  @param reg Register.
+  @return Register content. Registers that are not implemented read as zero.
+*/
+uint8_t
+vscp_ble_cfg_read_reg(uint16_t page, uint8_t reg);
+
+/*!
+  @brief Write a register in the shadow.
+  @param page Register page (only used for registers 0x00-0x7F).
+  @param reg Register.
+  @param val Value to write.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+
+  @note The write is persisted later by vscp_ble_cfg_poll() or
+  vscp_ble_cfg_flush().
+*/
+int
+vscp_ble_cfg_write_reg(uint16_t page, uint8_t reg, uint8_t val);
+
+/*!
+  @brief Read a run of registers from the shadow.
+  @param page Register page (only used for registers 0x00-0x7F).
+  @param reg First register.
+  @param pbuf Pointer to buffer that receives the register content.
+  @param count Number of registers to read. The run may not go past 0xFF.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+
+  @note The paged registers of the run are read as one consistent
+  snapshot.
+*/
+int
+vscp_ble_cfg_read_block(uint16_t page, uint8_t reg, uint8_t *pbuf, uint16_t count);
+
+/*!
+  @brief Write a run of registers in the shadow.
+  @param page Register page (only used for registers 0x00-0x7F).
+  @param reg First register.
+  @param pbuf Pointer to the values to write.
+  @param count Number of registers to write. The run may not go past 0xFF.
+  @param pwritten Pointer to variable that receives the number of
+    registers written, or NULL.
+  @return VSCP_ERROR_SUCCESS on success, else error code of the first
+    register that could not be written. Registers before it are written.
+
+  @note The paged registers of the run are updated together and are
+  persisted by one flash write.
+*/
+int
+vscp_ble_cfg_write_block(uint16_t page, uint8_t reg, const uint8_t *pbuf, uint16_t count, uint16_t *pwritten);
+
+/*!
+  @brief Get the currently selected register page.
+  @return Page set in the page select standard registers.
+*/
+uint16_t
+vscp_ble_cfg_get_page(void);
+
+/*!
+  @brief Get the advertising interval.
+  @return Advertising interval in milliseconds.
+*/
+uint16_t
+vscp_ble_cfg_get_adv_itvl(void);
+
+/*!
+  @brief Get the number of advertising events sent for each update.
+  @return Number of advertising events, zero for continuous advertising.
+*/
+uint8_t
+vscp_ble_cfg_get_adv_repeat(void);
+
+/*!
+  @brief Get the zone of the node.
+  @return Zone, 0xFF for all zones.
+*/
+uint8_t
+vscp_ble_cfg_get_zone(void);
+
+/*!
+  @brief Get the sub-zone of the node.
+  @return Sub-zone, 0xFF for all sub-zones.
+*/
+uint8_t
+vscp_ble_cfg_get_subzone(void);
+
+/*!
+  @brief Get the change generation of the shadow.
+  @return Counter that changes each time the shadow content changes.
+
+  @note Lets users of register content (for example the decision matrix)
+  notice that they need to reload it.
+*/
+uint32_t
+vscp_ble_cfg_get_generation(void);
+
+/*!
+  @brief Get the Bluetooth manufacturer code.
+  @return Manufacturer code.
+*/
+uint16_t
+vscp_ble_cfg_get_manufacturer(void);
+
+/*!
+  @brief Check if frame encryption is enabled.
+  @return Non zero if enabled.
+*/
+int
+vscp_ble_cfg_get_encryption(void);
+
+/*!
+  @brief Get the stored node GUID.
+  @param pguid Pointer to 16 byte buffer that will receive the GUID.
+  @return VSCP_ERROR_SUCCESS if a GUID is stored, else error code.
+*/
+int
+vscp_ble_cfg_get_guid(uint8_t *pguid);
+
+/*!
+  @brief Set the node GUID.
+  @param pguid Pointer to 16 byte GUID.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_cfg_set_guid(const uint8_t *pguid);
+
+/*!
+  @brief Get the frame encryption key.
+  @param pkey Pointer to 16 byte buffer that will receive the key.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_cfg_get_key(uint8_t *pkey);
+
+/*!
+  @brief Set the frame encryption key.
+  @param pkey Pointer to 16 byte key.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_cfg_set_key(const uint8_t *pkey);
+
+/*!
+  @brief Write pending changes to NVS if they are due.
+  @return VSCP_ERROR_SUCCESS on success or if nothing was due, else error code.
+
+  @note Should be called periodically from a task that may block on flash
+  writes. Pending changes are written when no write has been done for
+  CONFIG_VSCP_BLE_CFG_FLUSH_IDLE_MS or when the oldest pending write is
+  older than CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS.
+*/
+int
+vscp_ble_cfg_poll(void);
+
+/*!
+  @brief Write pending changes to NVS now.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_cfg_flush(void);
+
+#endif // VSCP_BLE_CFG_H
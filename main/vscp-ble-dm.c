@@ -0,0 +1,162 @@
+/*!
+  @file vscp-ble-dm.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+#include "vscp-ble-dm.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// zone_match
+//
+
+static int
+zone_match(uint8_t zone, uint8_t evzone)
+{
+  return (VSCP_BLE_DM_ZONE_ALL == zone) || (VSCP_BLE_DM_ZONE_ALL == evzone) || (zone == evzone);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_dm_compile
+//
+
+void
+vscp_ble_dm_compile(vscp_ble_dm_t *pdm, const uint8_t *prows, uint8_t cnt)
+{
+  if ((NULL == pdm) || ((NULL == prows) && cnt)) {
+    return;
+  }
+
+  if (cnt > VSCP_BLE_DM_MAX_ROWS) {
+    cnt = VSCP_BLE_DM_MAX_ROWS;
+  }
+
+  memset(pdm->m_class, 0, sizeof(pdm->m_class));
+  memset(pdm->m_type, 0, sizeof(pdm->m_type));
+  if (cnt) {
+    memcpy(pdm->m_rows, prows, cnt * VSCP_BLE_DM_ROW_SIZE);
+  }
+  pdm->m_cnt = cnt;
+
+  for (uint8_t i = 0; i < cnt; i++) {
+    const uint8_t *prow = pdm->m_rows[i];
+    uint64_t bit        = (uint64_t) 1 << i;
+    uint16_t mask;
+    uint16_t filter;
+
+    // Disabled rows are in no bitmap
+    if (!(prow[VSCP_BLE_DM_POS_FLAGS] & VSCP_BLE_DM_FLAG_ENABLED)) {
+      continue;
+    }
+
+    mask   = prow[VSCP_BLE_DM_POS_CLASS_MASK];
+    filter = prow[VSCP_BLE_DM_POS_CLASS_FILTER];
+    if (prow[VSCP_BLE_DM_POS_FLAGS] & VSCP_BLE_DM_FLAG_CLASS_MASK_BIT8) {
+      mask |= 0x100;
+    }
+    if (prow[VSCP_BLE_DM_POS_FLAGS] & VSCP_BLE_DM_FLAG_CLASS_FILTER_BIT8) {
+      filter |= 0x100;
+    }
+
+    for (uint16_t c = 0; c < VSCP_BLE_DM_CLASSES; c++) {
+      if (0 == ((c ^ filter) & mask)) {
+        pdm->m_class[c] |= bit;
+      }
+    }
+
+    mask   = prow[VSCP_BLE_DM_POS_TYPE_MASK];
+    filter = prow[VSCP_BLE_DM_POS_TYPE_FILTER];
+    for (uint16_t t = 0; t < VSCP_BLE_DM_TYPES; t++) {
+      if (0 == ((t ^ filter) & mask)) {
+        pdm->m_type[t] |= bit;
+      }
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_dm_match
+//
+
+int
+vscp_ble_dm_match(const vscp_ble_dm_t *pdm,
+                  const vscpEvent *pev,
+                  uint8_t zone,
+                  uint8_t subzone,
+                  vscp_ble_dm_action_cb_t cb,
+                  void *arg)
+{
+  uint64_t rows;
+  int cnt = 0;
+
+  // Check pointers
+  if ((NULL == pdm) || (NULL == pev)) {
+    return 0;
+  }
+
+  // Level II classes never match
+  if ((pev->vscp_class >= VSCP_BLE_DM_CLASSES) || (pev->vscp_type >= VSCP_BLE_DM_TYPES)) {
+    return 0;
+  }
+
+  rows = pdm->m_class[pev->vscp_class] & pdm->m_type[pev->vscp_type];
+
+  while (rows) {
+    uint8_t i           = (uint8_t) __builtin_ctzll(rows);
+    const uint8_t *prow = pdm->m_rows[i];
+    uint8_t flags       = prow[VSCP_BLE_DM_POS_FLAGS];
+
+    rows &= rows - 1;
+
+    if ((flags & VSCP_BLE_DM_FLAG_OADDR) && (prow[VSCP_BLE_DM_POS_OADDR] != pev->GUID[15])) {
+      continue;
+    }
+
+    if (flags & VSCP_BLE_DM_FLAG_ZONE) {
+      if ((pev->sizeData < 2) || (NULL == pev->pdata) || !zone_match(zone, pev->pdata[1])) {
+        continue;
+      }
+    }
+
+    if (flags & VSCP_BLE_DM_FLAG_SUBZONE) {
+      if ((pev->sizeData < 3) || (NULL == pev->pdata) || !zone_match(subzone, pev->pdata[2])) {
+        continue;
+      }
+    }
+
+    cnt++;
+    if (NULL != cb) {
+      cb(prow, pev, arg);
+    }
+  }
+
+  return cnt;
+}
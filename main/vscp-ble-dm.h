@@ -0,0 +1,132 @@
+
+/*!
+  @file vscp-ble-dm.h
+  @brief VSCP Level I decision matrix.
+
+  The decision matrix lets a node react to events by itself, without a
+  round trip over a gateway. Rows use the standard VSCP Level I layout
+  of eight bytes.
+
+    | 0 | Originating address (nickname) |
+    | 1 | Flags |
+    | 2 | Class mask (bit 8 in flags) |
+    | 3 | Class filter (bit 8 in flags) |
+    | 4 | Type mask |
+    | 5 | Type filter |
+    | 6 | Action |
+    | 7 | Action parameter |
+
+  The rows are compiled into one bitmap of matching rows for each class
+  and one for each type. Matching an event is then two table lookups and
+  an AND, whatever the number of rows. Originating address, zone and
+  sub-zone are only checked for the rows that are left.
+
+  Nothing here depends on ESP-IDF or NimBLE.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_DM_H
+#define VSCP_BLE_DM_H
+
+#include <stdint.h>
+
+#include <vscp.h>
+
+#define VSCP_BLE_DM_ROW_SIZE 8
+#define VSCP_BLE_DM_MAX_ROWS 64  // Rows in a bitmap
+#define VSCP_BLE_DM_CLASSES  512 // Level I classes
+#define VSCP_BLE_DM_TYPES    256
+
+// Row positions
+#define VSCP_BLE_DM_POS_OADDR        0
+#define VSCP_BLE_DM_POS_FLAGS        1
+#define VSCP_BLE_DM_POS_CLASS_MASK   2
+#define VSCP_BLE_DM_POS_CLASS_FILTER 3
+#define VSCP_BLE_DM_POS_TYPE_MASK    4
+#define VSCP_BLE_DM_POS_TYPE_FILTER  5
+#define VSCP_BLE_DM_POS_ACTION       6
+#define VSCP_BLE_DM_POS_ACTION_PARAM 7
+
+// Row flags
+#define VSCP_BLE_DM_FLAG_ENABLED           0x80
+#define VSCP_BLE_DM_FLAG_OADDR             0x40 // Originating address must match
+#define VSCP_BLE_DM_FLAG_HARDCODED         0x20 // Originating node is hard coded (not used)
+#define VSCP_BLE_DM_FLAG_ZONE              0x10 // Zone (data byte 1) must match
+#define VSCP_BLE_DM_FLAG_SUBZONE           0x08 // Sub-zone (data byte 2) must match
+#define VSCP_BLE_DM_FLAG_CLASS_MASK_BIT8   0x02
+#define VSCP_BLE_DM_FLAG_CLASS_FILTER_BIT8 0x01
+
+#define VSCP_BLE_DM_ZONE_ALL 0xff // Zone or sub-zone that matches all
+
+/*!
+  Compiled decision matrix
+*/
+typedef struct vscp_ble_dm {
+  uint64_t m_class[VSCP_BLE_DM_CLASSES];                     // Rows matching each class
+  uint64_t m_type[VSCP_BLE_DM_TYPES];                        // Rows matching each type
+  uint8_t m_rows[VSCP_BLE_DM_MAX_ROWS][VSCP_BLE_DM_ROW_SIZE]; // Copy of the rows
+  uint8_t m_cnt;                                             // Number of rows
+} vscp_ble_dm_t;
+
+/*!
+  @brief Action callback.
+  @param prow Pointer to the matching row.
+  @param pev Pointer to the event that matched.
+  @param arg User argument given to vscp_ble_dm_match().
+*/
+typedef void (*vscp_ble_dm_action_cb_t)(const uint8_t *prow, const vscpEvent *pev, void *arg);
+
+/*!
+  @brief Compile decision matrix rows.
+  @param pdm Pointer to decision matrix.
+  @param prows Pointer to rows, VSCP_BLE_DM_ROW_SIZE bytes each.
+  @param cnt Number of rows. Rows past VSCP_BLE_DM_MAX_ROWS are ignored.
+
+  @note The rows are copied. Compile again when they change.
+*/
+void
+vscp_ble_dm_compile(vscp_ble_dm_t *pdm, const uint8_t *prows, uint8_t cnt);
+
+/*!
+  @brief Run an event through the decision matrix.
+  @param pdm Pointer to compiled decision matrix.
+  @param pev Pointer to event. The originating address is the last GUID byte.
+  @param zone Zone of this node.
+  @param subzone Sub-zone of this node.
+  @param cb Action callback, called for each matching row in row order.
+  @param arg User argument passed to the callback.
+  @return Number of rows that matched.
+*/
+int
+vscp_ble_dm_match(const vscp_ble_dm_t *pdm,
+                  const vscpEvent *pev,
+                  uint8_t zone,
+                  uint8_t subzone,
+                  vscp_ble_dm_action_cb_t cb,
+                  void *arg);
+
+#endif // VSCP_BLE_DM_H
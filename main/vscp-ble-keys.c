@@ -0,0 +1,426 @@
+/*!
+  @file vscp-ble-keys.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vscp.h>
+#include "vscp-ble-keys.h"
+
+#define KEYS_LINE_MAX 128 // Longest line in the key file
+
+///////////////////////////////////////////////////////////////////////////////
+// keys_hex
+//
+// Parses two hex digits. Returns the byte or -1.
+//
+
+static int
+keys_hex(const char *p)
+{
+  int val = 0;
+
+  for (int i = 0; i < 2; i++) {
+    val <<= 4;
+    if ((p[i] >= '0') && (p[i] <= '9')) {
+      val |= p[i] - '0';
+    }
+    else if ((p[i] >= 'a') && (p[i] <= 'f')) {
+      val |= p[i] - 'a' + 10;
+    }
+    else if ((p[i] >= 'A') && (p[i] <= 'F')) {
+      val |= p[i] - 'A' + 10;
+    }
+    else {
+      return -1;
+    }
+  }
+
+  return val;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// keys_parse_key
+//
+// Parses a 128-bit key in hex.
+//
+
+static int
+keys_parse_key(uint8_t *pkey, const char *p)
+{
+  int val;
+
+  for (int i = 0; i < VSCP_BLE_KEYS_KEY_SIZE; i++) {
+    val = keys_hex(p + (2 * i));
+    if (val < 0) {
+      return VSCP_ERROR_INVALID_PARAMETER;
+    }
+    pkey[i] = (uint8_t) val;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// keys_parse_line
+//
+// Parses a key file line. Returns the offset of the key in the line and
+// the node id, zero for lines without a key or -1 if the line is
+// malformed.
+//
+
+static int
+keys_parse_line(const char *line, uint16_t *pnodeid)
+{
+  uint8_t guid[16];
+  uint8_t key[VSCP_BLE_KEYS_KEY_SIZE];
+  const char *p = line;
+  int val;
+
+  while (isspace((unsigned char) *p)) {
+    p++;
+  }
+  if (('\0' == *p) || ('#' == *p)) {
+    return 0;
+  }
+
+  // GUID, sixteen bytes separated by ':'
+  for (int i = 0; i < 16; i++) {
+    val = keys_hex(p);
+    if (val < 0) {
+      return -1;
+    }
+    guid[i] = (uint8_t) val;
+    p += 2;
+    if ((i < 15) && (':' != *p++)) {
+      return -1;
+    }
+  }
+
+  if (!isspace((unsigned char) *p)) {
+    return -1;
+  }
+  while (isspace((unsigned char) *p)) {
+    p++;
+  }
+
+  // Key, checked here so a bad key is found when the file is opened
+  if (VSCP_ERROR_SUCCESS != keys_parse_key(key, p)) {
+    return -1;
+  }
+
+  *pnodeid = ((uint16_t) guid[14] << 8) + guid[15];
+
+  return (int) (p - line);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_keys_open
+//
+
+int
+vscp_ble_keys_open(vscp_ble_keys_file_t *pfile, const char *path)
+{
+  char line[KEYS_LINE_MAX];
+  uint16_t nodeid;
+  long offset;
+  FILE *fp;
+  int pos;
+  int rv = VSCP_ERROR_SUCCESS;
+
+  if ((NULL == pfile) || (NULL == path)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memset(pfile->m_offset, 0, sizeof(pfile->m_offset));
+  pfile->m_cnt = 0;
+  pfile->m_fd  = -1;
+
+  fp = fopen(path, "r");
+  if (NULL == fp) {
+    return VSCP_ERROR_ERROR;
+  }
+
+  for (;;) {
+    offset = ftell(fp);
+    if (NULL == fgets(line, sizeof(line), fp)) {
+      break;
+    }
+
+    pos = keys_parse_line(line, &nodeid);
+    if (0 == pos) {
+      continue;
+    }
+    if ((pos < 0) || pfile->m_offset[nodeid]) {
+      rv = VSCP_ERROR_INVALID_PARAMETER;
+      break;
+    }
+
+    pfile->m_offset[nodeid] = (uint32_t) (offset + pos + 1);
+    pfile->m_cnt++;
+  }
+
+  fclose(fp);
+  if (VSCP_ERROR_SUCCESS != rv) {
+    return rv;
+  }
+
+  // Keys are read with pread() so that caches in several threads can share it
+  pfile->m_fd = open(path, O_RDONLY);
+  if (pfile->m_fd < 0) {
+    return VSCP_ERROR_ERROR;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_keys_close
+//
+
+void
+vscp_ble_keys_close(vscp_ble_keys_file_t *pfile)
+{
+  if ((NULL == pfile) || (pfile->m_fd < 0)) {
+    return;
+  }
+
+  close(pfile->m_fd);
+  pfile->m_fd = -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_keys_cache_init
+//
+
+int
+vscp_ble_keys_cache_init(vscp_ble_keys_cache_t *pcache,
+                         const vscp_ble_keys_file_t *pfile,
+                         vscp_ble_keys_entry_t *pentries,
+                         uint16_t size)
+{
+  if ((NULL == pcache) || (NULL == pfile) || (NULL == pentries)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == size) || (size >= VSCP_BLE_KEYS_NONE)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  pcache->m_pfile   = pfile;
+  pcache->m_entries = pentries;
+  pcache->m_size    = size;
+  pcache->m_used    = 0;
+  pcache->m_mru     = VSCP_BLE_KEYS_NONE;
+  pcache->m_lru     = VSCP_BLE_KEYS_NONE;
+  memset(pcache->m_slot, 0xff, sizeof(pcache->m_slot));
+  memset(&pcache->m_stats, 0, sizeof(pcache->m_stats));
+
+  for (uint16_t i = 0; i < size; i++) {
+    mbedtls_aes_init(&pentries[i].m_aes);
+    pentries[i].m_bUsed = 0;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_keys_cache_free
+//
+
+void
+vscp_ble_keys_cache_free(vscp_ble_keys_cache_t *pcache)
+{
+  if ((NULL == pcache) || (NULL == pcache->m_entries)) {
+    return;
+  }
+
+  // Do not leave key schedules in memory
+  for (uint16_t i = 0; i < pcache->m_size; i++) {
+    mbedtls_aes_free(&pcache->m_entries[i].m_aes);
+    pcache->m_entries[i].m_bUsed = 0;
+  }
+
+  memset(pcache->m_slot, 0xff, sizeof(pcache->m_slot));
+  pcache->m_used = 0;
+  pcache->m_mru  = VSCP_BLE_KEYS_NONE;
+  pcache->m_lru  = VSCP_BLE_KEYS_NONE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// keys_unlink
+//
+// Takes an entry out of the LRU list.
+//
+
+static void
+keys_unlink(vscp_ble_keys_cache_t *pcache, uint16_t idx)
+{
+  vscp_ble_keys_entry_t *pentry = &pcache->m_entries[idx];
+
+  if (VSCP_BLE_KEYS_NONE != pentry->m_prev) {
+    pcache->m_entries[pentry->m_prev].m_next = pentry->m_next;
+  }
+  else {
+    pcache->m_mru = pentry->m_next;
+  }
+
+  if (VSCP_BLE_KEYS_NONE != pentry->m_next) {
+    pcache->m_entries[pentry->m_next].m_prev = pentry->m_prev;
+  }
+  else {
+    pcache->m_lru = pentry->m_prev;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// keys_push
+//
+// Puts an entry first in the LRU list.
+//
+
+static void
+keys_push(vscp_ble_keys_cache_t *pcache, uint16_t idx)
+{
+  vscp_ble_keys_entry_t *pentry = &pcache->m_entries[idx];
+
+  pentry->m_prev = VSCP_BLE_KEYS_NONE;
+  pentry->m_next = pcache->m_mru;
+  if (VSCP_BLE_KEYS_NONE != pcache->m_mru) {
+    pcache->m_entries[pcache->m_mru].m_prev = idx;
+  }
+  else {
+    pcache->m_lru = idx;
+  }
+  pcache->m_mru = idx;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// keys_load
+//
+// Reads the key of a node and expands it into an entry.
+//
+
+static int
+keys_load(vscp_ble_keys_cache_t *pcache, vscp_ble_keys_entry_t *pentry, uint16_t nodeid)
+{
+  char hex[2 * VSCP_BLE_KEYS_KEY_SIZE];
+  uint8_t key[VSCP_BLE_KEYS_KEY_SIZE];
+  off_t offset = (off_t) pcache->m_pfile->m_offset[nodeid] - 1;
+  int rv;
+
+  if ((ssize_t) sizeof(hex) != pread(pcache->m_pfile->m_fd, hex, sizeof(hex), offset)) {
+    return VSCP_ERROR_ERROR;
+  }
+
+  rv = keys_parse_key(key, hex);
+  if (VSCP_ERROR_SUCCESS == rv) {
+    rv = (0 == mbedtls_aes_setkey_enc(&pentry->m_aes, key, 8 * VSCP_BLE_KEYS_KEY_SIZE)) ? VSCP_ERROR_SUCCESS
+                                                                                      : VSCP_ERROR_ERROR;
+  }
+
+  memset(key, 0, sizeof(key));
+  memset(hex, 0, sizeof(hex));
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_keys_get
+//
+
+const mbedtls_aes_context *
+vscp_ble_keys_get(vscp_ble_keys_cache_t *pcache, uint16_t nodeid)
+{
+  vscp_ble_keys_entry_t *pentry;
+  uint16_t idx;
+
+  if ((NULL == pcache) || (NULL == pcache->m_entries)) {
+    return NULL;
+  }
+
+  // Cached
+  idx = pcache->m_slot[nodeid];
+  if (VSCP_BLE_KEYS_NONE != idx) {
+    if (idx != pcache->m_mru) {
+      keys_unlink(pcache, idx);
+      keys_push(pcache, idx);
+    }
+    pcache->m_stats.m_hits++;
+    return &pcache->m_entries[idx].m_aes;
+  }
+
+  if ((pcache->m_pfile->m_fd < 0) || !pcache->m_pfile->m_offset[nodeid]) {
+    pcache->m_stats.m_unknown++;
+    return NULL;
+  }
+
+  // A free entry, else the least recently used one
+  if (pcache->m_used < pcache->m_size) {
+    idx = pcache->m_used++;
+  }
+  else {
+    idx = pcache->m_lru;
+    keys_unlink(pcache, idx);
+    if (pcache->m_entries[idx].m_bUsed) {
+      pcache->m_slot[pcache->m_entries[idx].m_nodeid] = VSCP_BLE_KEYS_NONE;
+      pcache->m_entries[idx].m_bUsed                  = 0;
+      pcache->m_stats.m_evictions++;
+    }
+  }
+
+  pentry = &pcache->m_entries[idx];
+  if (VSCP_ERROR_SUCCESS != keys_load(pcache, pentry, nodeid)) {
+    // Entry goes last so it is reused first
+    pentry->m_prev = pcache->m_lru;
+    pentry->m_next = VSCP_BLE_KEYS_NONE;
+    if (VSCP_BLE_KEYS_NONE != pcache->m_lru) {
+      pcache->m_entries[pcache->m_lru].m_next = idx;
+    }
+    else {
+      pcache->m_mru = idx;
+    }
+    pcache->m_lru = idx;
+    pcache->m_stats.m_unknown++;
+    return NULL;
+  }
+
+  pentry->m_nodeid       = nodeid;
+  pentry->m_bUsed        = 1;
+  pcache->m_slot[nodeid] = idx;
+  keys_push(pcache, idx);
+  pcache->m_stats.m_loads++;
+
+  return &pentry->m_aes;
+}
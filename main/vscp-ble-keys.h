@@ -0,0 +1,164 @@
+
+/*!
+  @file vscp-ble-keys.h
+  @brief Per node key store for gateways.
+
+  Used on a gateway that decrypts frames from many nodes, each with a
+  key of its own. The node firmware does not use it (it has one key, see
+  vscp_ble_cb_fetch_encryption_key()).
+
+  Keys are kept in a text file, one node per line
+
+    FF:FF:FF:FF:FF:FF:FF:FE:00:00:A5:A4:A3:A2:12:34 00112233445566778899AABBCCDDEEFF
+
+  that is the GUID of the node and its 128-bit AES key in hex. Empty
+  lines and lines starting with '#' are skipped. The node id (last two
+  bytes of the GUID) is what frames carry, so it must be unique in the
+  file.
+
+  vscp_ble_keys_open() only indexes the file (node id to file offset).
+  A key is read and its AES key schedule expanded the first time a node
+  is looked up, and is then kept in a bounded LRU cache so that a busy
+  gateway does not expand a key for every frame. Lookups are O(1).
+
+  The index is read only after it has been opened and can be shared by
+  threads. A cache is for one thread. With the sharded pipeline (see
+  vscp-ble-shard.h) give each shard a cache of its own, a node always
+  goes to the same shard.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_KEYS_H
+#define VSCP_BLE_KEYS_H
+
+#include <stdint.h>
+
+#include "mbedtls/aes.h"
+
+#define VSCP_BLE_KEYS_NODES    65536  // Node ids
+#define VSCP_BLE_KEYS_KEY_SIZE 16     // AES-128
+#define VSCP_BLE_KEYS_NONE     0xffff // No cache entry
+
+/*!
+  Key file index
+*/
+typedef struct vscp_ble_keys_file {
+  int m_fd;                               // Key file, -1 when closed
+  uint32_t m_offset[VSCP_BLE_KEYS_NODES]; // File offset of the key of each node plus one, zero if none
+  uint32_t m_cnt;                         // Number of nodes with a key
+} vscp_ble_keys_file_t;
+
+/*!
+  Cache entry, an expanded key
+*/
+typedef struct vscp_ble_keys_entry {
+  mbedtls_aes_context m_aes; // Expanded key (encryption schedule)
+  uint16_t m_nodeid;         // Node id
+  uint16_t m_prev;           // Towards most recently used
+  uint16_t m_next;           // Towards least recently used
+  uint8_t m_bUsed;           // Entry holds a key
+} vscp_ble_keys_entry_t;
+
+/*!
+  Cache statistics
+*/
+typedef struct vscp_ble_keys_stats {
+  uint32_t m_hits;      // Lookups served from the cache
+  uint32_t m_loads;     // Keys read from the file and expanded
+  uint32_t m_evictions; // Keys dropped to make room
+  uint32_t m_unknown;   // Lookups for nodes without a key
+} vscp_ble_keys_stats_t;
+
+/*!
+  Expanded key cache
+*/
+typedef struct vscp_ble_keys_cache {
+  const vscp_ble_keys_file_t *m_pfile;  // Key file index
+  vscp_ble_keys_entry_t *m_entries;     // Entries, caller storage
+  uint16_t m_size;                      // Number of entries
+  uint16_t m_used;                      // Entries taken into use
+  uint16_t m_mru;                       // Most recently used entry
+  uint16_t m_lru;                       // Least recently used entry
+  uint16_t m_slot[VSCP_BLE_KEYS_NODES]; // Entry of each node, VSCP_BLE_KEYS_NONE if not cached
+  vscp_ble_keys_stats_t m_stats;
+} vscp_ble_keys_cache_t;
+
+/*!
+  @brief Open and index a key file.
+  @param pfile Pointer to key file index.
+  @param path Path to the key file.
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_ERROR if the file can
+    not be read, VSCP_ERROR_INVALID_PARAMETER if a line is malformed or a node id
+    is used twice, else error code.
+
+  @note No keys are read here, only where they are in the file.
+*/
+int
+vscp_ble_keys_open(vscp_ble_keys_file_t *pfile, const char *path);
+
+/*!
+  @brief Close a key file.
+  @param pfile Pointer to key file index.
+*/
+void
+vscp_ble_keys_close(vscp_ble_keys_file_t *pfile);
+
+/*!
+  @brief Initialize an expanded key cache.
+  @param pcache Pointer to cache.
+  @param pfile Pointer to an opened key file index.
+  @param pentries Pointer to entry storage.
+  @param size Number of entries, 1 to VSCP_BLE_KEYS_NONE - 1.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_keys_cache_init(vscp_ble_keys_cache_t *pcache,
+                         const vscp_ble_keys_file_t *pfile,
+                         vscp_ble_keys_entry_t *pentries,
+                         uint16_t size);
+
+/*!
+  @brief Free the expanded keys of a cache.
+  @param pcache Pointer to cache.
+*/
+void
+vscp_ble_keys_cache_free(vscp_ble_keys_cache_t *pcache);
+
+/*!
+  @brief Get the expanded key of a node.
+  @param pcache Pointer to cache.
+  @param nodeid Node id.
+  @return Pointer to the AES context, or NULL if the node has no key.
+    Valid until the next lookup in the same cache.
+
+  @note The context has the encryption key schedule, which is what CTR
+  and CCM mode use in both directions.
+*/
+const mbedtls_aes_context *
+vscp_ble_keys_get(vscp_ble_keys_cache_t *pcache, uint16_t nodeid);
+
+#endif // VSCP_BLE_KEYS_H
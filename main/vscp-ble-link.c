@@ -0,0 +1,602 @@
+/*!
+  @file vscp-ble-link.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <vscp.h>
+#include "vscp-ble-link.h"
+
+#ifdef MSG_NOSIGNAL
+#define LINK_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define LINK_SEND_FLAGS 0
+#endif
+
+#define LINK_TX_SIZE 1460 // One TCP segment of SEND commands per write
+
+///////////////////////////////////////////////////////////////////////////////
+// crc16
+//
+// CRC-16/CCITT, polynomial 0x1021, initial value 0xFFFF
+//
+
+static uint16_t
+crc16(const uint8_t *pbuf, size_t len)
+{
+  uint16_t crc = 0xffff;
+
+  while (len--) {
+    crc ^= (uint16_t) *pbuf++ << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// send_all
+//
+
+static int
+send_all(int sock, const void *pbuf, size_t len)
+{
+  const uint8_t *p = pbuf;
+
+  while (len) {
+    ssize_t n = send(sock, p, len, LINK_SEND_FLAGS);
+    if (n <= 0) {
+      return -1;
+    }
+    p += n;
+    len -= (size_t) n;
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// read_reply
+//
+// Reads tcp/ip link reply lines until one that starts with +OK or -OK.
+// Other lines (welcome banner) are skipped. Returns 0 for +OK, 1 for -OK
+// and -1 on timeout or error.
+//
+
+static int
+read_reply(vscp_ble_link_t *plink)
+{
+  while (true) {
+    char *peol = memchr(plink->m_rx, '\n', plink->m_rxlen);
+    ssize_t n;
+
+    if (NULL != peol) {
+      size_t linelen = (size_t) (peol - plink->m_rx) + 1;
+      int rv         = -2;
+
+      if ((linelen >= 3) && (0 == memcmp(plink->m_rx, "+OK", 3))) {
+        rv = 0;
+      }
+      else if ((linelen >= 3) && (0 == memcmp(plink->m_rx, "-OK", 3))) {
+        rv = 1;
+      }
+
+      plink->m_rxlen -= (uint16_t) linelen;
+      memmove(plink->m_rx, plink->m_rx + linelen, plink->m_rxlen);
+
+      if (rv >= 0) {
+        return rv;
+      }
+      continue;
+    }
+
+    // A line longer than the buffer is not a reply, drop what we have
+    if (plink->m_rxlen == sizeof(plink->m_rx)) {
+      plink->m_rxlen = 0;
+    }
+
+    n = recv(plink->m_sock, plink->m_rx + plink->m_rxlen, sizeof(plink->m_rx) - plink->m_rxlen, 0);
+    if (n <= 0) {
+      return -1;
+    }
+    plink->m_rxlen += (uint16_t) n;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// command
+//
+// Sends a tcp/ip link command and reads its reply. Returns 0 for +OK.
+//
+
+static int
+command(vscp_ble_link_t *plink, const char *cmd, const char *arg)
+{
+  char line[80];
+  int len = snprintf(line, sizeof(line), "%s %s\r\n", cmd, arg);
+
+  if ((len < 0) || ((size_t) len >= sizeof(line))) {
+    return -1;
+  }
+
+  if (send_all(plink->m_sock, line, (size_t) len)) {
+    return -1;
+  }
+
+  return read_reply(plink);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// link_open
+//
+
+static int
+link_open(vscp_ble_link_t *plink)
+{
+  struct sockaddr_in addr = { 0 };
+  struct timeval tv       = { 0 };
+
+  plink->m_sock = socket(AF_INET, (VSCP_BLE_LINK_TCP == plink->m_proto) ? SOCK_STREAM : SOCK_DGRAM, 0);
+  if (plink->m_sock < 0) {
+    return -1;
+  }
+
+  tv.tv_sec  = VSCP_BLE_LINK_TIMEOUT_MS / 1000;
+  tv.tv_usec = (VSCP_BLE_LINK_TIMEOUT_MS % 1000) * 1000;
+  setsockopt(plink->m_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(plink->m_sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  // Connected UDP sockets report ICMP errors and can use send()
+  addr.sin_family      = AF_INET;
+  addr.sin_port        = htons(plink->m_port);
+  addr.sin_addr.s_addr = plink->m_ip;
+  if (connect(plink->m_sock, (struct sockaddr *) &addr, sizeof(addr))) {
+    vscp_ble_link_close(plink);
+    return -1;
+  }
+
+  if (VSCP_BLE_LINK_TCP == plink->m_proto) {
+    int one = 1;
+
+    // Commands are written a segment at a time. Without this the last
+    // part of a batch waits for the ack of the one before it.
+    setsockopt(plink->m_sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    plink->m_rxlen = 0;
+
+    // Welcome banner ends with +OK
+    if (read_reply(plink)) {
+      vscp_ble_link_close(plink);
+      return -1;
+    }
+
+    if ((NULL != plink->m_user) &&
+        (command(plink, "user", plink->m_user) || command(plink, "pass", plink->m_password))) {
+      vscp_ble_link_close(plink);
+      return -1;
+    }
+  }
+
+  plink->m_stats.m_connects++;
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// link_fail
+//
+// Closes the link and sets up the back off before the next attempt.
+//
+
+static int
+link_fail(vscp_ble_link_t *plink, uint32_t now_ms)
+{
+  vscp_ble_link_close(plink);
+  plink->m_stats.m_failures++;
+
+  plink->m_backoff_ms = plink->m_backoff_ms ? (plink->m_backoff_ms * 2) : VSCP_BLE_LINK_BACKOFF_MIN_MS;
+  if (plink->m_backoff_ms > VSCP_BLE_LINK_BACKOFF_MAX_MS) {
+    plink->m_backoff_ms = VSCP_BLE_LINK_BACKOFF_MAX_MS;
+  }
+  plink->m_retry_ms = now_ms + plink->m_backoff_ms;
+
+  return -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// link_pop
+//
+
+static void
+link_pop(vscp_ble_link_t *plink)
+{
+  plink->m_head = (plink->m_head + 1) % plink->m_size;
+  plink->m_count--;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// flush_udp
+//
+
+static int
+flush_udp(vscp_ble_link_t *plink, uint16_t n, uint32_t now_ms)
+{
+  uint8_t frame[VSCP_BLE_LINK_UDP_FRAME_SIZE(VSCP_MAX_DATA)];
+  int done = 0;
+
+  for (uint16_t i = 0; i < n; i++) {
+    size_t len = vscp_ble_link_udp_frame(frame, sizeof(frame), &plink->m_ring[plink->m_head]);
+
+    if (len && send_all(plink->m_sock, frame, len)) {
+      link_fail(plink, now_ms);
+      return done ? done : -1;
+    }
+
+    if (len) {
+      plink->m_stats.m_sent++;
+    }
+    else {
+      plink->m_stats.m_refused++;
+    }
+    link_pop(plink);
+    done++;
+  }
+
+  return done;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// flush_tcp
+//
+
+static int
+flush_tcp(vscp_ble_link_t *plink, uint16_t n, uint32_t now_ms)
+{
+  char tx[LINK_TX_SIZE];
+  size_t txlen = 0;
+  uint16_t cnt = 0;
+  int done     = 0;
+  bool bDrop   = false;
+
+  // Write all commands of the batch, a segment at a time
+  for (uint16_t i = 0; i < n; i++) {
+    const vscpEventEx *pex = &plink->m_ring[(plink->m_head + i) % plink->m_size];
+    size_t len             = vscp_ble_link_tcp_line(tx + txlen, sizeof(tx) - txlen, pex);
+
+    // Does not fit behind the commands before it, send them and try again
+    if ((0 == len) && txlen) {
+      if (send_all(plink->m_sock, tx, txlen)) {
+        return link_fail(plink, now_ms);
+      }
+      txlen = 0;
+      len   = vscp_ble_link_tcp_line(tx, sizeof(tx), pex);
+    }
+
+    if (0 == len) {
+      // Longer than a segment, stop the batch here and drop it below
+      bDrop = true;
+      break;
+    }
+    txlen += len;
+    cnt++;
+  }
+
+  if (txlen && send_all(plink->m_sock, tx, txlen)) {
+    return link_fail(plink, now_ms);
+  }
+
+  // One reply for each command, in order
+  for (uint16_t i = 0; i < cnt; i++) {
+    int rv = read_reply(plink);
+
+    if (rv < 0) {
+      // Events without a reply may or may not have arrived, they are sent
+      // again (at least once delivery)
+      link_fail(plink, now_ms);
+      return done ? done : -1;
+    }
+
+    if (0 == rv) {
+      plink->m_stats.m_sent++;
+    }
+    else {
+      plink->m_stats.m_refused++;
+    }
+    link_pop(plink);
+    done++;
+  }
+
+  if (bDrop) {
+    plink->m_stats.m_refused++;
+    link_pop(plink);
+    done++;
+  }
+
+  return done;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_link_init
+//
+
+int
+vscp_ble_link_init(vscp_ble_link_t *plink,
+                   vscp_ble_link_proto_t proto,
+                   const char *host,
+                   uint16_t port,
+                   vscpEventEx *pring,
+                   uint16_t size,
+                   uint16_t batch)
+{
+  struct in_addr ip;
+
+  // Check pointers
+  if ((NULL == plink) || (NULL == host) || (NULL == pring)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == size) || (0 == batch) || (1 != inet_pton(AF_INET, host, &ip))) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  memset(plink, 0, sizeof(vscp_ble_link_t));
+  plink->m_proto = proto;
+  plink->m_ip    = ip.s_addr;
+  plink->m_port  = port;
+  plink->m_sock  = -1;
+  plink->m_ring  = pring;
+  plink->m_size  = size;
+  plink->m_batch = batch;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_link_set_login
+//
+
+void
+vscp_ble_link_set_login(vscp_ble_link_t *plink, const char *user, const char *password)
+{
+  if (NULL == plink) {
+    return;
+  }
+
+  plink->m_user     = user;
+  plink->m_password = (NULL != password) ? password : "";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_link_put
+//
+
+int
+vscp_ble_link_put(vscp_ble_link_t *plink, const vscpEventEx *pex)
+{
+  // Check pointers
+  if ((NULL == plink) || (NULL == pex)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (plink->m_count >= plink->m_size) {
+    plink->m_stats.m_rejected++;
+    return VSCP_ERROR_FIFO_FULL;
+  }
+
+  plink->m_ring[(plink->m_head + plink->m_count) % plink->m_size] = *pex;
+  plink->m_count++;
+  plink->m_stats.m_put++;
+  if (plink->m_count > plink->m_stats.m_high_water) {
+    plink->m_stats.m_high_water = plink->m_count;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_link_space
+//
+
+uint16_t
+vscp_ble_link_space(const vscp_ble_link_t *plink)
+{
+  return (NULL != plink) ? (plink->m_size - plink->m_count) : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_link_flush
+//
+
+int
+vscp_ble_link_flush(vscp_ble_link_t *plink, uint32_t now_ms)
+{
+  uint16_t n;
+  int rv;
+
+  if ((NULL == plink) || (0 == plink->m_count)) {
+    return 0;
+  }
+
+  // Wait out the back off after a failure
+  if (plink->m_backoff_ms && ((int32_t) (now_ms - plink->m_retry_ms) < 0)) {
+    return 0;
+  }
+
+  if ((plink->m_sock < 0) && link_open(plink)) {
+    return link_fail(plink, now_ms);
+  }
+
+  n = (plink->m_count < plink->m_batch) ? plink->m_count : plink->m_batch;
+
+  if (VSCP_BLE_LINK_TCP == plink->m_proto) {
+    rv = flush_tcp(plink, n, now_ms);
+  }
+  else {
+    rv = flush_udp(plink, n, now_ms);
+  }
+
+  // Still connected, the batch went through
+  if (plink->m_sock >= 0) {
+    plink->m_backoff_ms = 0;
+  }
+
+  return rv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_link_close
+//
+
+void
+vscp_ble_link_close(vscp_ble_link_t *plink)
+{
+  if ((NULL == plink) || (plink->m_sock < 0)) {
+    return;
+  }
+
+  close(plink->m_sock);
+  plink->m_sock  = -1;
+  plink->m_rxlen = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_link_udp_frame
+//
+
+size_t
+vscp_ble_link_udp_frame(uint8_t *pbuf, size_t size, const vscpEventEx *pex)
+{
+  size_t len;
+  uint16_t crc;
+
+  // Check pointers
+  if ((NULL == pbuf) || (NULL == pex) || (pex->sizeData > VSCP_MAX_DATA)) {
+    return 0;
+  }
+
+  len = VSCP_BLE_LINK_UDP_FRAME_SIZE(pex->sizeData);
+  if (size < len) {
+    return 0;
+  }
+
+  pbuf[VSCP_BLE_LINK_UDP_POS_PKTTYPE]       = 0;
+  pbuf[VSCP_BLE_LINK_UDP_POS_HEAD]          = (pex->head >> 8) & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_HEAD + 1]      = pex->head & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_TIMESTAMP]     = (pex->timestamp >> 24) & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_TIMESTAMP + 1] = (pex->timestamp >> 16) & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_TIMESTAMP + 2] = (pex->timestamp >> 8) & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_TIMESTAMP + 3] = pex->timestamp & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_YEAR]          = (pex->year >> 8) & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_YEAR + 1]      = pex->year & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_MONTH]         = pex->month;
+  pbuf[VSCP_BLE_LINK_UDP_POS_DAY]           = pex->day;
+  pbuf[VSCP_BLE_LINK_UDP_POS_HOUR]          = pex->hour;
+  pbuf[VSCP_BLE_LINK_UDP_POS_MINUTE]        = pex->minute;
+  pbuf[VSCP_BLE_LINK_UDP_POS_SECOND]        = pex->second;
+  pbuf[VSCP_BLE_LINK_UDP_POS_CLASS]         = (pex->vscp_class >> 8) & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_CLASS + 1]     = pex->vscp_class & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_TYPE]          = (pex->vscp_type >> 8) & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_TYPE + 1]      = pex->vscp_type & 0xff;
+  memcpy(pbuf + VSCP_BLE_LINK_UDP_POS_GUID, pex->GUID, 16);
+  pbuf[VSCP_BLE_LINK_UDP_POS_SIZE]     = (pex->sizeData >> 8) & 0xff;
+  pbuf[VSCP_BLE_LINK_UDP_POS_SIZE + 1] = pex->sizeData & 0xff;
+  memcpy(pbuf + VSCP_BLE_LINK_UDP_POS_DATA, pex->data, pex->sizeData);
+
+  crc = crc16(pbuf + VSCP_BLE_LINK_UDP_POS_HEAD, VSCP_BLE_LINK_UDP_POS_DATA + pex->sizeData - 1);
+  pbuf[len - 2] = (crc >> 8) & 0xff;
+  pbuf[len - 1] = crc & 0xff;
+
+  return len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_link_tcp_line
+//
+// SEND head,class,type,obid,datetime,timestamp,GUID,data...
+//
+
+size_t
+vscp_ble_link_tcp_line(char *pbuf, size_t size, const vscpEventEx *pex)
+{
+  size_t pos = 0;
+  int n;
+
+  // Check pointers
+  if ((NULL == pbuf) || (NULL == pex) || (pex->sizeData > VSCP_MAX_DATA)) {
+    return 0;
+  }
+
+#define LINK_PRINT(...)                                                                                                \
+  do {                                                                                                                 \
+    n = snprintf(pbuf + pos, size - pos, __VA_ARGS__);                                                                 \
+    if ((n < 0) || ((size_t) n >= (size - pos))) {                                                                     \
+      return 0;                                                                                                        \
+    }                                                                                                                  \
+    pos += (size_t) n;                                                                                                 \
+  } while (0)
+
+  LINK_PRINT("SEND %u,%u,%u,%u,", pex->head, pex->vscp_class, pex->vscp_type, (unsigned) pex->obid);
+
+  // No date means the server sets it
+  if (pex->year) {
+    LINK_PRINT("%04u-%02u-%02uT%02u:%02u:%02u",
+               pex->year,
+               pex->month,
+               pex->day,
+               pex->hour,
+               pex->minute,
+               pex->second);
+  }
+
+  LINK_PRINT(",%u,", (unsigned) pex->timestamp);
+
+  for (uint8_t i = 0; i < 16; i++) {
+    LINK_PRINT((i < 15) ? "%02X:" : "%02X", pex->GUID[i]);
+  }
+
+  for (uint16_t i = 0; i < pex->sizeData; i++) {
+    LINK_PRINT(",%u", pex->data[i]);
+  }
+
+  LINK_PRINT("\r\n");
+
+#undef LINK_PRINT
+
+  return pos;
+}
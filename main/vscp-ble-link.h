@@ -0,0 +1,215 @@
+
+/*!
+  @file vscp-ble-link.h
+  @brief Forwarding sink for decoded events, VSCP UDP or tcp/ip link.
+
+  Used on a gateway to push events decoded with vscp_ble_frame_to_ex()
+  into VSCP infrastructure. The node firmware does not use it.
+
+  Events are put in a bounded retry buffer supplied by the caller and
+  are only removed when they have been delivered. When the buffer is
+  full vscp_ble_link_put() fails, which is the signal for the decoder to
+  slow down (backpressure). vscp_ble_link_flush() sends a batch of
+  buffered events.
+
+  UDP: one VSCP UDP frame per datagram as the frame format prescribes,
+  a batch is sent as consecutive datagrams. Delivery is not confirmed.
+
+  TCP: a batch of SEND commands is written at once and the replies are
+  read afterwards (pipelining). An event the server refuses (-OK) is
+  dropped, a timeout or socket error closes the connection and the batch
+  is retried after a back off.
+
+  Only BSD socket calls are used, so it builds with lwIP and on Linux.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_LINK_H
+#define VSCP_BLE_LINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vscp.h>
+
+// VSCP UDP frame (packet type 0, unencrypted)
+#define VSCP_BLE_LINK_UDP_POS_PKTTYPE   0
+#define VSCP_BLE_LINK_UDP_POS_HEAD      1  // 2 bytes
+#define VSCP_BLE_LINK_UDP_POS_TIMESTAMP 3  // 4 bytes
+#define VSCP_BLE_LINK_UDP_POS_YEAR      7  // 2 bytes
+#define VSCP_BLE_LINK_UDP_POS_MONTH     9
+#define VSCP_BLE_LINK_UDP_POS_DAY       10
+#define VSCP_BLE_LINK_UDP_POS_HOUR      11
+#define VSCP_BLE_LINK_UDP_POS_MINUTE    12
+#define VSCP_BLE_LINK_UDP_POS_SECOND    13
+#define VSCP_BLE_LINK_UDP_POS_CLASS     14 // 2 bytes
+#define VSCP_BLE_LINK_UDP_POS_TYPE      16 // 2 bytes
+#define VSCP_BLE_LINK_UDP_POS_GUID      18 // 16 bytes
+#define VSCP_BLE_LINK_UDP_POS_SIZE      34 // 2 bytes
+#define VSCP_BLE_LINK_UDP_POS_DATA      36 // Followed by CRC (2 bytes)
+
+#define VSCP_BLE_LINK_UDP_FRAME_SIZE(n) (VSCP_BLE_LINK_UDP_POS_DATA + (n) + 2)
+
+#define VSCP_BLE_LINK_BACKOFF_MIN_MS 500
+#define VSCP_BLE_LINK_BACKOFF_MAX_MS 30000
+#define VSCP_BLE_LINK_TIMEOUT_MS     2000 // Socket send and reply timeout
+
+/*!
+  Link protocol
+*/
+typedef enum vscp_ble_link_proto {
+  VSCP_BLE_LINK_UDP = 0,
+  VSCP_BLE_LINK_TCP,
+} vscp_ble_link_proto_t;
+
+/*!
+  Link statistics
+*/
+typedef struct vscp_ble_link_stats {
+  uint32_t m_put;        // Events put in the retry buffer
+  uint32_t m_rejected;   // Events rejected, retry buffer full
+  uint32_t m_sent;       // Events delivered
+  uint32_t m_refused;    // Events refused by the server (-OK) or too long to send, dropped
+  uint32_t m_failures;   // Failed batches, kept for retry
+  uint32_t m_connects;   // Connections made
+  uint16_t m_high_water; // Most events buffered at one time
+} vscp_ble_link_stats_t;
+
+/*!
+  Link state
+*/
+typedef struct vscp_ble_link {
+  vscp_ble_link_proto_t m_proto;
+  uint32_t m_ip;          // Server IPv4 address, network byte order
+  uint16_t m_port;        // Server port
+  int m_sock;             // Socket, -1 when not connected
+  const char *m_user;     // tcp/ip link user, NULL for no login
+  const char *m_password; // tcp/ip link password
+  vscpEventEx *m_ring;    // Retry buffer
+  uint16_t m_size;        // Retry buffer size
+  uint16_t m_head;        // Oldest buffered event
+  uint16_t m_count;       // Buffered events
+  uint16_t m_batch;       // Most events sent per flush
+  uint32_t m_backoff_ms;  // Current back off
+  uint32_t m_retry_ms;    // Time of next attempt after a failure
+  char m_rx[128];         // Partial reply line (TCP)
+  uint16_t m_rxlen;
+  vscp_ble_link_stats_t m_stats;
+} vscp_ble_link_t;
+
+/*!
+  @brief Initialize a link.
+  @param plink Pointer to link state.
+  @param proto Link protocol.
+  @param host Server IPv4 address as dotted decimal.
+  @param port Server port.
+  @param pring Pointer to retry buffer storage.
+  @param size Number of events in the retry buffer.
+  @param batch Most events sent per flush, at least one.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+
+  @note The socket is opened on the first flush.
+*/
+int
+vscp_ble_link_init(vscp_ble_link_t *plink,
+                   vscp_ble_link_proto_t proto,
+                   const char *host,
+                   uint16_t port,
+                   vscpEventEx *pring,
+                   uint16_t size,
+                   uint16_t batch);
+
+/*!
+  @brief Set the tcp/ip link login.
+  @param plink Pointer to link state.
+  @param user User name. The string must stay valid.
+  @param password Password. The string must stay valid.
+*/
+void
+vscp_ble_link_set_login(vscp_ble_link_t *plink, const char *user, const char *password);
+
+/*!
+  @brief Put an event in the retry buffer.
+  @param plink Pointer to link state.
+  @param pex Pointer to event.
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_FIFO_FULL if the
+    buffer is full. The caller should then hold back further events.
+*/
+int
+vscp_ble_link_put(vscp_ble_link_t *plink, const vscpEventEx *pex);
+
+/*!
+  @brief Get free space in the retry buffer.
+  @param plink Pointer to link state.
+  @return Number of events that can be put.
+*/
+uint16_t
+vscp_ble_link_space(const vscp_ble_link_t *plink);
+
+/*!
+  @brief Send a batch of buffered events.
+  @param plink Pointer to link state.
+  @param now_ms Current time in milliseconds (any epoch, used for back off).
+  @return Number of events delivered or dropped, zero if nothing was
+    due, or a negative value if the batch failed and is kept for retry.
+*/
+int
+vscp_ble_link_flush(vscp_ble_link_t *plink, uint32_t now_ms);
+
+/*!
+  @brief Close the link socket.
+  @param plink Pointer to link state.
+
+  @note Buffered events are kept.
+*/
+void
+vscp_ble_link_close(vscp_ble_link_t *plink);
+
+/*!
+  @brief Write an event as a VSCP UDP frame.
+  @param pbuf Pointer to buffer.
+  @param size Size of the buffer.
+  @param pex Pointer to event.
+  @return Frame length, zero if the buffer is too small.
+
+  @note The CRC is CRC-16/CCITT (polynomial 0x1021, initial value
+  0xFFFF) over head to data, most significant byte first.
+*/
+size_t
+vscp_ble_link_udp_frame(uint8_t *pbuf, size_t size, const vscpEventEx *pex);
+
+/*!
+  @brief Write an event as a tcp/ip link SEND command.
+  @param pbuf Pointer to buffer.
+  @param size Size of the buffer.
+  @param pex Pointer to event.
+  @return Line length including CRLF, zero if the buffer is too small.
+*/
+size_t
+vscp_ble_link_tcp_line(char *pbuf, size_t size, const vscpEventEx *pex);
+
+#endif // VSCP_BLE_LINK_H
@@ -0,0 +1,170 @@
+/*!
+  @file vscp-ble-periodic.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+#include "vscp-ble.h"
+#include "vscp-ble-adv.h"
+#include "vscp-ble-periodic.h"
+
+// 1M PHY: preamble (1), access address (4), header (2), extended header (ADI, 4) and CRC (3)
+#define PERIODIC_PDU_OVERHEAD 14
+#define PERIODIC_US_PER_BYTE  8
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_periodic_init
+//
+
+void
+vscp_ble_periodic_init(vscp_ble_periodic_t *pp)
+{
+  if (NULL == pp) {
+    return;
+  }
+
+  memset(pp, 0, sizeof(vscp_ble_periodic_t));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_periodic_add
+//
+
+int
+vscp_ble_periodic_add(vscp_ble_periodic_t *pp, const uint8_t *pframe, uint8_t len, uint8_t repeat)
+{
+  uint8_t idx;
+
+  // Check pointers
+  if ((NULL == pp) || (NULL == pframe)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == len) || (len > VSCP_BLE_PERIODIC_FRAME_MAX_SIZE) || (0 == repeat)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  // The ring overwrites the oldest frame when full
+  idx = (pp->m_newest + 1) % VSCP_BLE_PERIODIC_MAX_FRAMES;
+  memcpy(pp->m_frames[idx], pframe, len);
+  pp->m_len[idx]  = len;
+  pp->m_left[idx] = repeat;
+  pp->m_newest    = idx;
+  if (pp->m_count < VSCP_BLE_PERIODIC_MAX_FRAMES) {
+    pp->m_count++;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_periodic_build
+//
+
+uint16_t
+vscp_ble_periodic_build(vscp_ble_periodic_t *pp, uint8_t *pbuf, uint16_t size)
+{
+  uint16_t pos = 0;
+  uint8_t cnt  = 0;
+
+  // Check pointers
+  if ((NULL == pp) || (NULL == pbuf)) {
+    return 0;
+  }
+
+  // Newest first. Frames that are done are at the old end of the ring.
+  for (uint8_t i = 0; i < pp->m_count; i++) {
+    uint8_t idx = (pp->m_newest + VSCP_BLE_PERIODIC_MAX_FRAMES - i) % VSCP_BLE_PERIODIC_MAX_FRAMES;
+
+    if (0 == pp->m_left[idx]) {
+      break;
+    }
+
+    if ((pos + 2 + pp->m_len[idx]) > size) {
+      break;
+    }
+
+    pbuf[pos++] = pp->m_len[idx] + 1;
+    pbuf[pos++] = VSCP_BLE_AD_TYPE_MFG_DATA;
+    memcpy(pbuf + pos, pp->m_frames[idx], pp->m_len[idx]);
+    pos += pp->m_len[idx];
+
+    pp->m_left[idx]--;
+    cnt++;
+  }
+
+  // Frames behind the ones sent are dropped, they were either done or did
+  // not fit behind newer frames
+  pp->m_count = cnt;
+
+  // Frames just carried for the last time are dropped from the old end
+  while (pp->m_count) {
+    uint8_t oldest = (pp->m_newest + VSCP_BLE_PERIODIC_MAX_FRAMES + 1 - pp->m_count) % VSCP_BLE_PERIODIC_MAX_FRAMES;
+    if (pp->m_left[oldest]) {
+      break;
+    }
+    pp->m_count--;
+  }
+
+  return pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_periodic_train_us
+//
+
+uint32_t
+vscp_ble_periodic_train_us(uint16_t len)
+{
+  return ((uint32_t) len + PERIODIC_PDU_OVERHEAD) * PERIODIC_US_PER_BYTE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_periodic_listen_permille
+//
+
+uint16_t
+vscp_ble_periodic_listen_permille(uint16_t itvl_ms, uint16_t len, uint16_t widening_us)
+{
+  uint32_t listen_us;
+
+  if (0 == itvl_ms) {
+    return 1000;
+  }
+
+  listen_us = vscp_ble_periodic_train_us(len) + (2 * (uint32_t) widening_us);
+  if (listen_us >= ((uint32_t) itvl_ms * 1000)) {
+    return 1000;
+  }
+
+  // Round up, a gateway can not listen for less
+  return (uint16_t) ((listen_us + itvl_ms - 1) / itvl_ms);
+}
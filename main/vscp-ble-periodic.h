@@ -0,0 +1,122 @@
+
+/*!
+  @file vscp-ble-periodic.h
+  @brief Periodic advertising payload rotation and listen time planning.
+
+  In periodic mode a node sends its frames in a periodic advertising
+  train. A gateway that has synchronised to the train knows when the
+  next train is due and only listens then, instead of scanning all the
+  time.
+
+  The train payload holds the newest frames, one manufacturer AD
+  structure each, newest first. A frame stays in the payload for a
+  configured number of updates so that a gateway that misses a train
+  still gets it. The gateway removes duplicates using node id and
+  rolling index.
+
+  Nothing here depends on ESP-IDF or NimBLE.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_PERIODIC_H
+#define VSCP_BLE_PERIODIC_H
+
+#include <stdint.h>
+
+#include "vscp-ble.h"
+
+#define VSCP_BLE_PERIODIC_MAX_SIZE       245 // Train payload that fits one AUX_SYNC_IND
+#define VSCP_BLE_PERIODIC_MAX_FRAMES     8   // Frames kept for rotation
+#define VSCP_BLE_PERIODIC_FRAME_MAX_SIZE VSCP_BLE_FRAME_MAX_EVENT_SIZE
+
+/*!
+  Payload rotation state
+*/
+typedef struct vscp_ble_periodic {
+  uint8_t m_frames[VSCP_BLE_PERIODIC_MAX_FRAMES][VSCP_BLE_PERIODIC_FRAME_MAX_SIZE]; // Frames, ring
+  uint8_t m_len[VSCP_BLE_PERIODIC_MAX_FRAMES];                                      // Frame lengths
+  uint8_t m_left[VSCP_BLE_PERIODIC_MAX_FRAMES];                                     // Payloads left to carry frame
+  uint8_t m_newest;                                                                 // Ring index of newest frame
+  uint8_t m_count;                                                                  // Frames in the ring
+} vscp_ble_periodic_t;
+
+/*!
+  @brief Initialize payload rotation state.
+  @param pp Pointer to rotation state.
+*/
+void
+vscp_ble_periodic_init(vscp_ble_periodic_t *pp);
+
+/*!
+  @brief Add a frame to the rotation.
+  @param pp Pointer to rotation state.
+  @param pframe Pointer to VSCP BLE frame.
+  @param len Length of the frame.
+  @param repeat Number of payloads the frame is carried in, at least one.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+
+  @note When the ring is full the oldest frame is dropped.
+*/
+int
+vscp_ble_periodic_add(vscp_ble_periodic_t *pp, const uint8_t *pframe, uint8_t len, uint8_t repeat);
+
+/*!
+  @brief Build the next train payload.
+  @param pp Pointer to rotation state.
+  @param pbuf Pointer to buffer that receives the AD structures.
+  @param size Size of the buffer.
+  @return Length of the payload, zero if there is nothing to send.
+
+  @note Frames are added newest first for as long as they fit. Each
+  frame put in the payload has its repeat count decremented and frames
+  that are done are dropped.
+*/
+uint16_t
+vscp_ble_periodic_build(vscp_ble_periodic_t *pp, uint8_t *pbuf, uint16_t size);
+
+/*!
+  @brief Air time of a periodic train.
+  @param len Train payload length.
+  @return Approximate on air time of the AUX_SYNC_IND PDU on the 1M PHY
+    in microseconds.
+*/
+uint32_t
+vscp_ble_periodic_train_us(uint16_t len);
+
+/*!
+  @brief Gateway listen time for one synchronised node.
+  @param itvl_ms Periodic advertising interval in milliseconds.
+  @param len Train payload length.
+  @param widening_us Receive window widening on each side of the train
+    for clock drift, in microseconds.
+  @return Listen time as parts per thousand of the time. Continuous
+    scanning is 1000.
+*/
+uint16_t
+vscp_ble_periodic_listen_permille(uint16_t itvl_ms, uint16_t len, uint16_t widening_us);
+
+#endif // VSCP_BLE_PERIODIC_H
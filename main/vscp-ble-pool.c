@@ -0,0 +1,171 @@
+/*!
+  @file vscp-ble-pool.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+#include "vscp-ble.h"
+#include "vscp-ble-pool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_pool_init
+//
+
+int
+vscp_ble_pool_init(vscp_ble_pool_t *ppool, vscp_ble_pool_block_t *pblocks, uint8_t size)
+{
+  // Check pointers
+  if ((NULL == ppool) || (NULL == pblocks)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == size) || (size > VSCP_BLE_POOL_MAX_SIZE)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  memset(ppool, 0, sizeof(vscp_ble_pool_t));
+  ppool->m_blocks = pblocks;
+  ppool->m_size   = size;
+  ppool->m_free   = 0;
+
+  for (uint8_t i = 0; i < size; i++) {
+    pblocks[i].m_next  = ((i + 1) < size) ? (i + 1) : VSCP_BLE_POOL_NONE;
+    pblocks[i].m_bUsed = 0;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_pool_alloc
+//
+
+vscpEvent *
+vscp_ble_pool_alloc(vscp_ble_pool_t *ppool)
+{
+  vscp_ble_pool_block_t *pblock;
+
+  if (NULL == ppool) {
+    return NULL;
+  }
+
+  if (VSCP_BLE_POOL_NONE == ppool->m_free) {
+    ppool->m_failures++;
+    return NULL;
+  }
+
+  pblock          = &ppool->m_blocks[ppool->m_free];
+  ppool->m_free   = pblock->m_next;
+  pblock->m_next  = VSCP_BLE_POOL_NONE;
+  pblock->m_bUsed = 1;
+
+  ppool->m_allocs++;
+  ppool->m_used++;
+  if (ppool->m_used > ppool->m_high_water) {
+    ppool->m_high_water = ppool->m_used;
+  }
+
+  memset(&pblock->m_ev, 0, sizeof(vscpEvent));
+  pblock->m_ev.pdata = pblock->m_data;
+
+  return &pblock->m_ev;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_pool_new_event
+//
+
+vscpEvent *
+vscp_ble_pool_new_event(vscp_ble_pool_t *ppool,
+                        uint16_t head,
+                        uint16_t vscp_class,
+                        uint16_t vscp_type,
+                        const uint8_t *pdata,
+                        uint8_t size)
+{
+  vscpEvent *pev;
+
+  if ((size > VSCP_BLE_FRAME_MAX_DATA_SIZE) || (size && (NULL == pdata))) {
+    return NULL;
+  }
+
+  pev = vscp_ble_pool_alloc(ppool);
+  if (NULL == pev) {
+    return NULL;
+  }
+
+  pev->head       = head;
+  pev->vscp_class = vscp_class;
+  pev->vscp_type  = vscp_type;
+  pev->sizeData   = size;
+  if (size) {
+    memcpy(pev->pdata, pdata, size);
+  }
+
+  return pev;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_pool_release
+//
+
+int
+vscp_ble_pool_release(vscp_ble_pool_t *ppool, vscpEvent *pev)
+{
+  vscp_ble_pool_block_t *pblock;
+  size_t idx;
+
+  if (NULL == pev) {
+    return VSCP_ERROR_SUCCESS;
+  }
+
+  if (NULL == ppool) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  // The event is the first member of its block
+  pblock = (vscp_ble_pool_block_t *) pev;
+  if ((pblock < ppool->m_blocks) || (pblock >= (ppool->m_blocks + ppool->m_size))) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  idx = (size_t) (pblock - ppool->m_blocks);
+  if ((&ppool->m_blocks[idx] != pblock) || !pblock->m_bUsed) {
+    return VSCP_ERROR_INVALID_PARAMETER; // Not a block start or double release
+  }
+
+  pblock->m_bUsed = 0;
+  pblock->m_next  = ppool->m_free;
+  ppool->m_free   = (uint8_t) idx;
+  ppool->m_used--;
+
+  return VSCP_ERROR_SUCCESS;
+}
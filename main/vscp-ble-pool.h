@@ -0,0 +1,123 @@
+
+/*!
+  @file vscp-ble-pool.h
+  @brief Fixed block pool for VSCP events.
+
+  Events built on the node are taken from a pool of fixed size blocks.
+  Each block holds the event and room for VSCP_BLE_FRAME_MAX_DATA_SIZE
+  data bytes, and pdata of the event points into the block. Nothing is
+  allocated from the heap, so a busy producer can not fragment it.
+
+  Blocks are kept in a caller supplied array linked into a free list,
+  so allocation and release are O(1). The pool has no locking of its own.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_POOL_H
+#define VSCP_BLE_POOL_H
+
+#include <stdint.h>
+
+#include <vscp.h>
+#include "vscp-ble.h"
+
+#define VSCP_BLE_POOL_MAX_SIZE 255  // Blocks are indexed with a byte
+#define VSCP_BLE_POOL_NONE     0xff // End of free list
+
+/*!
+  Pool block
+*/
+typedef struct vscp_ble_pool_block {
+  vscpEvent m_ev;                               // Event, must be first
+  uint8_t m_data[VSCP_BLE_FRAME_MAX_DATA_SIZE]; // Event data
+  uint8_t m_next;                               // Next free block
+  uint8_t m_bUsed;                              // Block is allocated
+} vscp_ble_pool_block_t;
+
+/*!
+  Event pool
+*/
+typedef struct vscp_ble_pool {
+  vscp_ble_pool_block_t *m_blocks; // Block storage
+  uint8_t m_size;                  // Number of blocks
+  uint8_t m_free;                  // Free list
+  uint8_t m_used;                  // Blocks in use
+  uint8_t m_high_water;            // Most blocks in use
+  uint32_t m_allocs;               // Successful allocations
+  uint32_t m_failures;             // Allocations that failed, pool empty
+} vscp_ble_pool_t;
+
+/*!
+  @brief Initialize a pool.
+  @param ppool Pointer to pool.
+  @param pblocks Pointer to block storage.
+  @param size Number of blocks, at most VSCP_BLE_POOL_MAX_SIZE.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_pool_init(vscp_ble_pool_t *ppool, vscp_ble_pool_block_t *pblocks, uint8_t size);
+
+/*!
+  @brief Allocate an event.
+  @param ppool Pointer to pool.
+  @return Pointer to a zeroed event with pdata pointing to
+    VSCP_BLE_FRAME_MAX_DATA_SIZE bytes of data, or NULL if the pool is empty.
+*/
+vscpEvent *
+vscp_ble_pool_alloc(vscp_ble_pool_t *ppool);
+
+/*!
+  @brief Allocate and fill in an event.
+  @param ppool Pointer to pool.
+  @param head VSCP head (priority).
+  @param vscp_class VSCP class.
+  @param vscp_type VSCP type.
+  @param pdata Pointer to data, can be NULL if size is zero.
+  @param size Number of data bytes, at most VSCP_BLE_FRAME_MAX_DATA_SIZE.
+  @return Pointer to the event, or NULL if the pool is empty or the data
+    does not fit.
+*/
+vscpEvent *
+vscp_ble_pool_new_event(vscp_ble_pool_t *ppool,
+                        uint16_t head,
+                        uint16_t vscp_class,
+                        uint16_t vscp_type,
+                        const uint8_t *pdata,
+                        uint8_t size);
+
+/*!
+  @brief Return an event to the pool.
+  @param ppool Pointer to pool.
+  @param pev Pointer to event from vscp_ble_pool_alloc() or
+    vscp_ble_pool_new_event(). NULL is ignored.
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_INVALID_PARAMETER if
+    the event is not an allocated event of this pool.
+*/
+int
+vscp_ble_pool_release(vscp_ble_pool_t *ppool, vscpEvent *pev);
+
+#endif // VSCP_BLE_POOL_H
@@ -0,0 +1,98 @@
+/*!
+  @file vscp-ble-prof-decode.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-prof.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// get_u32
+//
+
+static uint32_t
+get_u32(const uint8_t *p)
+{
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_prof_decode
+//
+
+int
+vscp_ble_prof_decode(const uint8_t *prec,
+                     size_t len,
+                     vscp_ble_prof_info_t *pinfo,
+                     vscp_ble_prof_task_t *ptasks,
+                     uint8_t max_tasks)
+{
+  const uint8_t *p;
+
+  // Check pointers
+  if ((NULL == prec) || (NULL == pinfo) || ((NULL == ptasks) && max_tasks)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if (len < VSCP_BLE_PROF_POS_ENTRIES) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  if (VSCP_BLE_PROF_VERSION != prec[VSCP_BLE_PROF_POS_VERSION]) {
+    return VSCP_ERROR_NOT_SUPPORTED;
+  }
+
+  if (len != (VSCP_BLE_PROF_POS_ENTRIES + ((size_t) prec[VSCP_BLE_PROF_POS_TASKS] * VSCP_BLE_PROF_ENTRY_SIZE))) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  pinfo->m_version  = prec[VSCP_BLE_PROF_POS_VERSION];
+  pinfo->m_ntasks   = prec[VSCP_BLE_PROF_POS_TASKS];
+  pinfo->m_uptime_s = get_u32(prec + VSCP_BLE_PROF_POS_UPTIME);
+  pinfo->m_free     = get_u32(prec + VSCP_BLE_PROF_POS_FREE);
+  pinfo->m_min_free = get_u32(prec + VSCP_BLE_PROF_POS_MIN_FREE);
+  pinfo->m_largest  = get_u32(prec + VSCP_BLE_PROF_POS_LARGEST);
+  pinfo->m_run_time = get_u32(prec + VSCP_BLE_PROF_POS_RUN_TIME);
+
+  p = prec + VSCP_BLE_PROF_POS_ENTRIES;
+  for (uint8_t i = 0; (i < pinfo->m_ntasks) && (i < max_tasks); i++) {
+    memcpy(ptasks[i].m_name, p, VSCP_BLE_PROF_TASK_NAME_LEN);
+    ptasks[i].m_name[VSCP_BLE_PROF_TASK_NAME_LEN] = '\0';
+    ptasks[i].m_stack_hwm                         = ((uint16_t) p[8] << 8) | p[9];
+    ptasks[i].m_priority                          = p[10];
+    ptasks[i].m_state                             = p[11];
+    ptasks[i].m_run_time                          = get_u32(p + 12);
+    p += VSCP_BLE_PROF_ENTRY_SIZE;
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
@@ -0,0 +1,127 @@
+/*!
+  @file vscp-ble-prof.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include "vscp-ble-prof.h"
+
+// Task list, static so that sampling does not touch the heap it measures
+static TaskStatus_t s_tasks[CONFIG_VSCP_BLE_PROFILER_MAX_TASKS];
+
+// Latest record
+static uint8_t s_record[VSCP_BLE_PROF_RECORD_MAX_SIZE];
+static size_t s_record_len = 0;
+
+static portMUX_TYPE s_prof_mux = portMUX_INITIALIZER_UNLOCKED;
+
+///////////////////////////////////////////////////////////////////////////////
+// put_u32
+//
+
+static void
+put_u32(uint8_t *p, uint32_t val)
+{
+  p[0] = (val >> 24) & 0xff;
+  p[1] = (val >> 16) & 0xff;
+  p[2] = (val >> 8) & 0xff;
+  p[3] = val & 0xff;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_prof_sample
+//
+
+void
+vscp_ble_prof_sample(void)
+{
+  uint8_t rec[VSCP_BLE_PROF_RECORD_MAX_SIZE];
+  uint32_t total = 0;
+  UBaseType_t cnt;
+  uint8_t *p;
+
+  // Fails (returns zero) if there are more tasks than room
+  cnt = uxTaskGetSystemState(s_tasks, CONFIG_VSCP_BLE_PROFILER_MAX_TASKS, &total);
+
+  rec[VSCP_BLE_PROF_POS_VERSION] = VSCP_BLE_PROF_VERSION;
+  rec[VSCP_BLE_PROF_POS_TASKS]   = (uint8_t) cnt;
+  put_u32(rec + VSCP_BLE_PROF_POS_UPTIME, (uint32_t) (esp_timer_get_time() / 1000000));
+  put_u32(rec + VSCP_BLE_PROF_POS_FREE, heap_caps_get_free_size(MALLOC_CAP_DEFAULT));
+  put_u32(rec + VSCP_BLE_PROF_POS_MIN_FREE, heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT));
+  put_u32(rec + VSCP_BLE_PROF_POS_LARGEST, heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT));
+  put_u32(rec + VSCP_BLE_PROF_POS_RUN_TIME, total);
+
+  p = rec + VSCP_BLE_PROF_POS_ENTRIES;
+  for (UBaseType_t i = 0; i < cnt; i++) {
+    uint32_t hwm = s_tasks[i].usStackHighWaterMark;
+
+    // Zero padded
+    strncpy((char *) p, s_tasks[i].pcTaskName, VSCP_BLE_PROF_TASK_NAME_LEN);
+    p[8]  = (hwm > 0xffff) ? 0xff : ((hwm >> 8) & 0xff);
+    p[9]  = (hwm > 0xffff) ? 0xff : (hwm & 0xff);
+    p[10] = (uint8_t) s_tasks[i].uxCurrentPriority;
+    p[11] = (uint8_t) s_tasks[i].eCurrentState;
+    put_u32(p + 12, s_tasks[i].ulRunTimeCounter);
+    p += VSCP_BLE_PROF_ENTRY_SIZE;
+  }
+
+  taskENTER_CRITICAL(&s_prof_mux);
+  memcpy(s_record, rec, p - rec);
+  s_record_len = p - rec;
+  taskEXIT_CRITICAL(&s_prof_mux);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_prof_get
+//
+
+size_t
+vscp_ble_prof_get(uint8_t *pbuf, size_t size)
+{
+  size_t len;
+
+  if (NULL == pbuf) {
+    return 0;
+  }
+
+  taskENTER_CRITICAL(&s_prof_mux);
+  len = (s_record_len < size) ? s_record_len : size;
+  memcpy(pbuf, s_record, len);
+  taskEXIT_CRITICAL(&s_prof_mux);
+
+  return len;
+}
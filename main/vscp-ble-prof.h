@@ -0,0 +1,153 @@
+
+/*!
+  @file vscp-ble-prof.h
+  @brief Heap, stack and task run time profiler.
+
+  Samples free heap, minimum ever free heap, largest free heap block
+  and, for each task, the stack high water mark and run time counter.
+  The latest sample is kept as a compact binary record that is read
+  over GATT. All multi byte values are big endian.
+
+  Record
+  ------
+
+  | 0 | version | 1 byte | VSCP_BLE_PROF_VERSION |
+  | 1 | tasks | 1 byte | Number of task entries |
+  | 2 | uptime | 4 bytes | Seconds since boot |
+  | 6 | free heap | 4 bytes | Bytes |
+  | 10 | minimum free heap | 4 bytes | Bytes, since boot |
+  | 14 | largest free block | 4 bytes | Bytes |
+  | 18 | total run time | 4 bytes | Run time counter ticks |
+  | 22 | task entries | 16 bytes each | |
+
+  Task entry
+
+  | 0 | name | 8 bytes | Zero padded, truncated |
+  | 8 | stack high water mark | 2 bytes | Unused stack bytes, minimum since start |
+  | 10 | priority | 1 byte | Current priority |
+  | 11 | state | 1 byte | eTaskState |
+  | 12 | run time | 4 bytes | Run time counter ticks |
+
+  Task CPU load is the run time of the task over the total run time.
+  Deltas between two records give the load over that period.
+
+  vscp_ble_prof_decode() in vscp-ble-prof-decode.c unpacks a record on a
+  host. It does not need ESP-IDF or FreeRTOS.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_PROF_H
+#define VSCP_BLE_PROF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#define VSCP_BLE_PROF_VERSION 1
+
+#define VSCP_BLE_PROF_POS_VERSION   0
+#define VSCP_BLE_PROF_POS_TASKS     1
+#define VSCP_BLE_PROF_POS_UPTIME    2
+#define VSCP_BLE_PROF_POS_FREE      6
+#define VSCP_BLE_PROF_POS_MIN_FREE  10
+#define VSCP_BLE_PROF_POS_LARGEST   14
+#define VSCP_BLE_PROF_POS_RUN_TIME  18
+#define VSCP_BLE_PROF_POS_ENTRIES   22
+
+#define VSCP_BLE_PROF_TASK_NAME_LEN 8
+#define VSCP_BLE_PROF_ENTRY_SIZE    16
+
+// Largest record
+#define VSCP_BLE_PROF_RECORD_MAX_SIZE                                                                                  \
+  (VSCP_BLE_PROF_POS_ENTRIES + (CONFIG_VSCP_BLE_PROFILER_MAX_TASKS * VSCP_BLE_PROF_ENTRY_SIZE))
+
+/*!
+  @brief Take a new sample.
+
+  @note Suspends the scheduler while the task list is walked. Tasks
+  beyond CONFIG_VSCP_BLE_PROFILER_MAX_TASKS are left out.
+*/
+void
+vscp_ble_prof_sample(void);
+
+/*!
+  @brief Get the latest record.
+  @param pbuf Pointer to buffer that receives the record.
+  @param size Size of the buffer.
+  @return Number of bytes copied, zero if no sample has been taken yet.
+*/
+size_t
+vscp_ble_prof_get(uint8_t *pbuf, size_t size);
+
+/*!
+  Decoded record header
+*/
+typedef struct vscp_ble_prof_info {
+  uint8_t m_version;    // Record version
+  uint8_t m_ntasks;     // Task entries in the record
+  uint32_t m_uptime_s;  // Seconds since boot
+  uint32_t m_free;      // Free heap
+  uint32_t m_min_free;  // Minimum ever free heap
+  uint32_t m_largest;   // Largest free heap block
+  uint32_t m_run_time;  // Total run time
+} vscp_ble_prof_info_t;
+
+/*!
+  Decoded task entry
+*/
+typedef struct vscp_ble_prof_task {
+  char m_name[VSCP_BLE_PROF_TASK_NAME_LEN + 1]; // Task name, zero terminated
+  uint16_t m_stack_hwm;                         // Stack high water mark, 0xffff or more
+  uint8_t m_priority;                           // Current priority
+  uint8_t m_state;                              // FreeRTOS task state
+  uint32_t m_run_time;                          // Run time counter
+} vscp_ble_prof_task_t;
+
+/*!
+  @brief Decode a record read from the profiler characteristic.
+  @param prec Pointer to the record.
+  @param len Length of the record.
+  @param pinfo Pointer to structure that receives the header.
+  @param ptasks Pointer to array that receives the task entries, can be
+    NULL if max_tasks is zero.
+  @param max_tasks Size of the task array. Entries beyond it are not
+    decoded.
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_NOT_SUPPORTED for an
+    unknown version, VSCP_ERROR_INVALID_PARAMETER if the length does not
+    match the task count, else error code.
+
+  @note Has no ESP-IDF dependencies and builds on a host.
+*/
+int
+vscp_ble_prof_decode(const uint8_t *prec,
+                     size_t len,
+                     vscp_ble_prof_info_t *pinfo,
+                     vscp_ble_prof_task_t *ptasks,
+                     uint8_t max_tasks);
+
+#endif // VSCP_BLE_PROF_H
@@ -0,0 +1,363 @@
+/*!
+  @file vscp-ble-queue.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+#include "vscp-ble-queue.h"
+
+// Level I classes with coalesced measurements
+#define CLASS_MEASUREMENT   10
+#define CLASS_DATA          15
+#define CLASS_MEASUREMENT64 60
+#define CLASS_MEASUREZONE   65
+#define CLASS_MEASUREMENT32 70
+
+///////////////////////////////////////////////////////////////////////////////
+// index_slot
+//
+// Home slot of a key (Fibonacci hashing).
+//
+
+static uint8_t
+index_slot(uint32_t key)
+{
+  return (uint8_t) ((key * 2654435761u) >> (32 - VSCP_BLE_QUEUE_INDEX_BITS));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// index_find
+//
+// Returns the slot that holds key, or VSCP_BLE_QUEUE_NONE.
+//
+
+static uint8_t
+index_find(const vscp_ble_queue_t *pq, uint32_t key)
+{
+  uint8_t slot = index_slot(key);
+
+  // Linear probing, the index is never full
+  while (VSCP_BLE_QUEUE_NONE != pq->m_index[slot]) {
+    if (pq->m_items[pq->m_index[slot]].m_key == key) {
+      return slot;
+    }
+    slot = (slot + 1) & (VSCP_BLE_QUEUE_INDEX_SIZE - 1);
+  }
+
+  return VSCP_BLE_QUEUE_NONE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// index_remove
+//
+// Empties a slot and moves later entries of the probe sequence back so
+// that lookups never stop early (backward shift deletion).
+//
+
+static void
+index_remove(vscp_ble_queue_t *pq, uint8_t slot)
+{
+  uint8_t next = slot;
+
+  pq->m_indexed--;
+  while (true) {
+    uint8_t home;
+
+    pq->m_index[slot] = VSCP_BLE_QUEUE_NONE;
+    do {
+      next = (next + 1) & (VSCP_BLE_QUEUE_INDEX_SIZE - 1);
+      if (VSCP_BLE_QUEUE_NONE == pq->m_index[next]) {
+        return;
+      }
+      home = index_slot(pq->m_items[pq->m_index[next]].m_key);
+      // Entry can fill the hole if its home slot is not in (slot, next]
+    } while (((slot < next) && (home > slot) && (home <= next)) ||
+             ((slot > next) && ((home > slot) || (home <= next))));
+
+    pq->m_index[slot] = pq->m_index[next];
+    slot              = next;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// level_take
+//
+// Unlinks the oldest item of a level and puts it on the free list.
+//
+
+static vscpEvent *
+level_take(vscp_ble_queue_t *pq, uint8_t level)
+{
+  uint8_t idx = pq->m_head[level];
+  vscpEvent *pev;
+
+  pq->m_head[level] = pq->m_items[idx].m_next;
+  if (VSCP_BLE_QUEUE_NONE == pq->m_head[level]) {
+    pq->m_tail[level] = VSCP_BLE_QUEUE_NONE;
+    pq->m_levels &= ~(1 << level);
+  }
+
+  // A newer value of another priority may own the index entry
+  if (pq->m_items[idx].m_key) {
+    uint8_t slot = index_find(pq, pq->m_items[idx].m_key);
+    if ((VSCP_BLE_QUEUE_NONE != slot) && (pq->m_index[slot] == idx)) {
+      index_remove(pq, slot);
+    }
+    pq->m_items[idx].m_key = 0;
+  }
+
+  pev                     = pq->m_items[idx].m_pev;
+  pq->m_items[idx].m_pev  = NULL;
+  pq->m_items[idx].m_next = pq->m_free;
+  pq->m_free              = idx;
+  pq->m_count--;
+
+  return pev;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_queue_init
+//
+
+int
+vscp_ble_queue_init(vscp_ble_queue_t *pq, vscp_ble_queue_item_t *pitems, uint8_t size, uint8_t reserve)
+{
+  // Check pointers
+  if ((NULL == pq) || (NULL == pitems)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == size) || (size > VSCP_BLE_QUEUE_MAX_SIZE) || (reserve >= size)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  memset(pq, 0, sizeof(vscp_ble_queue_t));
+  pq->m_items   = pitems;
+  pq->m_size    = size;
+  pq->m_reserve = reserve;
+
+  for (uint8_t i = 0; i < size; i++) {
+    pitems[i].m_pev  = NULL;
+    pitems[i].m_key  = 0;
+    pitems[i].m_next = ((i + 1) < size) ? (i + 1) : VSCP_BLE_QUEUE_NONE;
+  }
+  pq->m_free = 0;
+
+  memset(pq->m_head, VSCP_BLE_QUEUE_NONE, sizeof(pq->m_head));
+  memset(pq->m_tail, VSCP_BLE_QUEUE_NONE, sizeof(pq->m_tail));
+  memset(pq->m_index, VSCP_BLE_QUEUE_NONE, sizeof(pq->m_index));
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_queue_level
+//
+
+uint8_t
+vscp_ble_queue_level(const vscpEvent *pev)
+{
+  if (VSCP_BLE_QUEUE_CLASS_ALARM == pev->vscp_class) {
+    return VSCP_BLE_QUEUE_LEVEL_ALARM;
+  }
+
+  return VSCP_BLE_QUEUE_PRIORITY_LEVEL(pev->head);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_queue_key
+//
+
+uint32_t
+vscp_ble_queue_key(const vscpEvent *pev)
+{
+  uint8_t index;
+
+  switch (pev->vscp_class) {
+    case CLASS_MEASUREMENT:
+    case CLASS_DATA:
+      if ((0 == pev->sizeData) || (NULL == pev->pdata)) {
+        return 0;
+      }
+      index = pev->pdata[0] & 0x07;
+      break;
+
+    case CLASS_MEASUREZONE:
+      if ((0 == pev->sizeData) || (NULL == pev->pdata)) {
+        return 0;
+      }
+      index = pev->pdata[0];
+      break;
+
+    case CLASS_MEASUREMENT64:
+    case CLASS_MEASUREMENT32:
+      index = 0;
+      break;
+
+    default:
+      return 0;
+  }
+
+  return ((uint32_t) pev->vscp_class << 16) | ((uint32_t) (pev->vscp_type & 0xff) << 8) | index;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_queue_push
+//
+
+int
+vscp_ble_queue_push(vscp_ble_queue_t *pq, vscpEvent *pev, vscpEvent **ppshed)
+{
+  uint8_t level;
+  uint8_t limit;
+  uint8_t idx;
+  uint8_t slot;
+  uint32_t key;
+
+  // Check pointers
+  if ((NULL == pq) || (NULL == pev) || (NULL == ppshed)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  *ppshed = NULL;
+  level   = vscp_ble_queue_level(pev);
+  limit   = (VSCP_BLE_QUEUE_LEVEL_ALARM == level) ? pq->m_size : (pq->m_size - pq->m_reserve);
+
+  // Replace a stale value of the same measurement in place
+  key = vscp_ble_queue_key(pev);
+  if (key) {
+    slot = index_find(pq, key);
+    if (VSCP_BLE_QUEUE_NONE != slot) {
+      idx = pq->m_index[slot];
+      if (vscp_ble_queue_level(pq->m_items[idx].m_pev) == level) {
+        *ppshed                = pq->m_items[idx].m_pev;
+        pq->m_items[idx].m_pev = pev;
+        pq->m_stats[level].m_coalesced++;
+        return VSCP_ERROR_SUCCESS;
+      }
+    }
+  }
+
+  if (pq->m_count >= limit) {
+    // Lowest priority level in use, alarms excluded
+    uint16_t sheddable = pq->m_levels & ~(1 << VSCP_BLE_QUEUE_LEVEL_ALARM);
+    uint8_t victim     = sheddable ? (uint8_t) (31 - __builtin_clz(sheddable)) : 0;
+
+    // Never shed anything of higher priority than the new event. An
+    // alarm may shed any other event, also when the reserve is in use.
+    if ((0 == sheddable) || (victim < level)) {
+      pq->m_stats[level].m_rejected++;
+      return VSCP_ERROR_FIFO_FULL;
+    }
+
+    pq->m_stats[victim].m_shed++;
+    *ppshed = level_take(pq, victim);
+  }
+
+  // Take a free item and append it to the level
+  idx                     = pq->m_free;
+  pq->m_free              = pq->m_items[idx].m_next;
+  pq->m_items[idx].m_pev  = pev;
+  pq->m_items[idx].m_next = VSCP_BLE_QUEUE_NONE;
+
+  if (VSCP_BLE_QUEUE_NONE == pq->m_tail[level]) {
+    pq->m_head[level] = idx;
+  }
+  else {
+    pq->m_items[pq->m_tail[level]].m_next = idx;
+  }
+  pq->m_tail[level] = idx;
+  pq->m_levels |= (1 << level);
+
+  // Index the measurement, the newest value takes over the entry of one
+  // queued with another priority
+  if (key) {
+    // Shedding may have moved entries
+    slot = index_find(pq, key);
+    if (VSCP_BLE_QUEUE_NONE != slot) {
+      pq->m_items[pq->m_index[slot]].m_key = 0;
+      pq->m_items[idx].m_key               = key;
+      pq->m_index[slot]                    = idx;
+    }
+    else if (pq->m_indexed < VSCP_BLE_QUEUE_INDEX_MAX) {
+      slot = index_slot(key);
+      while (VSCP_BLE_QUEUE_NONE != pq->m_index[slot]) {
+        slot = (slot + 1) & (VSCP_BLE_QUEUE_INDEX_SIZE - 1);
+      }
+      pq->m_items[idx].m_key = key;
+      pq->m_index[slot]      = idx;
+      pq->m_indexed++;
+    }
+  }
+
+  pq->m_count++;
+  if (pq->m_count > pq->m_high_water) {
+    pq->m_high_water = pq->m_count;
+  }
+  pq->m_stats[level].m_pushed++;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_queue_pop
+//
+
+vscpEvent *
+vscp_ble_queue_pop(vscp_ble_queue_t *pq)
+{
+  uint8_t level;
+
+  if ((NULL == pq) || (0 == pq->m_levels)) {
+    return NULL;
+  }
+
+  // Highest priority level in use
+  level = (uint8_t) __builtin_ctz(pq->m_levels);
+  pq->m_stats[level].m_popped++;
+
+  return level_take(pq, level);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_queue_count
+//
+
+uint8_t
+vscp_ble_queue_count(const vscp_ble_queue_t *pq)
+{
+  if (NULL == pq) {
+    return 0;
+  }
+
+  return pq->m_count;
+}
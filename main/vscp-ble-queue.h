@@ -0,0 +1,169 @@
+
+/*!
+  @file vscp-ble-queue.h
+  @brief Priority queue for outgoing VSCP events.
+
+  A bounded queue with one FIFO per VSCP priority (bits 5-7 of head,
+  zero is highest) and one for alarms ahead of all of them. Items are
+  kept in a caller supplied array linked into a free list and the level
+  lists, so push and pop never search.
+
+  When the queue is full the oldest event of the lowest priority level
+  that is not above the new event is shed to make room. Alarms are never
+  shed and a number of items is reserved for them.
+
+  Measurements are coalesced. A new measurement with the same class,
+  type and sensor index as a queued one of the same priority replaces
+  it in place, so it keeps the queue position of the stale value. A
+  small fixed hash index of queued measurements makes this O(1).
+
+  The queue holds event pointers and owns the events it holds. Events
+  that are popped or shed are handed back to the caller to release. The
+  queue has no locking of its own.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_QUEUE_H
+#define VSCP_BLE_QUEUE_H
+
+#include <stdint.h>
+
+#include <vscp.h>
+
+#define VSCP_BLE_QUEUE_CLASS_ALARM 1 // CLASS1.ALARM
+
+#define VSCP_BLE_QUEUE_LEVEL_ALARM 0    // Alarms
+#define VSCP_BLE_QUEUE_LEVELS      9    // Alarms + eight VSCP priorities
+#define VSCP_BLE_QUEUE_MAX_SIZE    255  // Items are indexed with a byte
+#define VSCP_BLE_QUEUE_NONE        0xff // End of list
+#define VSCP_BLE_QUEUE_INDEX_BITS  6    // Coalescing index slots, log2
+#define VSCP_BLE_QUEUE_INDEX_SIZE  (1 << VSCP_BLE_QUEUE_INDEX_BITS)
+#define VSCP_BLE_QUEUE_INDEX_MAX   48   // Most measurements indexed at once
+
+// Level of a non alarm event, VSCP priority 0 (highest) is level 1
+#define VSCP_BLE_QUEUE_PRIORITY_LEVEL(head) ((((head) >> 5) & 0x07) + 1)
+
+/*!
+  Queue item
+*/
+typedef struct vscp_ble_queue_item {
+  vscpEvent *m_pev; // Queued event
+  uint32_t m_key;   // Coalescing key, zero if not indexed
+  uint8_t m_next;   // Next item in free or level list
+} vscp_ble_queue_item_t;
+
+/*!
+  Per level statistics
+*/
+typedef struct vscp_ble_queue_stats {
+  uint32_t m_pushed;    // Events queued
+  uint32_t m_popped;    // Events handed out for sending
+  uint32_t m_shed;      // Queued events dropped to make room
+  uint32_t m_rejected;  // Events not queued because the queue was full
+  uint32_t m_coalesced; // Queued events replaced by a newer value
+} vscp_ble_queue_stats_t;
+
+/*!
+  Priority queue
+*/
+typedef struct vscp_ble_queue {
+  vscp_ble_queue_item_t *m_items;                        // Item storage
+  uint8_t m_size;                                        // Number of items
+  uint8_t m_reserve;                                     // Items only alarms can use
+  uint8_t m_count;                                       // Items in use
+  uint8_t m_high_water;                                  // Most items in use
+  uint8_t m_free;                                        // Free list
+  uint8_t m_head[VSCP_BLE_QUEUE_LEVELS];                 // Oldest item per level
+  uint8_t m_tail[VSCP_BLE_QUEUE_LEVELS];                 // Newest item per level
+  uint16_t m_levels;                                     // Bit n set when level n is not empty
+  uint8_t m_index[VSCP_BLE_QUEUE_INDEX_SIZE];            // Coalescing index, item per slot
+  uint8_t m_indexed;                                     // Items in the coalescing index
+  vscp_ble_queue_stats_t m_stats[VSCP_BLE_QUEUE_LEVELS]; // Statistics per level
+} vscp_ble_queue_t;
+
+/*!
+  @brief Initialize a queue.
+  @param pq Pointer to queue.
+  @param pitems Pointer to item storage.
+  @param size Number of items, at most VSCP_BLE_QUEUE_MAX_SIZE.
+  @param reserve Number of items that only alarms can use.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_queue_init(vscp_ble_queue_t *pq, vscp_ble_queue_item_t *pitems, uint8_t size, uint8_t reserve);
+
+/*!
+  @brief Get the level an event is queued on.
+  @param pev Pointer to event.
+  @return Queue level, VSCP_BLE_QUEUE_LEVEL_ALARM for alarms.
+*/
+uint8_t
+vscp_ble_queue_level(const vscpEvent *pev);
+
+/*!
+  @brief Get the coalescing key of an event.
+  @param pev Pointer to event.
+  @return Key made from class, type and sensor index, or zero if the
+    event is not a measurement that can be coalesced.
+
+  @note CLASS1.MEASUREMENT and CLASS1.DATA use the sensor index in the
+  low three bits of the data coding byte, CLASS1.MEASUREZONE the index
+  byte. CLASS1.MEASUREMENT64 and CLASS1.MEASUREMENT32 have no index.
+*/
+uint32_t
+vscp_ble_queue_key(const vscpEvent *pev);
+
+/*!
+  @brief Queue an event.
+  @param pq Pointer to queue.
+  @param pev Pointer to event. The queue owns the event on success.
+  @param ppshed Pointer that receives an event that was dropped to make
+    room or replaced by pev, or NULL. The caller must release it.
+  @return VSCP_ERROR_SUCCESS if the event was queued, VSCP_ERROR_FIFO_FULL
+    if there was no room for it (the caller keeps the event), else error code.
+*/
+int
+vscp_ble_queue_push(vscp_ble_queue_t *pq, vscpEvent *pev, vscpEvent **ppshed);
+
+/*!
+  @brief Take the highest priority event from the queue.
+  @param pq Pointer to queue.
+  @return Pointer to the oldest event of the highest priority level, or NULL
+    if the queue is empty. The caller must release it.
+*/
+vscpEvent *
+vscp_ble_queue_pop(vscp_ble_queue_t *pq);
+
+/*!
+  @brief Get the number of queued events.
+  @param pq Pointer to queue.
+  @return Number of queued events.
+*/
+uint8_t
+vscp_ble_queue_count(const vscp_ble_queue_t *pq);
+
+#endif // VSCP_BLE_QUEUE_H
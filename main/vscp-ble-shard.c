@@ -0,0 +1,497 @@
+/*!
+  @file vscp-ble-shard.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+#include "vscp-ble-shard.h"
+
+#define SHARD_RING_MASK  (VSCP_BLE_SHARD_RING_SIZE - 1)
+#define SHARD_NODES_MASK (VSCP_BLE_SHARD_NODES - 1)
+#define SHARD_ORDER_MASK (VSCP_BLE_SHARD_ORDER_SIZE - 1)
+
+///////////////////////////////////////////////////////////////////////////////
+// shard_hash
+//
+// FNV-1a hash of a frame. Repeats of a frame are the same bytes, a new
+// event that got the same rolling index almost never is.
+//
+
+static uint32_t
+shard_hash(const uint8_t *pframe, uint8_t len)
+{
+  uint32_t hash = 2166136261u;
+
+  for (uint8_t i = 0; i < len; i++) {
+    hash = (hash ^ pframe[i]) * 16777619u;
+  }
+
+  return hash;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// shard_node
+//
+// Finds the state of a node, or a slot for it. When the node is not found
+// among VSCP_BLE_SHARD_NODE_PROBE slots and none is free, the slot of the
+// node heard least recently is reused.
+//
+
+static vscp_ble_shard_node_t *
+shard_node(vscp_ble_shard_t *pshard, uint16_t nodeid, uint32_t rx_ms)
+{
+  vscp_ble_shard_node_t *pfree = NULL;
+  vscp_ble_shard_node_t *pold  = NULL;
+  uint32_t home                = (nodeid / pshard->m_ppipe->m_cnt) & SHARD_NODES_MASK;
+  vscp_ble_shard_node_t *pnode;
+
+  for (uint32_t i = 0; i < VSCP_BLE_SHARD_NODE_PROBE; i++) {
+    pnode = &pshard->m_nodes[(home + i) & SHARD_NODES_MASK];
+    if (!pnode->m_bUsed) {
+      if (NULL == pfree) {
+        pfree = pnode;
+      }
+      continue;
+    }
+    if (pnode->m_nodeid == nodeid) {
+      return pnode;
+    }
+    if ((NULL == pold) || ((rx_ms - pnode->m_last_ms) > (rx_ms - pold->m_last_ms))) {
+      pold = pnode;
+    }
+  }
+
+  if (NULL == pfree) {
+    pfree = pold;
+    pshard->m_stats.m_evicted++;
+  }
+
+  pnode = pfree;
+  memset(pnode, 0, sizeof(vscp_ble_shard_node_t));
+  pnode->m_nodeid  = nodeid;
+  pnode->m_bUsed   = 1;
+  pnode->m_last_ms = rx_ms;
+
+  return pnode;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// shard_handle
+//
+// Checks, deduplicates and decodes one frame. Returns non zero if the
+// event should go to the sink.
+//
+// A repeat is the frame last heard with its rolling index heard again
+// within VSCP_BLE_SHARD_DUP_MS. The index alone would drop new events
+// from a node that sends more than eight within that time.
+//
+
+static int
+shard_handle(vscp_ble_shard_t *pshard, vscp_ble_shard_in_t *pin, vscpEventEx *pex)
+{
+  vscp_ble_shard_pipe_t *ppipe = pshard->m_ppipe;
+  uint8_t index                = pin->m_frame[VSCP_BLE_FRAME_POS_HEAD] & 0x07;
+  vscp_ble_shard_node_t *pnode;
+  uint16_t nodeid;
+  uint32_t hash;
+
+  nodeid = ((uint16_t) pin->m_frame[VSCP_BLE_FRAME_POS_NODEID] << 8) + pin->m_frame[VSCP_BLE_FRAME_POS_NODEID + 1];
+
+  pshard->m_stats.m_frames++;
+
+  // Repeats are dropped before the (expensive) check
+  pnode            = shard_node(pshard, nodeid, pin->m_rx_ms);
+  hash             = shard_hash(pin->m_frame, pin->m_len);
+  pnode->m_last_ms = pin->m_rx_ms;
+  if ((pnode->m_seen & (1 << index)) && (pnode->m_seen_hash[index] == hash) &&
+      ((pin->m_rx_ms - pnode->m_seen_ms[index]) < VSCP_BLE_SHARD_DUP_MS)) {
+    pshard->m_stats.m_repeats++;
+    return 0;
+  }
+
+  if ((NULL != ppipe->m_check) &&
+      (VSCP_ERROR_SUCCESS !=
+       ppipe->m_check(pin->m_frame, &pin->m_len, nodeid, (uint8_t) (pshard - ppipe->m_shards), ppipe->m_arg))) {
+    pshard->m_stats.m_rejected++;
+    return 0;
+  }
+
+  if (vscp_ble_frame_to_ex(&pshard->m_ctx, pex, pin->m_frame, pin->m_len) < 0) {
+    pshard->m_stats.m_invalid++;
+    return 0;
+  }
+
+  // Only frames that made it count for replay detection
+  pnode->m_seen |= (1 << index);
+  pnode->m_seen_ms[index]   = pin->m_rx_ms;
+  pnode->m_seen_hash[index] = hash;
+
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// shard_wait_room
+//
+// Blocks the worker until the merge has taken an item from its out ring.
+// Returns zero if the pipeline was stopped.
+//
+
+static int
+shard_wait_room(vscp_ble_shard_t *pshard, unsigned tail)
+{
+  vscp_ble_shard_pipe_t *ppipe = pshard->m_ppipe;
+
+  while ((tail - atomic_load_explicit(&pshard->m_out_head, memory_order_acquire)) >= VSCP_BLE_SHARD_RING_SIZE) {
+    pshard->m_stats.m_stalls++;
+
+    // Flag first, then look again: either the merge sees the flag and
+    // posts or this sees the room it made
+    atomic_store(&pshard->m_bWaiting, true);
+    if ((tail - atomic_load(&pshard->m_out_head)) < VSCP_BLE_SHARD_RING_SIZE) {
+      atomic_store(&pshard->m_bWaiting, false);
+      break;
+    }
+
+    while ((0 != sem_wait(&pshard->m_room)) && (EINTR == errno)) {
+      ;
+    }
+
+    if (!atomic_load_explicit(&ppipe->m_bRun, memory_order_acquire)) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// shard_worker
+//
+
+static void *
+shard_worker(void *arg)
+{
+  vscp_ble_shard_t *pshard     = (vscp_ble_shard_t *) arg;
+  vscp_ble_shard_pipe_t *ppipe = pshard->m_ppipe;
+  vscp_ble_shard_in_t *pin;
+  vscp_ble_shard_out_t *pout;
+  unsigned head;
+  unsigned tail;
+
+  for (;;) {
+    if ((0 != sem_wait(&pshard->m_sem)) && (EINTR == errno)) {
+      continue;
+    }
+
+    if (!atomic_load_explicit(&ppipe->m_bRun, memory_order_acquire)) {
+      break;
+    }
+
+    head = atomic_load_explicit(&pshard->m_in_head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&pshard->m_in_tail, memory_order_acquire)) {
+      continue;
+    }
+    pin = &pshard->m_in[head & SHARD_RING_MASK];
+
+    // Time base, does not go to the merge
+    if (0 == pin->m_len) {
+      vscp_ble_set_time_base(&pshard->m_ctx, pin->m_time_id, pin->m_time_ms, 0);
+      atomic_store_explicit(&pshard->m_in_head, head + 1, memory_order_release);
+      continue;
+    }
+
+    // Wait for the merge to make room
+    tail = atomic_load_explicit(&pshard->m_out_tail, memory_order_relaxed);
+    if (!shard_wait_room(pshard, tail)) {
+      break;
+    }
+
+    pout           = &pshard->m_out[tail & SHARD_RING_MASK];
+    pout->m_rx_ms  = pin->m_rx_ms;
+    pout->m_bValid = (uint8_t) shard_handle(pshard, pin, &pout->m_ex);
+
+    atomic_store_explicit(&pshard->m_in_head, head + 1, memory_order_release);
+    atomic_store_explicit(&pshard->m_out_tail, tail + 1, memory_order_release);
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// shard_in_room
+//
+// Non zero if the capture thread can put an item in a shard.
+//
+
+static int
+shard_in_room(vscp_ble_shard_t *pshard)
+{
+  unsigned tail = atomic_load_explicit(&pshard->m_in_tail, memory_order_relaxed);
+
+  return (tail - atomic_load_explicit(&pshard->m_in_head, memory_order_acquire)) < VSCP_BLE_SHARD_RING_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// shard_in_commit
+//
+// Hands the item at the tail of the in ring to the worker.
+//
+
+static void
+shard_in_commit(vscp_ble_shard_t *pshard)
+{
+  atomic_fetch_add_explicit(&pshard->m_in_tail, 1, memory_order_release);
+  sem_post(&pshard->m_sem);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_shard_start
+//
+
+int
+vscp_ble_shard_start(vscp_ble_shard_pipe_t *ppipe,
+                     uint8_t cnt,
+                     const vscp_ble_ctx_t *ctx,
+                     vscp_ble_shard_check_cb_t check,
+                     vscp_ble_shard_sink_cb_t sink,
+                     void *arg)
+{
+  vscp_ble_shard_t *pshard;
+
+  if ((NULL == ppipe) || (NULL == ctx) || (NULL == sink)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == cnt) || (cnt > VSCP_BLE_SHARD_MAX)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  ppipe->m_cnt   = cnt;
+  ppipe->m_check = check;
+  ppipe->m_sink  = sink;
+  ppipe->m_arg   = arg;
+  ppipe->m_put   = 0;
+  ppipe->m_full  = 0;
+  atomic_init(&ppipe->m_order_head, 0);
+  atomic_init(&ppipe->m_order_tail, 0);
+  atomic_init(&ppipe->m_bRun, true);
+
+  for (uint8_t i = 0; i < cnt; i++) {
+    pshard = &ppipe->m_shards[i];
+    memcpy(&pshard->m_ctx, ctx, sizeof(vscp_ble_ctx_t));
+    atomic_init(&pshard->m_in_head, 0);
+    atomic_init(&pshard->m_in_tail, 0);
+    atomic_init(&pshard->m_out_head, 0);
+    atomic_init(&pshard->m_out_tail, 0);
+    memset(pshard->m_nodes, 0, sizeof(pshard->m_nodes));
+    memset(&pshard->m_stats, 0, sizeof(pshard->m_stats));
+    atomic_init(&pshard->m_bWaiting, false);
+    pshard->m_ppipe = ppipe;
+
+    if (0 != sem_init(&pshard->m_sem, 0, 0)) {
+      ppipe->m_cnt = i;
+      vscp_ble_shard_stop(ppipe);
+      return VSCP_ERROR_MEMORY;
+    }
+
+    if (0 != sem_init(&pshard->m_room, 0, 0)) {
+      sem_destroy(&pshard->m_sem);
+      ppipe->m_cnt = i;
+      vscp_ble_shard_stop(ppipe);
+      return VSCP_ERROR_MEMORY;
+    }
+
+    if (0 != pthread_create(&pshard->m_thread, NULL, shard_worker, pshard)) {
+      sem_destroy(&pshard->m_sem);
+      sem_destroy(&pshard->m_room);
+      ppipe->m_cnt = i;
+      vscp_ble_shard_stop(ppipe);
+      return VSCP_ERROR_MEMORY;
+    }
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_shard_put
+//
+
+int
+vscp_ble_shard_put(vscp_ble_shard_pipe_t *ppipe, const uint8_t *pframe, uint8_t len, uint32_t rx_ms)
+{
+  vscp_ble_shard_t *pshard;
+  vscp_ble_shard_in_t *pin;
+  uint16_t nodeid;
+  unsigned order;
+  uint8_t idx;
+
+  if ((NULL == ppipe) || (NULL == pframe)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((len <= VSCP_BLE_FRAME_POS_HEAD) || (len > VSCP_BLE_FRAME_MAX_EVENT_SIZE)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  // The node id decides the shard
+  nodeid = ((uint16_t) pframe[VSCP_BLE_FRAME_POS_NODEID] << 8) + pframe[VSCP_BLE_FRAME_POS_NODEID + 1];
+  idx    = nodeid % ppipe->m_cnt;
+  pshard = &ppipe->m_shards[idx];
+
+  order = atomic_load_explicit(&ppipe->m_order_tail, memory_order_relaxed);
+  if (!shard_in_room(pshard) ||
+      ((order - atomic_load_explicit(&ppipe->m_order_head, memory_order_acquire)) >= VSCP_BLE_SHARD_ORDER_SIZE)) {
+    ppipe->m_full++;
+    return VSCP_ERROR_FIFO_FULL;
+  }
+
+  pin = &pshard->m_in[atomic_load_explicit(&pshard->m_in_tail, memory_order_relaxed) & SHARD_RING_MASK];
+  memcpy(pin->m_frame, pframe, len);
+  pin->m_len   = len;
+  pin->m_rx_ms = rx_ms;
+
+  // Order entry before the frame so the merge never sees a frame it has no entry for
+  ppipe->m_order[order & SHARD_ORDER_MASK] = idx;
+  atomic_store_explicit(&ppipe->m_order_tail, order + 1, memory_order_release);
+  shard_in_commit(pshard);
+  ppipe->m_put++;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_shard_set_time_base
+//
+
+int
+vscp_ble_shard_set_time_base(vscp_ble_shard_pipe_t *ppipe, uint8_t id, uint64_t time_ms)
+{
+  vscp_ble_shard_in_t *pin;
+
+  if (NULL == ppipe) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  // All or none
+  for (uint8_t i = 0; i < ppipe->m_cnt; i++) {
+    if (!shard_in_room(&ppipe->m_shards[i])) {
+      return VSCP_ERROR_FIFO_FULL;
+    }
+  }
+
+  for (uint8_t i = 0; i < ppipe->m_cnt; i++) {
+    pin = &ppipe->m_shards[i].m_in[atomic_load_explicit(&ppipe->m_shards[i].m_in_tail, memory_order_relaxed) &
+                                   SHARD_RING_MASK];
+    pin->m_len     = 0;
+    pin->m_time_id = id;
+    pin->m_time_ms = time_ms;
+    shard_in_commit(&ppipe->m_shards[i]);
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_shard_merge
+//
+
+uint32_t
+vscp_ble_shard_merge(vscp_ble_shard_pipe_t *ppipe, uint32_t max)
+{
+  vscp_ble_shard_t *pshard;
+  vscp_ble_shard_out_t *pout;
+  unsigned order;
+  unsigned head;
+  uint32_t cnt = 0;
+
+  if (NULL == ppipe) {
+    return 0;
+  }
+
+  while (cnt < max) {
+    order = atomic_load_explicit(&ppipe->m_order_head, memory_order_relaxed);
+    if (order == atomic_load_explicit(&ppipe->m_order_tail, memory_order_acquire)) {
+      break; // Nothing in flight
+    }
+
+    // The oldest frame is the next one out of its shard
+    pshard = &ppipe->m_shards[ppipe->m_order[order & SHARD_ORDER_MASK]];
+    head   = atomic_load_explicit(&pshard->m_out_head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&pshard->m_out_tail, memory_order_acquire)) {
+      break; // Not decoded yet
+    }
+
+    pout = &pshard->m_out[head & SHARD_RING_MASK];
+    if (pout->m_bValid && (VSCP_ERROR_SUCCESS != ppipe->m_sink(&pout->m_ex, pout->m_rx_ms, ppipe->m_arg))) {
+      break; // Sink full, try again later
+    }
+
+    // Pairs with the flag in shard_wait_room()
+    atomic_store(&pshard->m_out_head, head + 1);
+    if (atomic_load(&pshard->m_bWaiting) && atomic_exchange(&pshard->m_bWaiting, false)) {
+      sem_post(&pshard->m_room);
+    }
+    atomic_store_explicit(&ppipe->m_order_head, order + 1, memory_order_release);
+    cnt++;
+  }
+
+  return cnt;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_shard_stop
+//
+
+void
+vscp_ble_shard_stop(vscp_ble_shard_pipe_t *ppipe)
+{
+  if (NULL == ppipe) {
+    return;
+  }
+
+  atomic_store_explicit(&ppipe->m_bRun, false, memory_order_release);
+
+  for (uint8_t i = 0; i < ppipe->m_cnt; i++) {
+    sem_post(&ppipe->m_shards[i].m_sem);
+    sem_post(&ppipe->m_shards[i].m_room);
+  }
+
+  for (uint8_t i = 0; i < ppipe->m_cnt; i++) {
+    pthread_join(ppipe->m_shards[i].m_thread, NULL);
+    sem_destroy(&ppipe->m_shards[i].m_sem);
+    sem_destroy(&ppipe->m_shards[i].m_room);
+  }
+
+  ppipe->m_cnt = 0;
+}
@@ -0,0 +1,250 @@
+
+/*!
+  @file vscp-ble-shard.h
+  @brief Sharded decode pipeline for gateways.
+
+  Used on a gateway that receives more frames than one thread can
+  handle. The node firmware does not use it.
+
+  The capture thread puts received frames in the pipeline. Each frame
+  goes to the worker shard that owns its node id, so the duplicate and
+  replay state of a node is only touched by one thread and needs no
+  locking. The workers check (decrypt/verify), drop repeats and decode
+  in parallel. vscp_ble_shard_merge() hands the decoded events to the
+  sink in the order the frames were captured.
+
+    capture --put--> shard 0..n-1 (verify, dedup, decode) --merge--> sink
+
+  All queues are single producer, single consumer rings. put and
+  set_time_base must be called from one thread (capture), merge from
+  one thread (sink), which can be the same.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_SHARD_H
+#define VSCP_BLE_SHARD_H
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include <vscp.h>
+
+#include "vscp-ble.h"
+
+#define VSCP_BLE_SHARD_MAX        8    // Most worker shards, power of two
+#define VSCP_BLE_SHARD_RING_SIZE  64   // Frames in flight per shard, power of two
+#define VSCP_BLE_SHARD_NODES      256  // Nodes tracked per shard, power of two
+#define VSCP_BLE_SHARD_NODE_PROBE 8    // Slots searched for a node before the least recent is reused
+#define VSCP_BLE_SHARD_DUP_MS     2000 // The same frame heard again within this time is a repeat
+
+// Capture order of all frames in flight (in and out rings of all shards)
+#define VSCP_BLE_SHARD_ORDER_SIZE (2 * VSCP_BLE_SHARD_MAX * VSCP_BLE_SHARD_RING_SIZE)
+
+/*!
+  @brief Check a received frame before it is decoded.
+  @param pframe Pointer to the frame, can be changed in place (decrypt).
+  @param plen Pointer to the frame length, can be changed.
+  @param nodeid Node id of the frame.
+  @param shard Shard (0 to cnt - 1) the frame is handled in.
+  @param arg Argument given to vscp_ble_shard_start().
+  @return VSCP_ERROR_SUCCESS to accept the frame, anything else drops it.
+
+  @note Called from the worker threads, for more than one frame at a
+  time. A node always goes to the same shard and a shard handles one
+  frame at a time, so state kept per shard (say a key cache, see
+  vscp-ble-keys.h) needs no lock. State shared between shards must be
+  protected by the callback.
+*/
+typedef int (*vscp_ble_shard_check_cb_t)(uint8_t *pframe, uint8_t *plen, uint16_t nodeid, uint8_t shard, void *arg);
+
+/*!
+  @brief Receives the decoded events, in capture order.
+  @param pex Pointer to the decoded event.
+  @param rx_ms Time the frame was captured (vscp_ble_shard_put()).
+  @param arg Argument given to vscp_ble_shard_start().
+  @return VSCP_ERROR_SUCCESS when the event has been taken. Anything
+    else stops the merge, the event is handed over again on the next
+    merge (backpressure).
+*/
+typedef int (*vscp_ble_shard_sink_cb_t)(const vscpEventEx *pex, uint32_t rx_ms, void *arg);
+
+/*!
+  Item on the way to a shard
+*/
+typedef struct vscp_ble_shard_in {
+  uint8_t m_frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE]; // Received frame
+  uint8_t m_len;                                   // Frame length, zero for a time base
+  uint8_t m_time_id;                               // Time base id
+  uint32_t m_rx_ms;                                // Capture time
+  uint64_t m_time_ms;                              // Time base
+} vscp_ble_shard_in_t;
+
+/*!
+  Item on the way to the merge
+*/
+typedef struct vscp_ble_shard_out {
+  vscpEventEx m_ex; // Decoded event
+  uint32_t m_rx_ms; // Capture time
+  uint8_t m_bValid; // Zero if the frame was dropped
+} vscp_ble_shard_out_t;
+
+/*!
+  Duplicate and replay state of a node
+*/
+typedef struct vscp_ble_shard_node {
+  uint16_t m_nodeid;       // Node id
+  uint8_t m_bUsed;         // Slot in use
+  uint8_t m_seen;          // Bit n set when rolling index n has been heard
+  uint32_t m_last_ms;      // When the node was last heard
+  uint32_t m_seen_ms[8];   // When each rolling index was last heard
+  uint32_t m_seen_hash[8]; // Hash of the frame last heard with each rolling index
+} vscp_ble_shard_node_t;
+
+/*!
+  Shard statistics, written by the worker
+*/
+typedef struct vscp_ble_shard_stats {
+  uint32_t m_frames;   // Frames handled
+  uint32_t m_repeats;  // Frames dropped as repeats
+  uint32_t m_rejected; // Frames dropped by the check callback
+  uint32_t m_invalid;  // Frames that did not decode
+  uint32_t m_evicted;  // Nodes that lost their slot to another node
+  uint32_t m_stalls;   // Waits for the merge to make room
+} vscp_ble_shard_stats_t;
+
+struct vscp_ble_shard_pipe;
+
+/*!
+  Worker shard
+*/
+typedef struct vscp_ble_shard {
+  vscp_ble_ctx_t m_ctx; // Decoder context, owned by the worker
+  vscp_ble_shard_in_t m_in[VSCP_BLE_SHARD_RING_SIZE];
+  atomic_uint m_in_head; // Next item to take (worker)
+  atomic_uint m_in_tail; // Next free item (capture)
+  vscp_ble_shard_out_t m_out[VSCP_BLE_SHARD_RING_SIZE];
+  atomic_uint m_out_head; // Next item to take (merge)
+  atomic_uint m_out_tail; // Next free item (worker)
+  vscp_ble_shard_node_t m_nodes[VSCP_BLE_SHARD_NODES];
+  sem_t m_sem;             // Posted for each item put
+  sem_t m_room;            // Posted by the merge when the worker waits for room
+  atomic_bool m_bWaiting;  // Set while the worker waits for room
+  pthread_t m_thread;
+  struct vscp_ble_shard_pipe *m_ppipe;
+  vscp_ble_shard_stats_t m_stats;
+} vscp_ble_shard_t;
+
+/*!
+  Pipeline state
+*/
+typedef struct vscp_ble_shard_pipe {
+  vscp_ble_shard_t m_shards[VSCP_BLE_SHARD_MAX];
+  uint8_t m_cnt;                              // Number of shards
+  uint8_t m_order[VSCP_BLE_SHARD_ORDER_SIZE]; // Shard of each frame in flight, in capture order
+  atomic_uint m_order_head;                   // Next frame to merge
+  atomic_uint m_order_tail;                   // Next free entry
+  vscp_ble_shard_check_cb_t m_check;          // Check callback, can be NULL
+  vscp_ble_shard_sink_cb_t m_sink;            // Sink callback
+  void *m_arg;                                // Callback argument
+  atomic_bool m_bRun;                         // Cleared to stop the workers
+  uint32_t m_put;                             // Frames put
+  uint32_t m_full;                            // Frames refused, pipeline full
+} vscp_ble_shard_pipe_t;
+
+/*!
+  @brief Start a pipeline.
+  @param ppipe Pointer to pipeline state.
+  @param cnt Number of worker shards, 1 to VSCP_BLE_SHARD_MAX. Usually
+    the number of cores minus the ones used for capture and merge.
+  @param ctx Pointer to the decoder context, copied to each shard.
+  @param check Check callback, NULL to accept all frames.
+  @param sink Sink callback.
+  @param arg Argument for the callbacks.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_shard_start(vscp_ble_shard_pipe_t *ppipe,
+                     uint8_t cnt,
+                     const vscp_ble_ctx_t *ctx,
+                     vscp_ble_shard_check_cb_t check,
+                     vscp_ble_shard_sink_cb_t sink,
+                     void *arg);
+
+/*!
+  @brief Put a received frame in the pipeline.
+  @param ppipe Pointer to pipeline state.
+  @param pframe Pointer to the frame.
+  @param len Frame length.
+  @param rx_ms Capture time in milliseconds, any monotonic clock.
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_FIFO_FULL if the
+    shard of the node is full (call vscp_ble_shard_merge() and try
+    again), else error code.
+
+  @note Frames too short to hold a node id are refused.
+*/
+int
+vscp_ble_shard_put(vscp_ble_shard_pipe_t *ppipe, const uint8_t *pframe, uint8_t len, uint32_t rx_ms);
+
+/*!
+  @brief Pass a new time base to all shards.
+  @param ppipe Pointer to pipeline state.
+  @param id Time base id.
+  @param time_ms Time base in milliseconds since epoch.
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_FIFO_FULL if a shard
+    is full, else error code.
+
+  @note Call with each time base frame the gateway sends (see
+  vscp_ble_time_to_frame()) so the shards can resolve event timestamps.
+  Frames put before it are decoded against the time bases before it.
+*/
+int
+vscp_ble_shard_set_time_base(vscp_ble_shard_pipe_t *ppipe, uint8_t id, uint64_t time_ms);
+
+/*!
+  @brief Hand decoded events to the sink in capture order.
+  @param ppipe Pointer to pipeline state.
+  @param max Most frames to handle.
+  @return Number of frames handled (also dropped ones).
+
+  @note Returns early when the oldest frame in flight is not decoded yet
+  or the sink does not take an event. Does not block.
+*/
+uint32_t
+vscp_ble_shard_merge(vscp_ble_shard_pipe_t *ppipe, uint32_t max);
+
+/*!
+  @brief Stop the workers.
+  @param ppipe Pointer to pipeline state.
+
+  @note Frames not merged yet are lost.
+*/
+void
+vscp_ble_shard_stop(vscp_ble_shard_pipe_t *ppipe);
+
+#endif // VSCP_BLE_SHARD_H
@@ -0,0 +1,101 @@
+/*!
+  @file vscp-ble-sleep.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vscp-ble-sleep.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_sleep_next
+//
+
+vscp_ble_sleep_state_t
+vscp_ble_sleep_next(vscp_ble_sleep_state_t state, vscp_ble_sleep_event_t ev)
+{
+  // The awake time budget always wins
+  if (VSCP_BLE_SLEEP_EV_TIMEOUT == ev) {
+    return VSCP_BLE_SLEEP_STATE_SLEEP;
+  }
+
+  switch (state) {
+    case VSCP_BLE_SLEEP_STATE_BOOT:
+      return (VSCP_BLE_SLEEP_EV_SYNC == ev) ? VSCP_BLE_SLEEP_STATE_SAMPLE : state;
+
+    case VSCP_BLE_SLEEP_STATE_SAMPLE:
+      return (VSCP_BLE_SLEEP_EV_SAMPLE_DONE == ev) ? VSCP_BLE_SLEEP_STATE_ADVERTISE : state;
+
+    case VSCP_BLE_SLEEP_STATE_ADVERTISE:
+      return (VSCP_BLE_SLEEP_EV_ADV_DONE == ev) ? VSCP_BLE_SLEEP_STATE_SLEEP : state;
+
+    case VSCP_BLE_SLEEP_STATE_SLEEP:
+    default:
+      return VSCP_BLE_SLEEP_STATE_SLEEP;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_sleep_retained_init
+//
+
+int
+vscp_ble_sleep_retained_init(vscp_ble_sleep_retained_t *pret)
+{
+  if (NULL == pret) {
+    return 0;
+  }
+
+  // RTC memory content is undefined after power on
+  if (VSCP_BLE_SLEEP_MAGIC != pret->m_magic) {
+    memset(pret, 0, sizeof(vscp_ble_sleep_retained_t));
+    pret->m_magic = VSCP_BLE_SLEEP_MAGIC;
+    return 0;
+  }
+
+  pret->m_wake_count++;
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_sleep_record_startup
+//
+
+void
+vscp_ble_sleep_record_startup(vscp_ble_sleep_retained_t *pret, uint32_t wake_to_adv_us)
+{
+  if (NULL == pret) {
+    return;
+  }
+
+  pret->m_wake_to_adv_us = wake_to_adv_us;
+  if (wake_to_adv_us > pret->m_wake_to_adv_max_us) {
+    pret->m_wake_to_adv_max_us = wake_to_adv_us;
+  }
+}
@@ -0,0 +1,115 @@
+
+/*!
+  @file vscp-ble-sleep.h
+  @brief Deep sleep duty cycled advertising.
+
+  In deep sleep mode the node wakes on a timer (or GPIO), takes a
+  sample, sends a short burst of adverts and goes back to deep sleep.
+  State that must survive deep sleep (frame sequence, sample counter,
+  last sampled value and startup timing) is kept in RTC memory, or in
+  NVS on chips that have no RTC memory.
+
+  The state machine is free of ESP-IDF dependencies. The application
+  feeds it events and acts on the state it enters.
+
+    BOOT --SYNC--> SAMPLE --SAMPLE_DONE--> ADVERTISE --ADV_DONE--> SLEEP
+
+  A TIMEOUT event (awake time budget exceeded) moves any state to SLEEP.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_SLEEP_H
+#define VSCP_BLE_SLEEP_H
+
+#include <stdint.h>
+
+#define VSCP_BLE_SLEEP_MAGIC   0x56534C50 // "VSLP", marks valid retained state
+#define VSCP_BLE_SLEEP_NVS_KEY "sleep"    // NVS key of retained state without RTC memory
+
+/*!
+  Duty cycle states
+*/
+typedef enum vscp_ble_sleep_state {
+  VSCP_BLE_SLEEP_STATE_BOOT = 0,  // Waiting for the BLE host to sync
+  VSCP_BLE_SLEEP_STATE_SAMPLE,    // Taking a sample
+  VSCP_BLE_SLEEP_STATE_ADVERTISE, // Sending the advert burst
+  VSCP_BLE_SLEEP_STATE_SLEEP,     // Going to deep sleep (terminal)
+} vscp_ble_sleep_state_t;
+
+/*!
+  Duty cycle events
+*/
+typedef enum vscp_ble_sleep_event {
+  VSCP_BLE_SLEEP_EV_SYNC = 0,    // BLE host synced
+  VSCP_BLE_SLEEP_EV_SAMPLE_DONE, // Sample taken
+  VSCP_BLE_SLEEP_EV_ADV_DONE,    // Advert burst completed
+  VSCP_BLE_SLEEP_EV_TIMEOUT,     // Awake time budget exceeded
+} vscp_ble_sleep_event_t;
+
+/*!
+  State retained over deep sleep
+*/
+typedef struct vscp_ble_sleep_retained {
+  uint32_t m_magic;              // VSCP_BLE_SLEEP_MAGIC when valid
+  uint32_t m_wake_count;         // Number of wakeups since power on
+  uint32_t m_sequence;           // Sample sequence counter
+  uint32_t m_frame_seq;          // Frame sequence (rolling index)
+  uint8_t m_last_size;           // Size of last sampled value
+  uint8_t m_last_data[8];        // Last sampled value
+  uint32_t m_wake_to_adv_us;     // Wake to first advert, last cycle
+  uint32_t m_wake_to_adv_max_us; // Wake to first advert, worst case
+  uint32_t m_budget_overruns;    // Cycles ended by the awake time budget
+} vscp_ble_sleep_retained_t;
+
+/*!
+  @brief Get the next duty cycle state.
+  @param state Current state.
+  @param ev Event that occurred.
+  @return New state. Events that are not expected in a state leave the
+    state unchanged.
+*/
+vscp_ble_sleep_state_t
+vscp_ble_sleep_next(vscp_ble_sleep_state_t state, vscp_ble_sleep_event_t ev);
+
+/*!
+  @brief Validate retained state after a wakeup or power on.
+  @param pret Pointer to retained state.
+  @return Non zero if retained state was valid (wakeup from deep sleep),
+    zero if it was reset (power on).
+*/
+int
+vscp_ble_sleep_retained_init(vscp_ble_sleep_retained_t *pret);
+
+/*!
+  @brief Record the time from wake to first advert for the current cycle.
+  @param pret Pointer to retained state.
+  @param wake_to_adv_us Time from wake to first advert in microseconds.
+*/
+void
+vscp_ble_sleep_record_startup(vscp_ble_sleep_retained_t *pret, uint32_t wake_to_adv_us);
+
+#endif // VSCP_BLE_SLEEP_H
@@ -0,0 +1,429 @@
+/*!
+  @file vscp-ble-verify.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "mbedtls/bignum.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/version.h"
+
+#include <vscp.h>
+#include "vscp-ble-verify.h"
+
+// mbedtls before 3.0, as Linux distributions ship it, has the mbedtls_sha256()
+// that returns an error code as mbedtls_sha256_ret()
+#if MBEDTLS_VERSION_MAJOR < 3
+#define mbedtls_sha256 mbedtls_sha256_ret
+#endif
+
+/*!
+  Work of one thread in a batch
+*/
+typedef struct verify_job {
+  vscp_ble_verify_t *m_pv;
+  uint8_t m_idx; // Thread index, also the curve group used
+  pthread_t m_thread;
+} verify_job_t;
+
+///////////////////////////////////////////////////////////////////////////////
+// verify_timestamp
+//
+// Timestamp of a payload, sent little endian.
+//
+
+static uint32_t
+verify_timestamp(const secure_payload_t *ppayload)
+{
+  const uint8_t *p = (const uint8_t *) &ppayload->timestamp;
+
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// verify_seen
+//
+// Non zero if a timestamp is in a window. Timestamps older than the
+// window count as in it when bOld is set.
+//
+
+static int
+verify_seen(const vscp_ble_verify_window_t *pwin, uint32_t ts, int bOld)
+{
+  uint32_t age;
+
+  if (!pwin->m_bUsed || (ts > pwin->m_newest)) {
+    return 0;
+  }
+
+  age = pwin->m_newest - ts;
+  if (age >= VSCP_BLE_VERIFY_WINDOW) {
+    return bOld;
+  }
+
+  return (pwin->m_bits >> age) & 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// verify_mark
+//
+// Records a timestamp in a window.
+//
+
+static void
+verify_mark(vscp_ble_verify_window_t *pwin, uint32_t ts)
+{
+  uint32_t shift;
+
+  if (!pwin->m_bUsed) {
+    pwin->m_newest = ts;
+    pwin->m_bits   = 1;
+    pwin->m_bUsed  = 1;
+    return;
+  }
+
+  if (ts > pwin->m_newest) {
+    shift          = ts - pwin->m_newest;
+    pwin->m_bits   = (shift < VSCP_BLE_VERIFY_WINDOW) ? (pwin->m_bits << shift) : 0;
+    pwin->m_bits |= 1;
+    pwin->m_newest = ts;
+    return;
+  }
+
+  if ((pwin->m_newest - ts) < VSCP_BLE_VERIFY_WINDOW) {
+    pwin->m_bits |= (1ULL << (pwin->m_newest - ts));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// verify_one
+//
+
+static vscp_ble_verify_result_t
+verify_one(mbedtls_ecp_group *pgrp, const mbedtls_ecp_point *pq, const secure_payload_t *ppayload)
+{
+  unsigned char hash[32];
+  mbedtls_mpi r;
+  mbedtls_mpi s;
+  int ret;
+
+  mbedtls_mpi_init(&r);
+  mbedtls_mpi_init(&s);
+
+  ret = mbedtls_sha256((const unsigned char *) &ppayload->timestamp, sizeof(ppayload->timestamp), hash, 0);
+  if (0 == ret) {
+    ret = mbedtls_mpi_read_binary(&r, ppayload->signature, 32);
+  }
+  if (0 == ret) {
+    ret = mbedtls_mpi_read_binary(&s, ppayload->signature + 32, 32);
+  }
+  if (0 == ret) {
+    ret = mbedtls_ecdsa_verify(pgrp, hash, sizeof(hash), pq, &r, &s);
+  }
+
+  mbedtls_mpi_free(&r);
+  mbedtls_mpi_free(&s);
+
+  return (0 == ret) ? VSCP_BLE_VERIFY_OK : VSCP_BLE_VERIFY_BAD;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// verify_worker
+//
+// Verifies every m_threads'th payload of the batch, starting at the
+// thread index.
+//
+
+static void *
+verify_worker(void *arg)
+{
+  verify_job_t *pjob    = (verify_job_t *) arg;
+  vscp_ble_verify_t *pv = pjob->m_pv;
+  vscp_ble_verify_item_t *pitem;
+
+  for (uint32_t i = pjob->m_idx; i < pv->m_items_cnt; i += pv->m_threads) {
+    pitem           = &pv->m_items[i];
+    pitem->m_result = verify_one(&pv->m_grp[pjob->m_idx], &pv->m_nodes[pitem->m_node].m_q, &pitem->m_payload);
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// verify_now_us
+//
+
+static uint64_t
+verify_now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((uint64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_verify_init
+//
+
+int
+vscp_ble_verify_init(vscp_ble_verify_t *pv,
+                     vscp_ble_verify_node_t *pnodes,
+                     uint16_t nodes_size,
+                     vscp_ble_verify_item_t *pitems,
+                     uint32_t items_size,
+                     uint8_t threads,
+                     vscp_ble_verify_cb_t cb,
+                     void *arg)
+{
+  if ((NULL == pv) || (NULL == pnodes) || (NULL == pitems)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((0 == nodes_size) || (nodes_size >= VSCP_BLE_VERIFY_NONE) || (0 == items_size) || (0 == threads) ||
+      (threads > VSCP_BLE_VERIFY_THREADS_MAX)) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  pv->m_nodes      = pnodes;
+  pv->m_nodes_size = nodes_size;
+  pv->m_nodes_used = 0;
+  pv->m_items      = pitems;
+  pv->m_items_size = items_size;
+  pv->m_items_cnt  = 0;
+  pv->m_threads    = threads;
+  pv->m_cb         = cb;
+  pv->m_arg        = arg;
+  memset(pv->m_slot, 0xff, sizeof(pv->m_slot));
+  memset(&pv->m_stats, 0, sizeof(pv->m_stats));
+
+  for (uint8_t i = 0; i < threads; i++) {
+    mbedtls_ecp_group_init(&pv->m_grp[i]);
+    if (0 != mbedtls_ecp_group_load(&pv->m_grp[i], MBEDTLS_ECP_DP_SECP256R1)) {
+      pv->m_threads = i + 1;
+      vscp_ble_verify_free(pv);
+      return VSCP_ERROR_ERROR;
+    }
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_verify_free
+//
+
+void
+vscp_ble_verify_free(vscp_ble_verify_t *pv)
+{
+  if (NULL == pv) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < pv->m_threads; i++) {
+    mbedtls_ecp_group_free(&pv->m_grp[i]);
+  }
+
+  for (uint16_t i = 0; i < pv->m_nodes_used; i++) {
+    mbedtls_ecp_point_free(&pv->m_nodes[i].m_q);
+  }
+
+  pv->m_threads    = 0;
+  pv->m_nodes_used = 0;
+  pv->m_items_cnt  = 0;
+  memset(pv->m_slot, 0xff, sizeof(pv->m_slot));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_verify_add_key
+//
+
+int
+vscp_ble_verify_add_key(vscp_ble_verify_t *pv, uint16_t nodeid, const uint8_t *pkey, size_t len)
+{
+  vscp_ble_verify_node_t *pnode;
+  mbedtls_ecp_point q;
+  uint16_t idx;
+
+  if ((NULL == pv) || (NULL == pkey)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  // Parse and check the key before anything is changed
+  mbedtls_ecp_point_init(&q);
+  if ((0 != mbedtls_ecp_point_read_binary(&pv->m_grp[0], &q, pkey, len)) ||
+      (0 != mbedtls_ecp_check_pubkey(&pv->m_grp[0], &q))) {
+    mbedtls_ecp_point_free(&q);
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  idx = pv->m_slot[nodeid];
+  if (VSCP_BLE_VERIFY_NONE == idx) {
+    if (pv->m_nodes_used >= pv->m_nodes_size) {
+      mbedtls_ecp_point_free(&q);
+      return VSCP_ERROR_BUFFER_TO_SMALL;
+    }
+    idx   = pv->m_nodes_used++;
+    pnode = &pv->m_nodes[idx];
+    memset(pnode, 0, sizeof(vscp_ble_verify_node_t));
+    mbedtls_ecp_point_init(&pnode->m_q);
+    pv->m_slot[nodeid] = idx;
+  }
+
+  pnode = &pv->m_nodes[idx];
+  mbedtls_ecp_point_free(&pnode->m_q);
+  pnode->m_q = q;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_verify_put
+//
+
+int
+vscp_ble_verify_put(vscp_ble_verify_t *pv, uint16_t nodeid, const secure_payload_t *ppayload)
+{
+  vscp_ble_verify_node_t *pnode;
+  vscp_ble_verify_item_t *pitem;
+  uint32_t ts;
+  uint16_t idx;
+
+  if ((NULL == pv) || (NULL == ppayload)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  idx = pv->m_slot[nodeid];
+  if (VSCP_BLE_VERIFY_NONE == idx) {
+    pv->m_stats.m_no_key++;
+    return VSCP_ERROR_NOT_SUPPORTED;
+  }
+
+  // Seen before, or another copy of a payload in this batch. A timestamp
+  // far below the others in the batch is queued, a forged newer one must
+  // not keep a real one out. run() drops copies that get in that way.
+  pnode = &pv->m_nodes[idx];
+  ts    = verify_timestamp(ppayload);
+  if (verify_seen(&pnode->m_done, ts, 1) || verify_seen(&pnode->m_queued, ts, 0)) {
+    pv->m_stats.m_seen++;
+    return VSCP_ERROR_ALREADY_DEFINED;
+  }
+
+  if (pv->m_items_cnt >= pv->m_items_size) {
+    return VSCP_ERROR_FIFO_FULL;
+  }
+
+  pitem = &pv->m_items[pv->m_items_cnt++];
+  memcpy(&pitem->m_payload, ppayload, sizeof(secure_payload_t));
+  pitem->m_nodeid = nodeid;
+  pitem->m_node   = idx;
+  pitem->m_result = VSCP_BLE_VERIFY_BAD;
+  verify_mark(&pnode->m_queued, ts);
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_verify_run
+//
+
+uint32_t
+vscp_ble_verify_run(vscp_ble_verify_t *pv)
+{
+  verify_job_t jobs[VSCP_BLE_VERIFY_THREADS_MAX];
+  vscp_ble_verify_node_t *pnode;
+  vscp_ble_verify_item_t *pitem;
+  uint8_t started = 1;
+  uint32_t valid  = 0;
+  uint64_t start;
+  uint32_t ts;
+
+  if ((NULL == pv) || (0 == pv->m_items_cnt)) {
+    return 0;
+  }
+
+  start = verify_now_us();
+
+  // Thread zero is the caller. A thread that can not be started leaves
+  // its share to the ones before it.
+  for (uint8_t i = 0; i < pv->m_threads; i++) {
+    jobs[i].m_pv  = pv;
+    jobs[i].m_idx = i;
+  }
+  for (uint8_t i = 1; i < pv->m_threads; i++) {
+    if (0 != pthread_create(&jobs[i].m_thread, NULL, verify_worker, &jobs[i])) {
+      break;
+    }
+    started++;
+  }
+  verify_worker(&jobs[0]);
+  for (uint8_t i = 1; i < started; i++) {
+    pthread_join(jobs[i].m_thread, NULL);
+  }
+  for (uint8_t i = started; i < pv->m_threads; i++) {
+    verify_worker(&jobs[i]);
+  }
+
+  pv->m_stats.m_busy_us += verify_now_us() - start;
+
+  // Replay state and results, in queue order
+  for (uint32_t i = 0; i < pv->m_items_cnt; i++) {
+    pitem                   = &pv->m_items[i];
+    pnode                   = &pv->m_nodes[pitem->m_node];
+    ts                      = verify_timestamp(&pitem->m_payload);
+    pnode->m_queued.m_bUsed = 0;
+
+    if ((VSCP_BLE_VERIFY_OK == pitem->m_result) && verify_seen(&pnode->m_done, ts, 1)) {
+      pv->m_stats.m_seen++; // Copy earlier in the batch
+      continue;
+    }
+
+    if (VSCP_BLE_VERIFY_OK == pitem->m_result) {
+      verify_mark(&pnode->m_done, ts);
+      pv->m_stats.m_verified++;
+      valid++;
+    }
+    else {
+      pv->m_stats.m_bad++;
+    }
+
+    if (NULL != pv->m_cb) {
+      pv->m_cb(pitem->m_nodeid, ts, (vscp_ble_verify_result_t) pitem->m_result, pv->m_arg);
+    }
+  }
+
+  pv->m_items_cnt = 0;
+
+  return valid;
+}
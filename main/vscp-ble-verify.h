@@ -0,0 +1,220 @@
+
+/*!
+  @file vscp-ble-verify.h
+  @brief Batch verification of signed payloads for gateways.
+
+  Used on a gateway to check the ECDSA P-256 signatures nodes make with
+  create_signed_payload(). The node firmware does not use it.
+
+  The public key of each node is parsed once when it is added and kept
+  as a curve point. Payloads are queued with vscp_ble_verify_put() and
+  checked together with vscp_ble_verify_run(), which spreads the batch
+  over a number of threads. Each thread has a curve group of its own, so
+  nothing is shared but the read only public keys.
+
+  A payload is only verified if its (node, timestamp) pair has not been
+  seen before. Each node has a window of the last VSCP_BLE_VERIFY_WINDOW
+  timestamps below the newest one verified. Timestamps that are in the
+  window or older than it are skipped without verifying. Only payloads
+  that verify move the window, so forged payloads can not push it ahead.
+
+  The signature is over the SHA-256 of the four timestamp bytes as sent
+  (little endian).
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_VERIFY_H
+#define VSCP_BLE_VERIFY_H
+
+#include <stdint.h>
+
+#include "mbedtls/ecp.h"
+
+#include "crypto.h"
+
+#define VSCP_BLE_VERIFY_NODES       65536  // Node ids
+#define VSCP_BLE_VERIFY_NONE        0xffff // No node entry
+#define VSCP_BLE_VERIFY_THREADS_MAX 16     // Most threads per batch
+#define VSCP_BLE_VERIFY_WINDOW      64     // Timestamps remembered below the newest
+
+/*!
+  Verification result
+*/
+typedef enum vscp_ble_verify_result {
+  VSCP_BLE_VERIFY_OK = 0, // Signature is valid
+  VSCP_BLE_VERIFY_BAD,    // Signature is not valid
+} vscp_ble_verify_result_t;
+
+/*!
+  @brief Receives the result of each payload of a batch, in queue order.
+  @param nodeid Node id.
+  @param timestamp Timestamp of the payload.
+  @param result Verification result.
+  @param arg Argument given to vscp_ble_verify_init().
+*/
+typedef void (*vscp_ble_verify_cb_t)(uint16_t nodeid, uint32_t timestamp, vscp_ble_verify_result_t result, void *arg);
+
+/*!
+  Timestamps of a node below and at the newest one
+*/
+typedef struct vscp_ble_verify_window {
+  uint32_t m_newest; // Newest timestamp
+  uint64_t m_bits;   // Bit n set when m_newest - n is in
+  uint8_t m_bUsed;   // Set when m_newest is valid
+} vscp_ble_verify_window_t;
+
+/*!
+  Public key and replay state of a node
+*/
+typedef struct vscp_ble_verify_node {
+  mbedtls_ecp_point m_q;             // Public key
+  vscp_ble_verify_window_t m_done;   // Timestamps verified
+  vscp_ble_verify_window_t m_queued; // Timestamps in the batch, skips copies
+} vscp_ble_verify_node_t;
+
+/*!
+  Queued payload
+*/
+typedef struct vscp_ble_verify_item {
+  secure_payload_t m_payload; // Payload as received
+  uint16_t m_nodeid;          // Node id
+  uint16_t m_node;            // Node entry
+  uint8_t m_result;           // vscp_ble_verify_result_t
+} vscp_ble_verify_item_t;
+
+/*!
+  Verifier statistics
+*/
+typedef struct vscp_ble_verify_stats {
+  uint32_t m_verified; // Valid signatures
+  uint32_t m_bad;      // Signatures that did not verify
+  uint32_t m_seen;     // Payloads skipped, timestamp already seen, queued or too old
+  uint32_t m_no_key;   // Payloads from nodes without a public key
+  uint64_t m_busy_us;  // Time spent verifying, verifications/s is
+                       // (m_verified + m_bad) * 1000000 / m_busy_us
+} vscp_ble_verify_stats_t;
+
+/*!
+  Verifier state
+*/
+typedef struct vscp_ble_verify {
+  vscp_ble_verify_node_t *m_nodes;                      // Node entries, caller storage
+  uint16_t m_nodes_size;                                // Number of node entries
+  uint16_t m_nodes_used;                                // Node entries in use
+  uint16_t m_slot[VSCP_BLE_VERIFY_NODES];               // Node entry of each node id
+  vscp_ble_verify_item_t *m_items;                      // Batch, caller storage
+  uint32_t m_items_size;                                // Batch size
+  uint32_t m_items_cnt;                                 // Payloads queued
+  uint8_t m_threads;                                    // Threads per batch
+  mbedtls_ecp_group m_grp[VSCP_BLE_VERIFY_THREADS_MAX]; // Curve, one per thread
+  vscp_ble_verify_cb_t m_cb;                            // Result callback
+  void *m_arg;                                          // Callback argument
+  vscp_ble_verify_stats_t m_stats;
+} vscp_ble_verify_t;
+
+/*!
+  @brief Initialize a verifier.
+  @param pv Pointer to verifier state.
+  @param pnodes Pointer to node entry storage.
+  @param nodes_size Number of node entries, 1 to VSCP_BLE_VERIFY_NONE - 1.
+  @param pitems Pointer to batch storage.
+  @param items_size Most payloads in a batch.
+  @param threads Threads per batch, 1 to VSCP_BLE_VERIFY_THREADS_MAX.
+  @param cb Result callback, can be NULL.
+  @param arg Callback argument.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_verify_init(vscp_ble_verify_t *pv,
+                     vscp_ble_verify_node_t *pnodes,
+                     uint16_t nodes_size,
+                     vscp_ble_verify_item_t *pitems,
+                     uint32_t items_size,
+                     uint8_t threads,
+                     vscp_ble_verify_cb_t cb,
+                     void *arg);
+
+/*!
+  @brief Free a verifier.
+  @param pv Pointer to verifier state.
+*/
+void
+vscp_ble_verify_free(vscp_ble_verify_t *pv);
+
+/*!
+  @brief Add the public key of a node.
+  @param pv Pointer to verifier state.
+  @param nodeid Node id.
+  @param pkey Pointer to the public key, an uncompressed P-256 point
+    (65 bytes, 0x04 X Y).
+  @param len Length of the key.
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_INVALID_PARAMETER if
+    the key is not a valid point, VSCP_ERROR_BUFFER_TO_SMALL if there is
+    no free node entry, else error code.
+
+  @note Adding a key for a node that has one replaces it. The replay
+  state of the node is kept.
+*/
+int
+vscp_ble_verify_add_key(vscp_ble_verify_t *pv, uint16_t nodeid, const uint8_t *pkey, size_t len);
+
+/*!
+  @brief Queue a payload for verification.
+  @param pv Pointer to verifier state.
+  @param nodeid Node id of the sender.
+  @param ppayload Pointer to the payload as received.
+  @return VSCP_ERROR_SUCCESS if queued, VSCP_ERROR_ALREADY_DEFINED if the
+    timestamp has been seen before or is in the batch (not queued),
+    VSCP_ERROR_NOT_SUPPORTED if the node has no public key,
+    VSCP_ERROR_FIFO_FULL if the batch is full (call vscp_ble_verify_run()),
+    else error code.
+
+  @note The timestamp is a replay counter. Each payload of a node must
+  have a new one, and payloads more than VSCP_BLE_VERIFY_WINDOW below the
+  newest verified one are dropped (see create_signed_payload()).
+*/
+int
+vscp_ble_verify_put(vscp_ble_verify_t *pv, uint16_t nodeid, const secure_payload_t *ppayload);
+
+/*!
+  @brief Verify the queued payloads.
+  @param pv Pointer to verifier state.
+  @return Number of valid signatures.
+
+  @note Blocks until the batch is done. The result callback is called
+  for each payload afterwards, from the calling thread. Threads are
+  started for each batch so batches should be large compared to the
+  number of threads.
+
+  A valid timestamp is reported once. A copy that got into the batch
+  (more than VSCP_BLE_VERIFY_WINDOW below the newest timestamp queued for
+  the node) is counted as seen and not reported.
+*/
+uint32_t
+vscp_ble_verify_run(vscp_ble_verify_t *pv);
+
+#endif // VSCP_BLE_VERIFY_H
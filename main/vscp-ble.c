@@ -33,73 +33,351 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <vscp.h>
 #include "vscp-ble.h"
 
-/*!
-  Frame counter
-  -------------
-  This is used to make sure that the same event is not sent
-  multiple times. The frame counter is incremented for each
-  event sent. The frame counter is a 3-bit value, so it
-  will roll over after 8 events. It is located in the low
-  three bits of the head byte.
- */
-static uint8_t s_rolling_index = 0;
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_set_guid
+//
+
+int
+vscp_ble_set_guid(vscp_ble_ctx_t *ctx, const uint8_t *pguid)
+{
+  // Check pointers
+  if ((NULL == ctx) || (NULL == pguid)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  memcpy(ctx->m_guid, pguid, 16);
+  ctx->m_nodeid = ((uint16_t) pguid[VSCP_BLE_GUID_POS_NODEID] << 8) + pguid[VSCP_BLE_GUID_POS_NODEID + 1];
+
+  return VSCP_ERROR_SUCCESS;
+}
 
 ///////////////////////////////////////////////////////////////////////////////
-// vscp_ble_ev_to_frame
+// vscp_ble_get_sequence
+//
+
+uint32_t
+vscp_ble_get_sequence(vscp_ble_ctx_t *ctx)
+{
+  if (NULL == ctx) {
+    return 0;
+  }
+
+  return atomic_load_explicit(&ctx->m_seq, memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_set_sequence
+//
+
+void
+vscp_ble_set_sequence(vscp_ble_ctx_t *ctx, uint32_t seq)
+{
+  if (NULL == ctx) {
+    return;
+  }
+
+  atomic_store_explicit(&ctx->m_seq, seq, memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_guid_from_addr
 //
 
 int
-vscp_ble_ev_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, vscpEvent *pev)
+vscp_ble_guid_from_addr(uint8_t *pguid, const uint8_t *paddr)
 {
   // Check pointers
-  if ((NULL == ctx) || (NULL == pbuf) || (NULL == pev)) {
-    return -1; // Invalid pointer
+  if ((NULL == pguid) || (NULL == paddr)) {
+    return VSCP_ERROR_INVALID_POINTER;
   }
 
+  memset(pguid, 0xff, 7);
+  pguid[7] = 0xfe;
+  pguid[8] = 0;
+  pguid[9] = 0;
+  for (int i = 0; i < 6; i++) {
+    pguid[10 + i] = paddr[5 - i];
+  }
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// frame_size
+//
+// Number of bytes an event frame with sizeData data bytes occupies.
+//
+
+static int
+frame_size(uint8_t sizeData)
+{
+  return VSCP_BLE_FRAME_POS_DATA + ((sizeData > 8) ? sizeData : 8);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// frame_size_ts
+//
+// Number of bytes an event frame with sizeData data bytes and a timestamp
+// occupies. The timestamp is the last VSCP_BLE_TIMESTAMP_SIZE bytes.
+//
+
+static int
+frame_size_ts(uint8_t sizeData)
+{
+  int size = VSCP_BLE_FRAME_POS_DATA + sizeData + VSCP_BLE_TIMESTAMP_SIZE;
+  int min  = frame_size(0);
+
+  return (size > min) ? size : min;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// frame_len
+//
+// Number of bytes a checked event frame occupies.
+//
+
+static int
+frame_len(const uint8_t *pbuf, uint8_t sizeData)
+{
+  if (pbuf[VSCP_BLE_FRAME_POS_FLAGS] & VSCP_BLE_FRAME_FLAG_TIMESTAMP) {
+    return frame_size_ts(sizeData);
+  }
+
+  return frame_size(sizeData);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// frame_encode
+//
+// Common part of the event and event ex encoders.
+//
+
+static int
+frame_encode(vscp_ble_ctx_t *ctx,
+             uint8_t *pbuf,
+             uint8_t bufsize,
+             uint16_t mancode,
+             uint16_t head,
+             uint16_t vscp_class,
+             uint16_t vscp_type,
+             const uint8_t *pdata,
+             uint16_t size,
+             uint32_t timestamp)
+{
+  // Data is padded to eight bytes and can be at most VSCP_BLE_FRAME_MAX_DATA_SIZE
+  uint8_t sizeData  = (size <= VSCP_BLE_FRAME_MAX_DATA_SIZE) ? size : VSCP_BLE_FRAME_MAX_DATA_SIZE;
+  uint8_t framesize = (uint8_t) frame_size(sizeData);
+  uint8_t flags     = VSCP_BLE_FRAME_TYPE_EVENT;
+  uint64_t ref;
+  uint32_t elapsed_us;
+  uint32_t delta_ms = 0;
+  uint32_t seq;
+
   // Check if the buffer is large enough to hold the event
-  if (bufsize < (VSCP_BLE_FRAME_MIN_SIZE + VSCP_BLE_FRAME_MAX_DATA_SIZE)) {
+  if (bufsize < framesize) {
     return -1; // Buffer too small
   }
 
+  // Timestamp against the time base, if there is one, it is recent enough
+  // and there is room for it
+  ref = atomic_load_explicit(&ctx->m_time_ref, memory_order_relaxed);
+  if ((ref & VSCP_BLE_TIME_VALID) && (bufsize >= frame_size_ts(sizeData))) {
+    // Modulo 2^32, right as vscp_ble_expire_time_base() keeps the base
+    // younger than the wrap. An event captured before the base is far off.
+    elapsed_us = timestamp - (uint32_t) VSCP_BLE_TIME_VALUE(ref);
+    delta_ms   = elapsed_us / 1000;
+    if (delta_ms <= VSCP_BLE_TIMESTAMP_MAX_MS) {
+      flags |= VSCP_BLE_FRAME_FLAG_TIMESTAMP;
+      framesize = (uint8_t) frame_size_ts(sizeData);
+    }
+  }
+
+  if (sizeData && (NULL == pdata)) {
+    return -1; // Invalid pointer
+  }
+
   // Manufacturer code (little endian)
-  pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER]     = ctx->m_manufacturer & 0xff;
-  pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER + 1] = (ctx->m_manufacturer >> 8) & 0xff;
+  pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER]     = mancode & 0xff;
+  pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER + 1] = (mancode >> 8) & 0xff;
 
-  // Flags (frame type = 0, no encryption, no authentication)
-  pbuf[VSCP_BLE_FRAME_POS_FLAGS] = 0;
+  // Flags (frame type = 0, no encryption, no authentication, timestamp)
+  pbuf[VSCP_BLE_FRAME_POS_FLAGS] = flags;
 
   // Node ID (big endian)
-  pbuf[VSCP_BLE_FRAME_POS_NODEID]     = ((pev->GUID[14] >> 8) & 0xff);
-  pbuf[VSCP_BLE_FRAME_POS_NODEID + 1] = (pev->GUID[15] & 0xff);
-
-  // Head (bit 4 (hard coded) is always set to one)
-  pbuf[VSCP_BLE_FRAME_POS_HEAD] = ((pev->head & 0x0f) | 0x10) + (s_rolling_index & 0x07);
+  pbuf[VSCP_BLE_FRAME_POS_NODEID]     = (ctx->m_nodeid >> 8) & 0xff;
+  pbuf[VSCP_BLE_FRAME_POS_NODEID + 1] = ctx->m_nodeid & 0xff;
 
-  // Increment the frame counter
-  ctx->m_rolling_index++;
+  // Head (bit 4 (hard coded) is always set to one, rolling index in the low three bits).
+  // Concurrent encoders each get a sequence number of their own.
+  seq                           = atomic_fetch_add_explicit(&ctx->m_seq, 1, memory_order_relaxed);
+  pbuf[VSCP_BLE_FRAME_POS_HEAD] = (head & 0x08) | 0x10 | (seq & 0x07);
 
   // VSCP Class (big endian)
-  pbuf[VSCP_BLE_FRAME_POS_CLASS]     = (pev->vscp_class >> 8) & 0xff;
-  pbuf[VSCP_BLE_FRAME_POS_CLASS + 1] = (pev->vscp_class & 0xff);
+  pbuf[VSCP_BLE_FRAME_POS_CLASS]     = (vscp_class >> 8) & 0xff;
+  pbuf[VSCP_BLE_FRAME_POS_CLASS + 1] = (vscp_class & 0xff);
 
   // VSCP Type (big endian)
-  pbuf[VSCP_BLE_FRAME_POS_TYPE]     = (pev->vscp_type >> 8) & 0xff;
-  pbuf[VSCP_BLE_FRAME_POS_TYPE + 1] = (pev->vscp_type & 0xff);
+  pbuf[VSCP_BLE_FRAME_POS_TYPE]     = (vscp_type >> 8) & 0xff;
+  pbuf[VSCP_BLE_FRAME_POS_TYPE + 1] = (vscp_type & 0xff);
 
   // Size of data
-  pbuf[VSCP_BLE_FRAME_POS_SIZE_DATA] = (pev->sizeData & 0xff);
+  pbuf[VSCP_BLE_FRAME_POS_SIZE_DATA] = sizeData;
 
-  // Data (up to VSCP_BLE_FRAME_MAX_DATA_SIZE bytes)
-  memcpy(pbuf + VSCP_BLE_FRAME_POS_DATA,
-         pev->pdata,
-         (pev->sizeData <= VSCP_BLE_FRAME_MAX_DATA_SIZE) ? pev->sizeData : VSCP_BLE_FRAME_MAX_DATA_SIZE);
+  // Data (up to VSCP_BLE_FRAME_MAX_DATA_SIZE bytes), zero padded
+  memset(pbuf + VSCP_BLE_FRAME_POS_DATA, 0, framesize - VSCP_BLE_FRAME_POS_DATA);
+  if (sizeData) {
+    memcpy(pbuf + VSCP_BLE_FRAME_POS_DATA, pdata, sizeData);
+  }
+
+  // Timestamp (time base id, delta big endian)
+  if (flags & VSCP_BLE_FRAME_FLAG_TIMESTAMP) {
+    pbuf[framesize - 3] = VSCP_BLE_TIME_ID(ref);
+    pbuf[framesize - 2] = (delta_ms >> 8) & 0xff;
+    pbuf[framesize - 1] = delta_ms & 0xff;
+  }
 
   // Return the size of the buffer content
-  return sizeof(vscpEvent);
+  return framesize;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// frame_check
+//
+// Validates a received event frame. Returns the size of the data or -1.
+//
+
+static int
+frame_check(const uint8_t *pbuf, uint8_t bufsize)
+{
+  uint8_t sizeData;
+
+  if (bufsize < VSCP_BLE_FRAME_MIN_SIZE) {
+    return -1; // Truncated
+  }
+
+  if (VSCP_BLE_FRAME_TYPE_EVENT != (pbuf[VSCP_BLE_FRAME_POS_FLAGS] & VSCP_BLE_FRAME_TYPE_MASK)) {
+    return -1; // Not an event frame
+  }
+
+  if (!(pbuf[VSCP_BLE_FRAME_POS_HEAD] & 0x10)) {
+    return -1; // Marker bit missing
+  }
+
+  sizeData = pbuf[VSCP_BLE_FRAME_POS_SIZE_DATA];
+  if (sizeData > VSCP_BLE_FRAME_MAX_DATA_SIZE) {
+    return -1;
+  }
+
+  // Data past the first eight bytes and the timestamp must all be there
+  if (bufsize < (VSCP_BLE_FRAME_POS_DATA + sizeData)) {
+    return -1;
+  }
+  if ((pbuf[VSCP_BLE_FRAME_POS_FLAGS] & VSCP_BLE_FRAME_FLAG_TIMESTAMP) && (bufsize < frame_size_ts(sizeData))) {
+    return -1;
+  }
+
+  return sizeData;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// frame_guid
+//
+// GUID of the sending node: the context GUID with the node id of the
+// frame in the last two bytes.
+//
+
+static void
+frame_guid(const vscp_ble_ctx_t *ctx, uint8_t *pguid, const uint8_t *pbuf)
+{
+  memcpy(pguid, ctx->m_guid, 16);
+  pguid[VSCP_BLE_GUID_POS_NODEID]     = pbuf[VSCP_BLE_FRAME_POS_NODEID];
+  pguid[VSCP_BLE_GUID_POS_NODEID + 1] = pbuf[VSCP_BLE_FRAME_POS_NODEID + 1];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// frame_capture_time
+//
+// Capture time of a checked event frame in ms since epoch, zero if it has
+// no timestamp or the time base is not known.
+//
+
+static uint64_t
+frame_capture_time(const vscp_ble_ctx_t *ctx, const uint8_t *pbuf, uint8_t sizeData)
+{
+  const uint8_t *pts;
+  uint64_t base;
+
+  if (!(pbuf[VSCP_BLE_FRAME_POS_FLAGS] & VSCP_BLE_FRAME_FLAG_TIMESTAMP)) {
+    return 0;
+  }
+
+  pts  = pbuf + frame_size_ts(sizeData) - VSCP_BLE_TIMESTAMP_SIZE;
+  base = atomic_load_explicit(&ctx->m_time_base[pts[0] & 1], memory_order_relaxed);
+  if (!(base & VSCP_BLE_TIME_VALID) || (VSCP_BLE_TIME_ID(base) != pts[0])) {
+    return 0; // Unknown or too old time base
+  }
+
+  return VSCP_BLE_TIME_VALUE(base) + (((uint16_t) pts[1] << 8) + pts[2]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// frame_datetime
+//
+// Date and time (UTC) of a capture time, all zero if it is not known.
+//
+
+static void
+frame_datetime(uint64_t time_ms,
+               uint16_t *pyear,
+               uint8_t *pmonth,
+               uint8_t *pday,
+               uint8_t *phour,
+               uint8_t *pminute,
+               uint8_t *psecond)
+{
+  time_t t = (time_t) (time_ms / 1000);
+  struct tm tm;
+
+  if (!time_ms || (NULL == gmtime_r(&t, &tm))) {
+    *pyear = *pmonth = *pday = *phour = *pminute = *psecond = 0;
+    return;
+  }
+
+  *pyear   = (uint16_t) (tm.tm_year + 1900);
+  *pmonth  = (uint8_t) (tm.tm_mon + 1);
+  *pday    = (uint8_t) tm.tm_mday;
+  *phour   = (uint8_t) tm.tm_hour;
+  *pminute = (uint8_t) tm.tm_min;
+  *psecond = (uint8_t) tm.tm_sec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_ev_to_frame
+//
+
+int
+vscp_ble_ev_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, vscpEvent *pev)
+{
+  // Check pointers
+  if ((NULL == ctx) || (NULL == pbuf) || (NULL == pev)) {
+    return -1; // Invalid pointer
+  }
+
+  return frame_encode(ctx,
+                      pbuf,
+                      bufsize,
+                      ctx->m_manufacturer,
+                      pev->head,
+                      pev->vscp_class,
+                      pev->vscp_type,
+                      pev->pdata,
+                      pev->sizeData,
+                      pev->timestamp);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -114,13 +392,16 @@ vscp_ble_ex_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, vscpEv
     return -1; // Invalid pointer
   }
 
-  // Check if the buffer is large enough to hold the event
-  if (bufsize < (VSCP_BLE_FRAME_MIN_SIZE + pex->sizeData)) {
-    return -1; // Buffer too small
-  }
-
-  // Return the size of the event
-  return sizeof(vscpEvent);
+  return frame_encode(ctx,
+                      pbuf,
+                      bufsize,
+                      mancode,
+                      pex->head,
+                      pex->vscp_class,
+                      pex->vscp_type,
+                      pex->data,
+                      pex->sizeData,
+                      pex->timestamp);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -130,12 +411,42 @@ vscp_ble_ex_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, vscpEv
 int
 vscp_ble_frame_to_ev(vscp_ble_ctx_t *ctx, vscpEvent *pev, uint8_t *pbuf, uint8_t bufsize)
 {
+  int sizeData;
+
   // Check pointers
   if ((NULL == ctx) || (NULL == pbuf) || (NULL == pev)) {
     return -1; // Invalid pointer
   }
 
-  return VSCP_ERROR_SUCCESS;
+  sizeData = frame_check(pbuf, bufsize);
+  if (sizeData < 0) {
+    return -1;
+  }
+
+  // Data goes to the buffer supplied by the caller
+  if (sizeData && (NULL == pev->pdata)) {
+    return -1;
+  }
+
+  pev->head       = pbuf[VSCP_BLE_FRAME_POS_HEAD] & 0x0f;
+  pev->vscp_class = ((uint16_t) pbuf[VSCP_BLE_FRAME_POS_CLASS] << 8) + pbuf[VSCP_BLE_FRAME_POS_CLASS + 1];
+  pev->vscp_type  = ((uint16_t) pbuf[VSCP_BLE_FRAME_POS_TYPE] << 8) + pbuf[VSCP_BLE_FRAME_POS_TYPE + 1];
+  pev->sizeData   = (uint16_t) sizeData;
+  pev->timestamp  = 0;
+  pev->obid       = 0;
+  frame_guid(ctx, pev->GUID, pbuf);
+  frame_datetime(frame_capture_time(ctx, pbuf, (uint8_t) sizeData),
+                 &pev->year,
+                 &pev->month,
+                 &pev->day,
+                 &pev->hour,
+                 &pev->minute,
+                 &pev->second);
+  if (sizeData) {
+    memcpy(pev->pdata, pbuf + VSCP_BLE_FRAME_POS_DATA, sizeData);
+  }
+
+  return frame_len(pbuf, (uint8_t) sizeData);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -145,10 +456,352 @@ vscp_ble_frame_to_ev(vscp_ble_ctx_t *ctx, vscpEvent *pev, uint8_t *pbuf, uint8_t
 int
 vscp_ble_frame_to_ex(vscp_ble_ctx_t *ctx, vscpEventEx *pex, uint8_t *pbuf, uint8_t bufsize)
 {
+  int sizeData;
+
   // Check pointers
   if ((NULL == ctx) || (NULL == pbuf) || (NULL == pex)) {
     return -1; // Invalid pointer
   }
 
+  sizeData = frame_check(pbuf, bufsize);
+  if (sizeData < 0) {
+    return -1;
+  }
+
+  pex->head       = pbuf[VSCP_BLE_FRAME_POS_HEAD] & 0x0f;
+  pex->vscp_class = ((uint16_t) pbuf[VSCP_BLE_FRAME_POS_CLASS] << 8) + pbuf[VSCP_BLE_FRAME_POS_CLASS + 1];
+  pex->vscp_type  = ((uint16_t) pbuf[VSCP_BLE_FRAME_POS_TYPE] << 8) + pbuf[VSCP_BLE_FRAME_POS_TYPE + 1];
+  pex->sizeData   = (uint16_t) sizeData;
+  pex->timestamp  = 0;
+  pex->obid       = 0;
+  frame_guid(ctx, pex->GUID, pbuf);
+  frame_datetime(frame_capture_time(ctx, pbuf, (uint8_t) sizeData),
+                 &pex->year,
+                 &pex->month,
+                 &pex->day,
+                 &pex->hour,
+                 &pex->minute,
+                 &pex->second);
+  memcpy(pex->data, pbuf + VSCP_BLE_FRAME_POS_DATA, sizeData);
+
+  return frame_len(pbuf, (uint8_t) sizeData);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_ack_mark
+//
+
+int
+vscp_ble_ack_mark(vscp_ble_ack_t *packs, uint8_t *pcnt, uint8_t maxcnt, uint16_t nodeid, uint8_t index)
+{
+  // Check pointers
+  if ((NULL == packs) || (NULL == pcnt)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  for (uint8_t i = 0; i < *pcnt; i++) {
+    if (packs[i].m_nodeid == nodeid) {
+      packs[i].m_bitmap |= (1 << (index & 0x07));
+      return VSCP_ERROR_SUCCESS;
+    }
+  }
+
+  if (*pcnt >= maxcnt) {
+    return VSCP_ERROR_BUFFER_TO_SMALL;
+  }
+
+  packs[*pcnt].m_nodeid = nodeid;
+  packs[*pcnt].m_bitmap = (1 << (index & 0x07));
+  (*pcnt)++;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_ack_to_frame
+//
+
+int
+vscp_ble_ack_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, const vscp_ble_ack_t *packs, uint8_t cnt)
+{
+  uint8_t pos = VSCP_BLE_ACK_POS_ENTRIES;
+
+  // Check pointers
+  if ((NULL == ctx) || (NULL == pbuf) || (cnt && (NULL == packs))) {
+    return -1; // Invalid pointer
+  }
+
+  if (bufsize < VSCP_BLE_ACK_FRAME_SIZE(cnt)) {
+    return -1; // Buffer too small
+  }
+
+  // Manufacturer code (little endian)
+  pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER]     = ctx->m_manufacturer & 0xff;
+  pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER + 1] = (ctx->m_manufacturer >> 8) & 0xff;
+
+  pbuf[VSCP_BLE_FRAME_POS_FLAGS] = VSCP_BLE_FRAME_TYPE_ACK;
+  pbuf[VSCP_BLE_ACK_POS_COUNT]   = cnt;
+
+  for (uint8_t i = 0; i < cnt; i++) {
+    pbuf[pos++] = (packs[i].m_nodeid >> 8) & 0xff;
+    pbuf[pos++] = packs[i].m_nodeid & 0xff;
+    pbuf[pos++] = packs[i].m_bitmap;
+  }
+
+  return pos;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ack_check_frame
+//
+// Returns the number of entries in a valid acknowledgement frame, else -1.
+//
+
+static int
+ack_check_frame(const uint8_t *pbuf, uint8_t len)
+{
+  if (NULL == pbuf) {
+    return -1;
+  }
+
+  if (len < VSCP_BLE_ACK_POS_ENTRIES) {
+    return -1;
+  }
+
+  if (VSCP_BLE_FRAME_TYPE_ACK != (pbuf[VSCP_BLE_FRAME_POS_FLAGS] & VSCP_BLE_FRAME_TYPE_MASK)) {
+    return -1;
+  }
+
+  if (len < VSCP_BLE_ACK_FRAME_SIZE(pbuf[VSCP_BLE_ACK_POS_COUNT])) {
+    return -1; // Truncated
+  }
+
+  return pbuf[VSCP_BLE_ACK_POS_COUNT];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_frame_to_ack
+//
+
+int
+vscp_ble_frame_to_ack(vscp_ble_ack_t *packs, uint8_t maxcnt, const uint8_t *pbuf, uint8_t len)
+{
+  const uint8_t *p;
+  int cnt;
+
+  // Check pointers
+  if (NULL == packs) {
+    return -1; // Invalid pointer
+  }
+
+  cnt = ack_check_frame(pbuf, len);
+  if ((cnt < 0) || (cnt > maxcnt)) {
+    return -1;
+  }
+
+  p = pbuf + VSCP_BLE_ACK_POS_ENTRIES;
+  for (int i = 0; i < cnt; i++) {
+    packs[i].m_nodeid = ((uint16_t) p[0] << 8) + p[1];
+    packs[i].m_bitmap = p[2];
+    p += VSCP_BLE_ACK_ENTRY_SIZE;
+  }
+
+  return cnt;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_ack_find
+//
+
+int
+vscp_ble_ack_find(const uint8_t *pbuf, uint8_t len, uint16_t nodeid)
+{
+  const uint8_t *p;
+  int cnt = ack_check_frame(pbuf, len);
+
+  if (cnt < 0) {
+    return -1;
+  }
+
+  p = pbuf + VSCP_BLE_ACK_POS_ENTRIES;
+  for (int i = 0; i < cnt; i++) {
+    if ((p[0] == ((nodeid >> 8) & 0xff)) && (p[1] == (nodeid & 0xff))) {
+      return p[2];
+    }
+    p += VSCP_BLE_ACK_ENTRY_SIZE;
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_ack_check
+//
+
+int
+vscp_ble_ack_check(const vscp_ble_ctx_t *ctx, const uint8_t *pbuf, uint8_t len, uint8_t index)
+{
+  int bitmap;
+
+  // Check pointers
+  if ((NULL == ctx) || (NULL == pbuf) || (len < VSCP_BLE_ACK_POS_ENTRIES)) {
+    return -1;
+  }
+
+  // Only gateways using our manufacturer code
+  if ((pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER] + (pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER + 1] << 8)) !=
+      ctx->m_manufacturer) {
+    return -1;
+  }
+
+  bitmap = vscp_ble_ack_find(pbuf, len, ctx->m_nodeid);
+  if (bitmap < 0) {
+    return -1;
+  }
+
+  return (bitmap & (1 << (index & 0x07))) ? 1 : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// time_base_add
+//
+// Remembers a time base for the decoders.
+//
+
+static void
+time_base_add(vscp_ble_ctx_t *ctx, uint8_t id, uint64_t time_ms)
+{
+  atomic_store_explicit(&ctx->m_time_base[id & 1], VSCP_BLE_TIME_PACK(id, time_ms), memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_set_time_base
+//
+
+void
+vscp_ble_set_time_base(vscp_ble_ctx_t *ctx, uint8_t id, uint64_t time_ms, uint64_t timestamp)
+{
+  if (NULL == ctx) {
+    return;
+  }
+
+  time_base_add(ctx, id, time_ms);
+  atomic_store_explicit(&ctx->m_time_ref, VSCP_BLE_TIME_PACK(id, timestamp), memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_expire_time_base
+//
+
+void
+vscp_ble_expire_time_base(vscp_ble_ctx_t *ctx, uint64_t now)
+{
+  uint64_t ref;
+
+  if (NULL == ctx) {
+    return;
+  }
+
+  // The clock is 48 bits in the context, over eight years of microseconds
+  now &= VSCP_BLE_TIME_MASK;
+  ref = atomic_load_explicit(&ctx->m_time_ref, memory_order_relaxed);
+  if (!(ref & VSCP_BLE_TIME_VALID) || (now <= (VSCP_BLE_TIME_VALUE(ref) + VSCP_BLE_TIMESTAMP_MAX_MS * 1000ULL))) {
+    return;
+  }
+
+  // Leave a time base that was set in the meantime
+  atomic_compare_exchange_strong_explicit(&ctx->m_time_ref, &ref, 0, memory_order_relaxed, memory_order_relaxed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_time_to_frame
+//
+
+int
+vscp_ble_time_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, uint64_t time_ms)
+{
+  uint8_t id;
+
+  // Check pointers
+  if ((NULL == ctx) || (NULL == pbuf)) {
+    return -1; // Invalid pointer
+  }
+
+  if (bufsize < VSCP_BLE_TIME_FRAME_SIZE) {
+    return -1; // Buffer too small
+  }
+
+  id = ctx->m_time_base_next++;
+  time_base_add(ctx, id, time_ms);
+
+  // Manufacturer code (little endian)
+  pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER]     = ctx->m_manufacturer & 0xff;
+  pbuf[VSCP_BLE_FRAME_POS_MANUFACTURER + 1] = (ctx->m_manufacturer >> 8) & 0xff;
+
+  pbuf[VSCP_BLE_FRAME_POS_FLAGS] = VSCP_BLE_FRAME_TYPE_TIME;
+  pbuf[VSCP_BLE_TIME_POS_ID]     = id;
+  for (int i = 0; i < 6; i++) {
+    pbuf[VSCP_BLE_TIME_POS_TIME + i] = (time_ms >> (8 * (5 - i))) & 0xff;
+  }
+
+  return VSCP_BLE_TIME_FRAME_SIZE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_frame_to_time
+//
+
+int
+vscp_ble_frame_to_time(uint8_t *pid, uint64_t *ptime_ms, const uint8_t *pbuf, uint8_t len)
+{
+  uint64_t time_ms = 0;
+
+  // Check pointers
+  if ((NULL == pid) || (NULL == ptime_ms) || (NULL == pbuf)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  if ((len < VSCP_BLE_TIME_FRAME_SIZE) ||
+      (VSCP_BLE_FRAME_TYPE_TIME != (pbuf[VSCP_BLE_FRAME_POS_FLAGS] & VSCP_BLE_FRAME_TYPE_MASK))) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  for (int i = 0; i < 6; i++) {
+    time_ms = (time_ms << 8) | pbuf[VSCP_BLE_TIME_POS_TIME + i];
+  }
+
+  *pid      = pbuf[VSCP_BLE_TIME_POS_ID];
+  *ptime_ms = time_ms;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vscp_ble_frame_time
+//
+
+int
+vscp_ble_frame_time(const vscp_ble_ctx_t *ctx, const uint8_t *pbuf, uint8_t len, uint64_t *ptime_ms)
+{
+  int sizeData;
+  uint64_t time_ms;
+
+  // Check pointers
+  if ((NULL == ctx) || (NULL == pbuf) || (NULL == ptime_ms)) {
+    return VSCP_ERROR_INVALID_POINTER;
+  }
+
+  sizeData = frame_check(pbuf, len);
+  if (sizeData < 0) {
+    return VSCP_ERROR_INVALID_PARAMETER;
+  }
+
+  time_ms = frame_capture_time(ctx, pbuf, (uint8_t) sizeData);
+  if (!time_ms) {
+    return VSCP_ERROR_NOT_SUPPORTED;
+  }
+
+  *ptime_ms = time_ms;
+
   return VSCP_ERROR_SUCCESS;
 }
@@ -38,21 +38,71 @@
   ------------
 
   | Manufacturer | 2 bytes | Bluetooth manufacturer id, use 0xFFFF for test. Note that little endian is used here. |
-  | Flags | 1 byte | 0x01 |
+  | Flags | 1 byte | 0x00 (frame type event), bit 4 set if a timestamp is present |
   | node id | 2 bytes | Node id. This is the last two bytes of the GUID. |
   | head | 1 byte | VSCP Head. Bit 4 is always set to one (hardcoded). |
-  | timestamp | 4 bytes | Microsecond timestamp |
   | vscp-class | 2 bytes | VSCP class |
   | vscp-type | 2 bytes | VSCP type |
-  | VSCP data | 0-17 bytes | VSCP data |
+  | size | 1 byte | Number of data bytes |
+  | VSCP data | 8-24 bytes | VSCP data, zero padded to eight bytes |
+  | timestamp | 3 bytes | Optional. Time base id and capture time in ms after the time base (big endian) |
+
+  The timestamp is always the last three bytes of the frame. For events
+  with five data bytes or less it takes the place of the padding so the
+  frame keeps its size. It is left out if it does not fit in the buffer
+  or if the node has not heard a time base for the last 65 seconds.
+
+  Node GUID
+  ---------
+
+  Nodes that have no GUID provisioned use a GUID derived from the
+  Bluetooth identity address, most significant byte first, so that the
+  node id is the two least significant bytes of the address.
+
+  FF FF FF FF FF FF FF FE 00 00 a5 a4 a3 a2 a1 a0
+
+  Acknowledgement frame
+  ---------------------
+
+  A gateway can broadcast which frames it has received so that nodes
+  can stop repeating them. The frame type is in the low nibble of the
+  flags byte.
+
+  | Manufacturer | 2 bytes | Bluetooth manufacturer id, little endian. |
+  | Flags | 1 byte | 0x01 (frame type acknowledgement) |
+  | count | 1 byte | Number of entries that follow |
+  | entry | 3 bytes | Node id (big endian) and a bitmap of received rolling indexes |
+
+  Bit n of the bitmap is set when the frame with rolling index n (low
+  three bits of head) from the node has been received. Seven entries fit
+  in a legacy advert together with the flags AD structure. The rolling
+  index wraps after eight frames so a gateway should only list frames
+  received during the last few seconds.
+
+  Time base frame
+  ---------------
+
+  A gateway broadcasts its wall clock every few seconds. Nodes stamp
+  events with the time since the last time base they heard, the gateway
+  adds the delta to the time base and gets the absolute capture time.
+
+  | Manufacturer | 2 bytes | Bluetooth manufacturer id, little endian. |
+  | Flags | 1 byte | 0x02 (frame type time base) |
+  | id | 1 byte | Time base id, incremented for each new time base |
+  | time | 6 bytes | Milliseconds since 1970-01-01 00:00:00 UTC (big endian) |
 */
 
+#ifndef VSCP_BLE_H
+#define VSCP_BLE_H
+
+#include <stdatomic.h>
+
 #include <vscp.h>
 
 // Legacy advertising
-#define VSCP_BLE_FRAME_MIN_SIZE      19     // Without name field
-#define VSCP_BLE_FRAME_MAX_SIZE      31     // With name field of 10 character is size
-#define VSCP_BLE_FRAME_MAX_DATA_SIZE 8 + 16 // advertising data + response data
+#define VSCP_BLE_FRAME_MIN_SIZE      19       // Without name field
+#define VSCP_BLE_FRAME_MAX_SIZE      31       // With name field of 10 character is size
+#define VSCP_BLE_FRAME_MAX_DATA_SIZE (8 + 16) // advertising data + response data
 
 #define VSCP_BLE_FRAME_POS_MANUFACTURER 0  // 2 bytes (note !!!! little endian)
 #define VSCP_BLE_FRAME_POS_FLAGS        2  // 1 byte
@@ -63,22 +113,79 @@
 #define VSCP_BLE_FRAME_POS_SIZE_DATA    10 // 1 byte
 #define VSCP_BLE_FRAME_POS_DATA         11 // Always 8 bytes (padded with zeros if needed)
 
+#define VSCP_BLE_GUID_POS_NODEID 14 // Node id is the last two bytes of the GUID
+
+// Frame types (low nibble of flags)
+#define VSCP_BLE_FRAME_TYPE_MASK  0x0f
+#define VSCP_BLE_FRAME_TYPE_EVENT 0 // VSCP event
+#define VSCP_BLE_FRAME_TYPE_ACK   1 // Gateway acknowledgement
+#define VSCP_BLE_FRAME_TYPE_TIME  2 // Gateway time base
+
+#define VSCP_BLE_FRAME_FLAG_TIMESTAMP 0x10 // Event frame ends with a timestamp
+
+#define VSCP_BLE_TIMESTAMP_SIZE   3      // Time base id (1 byte) + delta in ms (2 bytes)
+#define VSCP_BLE_TIMESTAMP_MAX_MS 0xffff // Longest delta that can be sent
+
+// Time base as kept in the context: valid flag, id and a 48 bit time
+#define VSCP_BLE_TIME_VALID        (1ULL << 63)
+#define VSCP_BLE_TIME_MASK         0xffffffffffffULL
+#define VSCP_BLE_TIME_PACK(id, t)  (VSCP_BLE_TIME_VALID | ((uint64_t) (id) << 48) | ((uint64_t) (t) & VSCP_BLE_TIME_MASK))
+#define VSCP_BLE_TIME_ID(v)        ((uint8_t) ((v) >> 48))
+#define VSCP_BLE_TIME_VALUE(v)     ((v) & VSCP_BLE_TIME_MASK)
+
+// Largest event frame (all data and a timestamp)
+#define VSCP_BLE_FRAME_MAX_EVENT_SIZE (VSCP_BLE_FRAME_POS_DATA + VSCP_BLE_FRAME_MAX_DATA_SIZE + VSCP_BLE_TIMESTAMP_SIZE)
+
+#define VSCP_BLE_TIME_POS_ID     3 // 1 byte
+#define VSCP_BLE_TIME_POS_TIME   4 // 6 bytes
+#define VSCP_BLE_TIME_FRAME_SIZE 10
+
+#define VSCP_BLE_ACK_POS_COUNT     3 // 1 byte
+#define VSCP_BLE_ACK_POS_ENTRIES   4 // 3 bytes per entry
+#define VSCP_BLE_ACK_ENTRY_SIZE    3 // Node id (2 bytes) + bitmap (1 byte)
+#define VSCP_BLE_ACK_FRAME_SIZE(n) (VSCP_BLE_ACK_POS_ENTRIES + ((n) * VSCP_BLE_ACK_ENTRY_SIZE))
+
 /*!
   VSCP BLE context
+
+  Holds all encoder state. Several tasks can encode with the same
+  context at the same time, each frame gets a sequence number of its
+  own without locking. Use one context per advertising set.
 */
 typedef struct vscp_ble_ctx {
+  uint8_t m_guid[16];          // Node GUID
+  uint16_t m_nodeid;           // Node id (last two bytes of GUID)
   uint16_t m_manufacturer;     // Manufacturer code
-  uint8_t m_rolling_index : 3; // Rolling index updated for each sent frame
+  atomic_uint_least32_t m_seq; // Frame sequence, the low three bits are the rolling index
   uint8_t m_bScanResponse : 1; // Scan response flag
   uint8_t m_bEncryption : 1;   // Set if frames should be encrypted
+  // Time base the encoder stamps events against (VSCP_BLE_TIME_PACK()).
+  // Id and the clock (us) when it was heard, updated in one go.
+  atomic_uint_least64_t m_time_ref;
+  // Time bases the decoders can resolve (current and previous), by id & 1.
+  // Id and milliseconds since epoch (VSCP_BLE_TIME_PACK()).
+  atomic_uint_least64_t m_time_base[2];
+  uint8_t m_time_base_next; // Id of the next time base frame (gateway)
 } vscp_ble_ctx_t;
 
+/*!
+  Acknowledgement entry
+*/
+typedef struct vscp_ble_ack {
+  uint16_t m_nodeid; // Node id
+  uint8_t m_bitmap;  // Bit n set when rolling index n has been received
+} vscp_ble_ack_t;
+
 /*!
   @brief Convert a VSCP event to a buffer format.
   @param pbuf Pointer to the buffer where the event will be stored.
   @param bufsize Size of the buffer.
   @param pev Pointer to the VSCP event structure.
   @return The number of bytes written to the buffer, or -1 on error.
+          This is VSCP_BLE_FRAME_MIN_SIZE for events with eight data
+          bytes or less. A timestamp follows the data: it fits in the
+          padding for five data bytes or less and makes the frame up to
+          VSCP_BLE_TIMESTAMP_SIZE bytes longer above that.
 
   @note This function converts a VSCP event to a buffer format suitable for
   transmission over Bluetooth Low Energy (BLE). The event is formatted
@@ -90,10 +197,11 @@ typedef struct vscp_ble_ctx {
   error. The function returns the size of the event in bytes
   after successful conversion.
 
-  The manufacturer code is specified as a parameter and is
-  included in the buffer in little-endian format. The head byte
-  is set with bit 4 always set to one (hardcoded) and the rolling
-  index is added to the low three bits of the head byte.
+  The manufacturer code and node id are taken from the context
+  (see vscp_ble_set_guid()), the GUID of the event is not used. The
+  manufacturer code is included in the buffer in little-endian format. The head byte
+  keeps bit 3 of the event head, has bit 4 always set to one (hardcoded) and
+  holds the rolling index in the low three bits.
 
   The size of the data must be 0-8 bytes for a valid frame but can be
   max 24 bytes in which case a scan response packet is sent to the server. If data
@@ -101,29 +209,89 @@ typedef struct vscp_ble_ctx {
   8 bytes. If the data is larger than 8 bytes the scan response packet is padded
   with zeros up to 16 bytes.
 
-
+  If the context has a time base (see vscp_ble_set_time_base()) the
+  timestamp of the event (microseconds, low 32 bits of the clock the time
+  base was heard on) is sent as the delta to the time base. Events
+  captured before the time base or more than VSCP_BLE_TIMESTAMP_MAX_MS
+  after it get no timestamp.
 */
 int
 vscp_ble_ev_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, vscpEvent *pev);
 
+/*!
+  @brief Set the node GUID used for encoded frames.
+  @param ctx Pointer to the VSCP BLE context.
+  @param pguid Pointer to the 16 byte GUID.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+
+  @note Call once at startup. The node id stamped into every frame is
+  derived here so that the encoders do not have to handle GUIDs.
+*/
+int
+vscp_ble_set_guid(vscp_ble_ctx_t *ctx, const uint8_t *pguid);
+
+/*!
+  @brief Get the sequence number the next encoded frame will get.
+  @param ctx Pointer to the VSCP BLE context.
+  @return Sequence number.
+*/
+uint32_t
+vscp_ble_get_sequence(vscp_ble_ctx_t *ctx);
+
+/*!
+  @brief Set the sequence number of the next encoded frame.
+  @param ctx Pointer to the VSCP BLE context.
+  @param seq Sequence number.
+
+  @note Used to continue the sequence after deep sleep.
+*/
+void
+vscp_ble_set_sequence(vscp_ble_ctx_t *ctx, uint32_t seq);
+
+/*!
+  @brief Derive a node GUID from a Bluetooth device address.
+  @param pguid Pointer to 16 byte buffer that will receive the GUID.
+  @param paddr Pointer to the six byte device address in NimBLE byte
+    order (least significant byte first).
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_guid_from_addr(uint8_t *pguid, const uint8_t *paddr);
+
 /*!
  * @brief Convert a VSCP event ex to a buffer.
+ * @param ctx Pointer to the VSCP BLE context.
  * @param pbuf Pointer to the buffer where the event exchange will be stored.
  * @param bufsize Size of the buffer.
  * @param pex Pointer to the VSCP event ex structure.
+ * @param mancode Manufacturer code for the frame.
  * @return The number of bytes written to the buffer, or -1 on error.
  *
- * @note This function is not implemented yet.
+ * @note Same frame as vscp_ble_ev_to_frame() but the manufacturer code is
+ * given by the caller.
  */
 int
 vscp_ble_ex_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, vscpEventEx *pex, uint16_t mancode);
 
 /*!
  * @brief Convert a buffer to a VSCP event.
- * @param pev Pointer to the VSCP event structure where the event will be stored.
+ * @param ctx Pointer to the VSCP BLE context. Its GUID is used as the
+ *   GUID of the sending node, with the node id of the frame in the last
+ *   two bytes.
+ * @param pev Pointer to the VSCP event structure where the event will be
+ *   stored. pdata must point to at least VSCP_BLE_FRAME_MAX_DATA_SIZE bytes.
  * @param pbuf Pointer to the buffer containing the event data.
  * @param bufsize Size of the buffer.
  * @return The number of bytes read from the buffer, or -1 on error.
+ *
+ * @note Radio input is untrusted. Frames that are truncated, are not
+ * event frames, lack the head marker bit or claim more data than
+ * VSCP_BLE_FRAME_MAX_DATA_SIZE are rejected. The low three bits of head
+ * hold the rolling index of the frame.
+ *
+ * If the frame has a timestamp against a time base known to the context
+ * the date and time (UTC, whole seconds) of the event are set, else they
+ * are zero. Use vscp_ble_frame_time() for the full resolution.
  */
 int
 vscp_ble_frame_to_ev(vscp_ble_ctx_t *ctx, vscpEvent *pev, uint8_t *pbuf, uint8_t bufsize);
@@ -131,6 +299,7 @@ vscp_ble_frame_to_ev(vscp_ble_ctx_t *ctx, vscpEvent *pev, uint8_t *pbuf, uint8_t
 /*!
  * @brief Convert a buffer to a VSCP event exchange.
  *
+ * @param ctx Pointer to the VSCP BLE context (see vscp_ble_frame_to_ev()).
  * @param pex Pointer to the VSCP event exchange structure where the event will be stored.
  * @param pbuf Pointer to the buffer containing the event data.
  * @param bufsize Size of the buffer.
@@ -139,6 +308,145 @@ vscp_ble_frame_to_ev(vscp_ble_ctx_t *ctx, vscpEvent *pev, uint8_t *pbuf, uint8_t
 int
 vscp_ble_frame_to_ex(vscp_ble_ctx_t *ctx, vscpEventEx *pex, uint8_t *pbuf, uint8_t bufsize);
 
+/*!
+  @brief Mark a received frame in a list of acknowledgement entries.
+  @param packs Pointer to array of entries.
+  @param pcnt Pointer to number of entries in use. Updated when an entry is added.
+  @param maxcnt Number of entries in the array.
+  @param nodeid Node id of the received frame.
+  @param index Rolling index of the received frame (low three bits of head).
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_BUFFER_TO_SMALL if the node
+    is not in the list and there is no room for it, else error code.
+*/
+int
+vscp_ble_ack_mark(vscp_ble_ack_t *packs, uint8_t *pcnt, uint8_t maxcnt, uint16_t nodeid, uint8_t index);
+
+/*!
+  @brief Encode acknowledgement entries into a frame.
+  @param ctx Pointer to the VSCP BLE context (manufacturer code).
+  @param pbuf Pointer to the buffer where the frame will be stored.
+  @param bufsize Size of the buffer.
+  @param packs Pointer to array of entries.
+  @param cnt Number of entries.
+  @return The number of bytes written to the buffer
+    (VSCP_BLE_ACK_FRAME_SIZE(cnt)), or -1 on error.
+*/
+int
+vscp_ble_ack_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, const vscp_ble_ack_t *packs, uint8_t cnt);
+
+/*!
+  @brief Decode the entries of an acknowledgement frame.
+  @param packs Pointer to array that will receive the entries.
+  @param maxcnt Number of entries in the array.
+  @param pbuf Pointer to the frame.
+  @param len Length of the frame.
+  @return Number of entries decoded, or -1 if this is not a valid
+    acknowledgement frame or it holds more than maxcnt entries.
+*/
+int
+vscp_ble_frame_to_ack(vscp_ble_ack_t *packs, uint8_t maxcnt, const uint8_t *pbuf, uint8_t len);
+
+/*!
+  @brief Look up the acknowledgement bitmap for a node in a frame.
+  @param pbuf Pointer to the frame.
+  @param len Length of the frame.
+  @param nodeid Node id to look for.
+  @return The bitmap for the node (zero if the node is not in the frame),
+    or -1 if this is not a valid acknowledgement frame.
+
+  @note Works directly on the frame so that a node can check a received
+  advert without decoding it.
+*/
+int
+vscp_ble_ack_find(const uint8_t *pbuf, uint8_t len, uint16_t nodeid);
+
+/*!
+  @brief Check if a frame acknowledges a frame sent by this node.
+  @param ctx Pointer to the VSCP BLE context (manufacturer code and node id).
+  @param pbuf Pointer to the frame.
+  @param len Length of the frame.
+  @param index Rolling index of the frame sent (low three bits of head).
+  @return 1 if the frame acknowledges it, 0 if not, or -1 if this is not
+    a valid acknowledgement frame with the manufacturer code of the context.
+
+  @note This is what ends a repeat burst early.
+*/
+int
+vscp_ble_ack_check(const vscp_ble_ctx_t *ctx, const uint8_t *pbuf, uint8_t len, uint8_t index);
+
+/*!
+  @brief Set the time base events are stamped against.
+  @param ctx Pointer to the VSCP BLE context.
+  @param id Time base id from the time base frame.
+  @param time_ms Time base in milliseconds since epoch.
+  @param timestamp Clock (microseconds) when the time base was heard.
+    Event timestamps are the low 32 bits of the same clock.
+
+  @note Called by a node when it hears a time base frame. The time base
+  is also remembered for decoding frames from other nodes.
+*/
+void
+vscp_ble_set_time_base(vscp_ble_ctx_t *ctx, uint8_t id, uint64_t time_ms, uint64_t timestamp);
+
+/*!
+  @brief Drop a time base that is too old to stamp events against.
+  @param ctx Pointer to the VSCP BLE context.
+  @param now Clock (microseconds) as given to vscp_ble_set_time_base().
+
+  @note Event timestamps are 32 bits and wrap after about 71 minutes, a
+  time base older than that would give wrong deltas. A node calls this
+  when it captures an event. Time bases older than
+  VSCP_BLE_TIMESTAMP_MAX_MS are dropped, events are not stamped until
+  the next time base is heard.
+*/
+void
+vscp_ble_expire_time_base(vscp_ble_ctx_t *ctx, uint64_t now);
+
+/*!
+  @brief Encode a new time base frame.
+  @param ctx Pointer to the VSCP BLE context (manufacturer code).
+  @param pbuf Pointer to the buffer where the frame will be stored.
+  @param bufsize Size of the buffer.
+  @param time_ms Current time in milliseconds since epoch.
+  @return The number of bytes written to the buffer
+    (VSCP_BLE_TIME_FRAME_SIZE), or -1 on error.
+
+  @note Used by gateways. The frame gets the next time base id and the
+  time base is remembered so that frames stamped against it (or the one
+  before it) can be decoded.
+*/
+int
+vscp_ble_time_to_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint8_t bufsize, uint64_t time_ms);
+
+/*!
+  @brief Decode a time base frame.
+  @param pid Pointer to variable that will receive the time base id.
+  @param ptime_ms Pointer to variable that will receive the time base in
+    milliseconds since epoch.
+  @param pbuf Pointer to the frame.
+  @param len Length of the frame.
+  @return VSCP_ERROR_SUCCESS on success, else error code.
+*/
+int
+vscp_ble_frame_to_time(uint8_t *pid, uint64_t *ptime_ms, const uint8_t *pbuf, uint8_t len);
+
+/*!
+  @brief Get the absolute capture time of an event frame.
+  @param ctx Pointer to the VSCP BLE context.
+  @param pbuf Pointer to the event frame.
+  @param len Length of the frame.
+  @param ptime_ms Pointer to variable that will receive the capture time
+    in milliseconds since epoch.
+  @return VSCP_ERROR_SUCCESS on success, VSCP_ERROR_NOT_SUPPORTED if the
+    frame has no timestamp or it refers to a time base the context does
+    not know, else error code.
+
+  @note A gateway gets the capture to delivery latency of a frame as its
+  own time at reception minus the capture time.
+*/
+int
+vscp_ble_frame_time(const vscp_ble_ctx_t *ctx, const uint8_t *pbuf, uint8_t len, uint64_t *ptime_ms);
+
 // ----------------------------------------------------------------------------
 //                              CALLBACKS
 // ----------------------------------------------------------------------------
@@ -153,4 +461,6 @@ vscp_ble_frame_to_ex(vscp_ble_ctx_t *ctx, vscpEventEx *pex, uint8_t *pbuf, uint8
 */
 
 void
-vscp_ble_cb_fetch_encryption_key(uint8_t *pkey);
\ No newline at end of file
+vscp_ble_cb_fetch_encryption_key(uint8_t *pkey);
+
+#endif // VSCP_BLE_H
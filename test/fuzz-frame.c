@@ -0,0 +1,327 @@
+/*!
+  @file fuzz-frame.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-adv.h"
+#include "vscp-ble-test.h"
+#include "vscp-ble.h"
+
+/*
+  Fuzz target for the frame and advertising data decoders. Every decoder
+  gets the input, and an event frame that decodes must encode and decode
+  back to the same event.
+
+  Built with Clang the target is a libFuzzer binary (fuzz-frame-libfuzzer,
+  VSCP_BLE_LIBFUZZER defined). Otherwise main() below drives it:
+
+    fuzz-frame                 mutated valid frames, FUZZ_ROUNDS inputs
+    fuzz-frame file...         each file is one input (a libFuzzer corpus)
+*/
+
+#define FUZZ_ROUNDS   200000
+#define FUZZ_MAX_SIZE 64 // Longer than any frame or advert
+
+static uint32_t s_decoded; // Event frames decoded, alone or in advertising data
+
+///////////////////////////////////////////////////////////////////////////////
+// check_event
+//
+// A decoded event frame encodes and decodes back to the same event.
+//
+
+static void
+check_event(vscp_ble_ctx_t *ctx, const uint8_t *pdata, size_t size, const vscpEventEx *pex, int len)
+{
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  vscp_ble_ctx_t enc = { 0 };
+  vscpEventEx ex2;
+  int len2;
+
+  if ((len < VSCP_BLE_FRAME_MIN_SIZE) || ((size_t) len > size) || (pex->sizeData > VSCP_BLE_FRAME_MAX_DATA_SIZE)) {
+    abort();
+  }
+
+  // Same node id and rolling index, no time base
+  memcpy(enc.m_guid, ctx->m_guid, 16);
+  enc.m_guid[VSCP_BLE_GUID_POS_NODEID]     = pdata[VSCP_BLE_FRAME_POS_NODEID];
+  enc.m_guid[VSCP_BLE_GUID_POS_NODEID + 1] = pdata[VSCP_BLE_FRAME_POS_NODEID + 1];
+  vscp_ble_set_guid(&enc, enc.m_guid);
+  vscp_ble_set_sequence(&enc, pex->head & 0x07);
+
+  len2 = vscp_ble_ex_to_frame(&enc, frame, sizeof(frame), (vscpEventEx *) pex, 0);
+  if ((len2 < 0) || (vscp_ble_frame_to_ex(&enc, &ex2, frame, (uint8_t) len2) != len2)) {
+    abort();
+  }
+
+  if ((ex2.head != pex->head) || (ex2.vscp_class != pex->vscp_class) || (ex2.vscp_type != pex->vscp_type) ||
+      (ex2.sizeData != pex->sizeData) || memcmp(ex2.data, pex->data, pex->sizeData) ||
+      memcmp(ex2.GUID, pex->GUID, 16)) {
+    abort();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// LLVMFuzzerTestOneInput
+//
+
+int
+LLVMFuzzerTestOneInput(const uint8_t *pdata, size_t size)
+{
+  static vscp_ble_ctx_t ctx;
+  uint8_t data[VSCP_BLE_FRAME_MAX_DATA_SIZE];
+  uint8_t *buf;
+  uint8_t *pcopy;
+  vscp_ble_ack_t acks[8];
+  vscpEventEx ex;
+  vscpEvent ev;
+  const uint8_t *pframe;
+  uint64_t time_ms;
+  uint8_t flen;
+  uint8_t id;
+  int len;
+
+  if (size > FUZZ_MAX_SIZE) {
+    return 0;
+  }
+
+  // The decoders take a non const buffer. The copy is on the heap and of
+  // the exact size so that reads past the end are caught.
+  buf = malloc(size ? size : 1);
+  if (NULL == buf) {
+    abort();
+  }
+  memcpy(buf, pdata, size);
+
+  // Time bases 0 and 1 are known, so timestamps resolve for some inputs
+  if (!(atomic_load(&ctx.m_time_base[0]) & VSCP_BLE_TIME_VALID)) {
+    vscp_ble_set_time_base(&ctx, 0, 1700000000000ULL, 0);
+    vscp_ble_set_time_base(&ctx, 1, 1700000001000ULL, 0);
+  }
+
+  len = vscp_ble_frame_to_ex(&ctx, &ex, buf, (uint8_t) size);
+  if (len >= 0) {
+    check_event(&ctx, buf, size, &ex, len);
+    s_decoded++;
+  }
+
+  ev.pdata = data;
+  if ((vscp_ble_frame_to_ev(&ctx, &ev, buf, (uint8_t) size) != len) ||
+      ((len >= 0) && ((ev.sizeData != ex.sizeData) || memcmp(data, ex.data, ex.sizeData)))) {
+    abort(); // Both decoders agree
+  }
+
+  vscp_ble_frame_time(&ctx, buf, (uint8_t) size, &time_ms);
+  vscp_ble_frame_to_ack(acks, sizeof(acks) / sizeof(acks[0]), buf, (uint8_t) size);
+  vscp_ble_ack_find(buf, (uint8_t) size, 0x0102);
+  vscp_ble_frame_to_time(&id, &time_ms, buf, (uint8_t) size);
+
+  // The frame in advertising data goes through the event decoder as well
+  pframe = vscp_ble_adv_find_frame(buf, (uint8_t) size, &flen);
+  if (NULL != pframe) {
+    if ((pframe < buf) || ((pframe + flen) > (buf + size))) {
+      abort();
+    }
+    pcopy = malloc(flen ? flen : 1);
+    if (NULL == pcopy) {
+      abort();
+    }
+    memcpy(pcopy, pframe, flen);
+    len = vscp_ble_frame_to_ex(&ctx, &ex, pcopy, flen);
+    if (len >= 0) {
+      check_event(&ctx, pcopy, flen, &ex, len);
+      s_decoded++;
+    }
+    free(pcopy);
+  }
+
+  free(buf);
+  return 0;
+}
+
+#ifndef VSCP_BLE_LIBFUZZER
+
+///////////////////////////////////////////////////////////////////////////////
+// fuzz_random
+//
+
+static uint32_t
+fuzz_random(void)
+{
+  static uint32_t state = 0x2545f491;
+
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fuzz_seed
+//
+// A valid frame of a random kind to mutate.
+//
+
+static size_t
+fuzz_seed(uint8_t *pbuf)
+{
+  static vscp_ble_ctx_t ctx;
+  uint8_t data[VSCP_BLE_FRAME_MAX_DATA_SIZE];
+  vscp_ble_ack_t acks[4] = { { 0x0102, 0x81 }, { 0x0304, 0x7e } };
+  vscp_ble_adv_t adv;
+  vscpEvent ev = { 0 };
+  int len;
+
+  for (size_t i = 0; i < sizeof(data); i++) {
+    data[i] = (uint8_t) fuzz_random();
+  }
+  ev.head       = (uint16_t) fuzz_random();
+  ev.vscp_class = (uint16_t) fuzz_random();
+  ev.vscp_type  = (uint16_t) fuzz_random();
+  ev.pdata      = data;
+  ev.sizeData   = fuzz_random() % (VSCP_BLE_FRAME_MAX_DATA_SIZE + 1);
+  ev.timestamp  = fuzz_random() % 70000000;
+  if (0 == (fuzz_random() % 4)) {
+    vscp_ble_set_time_base(&ctx, (uint8_t) fuzz_random(), 1700000000000ULL, 0);
+  }
+
+  switch (fuzz_random() % 6) {
+    case 0:
+      len = vscp_ble_ack_to_frame(&ctx, pbuf, FUZZ_MAX_SIZE, acks, fuzz_random() % 5);
+      break;
+
+    case 1:
+      len = vscp_ble_time_to_frame(&ctx, pbuf, FUZZ_MAX_SIZE, 1700000000000ULL + fuzz_random());
+      break;
+
+    case 2:
+      ev.sizeData = ev.sizeData % 9;
+      vscp_ble_adv_init(&adv, 0x06, (fuzz_random() & 1) ? "VSCP" : NULL);
+      len = vscp_ble_adv_set_event(&adv, &ctx, &ev);
+      if (len > 0) {
+        memcpy(pbuf, adv.m_buf, len);
+      }
+      break;
+
+    default:
+      len = vscp_ble_ev_to_frame(&ctx, pbuf, FUZZ_MAX_SIZE, &ev);
+      break;
+  }
+
+  return (len > 0) ? (size_t) len : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// fuzz_mutate
+//
+// Flips bits, overwrites bytes, truncates or extends the input.
+//
+
+static size_t
+fuzz_mutate(uint8_t *pbuf, size_t size)
+{
+  uint32_t n = 1 + (fuzz_random() % 4);
+
+  while (n--) {
+    uint32_t r = fuzz_random();
+
+    switch (r % 4) {
+      case 0:
+        if (size) {
+          pbuf[(r >> 8) % size] ^= (uint8_t) (1 << ((r >> 3) & 7));
+        }
+        break;
+
+      case 1:
+        if (size) {
+          pbuf[(r >> 8) % size] = (uint8_t) fuzz_random();
+        }
+        break;
+
+      case 2:
+        size = size ? ((r >> 8) % size) : 0;
+        break;
+
+      default:
+        while ((size < FUZZ_MAX_SIZE) && (fuzz_random() & 1)) {
+          pbuf[size++] = (uint8_t) fuzz_random();
+        }
+        break;
+    }
+  }
+
+  return size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(int argc, char *argv[])
+{
+  uint8_t buf[FUZZ_MAX_SIZE];
+  uint64_t start;
+  size_t size;
+
+  if (argc >= 2) {
+    for (int i = 1; i < argc; i++) {
+      FILE *pf = fopen(argv[i], "rb");
+      if (NULL == pf) {
+        perror(argv[i]);
+        return 1;
+      }
+      size = fread(buf, 1, sizeof(buf), pf);
+      fclose(pf);
+      LLVMFuzzerTestOneInput(buf, size);
+    }
+    return 0;
+  }
+
+  start = test_now_ns();
+  for (uint32_t i = 0; i < FUZZ_ROUNDS; i++) {
+    size = fuzz_mutate(buf, fuzz_seed(buf));
+    LLVMFuzzerTestOneInput(buf, size);
+  }
+  test_bench("fuzz_frame_input", (double) (test_now_ns() - start) / FUZZ_ROUNDS, "ns");
+  test_bench("fuzz_frame_decoded", (100.0 * s_decoded) / FUZZ_ROUNDS, "%");
+
+  // A good share of the inputs must get past the checks
+  TEST_CHECK(s_decoded > (FUZZ_ROUNDS / 5));
+
+  return TEST_RESULT();
+}
+
+#endif // VSCP_BLE_LIBFUZZER
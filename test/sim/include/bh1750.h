@@ -0,0 +1,7 @@
+// Simulation stand-in for the sensor driver header (test builds only). The
+// node samples a counter, the sensor is not used.
+
+#ifndef BH1750_H
+#define BH1750_H
+
+#endif // BH1750_H
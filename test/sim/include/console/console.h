@@ -0,0 +1,6 @@
+// Simulation stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#endif // CONSOLE_H
@@ -0,0 +1,22 @@
+// Simulation stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_DEFAULT (1 << 12)
+
+// A heap of SIM_HEAP_SIZE bytes less what the process has allocated.
+// The largest block is the free size, fragmentation is not modelled.
+size_t
+heap_caps_get_free_size(uint32_t caps);
+
+size_t
+heap_caps_get_minimum_free_size(uint32_t caps);
+
+size_t
+heap_caps_get_largest_free_block(uint32_t caps);
+
+#endif // ESP_HEAP_CAPS_H
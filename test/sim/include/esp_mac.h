@@ -0,0 +1,9 @@
+// Simulation stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef ESP_MAC_H
+#define ESP_MAC_H
+
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
+#define MACSTR     "%02x:%02x:%02x:%02x:%02x:%02x"
+
+#endif // ESP_MAC_H
@@ -0,0 +1,10 @@
+// Simulation stand-in for the ESP-IDF example header of the same name (test builds only)
+
+#ifndef H_ESP_PERIPHERAL_
+#define H_ESP_PERIPHERAL_
+
+// There is no console in the simulation, every call times out
+int
+scli_receive_key(int *key);
+
+#endif // H_ESP_PERIPHERAL_
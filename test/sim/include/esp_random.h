@@ -0,0 +1,12 @@
+// Simulation stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef ESP_RANDOM_H
+#define ESP_RANDOM_H
+
+#include <stdint.h>
+
+// Seeded pseudo random numbers so that runs repeat, see sim_seed()
+uint32_t
+esp_random(void);
+
+#endif // ESP_RANDOM_H
@@ -0,0 +1,8 @@
+// Simulation stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef ESP_SYSTEM_H
+#define ESP_SYSTEM_H
+
+#include "esp_err.h"
+
+#endif // ESP_SYSTEM_H
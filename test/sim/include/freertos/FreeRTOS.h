@@ -0,0 +1,39 @@
+// Simulation stand-in for the FreeRTOS header of the same name (test builds only).
+// Tasks run one at a time on virtual time, see sim.h.
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE       ((BaseType_t) 0)
+#define pdTRUE        ((BaseType_t) 1)
+#define pdPASS        pdTRUE
+#define pdFAIL        pdFALSE
+#define errQUEUE_FULL ((BaseType_t) 0)
+
+#define configTICK_RATE_HZ   100
+#define configMAX_PRIORITIES 25
+#define portMAX_DELAY        ((TickType_t) 0xffffffffUL)
+#define portTICK_PERIOD_MS   ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)    ((TickType_t) (((TickType_t) (ms) * (TickType_t) configTICK_RATE_HZ) / (TickType_t) 1000U))
+
+#define configASSERT(x) assert(x)
+
+// Only one task runs at a time, a critical section is a plain mutex
+typedef struct {
+  pthread_mutex_t m_mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_MUTEX_INITIALIZER }
+
+#define taskENTER_CRITICAL(pmux) pthread_mutex_lock(&(pmux)->m_mutex)
+#define taskEXIT_CRITICAL(pmux)  pthread_mutex_unlock(&(pmux)->m_mutex)
+
+#endif // FREERTOS_H
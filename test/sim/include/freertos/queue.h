@@ -0,0 +1,25 @@
+// Simulation stand-in for the FreeRTOS header of the same name (test builds only)
+
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_queue *QueueHandle_t;
+
+QueueHandle_t
+xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+void
+vQueueDelete(QueueHandle_t queue);
+
+BaseType_t
+xQueueSend(QueueHandle_t queue, const void *pitem, TickType_t ticks);
+
+BaseType_t
+xQueueReceive(QueueHandle_t queue, void *pitem, TickType_t ticks);
+
+UBaseType_t
+uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif // QUEUE_H
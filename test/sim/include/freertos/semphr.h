@@ -0,0 +1,34 @@
+// Simulation stand-in for the FreeRTOS header of the same name (test builds only)
+
+#ifndef SEMPHR_H
+#define SEMPHR_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_sem *SemaphoreHandle_t;
+
+SemaphoreHandle_t
+xSemaphoreCreateMutex(void);
+
+SemaphoreHandle_t
+xSemaphoreCreateRecursiveMutex(void);
+
+SemaphoreHandle_t
+xSemaphoreCreateBinary(void);
+
+void
+vSemaphoreDelete(SemaphoreHandle_t sem);
+
+BaseType_t
+xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks);
+
+BaseType_t
+xSemaphoreGive(SemaphoreHandle_t sem);
+
+BaseType_t
+xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks);
+
+BaseType_t
+xSemaphoreGiveRecursive(SemaphoreHandle_t sem);
+
+#endif // SEMPHR_H
@@ -0,0 +1,72 @@
+// Simulation stand-in for the FreeRTOS header of the same name (test builds only)
+
+#ifndef TASK_H
+#define TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+typedef enum {
+  eRunning = 0,
+  eReady,
+  eBlocked,
+  eSuspended,
+  eDeleted,
+  eInvalid
+} eTaskState;
+
+// Fields the firmware uses
+typedef struct xTASK_STATUS {
+  TaskHandle_t xHandle;
+  const char *pcTaskName;
+  eTaskState eCurrentState;
+  UBaseType_t uxCurrentPriority;
+  uint32_t ulRunTimeCounter;
+  uint32_t usStackHighWaterMark;
+} TaskStatus_t;
+
+BaseType_t
+xTaskCreate(TaskFunction_t fn,
+            const char *name,
+            uint32_t stack_depth,
+            void *param,
+            UBaseType_t priority,
+            TaskHandle_t *phandle);
+
+BaseType_t
+xTaskCreatePinnedToCore(TaskFunction_t fn,
+                        const char *name,
+                        uint32_t stack_depth,
+                        void *param,
+                        UBaseType_t priority,
+                        TaskHandle_t *phandle,
+                        BaseType_t core);
+
+void
+vTaskDelete(TaskHandle_t task);
+
+void
+vTaskDelay(TickType_t ticks);
+
+TickType_t
+xTaskGetTickCount(void);
+
+TaskHandle_t
+xTaskGetCurrentTaskHandle(void);
+
+uint32_t
+ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+BaseType_t
+xTaskNotifyGive(TaskHandle_t task);
+
+// Run time counters are thread CPU time in microseconds. There is no idle
+// task, so the total is the sum over the tasks. Host stacks are not
+// measured, the high-water mark is the stack depth the task was created
+// with.
+UBaseType_t
+uxTaskGetSystemState(TaskStatus_t *pstatus, UBaseType_t size, uint32_t *ptotal);
+
+#endif // TASK_H
@@ -0,0 +1,482 @@
+// Simulation stand-in for the NimBLE header of the same name (test builds only).
+// Declares the part of the host API the node uses, with the NimBLE names
+// and values. The host and the controller are modelled in sim-nimble.c.
+
+#ifndef H_BLE_HS_
+#define H_BLE_HS_
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "host/ble_uuid.h"
+#include "nimble/ble.h"
+
+#define MYNEWT_VAL(x)                   MYNEWT_VAL_##x
+#define MYNEWT_VAL_BLE_POWER_CONTROL    0
+#define MYNEWT_VAL_BLE_PERIODIC_ADV_ENH 0
+
+// Host log, formatted but dropped to keep the test output readable
+void
+sim_modlog(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+#define MODLOG_DFLT(ml_lvl_, ...) sim_modlog(__VA_ARGS__)
+
+// Host error codes
+#define BLE_HS_EAGAIN      1
+#define BLE_HS_EALREADY    2
+#define BLE_HS_EINVAL      3
+#define BLE_HS_EMSGSIZE    4
+#define BLE_HS_ENOENT      5
+#define BLE_HS_ENOMEM      6
+#define BLE_HS_ENOTCONN    7
+#define BLE_HS_ENOTSUP     8
+#define BLE_HS_ETIMEOUT    13
+#define BLE_HS_EDONE       14
+#define BLE_HS_EBUSY       15
+#define BLE_HS_ERR_ATT_BASE 0x100
+
+#define BLE_HS_FOREVER          INT32_MAX
+#define BLE_HS_CONN_HANDLE_NONE 0xffff
+
+// ATT
+#define BLE_ATT_MTU_DFLT     23
+#define BLE_ATT_ATTR_MAX_LEN 512
+
+#define BLE_ATT_ERR_INVALID_HANDLE         0x01
+#define BLE_ATT_ERR_READ_NOT_PERMITTED     0x02
+#define BLE_ATT_ERR_WRITE_NOT_PERMITTED    0x03
+#define BLE_ATT_ERR_INSUFFICIENT_AUTHEN    0x05
+#define BLE_ATT_ERR_REQ_NOT_SUPPORTED      0x06
+#define BLE_ATT_ERR_INVALID_OFFSET         0x07
+#define BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN 0x0d
+#define BLE_ATT_ERR_UNLIKELY               0x0e
+#define BLE_ATT_ERR_INSUFFICIENT_ENC       0x0f
+#define BLE_ATT_ERR_INSUFFICIENT_RES       0x11
+
+#define BLE_ATT_F_READ      0x01
+#define BLE_ATT_F_WRITE     0x02
+#define BLE_ATT_F_READ_ENC  0x04
+#define BLE_ATT_F_WRITE_ENC 0x20
+
+// Advertising
+#define BLE_HS_ADV_F_DISC_LTD    0x01
+#define BLE_HS_ADV_F_DISC_GEN    0x02
+#define BLE_HS_ADV_F_BREDR_UNSUP 0x04
+
+#define BLE_HS_ADV_MAX_SZ 31
+
+#define BLE_GAP_CONN_MODE_NON 0
+#define BLE_GAP_CONN_MODE_DIR 1
+#define BLE_GAP_CONN_MODE_UND 2
+
+#define BLE_GAP_DISC_MODE_NON 0
+#define BLE_GAP_DISC_MODE_LTD 1
+#define BLE_GAP_DISC_MODE_GEN 2
+
+#define BLE_HCI_ADV_ITVL         625 // us
+#define BLE_HCI_SCAN_ITVL        625 // us
+#define BLE_GAP_ADV_ITVL_MS(t)   ((t) * 1000 / BLE_HCI_ADV_ITVL)
+#define BLE_GAP_SCAN_ITVL_MS(t)  ((t) * 1000 / BLE_HCI_SCAN_ITVL)
+#define BLE_GAP_SCAN_WIN_MS(t)   ((t) * 1000 / BLE_HCI_SCAN_ITVL)
+#define BLE_GAP_ADV_FAST_ITVL_MS 30 // Interval used when none is given
+
+#define BLE_HCI_LE_PHY_1M 1
+#define BLE_HCI_LE_PHY_2M 2
+
+// Security manager
+#define BLE_SM_IOACT_NONE   0
+#define BLE_SM_IOACT_OOB    1
+#define BLE_SM_IOACT_INPUT  2
+#define BLE_SM_IOACT_DISP   3
+#define BLE_SM_IOACT_NUMCMP 4
+
+#define BLE_SM_PAIR_KEY_DIST_ENC 0x01
+#define BLE_SM_PAIR_KEY_DIST_ID  0x02
+
+// GAP events
+#define BLE_GAP_EVENT_CONNECT            0
+#define BLE_GAP_EVENT_DISCONNECT         1
+#define BLE_GAP_EVENT_CONN_UPDATE        3
+#define BLE_GAP_EVENT_DISC               7
+#define BLE_GAP_EVENT_DISC_COMPLETE      8
+#define BLE_GAP_EVENT_ADV_COMPLETE       9
+#define BLE_GAP_EVENT_ENC_CHANGE         10
+#define BLE_GAP_EVENT_PASSKEY_ACTION     11
+#define BLE_GAP_EVENT_NOTIFY_TX          13
+#define BLE_GAP_EVENT_SUBSCRIBE          14
+#define BLE_GAP_EVENT_MTU                15
+#define BLE_GAP_EVENT_REPEAT_PAIRING     17
+#define BLE_GAP_EVENT_AUTHORIZE          32
+#define BLE_GAP_EVENT_LINK_ESTAB         38
+
+#define BLE_GAP_REPEAT_PAIRING_RETRY  1
+#define BLE_GAP_REPEAT_PAIRING_IGNORE 2
+
+#define BLE_GAP_AUTHORIZE_ACCEPT 1
+#define BLE_GAP_AUTHORIZE_REJECT 2
+
+#define BLE_GAP_SUBSCRIBE_REASON_WRITE 1
+
+// GATT
+#define BLE_GATT_SVC_TYPE_END       0
+#define BLE_GATT_SVC_TYPE_PRIMARY   1
+#define BLE_GATT_SVC_TYPE_SECONDARY 2
+
+#define BLE_GATT_CHR_F_READ         0x0002
+#define BLE_GATT_CHR_F_WRITE_NO_RSP 0x0004
+#define BLE_GATT_CHR_F_WRITE        0x0008
+#define BLE_GATT_CHR_F_NOTIFY       0x0010
+#define BLE_GATT_CHR_F_INDICATE     0x0020
+#define BLE_GATT_CHR_F_READ_ENC     0x0200
+#define BLE_GATT_CHR_F_WRITE_ENC    0x1000
+
+#define BLE_GATT_ACCESS_OP_READ_CHR  0
+#define BLE_GATT_ACCESS_OP_WRITE_CHR 1
+#define BLE_GATT_ACCESS_OP_READ_DSC  2
+#define BLE_GATT_ACCESS_OP_WRITE_DSC 3
+
+#define BLE_GATT_REGISTER_OP_SVC 1
+#define BLE_GATT_REGISTER_OP_CHR 2
+#define BLE_GATT_REGISTER_OP_DSC 3
+
+// Flat buffer in place of the NimBLE mbuf chain
+#define SIM_MBUF_SIZE 1024
+
+struct os_mbuf {
+  uint8_t *om_data;
+  uint16_t om_len;
+  uint8_t m_buf[SIM_MBUF_SIZE];
+};
+
+#define OS_MBUF_PKTLEN(om) ((om)->om_len)
+
+struct os_mbuf *
+os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len);
+
+int
+os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len);
+
+int
+os_mbuf_free_chain(struct os_mbuf *om);
+
+struct os_mbuf *
+ble_hs_mbuf_from_flat(const void *buf, uint16_t len);
+
+int
+ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len);
+
+// GAP
+struct ble_hs_adv_fields {
+  uint8_t flags;
+  const uint8_t *name;
+  uint8_t name_len;
+  unsigned name_is_complete : 1;
+  const uint8_t *device_addr;
+  uint8_t device_addr_type;
+  unsigned device_addr_is_present : 1;
+  const uint8_t *mfg_data;
+  uint8_t mfg_data_len;
+};
+
+struct ble_gap_adv_params {
+  uint8_t conn_mode;
+  uint8_t disc_mode;
+  uint16_t itvl_min;
+  uint16_t itvl_max;
+  uint8_t channel_map;
+  uint8_t filter_policy;
+  uint8_t high_duty_cycle : 1;
+};
+
+struct ble_gap_disc_params {
+  uint16_t itvl;
+  uint16_t window;
+  uint8_t filter_policy;
+  uint8_t limited : 1;
+  uint8_t passive : 1;
+  uint8_t filter_duplicates : 1;
+};
+
+struct ble_gap_sec_state {
+  unsigned encrypted : 1;
+  unsigned authenticated : 1;
+  unsigned bonded : 1;
+  unsigned key_size : 5;
+};
+
+struct ble_gap_conn_desc {
+  struct ble_gap_sec_state sec_state;
+  ble_addr_t our_id_addr;
+  ble_addr_t peer_id_addr;
+  ble_addr_t our_ota_addr;
+  ble_addr_t peer_ota_addr;
+  uint16_t conn_handle;
+  uint16_t conn_itvl;
+  uint16_t conn_latency;
+  uint16_t supervision_timeout;
+  uint8_t role;
+  uint8_t master_clock_accuracy;
+};
+
+struct ble_gap_disc_desc {
+  uint8_t event_type;
+  uint8_t length_data;
+  ble_addr_t addr;
+  int8_t rssi;
+  const uint8_t *data;
+  ble_addr_t direct_addr;
+};
+
+struct ble_gap_passkey_params {
+  uint8_t action;
+  uint32_t numcmp;
+};
+
+struct ble_gap_event {
+  uint8_t type;
+  union {
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } connect;
+    struct {
+      int reason;
+      struct ble_gap_conn_desc conn;
+    } disconnect;
+    struct ble_gap_disc_desc disc;
+    struct {
+      int reason;
+    } disc_complete;
+    struct {
+      int reason;
+    } adv_complete;
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } conn_update;
+    struct {
+      int status;
+      uint16_t conn_handle;
+    } enc_change;
+    struct {
+      uint16_t conn_handle;
+      struct ble_gap_passkey_params params;
+    } passkey;
+    struct {
+      int status;
+      uint16_t conn_handle;
+      uint16_t attr_handle;
+      uint8_t indication : 1;
+    } notify_tx;
+    struct {
+      uint16_t conn_handle;
+      uint16_t attr_handle;
+      uint8_t reason;
+      uint8_t prev_notify : 1;
+      uint8_t cur_notify : 1;
+      uint8_t prev_indicate : 1;
+      uint8_t cur_indicate : 1;
+    } subscribe;
+    struct {
+      uint16_t conn_handle;
+      uint16_t channel_id;
+      uint16_t value;
+    } mtu;
+    struct {
+      uint16_t conn_handle;
+      uint8_t cur_key_size;
+      uint8_t cur_authenticated : 1;
+      uint8_t cur_sc : 1;
+      uint8_t new_key_size;
+      uint8_t new_authenticated : 1;
+      uint8_t new_sc : 1;
+      uint8_t new_bonding : 1;
+    } repeat_pairing;
+    struct {
+      uint16_t conn_handle;
+      uint16_t attr_handle;
+      int is_read;
+      int out_response;
+    } authorize;
+  };
+};
+
+typedef int
+ble_gap_event_fn(struct ble_gap_event *event, void *arg);
+
+int
+ble_gap_adv_set_data(const uint8_t *data, int data_len);
+
+int
+ble_gap_adv_rsp_set_fields(const struct ble_hs_adv_fields *rsp_fields);
+
+int
+ble_gap_adv_start(uint8_t own_addr_type,
+                  const ble_addr_t *direct_addr,
+                  int32_t duration_ms,
+                  const struct ble_gap_adv_params *adv_params,
+                  ble_gap_event_fn *cb,
+                  void *cb_arg);
+
+int
+ble_gap_adv_stop(void);
+
+int
+ble_gap_adv_active(void);
+
+int
+ble_gap_disc(uint8_t own_addr_type,
+             int32_t duration_ms,
+             const struct ble_gap_disc_params *disc_params,
+             ble_gap_event_fn *cb,
+             void *cb_arg);
+
+int
+ble_gap_disc_cancel(void);
+
+int
+ble_gap_disc_active(void);
+
+int
+ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc);
+
+// ATT MTU of a connection, zero if it is not connected
+uint16_t
+ble_att_mtu(uint16_t conn_handle);
+
+// Identity
+int
+ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type);
+
+int
+ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa);
+
+// Security manager and bond store
+struct ble_sm_io {
+  uint8_t action;
+  union {
+    uint32_t passkey;
+    uint8_t oob[16];
+    uint8_t numcmp_accept;
+  };
+};
+
+int
+ble_sm_inject_io(uint16_t conn_handle, struct ble_sm_io *pkey);
+
+struct ble_store_status_event;
+
+typedef int
+ble_store_status_fn(struct ble_store_status_event *event, void *arg);
+
+int
+ble_store_util_status_rr(struct ble_store_status_event *event, void *arg);
+
+int
+ble_store_util_delete_peer(const ble_addr_t *peer_id_addr);
+
+// GATT server
+struct ble_gatt_access_ctxt;
+
+typedef int
+ble_gatt_access_fn(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+struct ble_gatt_dsc_def {
+  const ble_uuid_t *uuid;
+  uint8_t att_flags;
+  uint8_t min_key_size;
+  ble_gatt_access_fn *access_cb;
+  void *arg;
+};
+
+struct ble_gatt_chr_def {
+  const ble_uuid_t *uuid;
+  ble_gatt_access_fn *access_cb;
+  void *arg;
+  struct ble_gatt_dsc_def *descriptors;
+  uint16_t flags;
+  uint8_t min_key_size;
+  uint16_t *val_handle;
+};
+
+struct ble_gatt_svc_def {
+  uint8_t type;
+  const ble_uuid_t *uuid;
+  const struct ble_gatt_svc_def **includes;
+  const struct ble_gatt_chr_def *characteristics;
+};
+
+struct ble_gatt_access_ctxt {
+  uint8_t op;
+  struct os_mbuf *om;
+  union {
+    const struct ble_gatt_chr_def *chr;
+    const struct ble_gatt_dsc_def *dsc;
+  };
+  uint16_t offset;
+};
+
+struct ble_gatt_register_ctxt {
+  uint8_t op;
+  union {
+    struct {
+      uint16_t handle;
+      const struct ble_gatt_svc_def *svc_def;
+    } svc;
+    struct {
+      uint16_t def_handle;
+      uint16_t val_handle;
+      const struct ble_gatt_chr_def *chr_def;
+      const struct ble_gatt_svc_def *svc_def;
+    } chr;
+    struct {
+      uint16_t handle;
+      const struct ble_gatt_dsc_def *dsc_def;
+      const struct ble_gatt_chr_def *chr_def;
+      const struct ble_gatt_svc_def *svc_def;
+    } dsc;
+  };
+};
+
+typedef void
+ble_gatt_register_fn(struct ble_gatt_register_ctxt *ctxt, void *arg);
+
+int
+ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs);
+
+int
+ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs);
+
+void
+ble_gatts_chr_updated(uint16_t chr_val_handle);
+
+// Host configuration
+typedef void
+ble_hs_reset_fn(int reason);
+
+typedef void
+ble_hs_sync_fn(void);
+
+struct ble_hs_cfg {
+  ble_hs_reset_fn *reset_cb;
+  ble_hs_sync_fn *sync_cb;
+  ble_gatt_register_fn *gatts_register_cb;
+  void *gatts_register_arg;
+  ble_store_status_fn *store_status_cb;
+  void *store_status_arg;
+  uint8_t sm_io_cap;
+  unsigned sm_oob_data_flag : 1;
+  unsigned sm_bonding : 1;
+  unsigned sm_mitm : 1;
+  unsigned sm_sc : 1;
+  unsigned sm_keypress : 1;
+  uint8_t sm_our_key_dist;
+  uint8_t sm_their_key_dist;
+};
+
+extern struct ble_hs_cfg ble_hs_cfg;
+
+#endif // H_BLE_HS_
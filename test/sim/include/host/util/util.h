@@ -0,0 +1,9 @@
+// Simulation stand-in for the NimBLE header of the same name (test builds only)
+
+#ifndef H_BLE_HS_UTIL_
+#define H_BLE_HS_UTIL_
+
+int
+ble_hs_util_ensure_addr(int prefer_random);
+
+#endif // H_BLE_HS_UTIL_
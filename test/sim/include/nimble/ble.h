@@ -0,0 +1,16 @@
+// Simulation stand-in for the NimBLE header of the same name (test builds only)
+
+#ifndef H_BLE_
+#define H_BLE_
+
+#include <stdint.h>
+
+#define BLE_ADDR_PUBLIC 0x00
+#define BLE_ADDR_RANDOM 0x01
+
+typedef struct {
+  uint8_t type;
+  uint8_t val[6];
+} ble_addr_t;
+
+#endif // H_BLE_
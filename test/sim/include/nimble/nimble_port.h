@@ -0,0 +1,17 @@
+// Simulation stand-in for the NimBLE header of the same name (test builds only)
+
+#ifndef _NIMBLE_PORT_H
+#define _NIMBLE_PORT_H
+
+#include "esp_err.h"
+
+esp_err_t
+nimble_port_init(void);
+
+void
+nimble_port_run(void);
+
+int
+nimble_port_stop(void);
+
+#endif // _NIMBLE_PORT_H
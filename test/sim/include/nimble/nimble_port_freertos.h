@@ -0,0 +1,16 @@
+// Simulation stand-in for the NimBLE header of the same name (test builds only)
+
+#ifndef _NIMBLE_PORT_FREERTOS_H
+#define _NIMBLE_PORT_FREERTOS_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Creates the host task
+void
+nimble_port_freertos_init(TaskFunction_t host_task_fn);
+
+void
+nimble_port_freertos_deinit(void);
+
+#endif // _NIMBLE_PORT_FREERTOS_H
@@ -0,0 +1,41 @@
+// Simulation stand-in for the generated sdkconfig.h (test builds only).
+// Kconfig defaults with advertising statistics, adaptive advertising and
+// the profiler on, so that the listen window, the load control and the
+// profiler characteristic run as well. A test can select other options
+// with compile definitions.
+
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+#define CONFIG_BT_NIMBLE_MAX_CONNECTIONS 3
+#define CONFIG_EXAMPLE_IO_TYPE           3
+
+#define CONFIG_VSCP_BLE_CFG_FLUSH_IDLE_MS   2000
+#define CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS    30000
+#define CONFIG_VSCP_BLE_QUEUE_SIZE          16
+#define CONFIG_VSCP_BLE_QUEUE_ALARM_RESERVE 4
+#define CONFIG_VSCP_BLE_POOL_SIZE           20
+
+#ifndef CONFIG_VSCP_BLE_ADV_STATS
+#define CONFIG_VSCP_BLE_ADV_STATS 1
+#endif
+#define CONFIG_VSCP_BLE_ADV_STATS_LOG_INTERVAL 60
+
+#ifndef CONFIG_VSCP_BLE_ADAPTIVE_ADV
+#define CONFIG_VSCP_BLE_ADAPTIVE_ADV 1
+#endif
+#define CONFIG_VSCP_BLE_ADAPTIVE_ITVL_MAX_MS 1000
+#define CONFIG_VSCP_BLE_ADAPTIVE_REPEAT_MIN  1
+#define CONFIG_VSCP_BLE_ADAPTIVE_REPEAT_MAX  5
+#define CONFIG_VSCP_BLE_ADAPTIVE_LOAD_LOW    50
+#define CONFIG_VSCP_BLE_ADAPTIVE_LOAD_HIGH   200
+
+#define CONFIG_VSCP_BLE_LISTEN_MS 100
+
+#ifndef CONFIG_VSCP_BLE_PROFILER
+#define CONFIG_VSCP_BLE_PROFILER 1
+#endif
+#define CONFIG_VSCP_BLE_PROFILER_PERIOD_MS 1000
+#define CONFIG_VSCP_BLE_PROFILER_MAX_TASKS 16
+
+#endif // SDKCONFIG_H
@@ -0,0 +1,9 @@
+// Simulation stand-in for the NimBLE header of the same name (test builds only)
+
+#ifndef H_BLE_SVC_ANS_
+#define H_BLE_SVC_ANS_
+
+void
+ble_svc_ans_init(void);
+
+#endif // H_BLE_SVC_ANS_
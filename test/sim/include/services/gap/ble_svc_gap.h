@@ -0,0 +1,15 @@
+// Simulation stand-in for the NimBLE header of the same name (test builds only)
+
+#ifndef H_BLE_SVC_GAP_
+#define H_BLE_SVC_GAP_
+
+void
+ble_svc_gap_init(void);
+
+int
+ble_svc_gap_device_name_set(const char *name);
+
+const char *
+ble_svc_gap_device_name(void);
+
+#endif // H_BLE_SVC_GAP_
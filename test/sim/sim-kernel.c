@@ -0,0 +1,1037 @@
+/*!
+  @file sim-kernel.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <assert.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include "stubs.h"
+
+#include "sim.h"
+
+#define SIM_TASK_NAME_SIZE 16
+#define SIM_TICK_US        (portTICK_PERIOD_MS * 1000LL)
+#define SIM_HEAP_SIZE      (300 * 1024) // Heap of the heap_caps_*() stand-ins
+
+typedef enum sim_task_state {
+  SIM_TASK_READY = 0, // Waiting for the CPU
+  SIM_TASK_RUNNING,   // Has the CPU
+  SIM_TASK_BLOCKED,   // Waiting for an object or a timeout
+  SIM_TASK_DONE       // Returned or deleted
+} sim_task_state_t;
+
+struct sim_task {
+  struct sim_task *m_next;        // Next task in the task list
+  pthread_t m_thread;             // Thread running the task
+  pthread_cond_t m_cond;          // Signalled when the task gets the CPU
+  char m_name[SIM_TASK_NAME_SIZE]; // Task name
+  TaskFunction_t m_fn;            // Task function
+  void *m_param;                  // Task function argument
+  UBaseType_t m_priority;         // Priority, higher runs first
+  uint32_t m_stack_depth;         // Stack depth given at creation
+  sim_task_state_t m_state;       // Scheduling state
+  uint64_t m_ready_seq;           // Order of getting ready, FIFO within a priority
+  const void *m_wait;             // Object blocked on, NULL for a delay
+  int64_t m_wake_us;              // Timeout when blocked, -1 for none
+  bool m_bTimedOut;               // Woken by the timeout
+  uint32_t m_notify;              // Notification value
+  int64_t m_cpu_start_ns;         // Thread CPU time when last given the CPU
+  sim_task_stats_t m_stats;       // Statistics
+};
+
+struct sim_queue {
+  uint8_t *m_items;       // Item storage
+  UBaseType_t m_length;   // Most items
+  UBaseType_t m_itemsize; // Item size
+  UBaseType_t m_head;     // Oldest item
+  UBaseType_t m_count;    // Items queued
+  uint8_t m_recv_wait;    // Receivers block on this
+  uint8_t m_send_wait;    // Senders block on this
+};
+
+typedef enum sim_sem_kind {
+  SIM_SEM_MUTEX = 0,
+  SIM_SEM_RECURSIVE,
+  SIM_SEM_BINARY
+} sim_sem_kind_t;
+
+struct sim_sem {
+  sim_sem_kind_t m_kind;     // Kind of semaphore
+  struct sim_task *m_owner;  // Holder of a mutex
+  UBaseType_t m_count;       // Mutex depth, or count of a binary semaphore
+  uint8_t m_wait;            // Takers block on this
+};
+
+// The kernel lock guards all scheduler state. The running task holds it
+// only inside the kernel calls, the scheduler waits on it otherwise.
+static pthread_mutex_t s_lock     = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_sched_cond = PTHREAD_COND_INITIALIZER;
+
+static struct sim_task *s_tasks;   // All tasks, in creation order
+static struct sim_task *s_current; // Running task, NULL in the scheduler
+static uint64_t s_ready_seq;
+static sim_timer_t *s_timers; // Armed timers, earliest first
+
+static size_t s_heap_min_free = SIM_HEAP_SIZE;
+
+static uint64_t s_rand_fw    = 0x9e3779b97f4a7c15ULL; // esp_random()
+static uint64_t s_rand_model = 0xd1b54a32d192ed03ULL; // sim_random()
+
+///////////////////////////////////////////////////////////////////////////////
+// thread_cpu_ns
+//
+
+static int64_t
+thread_cpu_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xorshift
+//
+
+static uint32_t
+xorshift(uint64_t *pstate)
+{
+  uint64_t x = *pstate;
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *pstate = x;
+  return (uint32_t) ((x * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// make_ready
+//
+
+static void
+make_ready(struct sim_task *ptask)
+{
+  ptask->m_state     = SIM_TASK_READY;
+  ptask->m_wait      = NULL;
+  ptask->m_wake_us   = -1;
+  ptask->m_ready_seq = s_ready_seq++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// wake_waiters
+//
+// Makes all tasks blocked on an object ready. They check the object
+// again when they run.
+//
+
+static void
+wake_waiters(const void *pobj)
+{
+  for (struct sim_task *ptask = s_tasks; NULL != ptask; ptask = ptask->m_next) {
+    if ((SIM_TASK_BLOCKED == ptask->m_state) && (pobj == ptask->m_wait)) {
+      ptask->m_bTimedOut = false;
+      make_ready(ptask);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// pick_ready
+//
+
+static struct sim_task *
+pick_ready(void)
+{
+  struct sim_task *pbest = NULL;
+
+  for (struct sim_task *ptask = s_tasks; NULL != ptask; ptask = ptask->m_next) {
+    if (SIM_TASK_READY != ptask->m_state) {
+      continue;
+    }
+    if ((NULL == pbest) || (ptask->m_priority > pbest->m_priority) ||
+        ((ptask->m_priority == pbest->m_priority) && (ptask->m_ready_seq < pbest->m_ready_seq))) {
+      pbest = ptask;
+    }
+  }
+
+  return pbest;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// task_switch
+//
+// Gives the CPU back to the scheduler and waits until the task is picked
+// again. The caller holds the kernel lock and has set the task state.
+//
+
+static void
+task_switch(struct sim_task *self)
+{
+  self->m_stats.m_cpu_ns += thread_cpu_ns() - self->m_cpu_start_ns;
+  self->m_stats.m_switches++;
+
+  s_current = NULL;
+  pthread_cond_signal(&s_sched_cond);
+  while (s_current != self) {
+    pthread_cond_wait(&self->m_cond, &s_lock);
+  }
+
+  self->m_cpu_start_ns = thread_cpu_ns();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// task_block
+//
+// Blocks the running task on an object for at most ticks. Returns false
+// on timeout. The caller holds the kernel lock and checks the object
+// again afterwards.
+//
+
+static bool
+task_block(const void *pobj, TickType_t ticks)
+{
+  struct sim_task *self = s_current;
+
+  if (0 == ticks) {
+    return false;
+  }
+
+  // Only tasks block, timers and the scheduler poll with zero ticks
+  assert(NULL != self);
+
+  self->m_state     = SIM_TASK_BLOCKED;
+  self->m_wait      = pobj;
+  self->m_bTimedOut = false;
+  self->m_wake_us   = -1;
+  if (portMAX_DELAY != ticks) {
+    // Woken by the tick interrupt, like FreeRTOS
+    self->m_wake_us = ((esp_timer_get_time() / SIM_TICK_US) + ticks) * SIM_TICK_US;
+  }
+
+  task_switch(self);
+
+  return !self->m_bTimedOut;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// task_preempt
+//
+// Lets a task of higher priority that has become ready run before the
+// running task continues.
+//
+
+static void
+task_preempt(void)
+{
+  struct sim_task *self = s_current;
+  struct sim_task *pnext;
+
+  if (NULL == self) {
+    return;
+  }
+
+  pnext = pick_ready();
+  if ((NULL != pnext) && (pnext->m_priority > self->m_priority)) {
+    make_ready(self);
+    task_switch(self);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// task_exit
+//
+
+static void
+task_exit(struct sim_task *self)
+{
+  pthread_mutex_lock(&s_lock);
+  self->m_stats.m_cpu_ns += thread_cpu_ns() - self->m_cpu_start_ns;
+  self->m_state = SIM_TASK_DONE;
+  s_current     = NULL;
+  pthread_cond_signal(&s_sched_cond);
+  pthread_mutex_unlock(&s_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// task_thread
+//
+
+static void *
+task_thread(void *arg)
+{
+  struct sim_task *self = arg;
+
+  pthread_mutex_lock(&s_lock);
+  while (s_current != self) {
+    pthread_cond_wait(&self->m_cond, &s_lock);
+  }
+  self->m_cpu_start_ns = thread_cpu_ns();
+  pthread_mutex_unlock(&s_lock);
+
+  // A task that returns is deleted, like the ESP-IDF main task
+  self->m_fn(self->m_param);
+  task_exit(self);
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xTaskCreate
+//
+
+BaseType_t
+xTaskCreate(TaskFunction_t fn,
+            const char *name,
+            uint32_t stack_depth,
+            void *param,
+            UBaseType_t priority,
+            TaskHandle_t *phandle)
+{
+  struct sim_task *ptask;
+  struct sim_task **pp;
+  pthread_attr_t attr;
+
+  ptask = calloc(1, sizeof(struct sim_task));
+  if (NULL == ptask) {
+    return pdFAIL;
+  }
+
+  strncpy(ptask->m_name, name, sizeof(ptask->m_name) - 1);
+  ptask->m_fn          = fn;
+  ptask->m_param       = param;
+  ptask->m_priority    = priority;
+  ptask->m_stack_depth = stack_depth;
+  pthread_cond_init(&ptask->m_cond, NULL);
+
+  pthread_mutex_lock(&s_lock);
+
+  for (pp = &s_tasks; NULL != *pp; pp = &(*pp)->m_next) {
+  }
+  *pp = ptask;
+  make_ready(ptask);
+
+  // The thread waits for the scheduler before it runs the task function
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (0 != pthread_create(&ptask->m_thread, &attr, task_thread, ptask)) {
+    abort();
+  }
+  pthread_attr_destroy(&attr);
+
+  if (NULL != phandle) {
+    *phandle = ptask;
+  }
+
+  task_preempt();
+  pthread_mutex_unlock(&s_lock);
+
+  return pdPASS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xTaskCreatePinnedToCore
+//
+
+BaseType_t
+xTaskCreatePinnedToCore(TaskFunction_t fn,
+                        const char *name,
+                        uint32_t stack_depth,
+                        void *param,
+                        UBaseType_t priority,
+                        TaskHandle_t *phandle,
+                        BaseType_t core)
+{
+  // One CPU
+  return xTaskCreate(fn, name, stack_depth, param, priority, phandle);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vTaskDelete
+//
+
+void
+vTaskDelete(TaskHandle_t task)
+{
+  if ((NULL == task) || (s_current == task)) {
+    task_exit(s_current);
+    pthread_exit(NULL);
+  }
+
+  // Another task is never scheduled again, its thread stays parked
+  pthread_mutex_lock(&s_lock);
+  task->m_state = SIM_TASK_DONE;
+  pthread_mutex_unlock(&s_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vTaskDelay
+//
+
+void
+vTaskDelay(TickType_t ticks)
+{
+  pthread_mutex_lock(&s_lock);
+  if (0 == ticks) {
+    // Yield to tasks of the same priority
+    make_ready(s_current);
+    task_switch(s_current);
+  }
+  else {
+    task_block(NULL, ticks);
+  }
+  pthread_mutex_unlock(&s_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xTaskGetTickCount
+//
+
+TickType_t
+xTaskGetTickCount(void)
+{
+  return (TickType_t) (esp_timer_get_time() / SIM_TICK_US);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xTaskGetCurrentTaskHandle
+//
+
+TaskHandle_t
+xTaskGetCurrentTaskHandle(void)
+{
+  return s_current;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ulTaskNotifyTake
+//
+
+uint32_t
+ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+  struct sim_task *self;
+  uint32_t value;
+
+  pthread_mutex_lock(&s_lock);
+  self = s_current;
+  assert(NULL != self);
+
+  if (0 == self->m_notify) {
+    task_block(&self->m_notify, ticks);
+  }
+
+  value = self->m_notify;
+  if (value) {
+    self->m_notify = clear ? 0 : (value - 1);
+  }
+  pthread_mutex_unlock(&s_lock);
+
+  return value;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xTaskNotifyGive
+//
+
+BaseType_t
+xTaskNotifyGive(TaskHandle_t task)
+{
+  pthread_mutex_lock(&s_lock);
+  task->m_notify++;
+  wake_waiters(&task->m_notify);
+  task_preempt();
+  pthread_mutex_unlock(&s_lock);
+
+  return pdPASS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// uxTaskGetSystemState
+//
+
+UBaseType_t
+uxTaskGetSystemState(TaskStatus_t *pstatus, UBaseType_t size, uint32_t *ptotal)
+{
+  static const eTaskState states[] = { eReady, eRunning, eBlocked, eDeleted };
+  UBaseType_t cnt = 0;
+  uint32_t total  = 0;
+
+  pthread_mutex_lock(&s_lock);
+  for (struct sim_task *ptask = s_tasks; NULL != ptask; ptask = ptask->m_next) {
+    if (SIM_TASK_DONE != ptask->m_state) {
+      cnt++;
+    }
+  }
+  if (cnt > size) {
+    pthread_mutex_unlock(&s_lock);
+    return 0;
+  }
+
+  cnt = 0;
+  for (struct sim_task *ptask = s_tasks; NULL != ptask; ptask = ptask->m_next) {
+    if (SIM_TASK_DONE == ptask->m_state) {
+      continue;
+    }
+    pstatus[cnt].xHandle              = ptask;
+    pstatus[cnt].pcTaskName           = ptask->m_name;
+    pstatus[cnt].eCurrentState        = states[ptask->m_state];
+    pstatus[cnt].uxCurrentPriority    = ptask->m_priority;
+    pstatus[cnt].ulRunTimeCounter     = (uint32_t) (ptask->m_stats.m_cpu_ns / 1000);
+    pstatus[cnt].usStackHighWaterMark = ptask->m_stack_depth;
+    total += pstatus[cnt].ulRunTimeCounter;
+    cnt++;
+  }
+  pthread_mutex_unlock(&s_lock);
+
+  if (NULL != ptotal) {
+    *ptotal = total;
+  }
+
+  return cnt;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xQueueCreate
+//
+
+QueueHandle_t
+xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+  struct sim_queue *pq = calloc(1, sizeof(struct sim_queue));
+
+  if (NULL == pq) {
+    return NULL;
+  }
+
+  pq->m_items = calloc(length, item_size);
+  if (NULL == pq->m_items) {
+    free(pq);
+    return NULL;
+  }
+  pq->m_length   = length;
+  pq->m_itemsize = item_size;
+
+  return pq;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vQueueDelete
+//
+
+void
+vQueueDelete(QueueHandle_t queue)
+{
+  free(queue->m_items);
+  free(queue);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xQueueSend
+//
+// Also used by timer callbacks, with zero ticks.
+//
+
+BaseType_t
+xQueueSend(QueueHandle_t queue, const void *pitem, TickType_t ticks)
+{
+  UBaseType_t tail;
+
+  pthread_mutex_lock(&s_lock);
+
+  while (queue->m_count == queue->m_length) {
+    if (!task_block(&queue->m_send_wait, ticks)) {
+      pthread_mutex_unlock(&s_lock);
+      return errQUEUE_FULL;
+    }
+  }
+
+  tail = (queue->m_head + queue->m_count) % queue->m_length;
+  memcpy(queue->m_items + (tail * queue->m_itemsize), pitem, queue->m_itemsize);
+  queue->m_count++;
+
+  wake_waiters(&queue->m_recv_wait);
+  task_preempt();
+  pthread_mutex_unlock(&s_lock);
+
+  return pdPASS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xQueueReceive
+//
+
+BaseType_t
+xQueueReceive(QueueHandle_t queue, void *pitem, TickType_t ticks)
+{
+  pthread_mutex_lock(&s_lock);
+
+  while (0 == queue->m_count) {
+    if (!task_block(&queue->m_recv_wait, ticks)) {
+      pthread_mutex_unlock(&s_lock);
+      return pdFALSE;
+    }
+  }
+
+  memcpy(pitem, queue->m_items + (queue->m_head * queue->m_itemsize), queue->m_itemsize);
+  queue->m_head = (queue->m_head + 1) % queue->m_length;
+  queue->m_count--;
+
+  wake_waiters(&queue->m_send_wait);
+  task_preempt();
+  pthread_mutex_unlock(&s_lock);
+
+  return pdTRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// uxQueueMessagesWaiting
+//
+
+UBaseType_t
+uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  UBaseType_t count;
+
+  pthread_mutex_lock(&s_lock);
+  count = queue->m_count;
+  pthread_mutex_unlock(&s_lock);
+
+  return count;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sem_create
+//
+
+static SemaphoreHandle_t
+sem_create(sim_sem_kind_t kind)
+{
+  struct sim_sem *psem = calloc(1, sizeof(struct sim_sem));
+
+  if (NULL != psem) {
+    psem->m_kind = kind;
+  }
+
+  return psem;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xSemaphoreCreateMutex
+//
+
+SemaphoreHandle_t
+xSemaphoreCreateMutex(void)
+{
+  return sem_create(SIM_SEM_MUTEX);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xSemaphoreCreateRecursiveMutex
+//
+
+SemaphoreHandle_t
+xSemaphoreCreateRecursiveMutex(void)
+{
+  return sem_create(SIM_SEM_RECURSIVE);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xSemaphoreCreateBinary
+//
+
+SemaphoreHandle_t
+xSemaphoreCreateBinary(void)
+{
+  return sem_create(SIM_SEM_BINARY);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// vSemaphoreDelete
+//
+
+void
+vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+  free(sem);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sem_take
+//
+
+static BaseType_t
+sem_take(SemaphoreHandle_t sem, TickType_t ticks, bool bRecursive)
+{
+  struct sim_task *self;
+
+  pthread_mutex_lock(&s_lock);
+  self = s_current;
+
+  if (SIM_SEM_BINARY == sem->m_kind) {
+    while (0 == sem->m_count) {
+      if (!task_block(&sem->m_wait, ticks)) {
+        pthread_mutex_unlock(&s_lock);
+        return pdFALSE;
+      }
+    }
+    sem->m_count--;
+    pthread_mutex_unlock(&s_lock);
+    return pdTRUE;
+  }
+
+  // Mutexes are taken by tasks only, recursively if it is recursive
+  assert(NULL != self);
+  assert(bRecursive == (SIM_SEM_RECURSIVE == sem->m_kind));
+  assert(bRecursive || (sem->m_owner != self));
+
+  while ((NULL != sem->m_owner) && (sem->m_owner != self)) {
+    if (!task_block(&sem->m_wait, ticks)) {
+      pthread_mutex_unlock(&s_lock);
+      return pdFALSE;
+    }
+  }
+  sem->m_owner = self;
+  sem->m_count++;
+
+  pthread_mutex_unlock(&s_lock);
+  return pdTRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sem_give
+//
+
+static BaseType_t
+sem_give(SemaphoreHandle_t sem, bool bRecursive)
+{
+  pthread_mutex_lock(&s_lock);
+
+  if (SIM_SEM_BINARY == sem->m_kind) {
+    if (sem->m_count) {
+      pthread_mutex_unlock(&s_lock);
+      return pdFALSE;
+    }
+    sem->m_count = 1;
+  }
+  else {
+    // Only the holder gives a mutex back
+    assert(bRecursive == (SIM_SEM_RECURSIVE == sem->m_kind));
+    if ((sem->m_owner != s_current) || (0 == sem->m_count)) {
+      pthread_mutex_unlock(&s_lock);
+      return pdFALSE;
+    }
+    if (0 != --sem->m_count) {
+      pthread_mutex_unlock(&s_lock);
+      return pdTRUE;
+    }
+    sem->m_owner = NULL;
+  }
+
+  wake_waiters(&sem->m_wait);
+  task_preempt();
+  pthread_mutex_unlock(&s_lock);
+
+  return pdTRUE;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xSemaphoreTake
+//
+
+BaseType_t
+xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+  return sem_take(sem, ticks, false);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xSemaphoreGive
+//
+
+BaseType_t
+xSemaphoreGive(SemaphoreHandle_t sem)
+{
+  return sem_give(sem, false);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xSemaphoreTakeRecursive
+//
+
+BaseType_t
+xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks)
+{
+  return sem_take(sem, ticks, true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// xSemaphoreGiveRecursive
+//
+
+BaseType_t
+xSemaphoreGiveRecursive(SemaphoreHandle_t sem)
+{
+  return sem_give(sem, true);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// esp_random
+//
+
+uint32_t
+esp_random(void)
+{
+  return xorshift(&s_rand_fw);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// heap_caps_get_free_size
+//
+
+size_t
+heap_caps_get_free_size(uint32_t caps)
+{
+  struct mallinfo2 mi = mallinfo2();
+  size_t free_size    = (mi.uordblks < SIM_HEAP_SIZE) ? (SIM_HEAP_SIZE - mi.uordblks) : 0;
+
+  if (free_size < s_heap_min_free) {
+    s_heap_min_free = free_size;
+  }
+
+  return free_size;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// heap_caps_get_minimum_free_size
+//
+
+size_t
+heap_caps_get_minimum_free_size(uint32_t caps)
+{
+  heap_caps_get_free_size(caps);
+  return s_heap_min_free;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// heap_caps_get_largest_free_block
+//
+
+size_t
+heap_caps_get_largest_free_block(uint32_t caps)
+{
+  return heap_caps_get_free_size(caps);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_seed
+//
+
+void
+sim_seed(uint64_t seed)
+{
+  // Never zero, xorshift would stick there
+  s_rand_fw    = (seed * 0x9e3779b97f4a7c15ULL) | 1;
+  s_rand_model = (seed * 0xd1b54a32d192ed03ULL) | 2;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_random
+//
+
+uint32_t
+sim_random(void)
+{
+  return xorshift(&s_rand_model);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// timer_remove
+//
+// Called with the kernel lock held.
+//
+
+static void
+timer_remove(sim_timer_t *ptimer)
+{
+  sim_timer_t **pp;
+
+  if (!ptimer->m_bArmed) {
+    return;
+  }
+
+  for (pp = &s_timers; *pp != ptimer; pp = &(*pp)->m_next) {
+  }
+  *pp              = ptimer->m_next;
+  ptimer->m_bArmed = false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_timer_start
+//
+
+void
+sim_timer_start(sim_timer_t *ptimer, int64_t at_us, void (*fn)(void *), void *arg)
+{
+  sim_timer_t **pp;
+
+  pthread_mutex_lock(&s_lock);
+  timer_remove(ptimer);
+
+  ptimer->m_at_us = at_us;
+  ptimer->m_fn    = fn;
+  ptimer->m_arg   = arg;
+
+  // After timers that expire at the same time
+  for (pp = &s_timers; (NULL != *pp) && ((*pp)->m_at_us <= at_us); pp = &(*pp)->m_next) {
+  }
+  ptimer->m_next   = *pp;
+  *pp              = ptimer;
+  ptimer->m_bArmed = true;
+
+  pthread_mutex_unlock(&s_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_timer_stop
+//
+
+void
+sim_timer_stop(sim_timer_t *ptimer)
+{
+  pthread_mutex_lock(&s_lock);
+  timer_remove(ptimer);
+  pthread_mutex_unlock(&s_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_run
+//
+
+void
+sim_run(int64_t until_us)
+{
+  struct sim_task *ptask;
+  int64_t next_us;
+  int64_t now;
+
+  pthread_mutex_lock(&s_lock);
+
+  while (true) {
+    // Run ready tasks until all of them are blocked
+    ptask = pick_ready();
+    if (NULL != ptask) {
+      ptask->m_state = SIM_TASK_RUNNING;
+      s_current      = ptask;
+      pthread_cond_signal(&ptask->m_cond);
+      while (NULL != s_current) {
+        pthread_cond_wait(&s_sched_cond, &s_lock);
+      }
+      continue;
+    }
+
+    // Idle, move the clock to the next timer or timeout
+    next_us = INT64_MAX;
+    if (NULL != s_timers) {
+      next_us = s_timers->m_at_us;
+    }
+    for (ptask = s_tasks; NULL != ptask; ptask = ptask->m_next) {
+      if ((SIM_TASK_BLOCKED == ptask->m_state) && (ptask->m_wake_us >= 0) && (ptask->m_wake_us < next_us)) {
+        next_us = ptask->m_wake_us;
+      }
+    }
+
+    now = esp_timer_get_time();
+    if (next_us > until_us) {
+      if (until_us > now) {
+        stub_time_set(until_us);
+      }
+      break;
+    }
+    if (next_us > now) {
+      stub_time_set(next_us);
+      now = next_us;
+    }
+
+    // Timers first, they may make tasks ready without a timeout
+    while ((NULL != s_timers) && (s_timers->m_at_us <= now)) {
+      sim_timer_t *ptimer = s_timers;
+      timer_remove(ptimer);
+      pthread_mutex_unlock(&s_lock);
+      ptimer->m_fn(ptimer->m_arg);
+      pthread_mutex_lock(&s_lock);
+    }
+
+    for (ptask = s_tasks; NULL != ptask; ptask = ptask->m_next) {
+      if ((SIM_TASK_BLOCKED == ptask->m_state) && (ptask->m_wake_us >= 0) && (ptask->m_wake_us <= now)) {
+        make_ready(ptask);
+        ptask->m_bTimedOut = true;
+      }
+    }
+  }
+
+  pthread_mutex_unlock(&s_lock);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_task_get_stats
+//
+
+bool
+sim_task_get_stats(const char *name, sim_task_stats_t *pstats)
+{
+  bool bFound = false;
+
+  pthread_mutex_lock(&s_lock);
+  for (struct sim_task *ptask = s_tasks; NULL != ptask; ptask = ptask->m_next) {
+    if (0 == strcmp(ptask->m_name, name)) {
+      *pstats = ptask->m_stats;
+      bFound  = true;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&s_lock);
+
+  return bFound;
+}
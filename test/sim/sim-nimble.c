@@ -0,0 +1,1513 @@
+/*!
+  @file sim-nimble.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <assert.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_peripheral.h"
+#include "esp_timer.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+#include "host/ble_hs.h"
+#include "host/ble_uuid.h"
+#include "host/util/util.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "services/ans/ble_svc_ans.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+
+#include "sim.h"
+
+#define SIM_HOST_QUEUE_SIZE  32   // Host events, like the msys pool this can run out
+#define SIM_HOST_PRIORITY    (configMAX_PRIORITIES - 4)
+#define SIM_ADV_DELAY_MAX_US 10000 // advDelay, 0-10 ms added to each interval
+#define SIM_MAX_SVCS         8
+#define SIM_MAX_ATTRS        64
+#define SIM_MAX_CONNS        3
+#define SIM_MAX_SUBS         8
+#define SIM_CONN_ITVL        24 // 30 ms in 1.25 ms units
+
+#define BLE_ERR_REM_USER_CONN_TERM 0x13
+#define BLE_HS_ERR_HCI_BASE        0x200
+
+// Host events
+typedef enum sim_host_ev_kind {
+  SIM_HOST_EV_GAP = 0, // Deliver a GAP event
+  SIM_HOST_EV_CENTRAL  // Handle a central request
+} sim_host_ev_kind_t;
+
+// Requests from the central
+typedef enum sim_central_op {
+  SIM_CENTRAL_CONNECT = 0,
+  SIM_CENTRAL_ENCRYPT,
+  SIM_CENTRAL_SUBSCRIBE,
+  SIM_CENTRAL_READ,
+  SIM_CENTRAL_WRITE,
+  SIM_CENTRAL_DISCONNECT
+} sim_central_op_t;
+
+typedef struct sim_central_req {
+  sim_central_op_t m_op;    // Request
+  uint16_t m_conn_handle;   // Connection (set by CONNECT)
+  uint16_t m_attr_handle;   // Attribute
+  uint16_t m_offset;        // Read offset
+  const uint8_t *m_pwrite;  // Value to write
+  uint16_t m_len;           // Write length, or read part length
+  uint8_t *m_pread;         // Read buffer
+  uint16_t m_size;          // Read buffer size
+  bool m_bBonded;           // ENCRYPT: link is bonded
+  int m_rc;                 // Result
+  TaskHandle_t m_waiter;    // Task to notify when done
+} sim_central_req_t;
+
+typedef struct sim_host_ev {
+  sim_host_ev_kind_t m_kind;
+  struct ble_gap_event m_gap;       // GAP event
+  ble_gap_event_fn *m_cb;           // GAP callback
+  void *m_arg;                      // GAP callback argument
+  uint8_t m_data[BLE_HS_ADV_MAX_SZ]; // Advert data of a DISC event
+  sim_central_req_t *m_preq;        // Central request
+} sim_host_ev_t;
+
+// GATT attributes
+typedef struct sim_attr {
+  uint16_t m_handle;                   // Attribute handle
+  const struct ble_gatt_chr_def *m_chr; // Characteristic (value attribute)
+  const struct ble_gatt_dsc_def *m_dsc; // Descriptor, NULL for a characteristic value
+} sim_attr_t;
+
+// Connections
+typedef struct sim_conn {
+  bool m_bUsed;
+  struct ble_gap_conn_desc m_desc;
+  uint16_t m_mtu;
+  int64_t m_connect_us;            // Anchor of the first connection event
+  uint16_t m_subs[SIM_MAX_SUBS];   // Value handles subscribed to
+  uint8_t m_nsubs;
+} sim_conn_t;
+
+struct ble_hs_cfg ble_hs_cfg;
+
+static QueueHandle_t s_host_queue;
+static bool s_bSynced;
+static bool s_bStop;
+static char s_device_name[32];
+static const uint8_t s_addr[6] = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5 };
+
+static const struct ble_gatt_svc_def *s_svcs[SIM_MAX_SVCS];
+static uint8_t s_nsvcs;
+static sim_attr_t s_attrs[SIM_MAX_ATTRS];
+static uint8_t s_nattrs;
+
+static sim_conn_t s_conns[SIM_MAX_CONNS];
+
+// Controller advertising state
+static struct {
+  bool m_bActive;
+  uint8_t m_conn_mode;
+  uint8_t m_data[BLE_HS_ADV_MAX_SZ];
+  uint8_t m_len;
+  int64_t m_itvl_us;
+  int64_t m_end_us; // -1 advertises until stopped
+  ble_gap_event_fn *m_cb;
+  void *m_arg;
+  sim_timer_t m_event_timer;
+  sim_timer_t m_end_timer;
+} s_adv;
+
+// Controller scanning state
+static struct {
+  bool m_bActive;
+  uint32_t m_rate; // Adverts per second on the channel
+  uint8_t m_data[BLE_HS_ADV_MAX_SZ];
+  uint8_t m_len;
+  uint32_t m_duty_permille; // Scan window / scan interval
+  ble_gap_event_fn *m_cb;
+  void *m_arg;
+  sim_timer_t m_report_timer;
+  sim_timer_t m_end_timer;
+} s_disc;
+
+static sim_air_cb_t s_air_cb;
+static void *s_air_arg;
+static sim_notify_cb_t s_notify_cb;
+static void *s_notify_arg;
+static sim_nimble_stats_t s_stats;
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_modlog
+//
+
+void
+sim_modlog(const char *fmt, ...)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// scli_receive_key
+//
+
+int
+scli_receive_key(int *key)
+{
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// host_post
+//
+// Queues a host event. Never blocks, also called from timers.
+//
+
+static void
+host_post(sim_host_ev_t *pev)
+{
+  if (pdPASS != xQueueSend(s_host_queue, pev, 0)) {
+    s_stats.m_host_drops++;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// host_post_gap
+//
+
+static void
+host_post_gap(const struct ble_gap_event *pgap, ble_gap_event_fn *cb, void *arg)
+{
+  sim_host_ev_t ev = { 0 };
+
+  if (NULL == cb) {
+    return;
+  }
+
+  ev.m_kind = SIM_HOST_EV_GAP;
+  ev.m_gap  = *pgap;
+  ev.m_cb   = cb;
+  ev.m_arg  = arg;
+  host_post(&ev);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// os_msys_get_pkthdr
+//
+
+struct os_mbuf *
+os_msys_get_pkthdr(uint16_t dsize, uint16_t user_hdr_len)
+{
+  struct os_mbuf *om;
+
+  if (dsize > SIM_MBUF_SIZE) {
+    return NULL;
+  }
+
+  om = calloc(1, sizeof(struct os_mbuf));
+  if (NULL != om) {
+    om->om_data = om->m_buf;
+  }
+
+  return om;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// os_mbuf_append
+//
+
+int
+os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len)
+{
+  if ((om->om_len + len) > SIM_MBUF_SIZE) {
+    return BLE_HS_ENOMEM;
+  }
+
+  memcpy(om->om_data + om->om_len, data, len);
+  om->om_len += len;
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// os_mbuf_free_chain
+//
+
+int
+os_mbuf_free_chain(struct os_mbuf *om)
+{
+  free(om);
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_hs_mbuf_from_flat
+//
+
+struct os_mbuf *
+ble_hs_mbuf_from_flat(const void *buf, uint16_t len)
+{
+  struct os_mbuf *om = os_msys_get_pkthdr(len, 0);
+
+  if ((NULL != om) && (0 != os_mbuf_append(om, buf, len))) {
+    os_mbuf_free_chain(om);
+    om = NULL;
+  }
+
+  return om;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_hs_mbuf_to_flat
+//
+
+int
+ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len)
+{
+  uint16_t len = (om->om_len < max_len) ? om->om_len : max_len;
+
+  memcpy(flat, om->om_data, len);
+  if (NULL != out_copy_len) {
+    *out_copy_len = len;
+  }
+
+  return (om->om_len > max_len) ? BLE_HS_EMSGSIZE : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_uuid_cmp
+//
+
+int
+ble_uuid_cmp(const ble_uuid_t *uuid1, const ble_uuid_t *uuid2)
+{
+  if (uuid1->type != uuid2->type) {
+    return uuid1->type - uuid2->type;
+  }
+
+  if (BLE_UUID_TYPE_16 == uuid1->type) {
+    return (int) ((const ble_uuid16_t *) uuid1)->value - (int) ((const ble_uuid16_t *) uuid2)->value;
+  }
+
+  return memcmp(((const ble_uuid128_t *) uuid1)->value, ((const ble_uuid128_t *) uuid2)->value, 16);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_uuid_to_str
+//
+
+char *
+ble_uuid_to_str(const ble_uuid_t *uuid, char *dst)
+{
+  const uint8_t *u8;
+
+  if (BLE_UUID_TYPE_16 == uuid->type) {
+    snprintf(dst, BLE_UUID_STR_LEN, "0x%04x", ((const ble_uuid16_t *) uuid)->value);
+    return dst;
+  }
+
+  // Most significant byte first, like NimBLE
+  u8 = ((const ble_uuid128_t *) uuid)->value;
+  snprintf(dst,
+           BLE_UUID_STR_LEN,
+           "%02x%02x%02x%02x-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x",
+           u8[15], u8[14], u8[13], u8[12], u8[11], u8[10], u8[9], u8[8],
+           u8[7], u8[6], u8[5], u8[4], u8[3], u8[2], u8[1], u8[0]);
+
+  return dst;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_hs_util_ensure_addr
+//
+
+int
+ble_hs_util_ensure_addr(int prefer_random)
+{
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_hs_id_infer_auto
+//
+
+int
+ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type)
+{
+  *out_addr_type = BLE_ADDR_PUBLIC;
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_hs_id_copy_addr
+//
+
+int
+ble_hs_id_copy_addr(uint8_t id_addr_type, uint8_t *out_id_addr, int *out_is_nrpa)
+{
+  memcpy(out_id_addr, s_addr, sizeof(s_addr));
+  if (NULL != out_is_nrpa) {
+    *out_is_nrpa = 0;
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_sm_inject_io
+//
+
+int
+ble_sm_inject_io(uint16_t conn_handle, struct ble_sm_io *pkey)
+{
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_store_config_init
+//
+
+void
+ble_store_config_init(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_store_util_status_rr
+//
+
+int
+ble_store_util_status_rr(struct ble_store_status_event *event, void *arg)
+{
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_store_util_delete_peer
+//
+
+int
+ble_store_util_delete_peer(const ble_addr_t *peer_id_addr)
+{
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_svc_gap_init
+//
+
+void
+ble_svc_gap_init(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_svc_gap_device_name_set
+//
+
+int
+ble_svc_gap_device_name_set(const char *name)
+{
+  if (strlen(name) >= sizeof(s_device_name)) {
+    return BLE_HS_EINVAL;
+  }
+
+  strcpy(s_device_name, name);
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_svc_gap_device_name
+//
+
+const char *
+ble_svc_gap_device_name(void)
+{
+  return s_device_name;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_svc_gatt_init
+//
+
+void
+ble_svc_gatt_init(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_svc_ans_init
+//
+
+void
+ble_svc_ans_init(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// adv_event_cb
+//
+// One advertising event: the data is sent on the three primary channels
+// and the next event is planned an interval plus advDelay later.
+//
+
+static void
+adv_event_cb(void *arg)
+{
+  int64_t next_us;
+
+  if (!s_adv.m_bActive) {
+    return;
+  }
+
+  s_stats.m_adv_events++;
+  if (NULL != s_air_cb) {
+    s_air_cb(s_adv.m_data, s_adv.m_len, s_air_arg);
+  }
+
+  next_us = esp_timer_get_time() + s_adv.m_itvl_us + (sim_random() % (SIM_ADV_DELAY_MAX_US + 1));
+  if ((s_adv.m_end_us < 0) || (next_us < s_adv.m_end_us)) {
+    sim_timer_start(&s_adv.m_event_timer, next_us, adv_event_cb, NULL);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// adv_end_cb
+//
+
+static void
+adv_end_cb(void *arg)
+{
+  struct ble_gap_event event = { 0 };
+
+  s_adv.m_bActive = false;
+  sim_timer_stop(&s_adv.m_event_timer);
+  s_stats.m_adv_completes++;
+
+  event.type                = BLE_GAP_EVENT_ADV_COMPLETE;
+  event.adv_complete.reason = BLE_HS_ETIMEOUT;
+  host_post_gap(&event, s_adv.m_cb, s_adv.m_arg);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_adv_set_data
+//
+
+int
+ble_gap_adv_set_data(const uint8_t *data, int data_len)
+{
+  if ((data_len < 0) || (data_len > BLE_HS_ADV_MAX_SZ)) {
+    return BLE_HS_EINVAL;
+  }
+
+  // The controller sends the new data from the next advertising event
+  memcpy(s_adv.m_data, data, data_len);
+  s_adv.m_len = data_len;
+  s_stats.m_set_data++;
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_adv_rsp_set_fields
+//
+
+int
+ble_gap_adv_rsp_set_fields(const struct ble_hs_adv_fields *rsp_fields)
+{
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_adv_start
+//
+
+int
+ble_gap_adv_start(uint8_t own_addr_type,
+                  const ble_addr_t *direct_addr,
+                  int32_t duration_ms,
+                  const struct ble_gap_adv_params *adv_params,
+                  ble_gap_event_fn *cb,
+                  void *cb_arg)
+{
+  int64_t now = esp_timer_get_time();
+  uint16_t itvl;
+
+  if (s_adv.m_bActive) {
+    return BLE_HS_EALREADY;
+  }
+
+  itvl = adv_params->itvl_min;
+  if (0 == itvl) {
+    itvl = BLE_GAP_ADV_ITVL_MS(BLE_GAP_ADV_FAST_ITVL_MS);
+  }
+
+  s_adv.m_bActive   = true;
+  s_adv.m_conn_mode = adv_params->conn_mode;
+  s_adv.m_itvl_us   = (int64_t) itvl * BLE_HCI_ADV_ITVL;
+  s_adv.m_cb        = cb;
+  s_adv.m_arg       = cb_arg;
+  s_adv.m_end_us    = -1;
+
+  s_stats.m_adv_starts++;
+  s_stats.m_itvl_ms     = (uint16_t) (s_adv.m_itvl_us / 1000);
+  s_stats.m_duration_ms = duration_ms;
+  s_stats.m_conn_mode   = adv_params->conn_mode;
+
+  // First event after advDelay
+  sim_timer_start(&s_adv.m_event_timer, now + (sim_random() % (SIM_ADV_DELAY_MAX_US + 1)), adv_event_cb, NULL);
+  if (BLE_HS_FOREVER != duration_ms) {
+    s_adv.m_end_us = now + (duration_ms * 1000LL);
+    sim_timer_start(&s_adv.m_end_timer, s_adv.m_end_us, adv_end_cb, NULL);
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_adv_stop
+//
+
+int
+ble_gap_adv_stop(void)
+{
+  if (!s_adv.m_bActive) {
+    return BLE_HS_EALREADY;
+  }
+
+  // No ADV_COMPLETE event when stopped by the host
+  s_adv.m_bActive = false;
+  sim_timer_stop(&s_adv.m_event_timer);
+  sim_timer_stop(&s_adv.m_end_timer);
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_adv_active
+//
+
+int
+ble_gap_adv_active(void)
+{
+  return s_adv.m_bActive;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// disc_next_report
+//
+// Plans the next report, Poisson arrivals at the channel rate seen
+// through the scan duty cycle.
+//
+
+static void
+disc_report_cb(void *arg);
+
+static void
+disc_next_report(void)
+{
+  double rate = (s_disc.m_rate * (double) s_disc.m_duty_permille) / 1000.0;
+  double u;
+
+  if (rate <= 0.0) {
+    return;
+  }
+
+  u = (sim_random() + 1.0) / 4294967297.0;
+  sim_timer_start(&s_disc.m_report_timer,
+                  esp_timer_get_time() + 1 + (int64_t) (-log(u) * 1e6 / rate),
+                  disc_report_cb,
+                  NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// disc_report_cb
+//
+
+static void
+disc_report_cb(void *arg)
+{
+  sim_host_ev_t ev = { 0 };
+
+  if (!s_disc.m_bActive) {
+    return;
+  }
+
+  s_stats.m_disc_reports++;
+
+  // The data is pointed into the host event when it is delivered
+  ev.m_kind                 = SIM_HOST_EV_GAP;
+  ev.m_gap.type             = BLE_GAP_EVENT_DISC;
+  ev.m_gap.disc.length_data = s_disc.m_len;
+  ev.m_gap.disc.rssi        = -70;
+  ev.m_cb                   = s_disc.m_cb;
+  ev.m_arg                  = s_disc.m_arg;
+  memcpy(ev.m_data, s_disc.m_data, s_disc.m_len);
+  host_post(&ev);
+
+  disc_next_report();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// disc_end_cb
+//
+
+static void
+disc_end_cb(void *arg)
+{
+  struct ble_gap_event event = { 0 };
+
+  s_disc.m_bActive = false;
+  sim_timer_stop(&s_disc.m_report_timer);
+
+  event.type                 = BLE_GAP_EVENT_DISC_COMPLETE;
+  event.disc_complete.reason = 0;
+  host_post_gap(&event, s_disc.m_cb, s_disc.m_arg);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_disc
+//
+
+int
+ble_gap_disc(uint8_t own_addr_type,
+             int32_t duration_ms,
+             const struct ble_gap_disc_params *disc_params,
+             ble_gap_event_fn *cb,
+             void *cb_arg)
+{
+  if (s_disc.m_bActive) {
+    return BLE_HS_EALREADY;
+  }
+
+  s_disc.m_bActive       = true;
+  s_disc.m_cb            = cb;
+  s_disc.m_arg           = cb_arg;
+  s_disc.m_duty_permille = 1000;
+  if (disc_params->itvl && (disc_params->window < disc_params->itvl)) {
+    s_disc.m_duty_permille = (disc_params->window * 1000) / disc_params->itvl;
+  }
+  s_stats.m_disc_starts++;
+
+  disc_next_report();
+  if (BLE_HS_FOREVER != duration_ms) {
+    sim_timer_start(&s_disc.m_end_timer, esp_timer_get_time() + (duration_ms * 1000LL), disc_end_cb, NULL);
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_disc_cancel
+//
+
+int
+ble_gap_disc_cancel(void)
+{
+  if (!s_disc.m_bActive) {
+    return BLE_HS_EALREADY;
+  }
+
+  s_disc.m_bActive = false;
+  sim_timer_stop(&s_disc.m_report_timer);
+  sim_timer_stop(&s_disc.m_end_timer);
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_disc_active
+//
+
+int
+ble_gap_disc_active(void)
+{
+  return s_disc.m_bActive;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// conn_find
+//
+
+static sim_conn_t *
+conn_find(uint16_t conn_handle)
+{
+  for (int i = 0; i < SIM_MAX_CONNS; i++) {
+    if (s_conns[i].m_bUsed && (s_conns[i].m_desc.conn_handle == conn_handle)) {
+      return &s_conns[i];
+    }
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gap_conn_find
+//
+
+int
+ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc)
+{
+  sim_conn_t *pconn = conn_find(handle);
+
+  if (NULL == pconn) {
+    return BLE_HS_ENOTCONN;
+  }
+
+  if (NULL != out_desc) {
+    *out_desc = pconn->m_desc;
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_att_mtu
+//
+
+uint16_t
+ble_att_mtu(uint16_t conn_handle)
+{
+  sim_conn_t *pconn = conn_find(conn_handle);
+
+  return (NULL == pconn) ? 0 : pconn->m_mtu;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// attr_find
+//
+
+static sim_attr_t *
+attr_find(uint16_t handle)
+{
+  for (int i = 0; i < s_nattrs; i++) {
+    if (s_attrs[i].m_handle == handle) {
+      return &s_attrs[i];
+    }
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// attr_add
+//
+
+static void
+attr_add(uint16_t handle, const struct ble_gatt_chr_def *pchr, const struct ble_gatt_dsc_def *pdsc)
+{
+  assert(s_nattrs < SIM_MAX_ATTRS);
+
+  s_attrs[s_nattrs].m_handle = handle;
+  s_attrs[s_nattrs].m_chr    = pchr;
+  s_attrs[s_nattrs].m_dsc    = pdsc;
+  s_nattrs++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// attr_access
+//
+// Runs the access callback of an attribute. A read returns the whole
+// value in *pom, the caller takes the part it needs.
+//
+
+static int
+attr_access(uint16_t conn_handle, sim_attr_t *pattr, uint8_t op, uint16_t offset, struct os_mbuf *om)
+{
+  struct ble_gatt_access_ctxt ctxt = { 0 };
+  ble_gatt_access_fn *access_cb;
+  void *arg;
+
+  ctxt.op     = op;
+  ctxt.om     = om;
+  ctxt.offset = offset;
+  if (NULL != pattr->m_dsc) {
+    ctxt.dsc  = pattr->m_dsc;
+    access_cb = pattr->m_dsc->access_cb;
+    arg       = pattr->m_dsc->arg;
+  }
+  else {
+    ctxt.chr  = pattr->m_chr;
+    access_cb = pattr->m_chr->access_cb;
+    arg       = pattr->m_chr->arg;
+  }
+
+  return access_cb(conn_handle, pattr->m_handle, &ctxt, arg);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// gatts_register
+//
+// Assigns handles and reports them to the application, like
+// ble_gatts_start() does when the host starts.
+//
+
+static void
+gatts_register(void)
+{
+  struct ble_gatt_register_ctxt ctxt;
+  uint16_t handle = 1;
+
+  for (int s = 0; s < s_nsvcs; s++) {
+    for (const struct ble_gatt_svc_def *psvc = s_svcs[s]; BLE_GATT_SVC_TYPE_END != psvc->type; psvc++) {
+      memset(&ctxt, 0, sizeof(ctxt));
+      ctxt.op             = BLE_GATT_REGISTER_OP_SVC;
+      ctxt.svc.handle     = handle++;
+      ctxt.svc.svc_def    = psvc;
+      if (NULL != ble_hs_cfg.gatts_register_cb) {
+        ble_hs_cfg.gatts_register_cb(&ctxt, ble_hs_cfg.gatts_register_arg);
+      }
+
+      for (const struct ble_gatt_chr_def *pchr = psvc->characteristics; (NULL != pchr) && (NULL != pchr->uuid);
+           pchr++) {
+        memset(&ctxt, 0, sizeof(ctxt));
+        ctxt.op             = BLE_GATT_REGISTER_OP_CHR;
+        ctxt.chr.def_handle = handle++;
+        ctxt.chr.val_handle = handle++;
+        ctxt.chr.chr_def    = pchr;
+        ctxt.chr.svc_def    = psvc;
+        attr_add(ctxt.chr.val_handle, pchr, NULL);
+        if (NULL != pchr->val_handle) {
+          *pchr->val_handle = ctxt.chr.val_handle;
+        }
+        if (NULL != ble_hs_cfg.gatts_register_cb) {
+          ble_hs_cfg.gatts_register_cb(&ctxt, ble_hs_cfg.gatts_register_arg);
+        }
+
+        // Client configuration descriptor
+        if (pchr->flags & (BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE)) {
+          handle++;
+        }
+
+        for (struct ble_gatt_dsc_def *pdsc = pchr->descriptors; (NULL != pdsc) && (NULL != pdsc->uuid); pdsc++) {
+          memset(&ctxt, 0, sizeof(ctxt));
+          ctxt.op          = BLE_GATT_REGISTER_OP_DSC;
+          ctxt.dsc.handle  = handle++;
+          ctxt.dsc.dsc_def = pdsc;
+          ctxt.dsc.chr_def = pchr;
+          ctxt.dsc.svc_def = psvc;
+          attr_add(ctxt.dsc.handle, pchr, pdsc);
+          if (NULL != ble_hs_cfg.gatts_register_cb) {
+            ble_hs_cfg.gatts_register_cb(&ctxt, ble_hs_cfg.gatts_register_arg);
+          }
+        }
+      }
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gatts_count_cfg
+//
+
+int
+ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs)
+{
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gatts_add_svcs
+//
+
+int
+ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs)
+{
+  if (s_nsvcs >= SIM_MAX_SVCS) {
+    return BLE_HS_ENOMEM;
+  }
+
+  s_svcs[s_nsvcs++] = svcs;
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ble_gatts_chr_updated
+//
+// Notifies subscribed centrals. Like NimBLE the value is read through
+// the access callback in the calling task, the notification goes out
+// in the next connection event.
+//
+
+void
+ble_gatts_chr_updated(uint16_t chr_val_handle)
+{
+  sim_attr_t *pattr = attr_find(chr_val_handle);
+  struct ble_gap_event event;
+  struct os_mbuf *om;
+  int64_t now = esp_timer_get_time();
+  int64_t itvl_us;
+  int64_t rx_us;
+
+  if (NULL == pattr) {
+    return;
+  }
+
+  for (int i = 0; i < SIM_MAX_CONNS; i++) {
+    sim_conn_t *pconn = &s_conns[i];
+    bool bSubscribed  = false;
+
+    if (!pconn->m_bUsed) {
+      continue;
+    }
+    for (int j = 0; j < pconn->m_nsubs; j++) {
+      bSubscribed |= (pconn->m_subs[j] == chr_val_handle);
+    }
+    if (!bSubscribed) {
+      continue;
+    }
+
+    om = os_msys_get_pkthdr(0, 0);
+    if (NULL == om) {
+      continue;
+    }
+    if (0 == attr_access(BLE_HS_CONN_HANDLE_NONE, pattr, BLE_GATT_ACCESS_OP_READ_CHR, 0, om)) {
+      itvl_us = pconn->m_desc.conn_itvl * 1250LL;
+      rx_us   = pconn->m_connect_us + (((now - pconn->m_connect_us) + itvl_us - 1) / itvl_us) * itvl_us;
+      s_stats.m_notifications++;
+      if (NULL != s_notify_cb) {
+        s_notify_cb(pconn->m_desc.conn_handle,
+                    chr_val_handle,
+                    om->om_data,
+                    (om->om_len < (pconn->m_mtu - 3)) ? om->om_len : (pconn->m_mtu - 3),
+                    rx_us,
+                    s_notify_arg);
+      }
+
+      memset(&event, 0, sizeof(event));
+      event.type                  = BLE_GAP_EVENT_NOTIFY_TX;
+      event.notify_tx.conn_handle = pconn->m_desc.conn_handle;
+      event.notify_tx.attr_handle = chr_val_handle;
+      if (NULL != s_adv.m_cb) {
+        s_adv.m_cb(&event, s_adv.m_arg);
+      }
+    }
+    os_mbuf_free_chain(om);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// central_att
+//
+// Handles a read or write request in the host task. Permissions are
+// checked like the ATT server does before the access callback runs.
+//
+
+static int
+central_att(sim_central_req_t *preq)
+{
+  sim_conn_t *pconn = conn_find(preq->m_conn_handle);
+  sim_attr_t *pattr = attr_find(preq->m_attr_handle);
+  bool bRead        = (SIM_CENTRAL_READ == preq->m_op);
+  struct os_mbuf *om;
+  uint16_t part;
+  uint16_t flags;
+  uint8_t op;
+  int rc;
+
+  if (NULL == pconn) {
+    return BLE_HS_ENOTCONN;
+  }
+  if (NULL == pattr) {
+    return BLE_ATT_ERR_INVALID_HANDLE;
+  }
+
+  if (NULL != pattr->m_dsc) {
+    flags = pattr->m_dsc->att_flags;
+    if (bRead && !(flags & BLE_ATT_F_READ)) {
+      return BLE_ATT_ERR_READ_NOT_PERMITTED;
+    }
+    if (!bRead && !(flags & BLE_ATT_F_WRITE)) {
+      return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+    }
+    if ((flags & (bRead ? BLE_ATT_F_READ_ENC : BLE_ATT_F_WRITE_ENC)) && !pconn->m_desc.sec_state.encrypted) {
+      return BLE_ATT_ERR_INSUFFICIENT_ENC;
+    }
+    op = bRead ? BLE_GATT_ACCESS_OP_READ_DSC : BLE_GATT_ACCESS_OP_WRITE_DSC;
+  }
+  else {
+    flags = pattr->m_chr->flags;
+    if (bRead && !(flags & BLE_GATT_CHR_F_READ)) {
+      return BLE_ATT_ERR_READ_NOT_PERMITTED;
+    }
+    if (!bRead && !(flags & (BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP))) {
+      return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+    }
+    if ((flags & (bRead ? BLE_GATT_CHR_F_READ_ENC : BLE_GATT_CHR_F_WRITE_ENC)) && !pconn->m_desc.sec_state.encrypted) {
+      return BLE_ATT_ERR_INSUFFICIENT_ENC;
+    }
+    op = bRead ? BLE_GATT_ACCESS_OP_READ_CHR : BLE_GATT_ACCESS_OP_WRITE_CHR;
+  }
+
+  if (!bRead && (preq->m_len > BLE_ATT_ATTR_MAX_LEN)) {
+    return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+  }
+
+  om = bRead ? os_msys_get_pkthdr(0, 0) : ble_hs_mbuf_from_flat(preq->m_pwrite, preq->m_len);
+  if (NULL == om) {
+    return BLE_ATT_ERR_INSUFFICIENT_RES;
+  }
+
+  rc = attr_access(preq->m_conn_handle, pattr, op, bRead ? preq->m_offset : 0, om);
+  if ((0 == rc) && bRead) {
+    // The whole value is read for each part, the part at the offset is sent
+    if (preq->m_offset > om->om_len) {
+      rc = BLE_ATT_ERR_INVALID_OFFSET;
+    }
+    else {
+      part = om->om_len - preq->m_offset;
+      if (part > (pconn->m_mtu - 1)) {
+        part = pconn->m_mtu - 1;
+      }
+      if (part > preq->m_size) {
+        part = preq->m_size;
+      }
+      memcpy(preq->m_pread, om->om_data + preq->m_offset, part);
+      preq->m_len = part;
+    }
+  }
+  os_mbuf_free_chain(om);
+
+  return rc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// central_request
+//
+// Handles a central request in the host task.
+//
+
+static int
+central_request(sim_central_req_t *preq)
+{
+  struct ble_gap_event event = { 0 };
+  sim_conn_t *pconn;
+  sim_attr_t *pattr;
+
+  switch (preq->m_op) {
+    case SIM_CENTRAL_CONNECT:
+      pconn = NULL;
+      for (int i = 0; i < SIM_MAX_CONNS; i++) {
+        if (!s_conns[i].m_bUsed) {
+          pconn = &s_conns[i];
+          break;
+        }
+      }
+      // Only a connectable advert can be connected to
+      if ((NULL == pconn) || !s_adv.m_bActive || (BLE_GAP_CONN_MODE_NON == s_adv.m_conn_mode)) {
+        return BLE_HS_ENOTCONN;
+      }
+
+      memset(pconn, 0, sizeof(sim_conn_t));
+      pconn->m_bUsed                      = true;
+      pconn->m_mtu                        = BLE_ATT_MTU_DFLT;
+      pconn->m_connect_us                 = esp_timer_get_time();
+      pconn->m_desc.conn_handle           = (uint16_t) (1 + (pconn - s_conns));
+      pconn->m_desc.conn_itvl             = SIM_CONN_ITVL;
+      pconn->m_desc.supervision_timeout   = 400;
+      pconn->m_desc.peer_id_addr.val[0]   = 0xc0 + pconn->m_desc.conn_handle;
+      pconn->m_desc.peer_ota_addr         = pconn->m_desc.peer_id_addr;
+      memcpy(pconn->m_desc.our_id_addr.val, s_addr, sizeof(s_addr));
+      pconn->m_desc.our_ota_addr          = pconn->m_desc.our_id_addr;
+      preq->m_conn_handle                 = pconn->m_desc.conn_handle;
+
+      // The controller stops advertising when the advert is connected to
+      s_adv.m_bActive = false;
+      sim_timer_stop(&s_adv.m_event_timer);
+      sim_timer_stop(&s_adv.m_end_timer);
+
+      event.type                = BLE_GAP_EVENT_LINK_ESTAB;
+      event.connect.status      = 0;
+      event.connect.conn_handle = pconn->m_desc.conn_handle;
+      s_adv.m_cb(&event, s_adv.m_arg);
+      return 0;
+
+    case SIM_CENTRAL_ENCRYPT:
+      pconn = conn_find(preq->m_conn_handle);
+      if (NULL == pconn) {
+        return BLE_HS_ENOTCONN;
+      }
+      pconn->m_desc.sec_state.encrypted = 1;
+      pconn->m_desc.sec_state.bonded    = preq->m_bBonded;
+      pconn->m_desc.sec_state.key_size  = 16;
+
+      event.type                   = BLE_GAP_EVENT_ENC_CHANGE;
+      event.enc_change.status      = 0;
+      event.enc_change.conn_handle = preq->m_conn_handle;
+      s_adv.m_cb(&event, s_adv.m_arg);
+      return 0;
+
+    case SIM_CENTRAL_SUBSCRIBE:
+      pconn = conn_find(preq->m_conn_handle);
+      pattr = attr_find(preq->m_attr_handle);
+      if (NULL == pconn) {
+        return BLE_HS_ENOTCONN;
+      }
+      if ((NULL == pattr) || (NULL != pattr->m_dsc) || !(pattr->m_chr->flags & BLE_GATT_CHR_F_NOTIFY)) {
+        return BLE_ATT_ERR_WRITE_NOT_PERMITTED;
+      }
+      if (pconn->m_nsubs >= SIM_MAX_SUBS) {
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+      }
+      pconn->m_subs[pconn->m_nsubs++] = preq->m_attr_handle;
+
+      event.type                  = BLE_GAP_EVENT_SUBSCRIBE;
+      event.subscribe.conn_handle = preq->m_conn_handle;
+      event.subscribe.attr_handle = preq->m_attr_handle;
+      event.subscribe.reason      = BLE_GAP_SUBSCRIBE_REASON_WRITE;
+      event.subscribe.cur_notify  = 1;
+      s_adv.m_cb(&event, s_adv.m_arg);
+      return 0;
+
+    case SIM_CENTRAL_READ:
+    case SIM_CENTRAL_WRITE:
+      return central_att(preq);
+
+    case SIM_CENTRAL_DISCONNECT:
+      pconn = conn_find(preq->m_conn_handle);
+      if (NULL == pconn) {
+        return BLE_HS_ENOTCONN;
+      }
+      event.type              = BLE_GAP_EVENT_DISCONNECT;
+      event.disconnect.reason = BLE_HS_ERR_HCI_BASE + BLE_ERR_REM_USER_CONN_TERM;
+      event.disconnect.conn   = pconn->m_desc;
+      pconn->m_bUsed          = false;
+      s_adv.m_cb(&event, s_adv.m_arg);
+      return 0;
+  }
+
+  return BLE_HS_EINVAL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nimble_port_init
+//
+
+esp_err_t
+nimble_port_init(void)
+{
+  s_host_queue = xQueueCreate(SIM_HOST_QUEUE_SIZE, sizeof(sim_host_ev_t));
+  if (NULL == s_host_queue) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nimble_port_run
+//
+// Host task loop. The host is in sync with the controller right away.
+//
+
+void
+nimble_port_run(void)
+{
+  sim_host_ev_t ev;
+
+  if (!s_bSynced) {
+    s_bSynced = true;
+    gatts_register();
+    if (NULL != ble_hs_cfg.sync_cb) {
+      ble_hs_cfg.sync_cb();
+    }
+  }
+
+  while (!s_bStop) {
+    if (pdTRUE != xQueueReceive(s_host_queue, &ev, portMAX_DELAY)) {
+      continue;
+    }
+
+    if (SIM_HOST_EV_GAP == ev.m_kind) {
+      if (BLE_GAP_EVENT_DISC == ev.m_gap.type) {
+        ev.m_gap.disc.data = ev.m_data;
+      }
+      ev.m_cb(&ev.m_gap, ev.m_arg);
+    }
+    else {
+      ev.m_preq->m_rc = central_request(ev.m_preq);
+      xTaskNotifyGive(ev.m_preq->m_waiter);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nimble_port_stop
+//
+
+int
+nimble_port_stop(void)
+{
+  s_bStop = true;
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nimble_port_freertos_init
+//
+
+void
+nimble_port_freertos_init(TaskFunction_t host_task_fn)
+{
+  xTaskCreate(host_task_fn, "nimble_host", 4096, NULL, SIM_HOST_PRIORITY, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nimble_port_freertos_deinit
+//
+
+void
+nimble_port_freertos_deinit(void)
+{
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_nimble_set_air_cb
+//
+
+void
+sim_nimble_set_air_cb(sim_air_cb_t cb, void *arg)
+{
+  s_air_cb  = cb;
+  s_air_arg = arg;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_nimble_set_scan_load
+//
+
+void
+sim_nimble_set_scan_load(uint32_t rate, const uint8_t *pdata, uint8_t len)
+{
+  if (len > sizeof(s_disc.m_data)) {
+    len = sizeof(s_disc.m_data);
+  }
+
+  s_disc.m_rate = rate;
+  s_disc.m_len  = len;
+  memcpy(s_disc.m_data, pdata, len);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_nimble_get_stats
+//
+
+void
+sim_nimble_get_stats(sim_nimble_stats_t *pstats)
+{
+  *pstats = s_stats;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_gatts_find_chr
+//
+
+uint16_t
+sim_gatts_find_chr(const ble_uuid_t *uuid)
+{
+  for (int i = 0; i < s_nattrs; i++) {
+    if ((NULL == s_attrs[i].m_dsc) && (0 == ble_uuid_cmp(s_attrs[i].m_chr->uuid, uuid))) {
+      return s_attrs[i].m_handle;
+    }
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_central_set_notify_cb
+//
+
+void
+sim_central_set_notify_cb(sim_notify_cb_t cb, void *arg)
+{
+  s_notify_cb  = cb;
+  s_notify_arg = arg;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// central_call
+//
+// Hands a request to the host task and waits for the result.
+//
+
+static int
+central_call(sim_central_req_t *preq)
+{
+  sim_host_ev_t ev = { 0 };
+
+  preq->m_waiter = xTaskGetCurrentTaskHandle();
+  assert(NULL != preq->m_waiter);
+
+  ev.m_kind = SIM_HOST_EV_CENTRAL;
+  ev.m_preq = preq;
+  if (pdPASS != xQueueSend(s_host_queue, &ev, portMAX_DELAY)) {
+    return BLE_HS_ENOMEM;
+  }
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+  return preq->m_rc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_central_connect
+//
+
+uint16_t
+sim_central_connect(void)
+{
+  sim_central_req_t req = { .m_op = SIM_CENTRAL_CONNECT };
+
+  if (0 != central_call(&req)) {
+    return BLE_HS_CONN_HANDLE_NONE;
+  }
+
+  return req.m_conn_handle;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_central_encrypt
+//
+
+int
+sim_central_encrypt(uint16_t conn_handle, bool bBonded)
+{
+  sim_central_req_t req = { .m_op = SIM_CENTRAL_ENCRYPT, .m_conn_handle = conn_handle, .m_bBonded = bBonded };
+
+  return central_call(&req);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_central_subscribe
+//
+
+int
+sim_central_subscribe(uint16_t conn_handle, uint16_t attr_handle)
+{
+  sim_central_req_t req = { .m_op = SIM_CENTRAL_SUBSCRIBE, .m_conn_handle = conn_handle, .m_attr_handle = attr_handle };
+
+  return central_call(&req);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_central_read
+//
+
+int
+sim_central_read(uint16_t conn_handle, uint16_t attr_handle, uint16_t offset, uint8_t *pbuf, uint16_t size, uint16_t *plen)
+{
+  sim_central_req_t req = { .m_op          = SIM_CENTRAL_READ,
+                            .m_conn_handle = conn_handle,
+                            .m_attr_handle = attr_handle,
+                            .m_offset      = offset,
+                            .m_pread       = pbuf,
+                            .m_size        = size };
+  int rc;
+
+  rc    = central_call(&req);
+  *plen = (0 == rc) ? req.m_len : 0;
+
+  return rc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_central_read_long
+//
+
+int
+sim_central_read_long(uint16_t conn_handle,
+                      uint16_t attr_handle,
+                      uint8_t *pbuf,
+                      uint16_t size,
+                      uint16_t *plen,
+                      uint16_t *pparts)
+{
+  sim_conn_t *pconn = conn_find(conn_handle);
+  uint16_t offset   = 0;
+  uint16_t parts    = 0;
+  uint16_t len;
+  int rc;
+
+  if (NULL == pconn) {
+    return BLE_HS_ENOTCONN;
+  }
+
+  // A part shorter than MTU - 1 is the last one
+  do {
+    rc = sim_central_read(conn_handle, attr_handle, offset, pbuf + offset, size - offset, &len);
+    if (0 != rc) {
+      break;
+    }
+    offset += len;
+    parts++;
+  } while ((len == (pconn->m_mtu - 1)) && (offset < size));
+
+  *plen = offset;
+  if (NULL != pparts) {
+    *pparts = parts;
+  }
+
+  return rc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_central_write
+//
+
+int
+sim_central_write(uint16_t conn_handle, uint16_t attr_handle, const uint8_t *pdata, uint16_t len)
+{
+  sim_central_req_t req = { .m_op          = SIM_CENTRAL_WRITE,
+                            .m_conn_handle = conn_handle,
+                            .m_attr_handle = attr_handle,
+                            .m_pwrite      = pdata,
+                            .m_len         = len };
+
+  // A long write is queued in parts and handed over in one go on execute
+  return central_call(&req);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sim_central_disconnect
+//
+
+int
+sim_central_disconnect(uint16_t conn_handle)
+{
+  sim_central_req_t req = { .m_op = SIM_CENTRAL_DISCONNECT, .m_conn_handle = conn_handle };
+
+  return central_call(&req);
+}
@@ -0,0 +1,305 @@
+
+/*!
+  @file sim.h
+  @brief Node simulation on virtual time.
+
+  Control side of the node simulation. The node firmware (main.c,
+  gatt_svr.c and the node modules) is built unchanged against stand-ins
+  for FreeRTOS and the NimBLE host and controller.
+
+  FreeRTOS tasks are threads, but only one of them runs at a time. The
+  scheduler runs the ready task with the highest priority until it
+  blocks, and when no task is ready it moves the virtual clock
+  (esp_timer_get_time()) to the next timeout or timer. Code runs in zero
+  virtual time, so a run is repeatable for a given seed and measures
+  protocol timing, not host CPU speed. CPU time is measured per task
+  with the thread CPU clock.
+
+  The NimBLE model runs the host task with a host event queue. GAP
+  events and ATT requests from the simulated central are handled there
+  like in NimBLE. The controller sends an advert every interval plus a
+  random 0-10 ms advDelay and reports adverts of other nodes at a set
+  rate while scanning.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+
+/*!
+  Timer run by the scheduler. Callbacks run outside of any task and must
+  not block.
+*/
+typedef struct sim_timer {
+  struct sim_timer *m_next; // Next armed timer (by expiry time)
+  int64_t m_at_us;          // Expiry time
+  void (*m_fn)(void *);     // Callback
+  void *m_arg;              // Callback argument
+  bool m_bArmed;            // Set while in the timer list
+} sim_timer_t;
+
+/*!
+  Task statistics
+*/
+typedef struct sim_task_stats {
+  int64_t m_cpu_ns;    // Thread CPU time used by the task
+  uint32_t m_switches; // Times the task gave up the CPU
+} sim_task_stats_t;
+
+/*!
+  NimBLE model statistics
+*/
+typedef struct sim_nimble_stats {
+  uint32_t m_set_data;      // ble_gap_adv_set_data() calls
+  uint32_t m_adv_starts;    // Successful ble_gap_adv_start() calls
+  uint32_t m_adv_events;    // Advertising events sent on air
+  uint32_t m_adv_completes; // Bursts that ended at their duration
+  uint32_t m_disc_starts;   // Successful ble_gap_disc() calls
+  uint32_t m_disc_reports;  // Adverts reported while scanning
+  uint32_t m_notifications; // Notifications sent to subscribed centrals
+  uint32_t m_host_drops;    // Host events lost on a full host queue
+  uint16_t m_itvl_ms;       // Advertising interval of the last burst
+  int32_t m_duration_ms;    // Duration of the last burst (BLE_HS_FOREVER if none)
+  uint8_t m_conn_mode;      // Connectable mode of the last burst
+} sim_nimble_stats_t;
+
+/*!
+  @brief Called for each advertising event on air.
+  @param pdata Advertising data.
+  @param len Length of the advertising data.
+  @param arg Argument given to sim_nimble_set_air_cb().
+*/
+typedef void (*sim_air_cb_t)(const uint8_t *pdata, uint8_t len, void *arg);
+
+/*!
+  @brief Called when a notification reaches the central.
+  @param conn_handle Connection.
+  @param attr_handle Characteristic value handle.
+  @param pdata Notified value.
+  @param len Length of the value.
+  @param rx_us Virtual time of the connection event that carried it.
+  @param arg Argument given to sim_central_set_notify_cb().
+*/
+typedef void (*sim_notify_cb_t)(uint16_t conn_handle,
+                                uint16_t attr_handle,
+                                const uint8_t *pdata,
+                                uint16_t len,
+                                int64_t rx_us,
+                                void *arg);
+
+// ----------------------------------------------------------------------------
+//                              Kernel
+// ----------------------------------------------------------------------------
+
+/*!
+  @brief Seed esp_random() and the model random numbers.
+  @param seed Seed, runs with the same seed repeat exactly.
+*/
+void
+sim_seed(uint64_t seed);
+
+/*!
+  @brief Random number for the models, independent of esp_random().
+  @return 32 bit pseudo random number.
+*/
+uint32_t
+sim_random(void);
+
+/*!
+  @brief Run the tasks until the virtual clock reaches a time.
+  @param until_us Virtual time to stop at.
+
+  @note Call from the test main thread, after creating the first task
+  with xTaskCreate(). Can be called again to continue the run.
+*/
+void
+sim_run(int64_t until_us);
+
+/*!
+  @brief Arm a timer, or move it if it is armed.
+  @param ptimer Pointer to the timer.
+  @param at_us Virtual time it expires.
+  @param fn Callback.
+  @param arg Callback argument.
+*/
+void
+sim_timer_start(sim_timer_t *ptimer, int64_t at_us, void (*fn)(void *), void *arg);
+
+/*!
+  @brief Disarm a timer. Nothing happens if it is not armed.
+  @param ptimer Pointer to the timer.
+*/
+void
+sim_timer_stop(sim_timer_t *ptimer);
+
+/*!
+  @brief Get the statistics of a task.
+  @param name Task name.
+  @param pstats Pointer to structure that receives the statistics.
+  @return True if the task exists.
+*/
+bool
+sim_task_get_stats(const char *name, sim_task_stats_t *pstats);
+
+// ----------------------------------------------------------------------------
+//                              NimBLE model
+// ----------------------------------------------------------------------------
+
+/*!
+  @brief Set the callback for adverts on air.
+  @param cb Callback, NULL for none.
+  @param arg Callback argument.
+*/
+void
+sim_nimble_set_air_cb(sim_air_cb_t cb, void *arg);
+
+/*!
+  @brief Set the adverts of other nodes heard while scanning.
+  @param rate Adverts per second on the channel (Poisson arrivals),
+    zero for a quiet channel.
+  @param pdata Advertising data reported for them.
+  @param len Length of the advertising data.
+*/
+void
+sim_nimble_set_scan_load(uint32_t rate, const uint8_t *pdata, uint8_t len);
+
+/*!
+  @brief Get the NimBLE model statistics.
+  @param pstats Pointer to structure that receives the statistics.
+*/
+void
+sim_nimble_get_stats(sim_nimble_stats_t *pstats);
+
+/*!
+  @brief Find a registered characteristic.
+  @param uuid Characteristic UUID.
+  @return Value handle, zero if there is no such characteristic.
+*/
+uint16_t
+sim_gatts_find_chr(const ble_uuid_t *uuid);
+
+// ----------------------------------------------------------------------------
+//                              Central
+// ----------------------------------------------------------------------------
+
+// The central calls block until the host task has handled the request,
+// call them from a task. ATT calls return zero or a BLE_ATT_ERR_* code.
+
+/*!
+  @brief Set the callback for notifications received by the central.
+  @param cb Callback, NULL for none.
+  @param arg Callback argument.
+*/
+void
+sim_central_set_notify_cb(sim_notify_cb_t cb, void *arg);
+
+/*!
+  @brief Connect to the node.
+  @return Connection handle, BLE_HS_CONN_HANDLE_NONE if the node is not
+    advertising, advertises non connectable or has no free connection.
+*/
+uint16_t
+sim_central_connect(void);
+
+/*!
+  @brief Encrypt the link.
+  @param conn_handle Connection.
+  @param bBonded Link is bonded.
+  @return Zero on success, else a BLE_HS_* code.
+*/
+int
+sim_central_encrypt(uint16_t conn_handle, bool bBonded);
+
+/*!
+  @brief Subscribe to notifications of a characteristic.
+  @param conn_handle Connection.
+  @param attr_handle Characteristic value handle.
+  @return Zero on success, else a BLE_ATT_ERR_* code.
+*/
+int
+sim_central_subscribe(uint16_t conn_handle, uint16_t attr_handle);
+
+/*!
+  @brief Read (offset zero) or read blob (offset above zero).
+  @param conn_handle Connection.
+  @param attr_handle Attribute handle.
+  @param offset Offset of the part to read.
+  @param pbuf Buffer that receives the part, at most ATT MTU - 1 bytes.
+  @param size Size of the buffer.
+  @param plen Pointer to variable that receives the part length.
+  @return Zero on success, else a BLE_ATT_ERR_* code.
+*/
+int
+sim_central_read(uint16_t conn_handle, uint16_t attr_handle, uint16_t offset, uint8_t *pbuf, uint16_t size, uint16_t *plen);
+
+/*!
+  @brief Long read, read blob until a part is short.
+  @param conn_handle Connection.
+  @param attr_handle Attribute handle.
+  @param pbuf Buffer that receives the value.
+  @param size Size of the buffer.
+  @param plen Pointer to variable that receives the value length.
+  @param pparts Pointer to variable that receives the number of
+    requests, NULL if not needed.
+  @return Zero on success, else a BLE_ATT_ERR_* code.
+*/
+int
+sim_central_read_long(uint16_t conn_handle,
+                      uint16_t attr_handle,
+                      uint8_t *pbuf,
+                      uint16_t size,
+                      uint16_t *plen,
+                      uint16_t *pparts);
+
+/*!
+  @brief Write, a long write (prepare and execute) if it does not fit
+    in one request.
+  @param conn_handle Connection.
+  @param attr_handle Attribute handle.
+  @param pdata Value to write.
+  @param len Length of the value, at most BLE_ATT_ATTR_MAX_LEN.
+  @return Zero on success, else a BLE_ATT_ERR_* code.
+*/
+int
+sim_central_write(uint16_t conn_handle, uint16_t attr_handle, const uint8_t *pdata, uint16_t len);
+
+/*!
+  @brief Disconnect.
+  @param conn_handle Connection.
+  @return Zero on success, else a BLE_HS_* code.
+*/
+int
+sim_central_disconnect(uint16_t conn_handle);
+
+#endif // SIM_H
@@ -0,0 +1,29 @@
+// Host stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef ESP_ERR_H
+#define ESP_ERR_H
+
+#include <assert.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK   0
+#define ESP_FAIL -1
+
+#define ESP_ERR_NO_MEM                0x101
+#define ESP_ERR_INVALID_ARG           0x102
+#define ESP_ERR_INVALID_STATE         0x103
+#define ESP_ERR_NVS_NOT_FOUND         0x1102
+#define ESP_ERR_NVS_INVALID_LENGTH    0x110c
+#define ESP_ERR_NVS_NO_FREE_PAGES     0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND 0x1110
+
+// Aborts on error like the ESP-IDF macro
+#define ESP_ERROR_CHECK(x)                                                                                             \
+  do {                                                                                                                 \
+    esp_err_t err_rc_ = (x);                                                                                           \
+    assert(ESP_OK == err_rc_);                                                                                         \
+    (void) err_rc_;                                                                                                    \
+  } while (0)
+
+#endif // ESP_ERR_H
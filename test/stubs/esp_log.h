@@ -0,0 +1,14 @@
+// Host stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef ESP_LOG_H
+#define ESP_LOG_H
+
+#include <stdio.h>
+
+// Informational output is dropped to keep test output readable
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) ((void) (tag))
+#define ESP_LOGD(tag, fmt, ...) ((void) (tag))
+
+#endif // ESP_LOG_H
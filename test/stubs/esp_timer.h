@@ -0,0 +1,12 @@
+// Host stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef ESP_TIMER_H
+#define ESP_TIMER_H
+
+#include <stdint.h>
+
+// Virtual time, see stub_time_set() and stub_time_advance() in stubs.h
+int64_t
+esp_timer_get_time(void);
+
+#endif // ESP_TIMER_H
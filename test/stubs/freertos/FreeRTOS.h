@@ -0,0 +1,18 @@
+// Host stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+#include <pthread.h>
+
+// A critical section is a mutex on the host
+typedef struct {
+  pthread_mutex_t m_mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED { PTHREAD_MUTEX_INITIALIZER }
+
+#define taskENTER_CRITICAL(pmux) pthread_mutex_lock(&(pmux)->m_mutex)
+#define taskEXIT_CRITICAL(pmux)  pthread_mutex_unlock(&(pmux)->m_mutex)
+
+#endif // FREERTOS_H
@@ -0,0 +1,30 @@
+// Host stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef NVS_H
+#define NVS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+esp_err_t
+nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *phandle);
+
+esp_err_t
+nvs_get_blob(nvs_handle_t handle, const char *key, void *pvalue, size_t *plen);
+
+esp_err_t
+nvs_set_blob(nvs_handle_t handle, const char *key, const void *pvalue, size_t len);
+
+esp_err_t
+nvs_commit(nvs_handle_t handle);
+
+void
+nvs_close(nvs_handle_t handle);
+
+#endif // NVS_H
@@ -0,0 +1,15 @@
+// Host stand-in for the ESP-IDF header of the same name (test builds only)
+
+#ifndef NVS_FLASH_H
+#define NVS_FLASH_H
+
+#include "esp_err.h"
+
+// The NVS stand-in is always ready, see stub_nvs_erase() in stubs.h
+esp_err_t
+nvs_flash_init(void);
+
+esp_err_t
+nvs_flash_erase(void);
+
+#endif // NVS_FLASH_H
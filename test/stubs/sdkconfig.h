@@ -0,0 +1,12 @@
+// Host stand-in for the generated sdkconfig.h (test builds only). Values
+// are the Kconfig defaults of the options the tested modules use.
+
+#ifndef SDKCONFIG_H
+#define SDKCONFIG_H
+
+#define CONFIG_VSCP_BLE_CFG_FLUSH_IDLE_MS 2000
+#define CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS  30000
+
+#define CONFIG_VSCP_BLE_PROFILER_MAX_TASKS 16
+
+#endif // SDKCONFIG_H
@@ -0,0 +1,283 @@
+/*!
+  @file stubs.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+
+#include "stubs.h"
+
+#define STUB_NVS_ENTRIES   16   // Stored key/value pairs
+#define STUB_NVS_NAME_SIZE 16   // Namespace and key length (NVS limit incl. nul)
+#define STUB_NVS_MAX_BLOB  4096 // Largest stored blob
+
+typedef struct stub_nvs_entry {
+  char m_ns[STUB_NVS_NAME_SIZE];  // Namespace
+  char m_key[STUB_NVS_NAME_SIZE]; // Key, empty when the entry is free
+  size_t m_len;                   // Blob length
+  uint8_t m_data[STUB_NVS_MAX_BLOB];
+} stub_nvs_entry_t;
+
+static int64_t s_time_us;
+
+static stub_nvs_entry_t s_nvs[STUB_NVS_ENTRIES];
+static char s_open_ns[STUB_NVS_ENTRIES][STUB_NVS_NAME_SIZE]; // Namespace of each open handle
+static stub_nvs_stats_t s_stats;
+static uint32_t s_fail_count;
+static esp_err_t s_fail_err;
+
+///////////////////////////////////////////////////////////////////////////////
+// esp_timer_get_time
+//
+
+int64_t
+esp_timer_get_time(void)
+{
+  return s_time_us;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stub_time_set
+//
+
+void
+stub_time_set(int64_t us)
+{
+  s_time_us = us;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stub_time_advance
+//
+
+void
+stub_time_advance(int64_t us)
+{
+  s_time_us += us;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// find_entry
+//
+
+static stub_nvs_entry_t *
+find_entry(const char *ns, const char *key)
+{
+  for (int i = 0; i < STUB_NVS_ENTRIES; i++) {
+    if (s_nvs[i].m_key[0] && !strcmp(s_nvs[i].m_ns, ns) && ((NULL == key) || !strcmp(s_nvs[i].m_key, key))) {
+      return &s_nvs[i];
+    }
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nvs_open
+//
+
+esp_err_t
+nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *phandle)
+{
+  if ((NULL == name) || (NULL == phandle) || (strlen(name) >= STUB_NVS_NAME_SIZE)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  // As on target a namespace that has never been written can not be opened read only
+  if ((NVS_READONLY == mode) && (NULL == find_entry(name, NULL))) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  for (int i = 0; i < STUB_NVS_ENTRIES; i++) {
+    if (!s_open_ns[i][0]) {
+      strcpy(s_open_ns[i], name);
+      *phandle = (nvs_handle_t) (i + 1);
+      return ESP_OK;
+    }
+  }
+
+  return ESP_ERR_NO_MEM;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nvs_close
+//
+
+void
+nvs_close(nvs_handle_t handle)
+{
+  if ((handle > 0) && (handle <= STUB_NVS_ENTRIES)) {
+    s_open_ns[handle - 1][0] = '\0';
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nvs_get_blob
+//
+
+esp_err_t
+nvs_get_blob(nvs_handle_t handle, const char *key, void *pvalue, size_t *plen)
+{
+  stub_nvs_entry_t *pentry;
+
+  if ((0 == handle) || (handle > STUB_NVS_ENTRIES) || !s_open_ns[handle - 1][0] || (NULL == key) || (NULL == plen)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  pentry = find_entry(s_open_ns[handle - 1], key);
+  if (NULL == pentry) {
+    return ESP_ERR_NVS_NOT_FOUND;
+  }
+
+  // A NULL buffer asks for the length only
+  if (NULL != pvalue) {
+    if (*plen < pentry->m_len) {
+      return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(pvalue, pentry->m_data, pentry->m_len);
+  }
+  *plen = pentry->m_len;
+
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nvs_set_blob
+//
+
+esp_err_t
+nvs_set_blob(nvs_handle_t handle, const char *key, const void *pvalue, size_t len)
+{
+  stub_nvs_entry_t *pentry;
+
+  if ((0 == handle) || (handle > STUB_NVS_ENTRIES) || !s_open_ns[handle - 1][0] || (NULL == key) ||
+      (strlen(key) >= STUB_NVS_NAME_SIZE) || (NULL == pvalue) || (len > STUB_NVS_MAX_BLOB)) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  if (s_fail_count) {
+    s_fail_count--;
+    return s_fail_err;
+  }
+
+  pentry = find_entry(s_open_ns[handle - 1], key);
+  for (int i = 0; (NULL == pentry) && (i < STUB_NVS_ENTRIES); i++) {
+    if (!s_nvs[i].m_key[0]) {
+      pentry = &s_nvs[i];
+      strcpy(pentry->m_ns, s_open_ns[handle - 1]);
+      strcpy(pentry->m_key, key);
+    }
+  }
+  if (NULL == pentry) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  memcpy(pentry->m_data, pvalue, len);
+  pentry->m_len = len;
+
+  s_stats.m_sets++;
+  s_stats.m_bytes_written += len;
+
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nvs_commit
+//
+
+esp_err_t
+nvs_commit(nvs_handle_t handle)
+{
+  if ((0 == handle) || (handle > STUB_NVS_ENTRIES) || !s_open_ns[handle - 1][0]) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  s_stats.m_commits++;
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nvs_flash_init
+//
+
+esp_err_t
+nvs_flash_init(void)
+{
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// nvs_flash_erase
+//
+
+esp_err_t
+nvs_flash_erase(void)
+{
+  stub_nvs_erase();
+  return ESP_OK;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stub_nvs_erase
+//
+
+void
+stub_nvs_erase(void)
+{
+  memset(s_nvs, 0, sizeof(s_nvs));
+  memset(&s_stats, 0, sizeof(s_stats));
+  s_fail_count = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stub_nvs_fail
+//
+
+void
+stub_nvs_fail(uint32_t count, esp_err_t err)
+{
+  s_fail_count = count;
+  s_fail_err   = err;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stub_nvs_get_stats
+//
+
+void
+stub_nvs_get_stats(stub_nvs_stats_t *pstats)
+{
+  if (NULL != pstats) {
+    *pstats = s_stats;
+  }
+}
@@ -0,0 +1,88 @@
+
+/*!
+  @file stubs.h
+  @brief Host stand-ins for ESP-IDF services.
+
+  Control side of the host stand-ins for the ESP-IDF services used by
+  the node modules: a virtual esp_timer clock and an in-RAM NVS that
+  counts flash writes and can be made to fail.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef STUBS_H
+#define STUBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/*!
+  NVS stand-in statistics
+*/
+typedef struct stub_nvs_stats {
+  uint32_t m_sets;          // nvs_set_blob() calls
+  uint32_t m_commits;       // nvs_commit() calls
+  uint64_t m_bytes_written; // Bytes passed to nvs_set_blob()
+} stub_nvs_stats_t;
+
+/*!
+  @brief Set the virtual time returned by esp_timer_get_time().
+  @param us Time in microseconds.
+*/
+void
+stub_time_set(int64_t us);
+
+/*!
+  @brief Move the virtual time forward.
+  @param us Microseconds to advance.
+*/
+void
+stub_time_advance(int64_t us);
+
+/*!
+  @brief Erase everything stored in the NVS stand-in and clear statistics.
+*/
+void
+stub_nvs_erase(void);
+
+/*!
+  @brief Make the next nvs_set_blob() calls fail.
+  @param count Number of calls that should fail.
+  @param err Error code they return.
+*/
+void
+stub_nvs_fail(uint32_t count, esp_err_t err);
+
+/*!
+  @brief Get the NVS stand-in statistics.
+  @param pstats Pointer to structure that receives the statistics.
+*/
+void
+stub_nvs_get_stats(stub_nvs_stats_t *pstats);
+
+#endif // STUBS_H
@@ -0,0 +1,166 @@
+/*!
+  @file test-adapt.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+
+#include "vscp-ble-adapt.h"
+#include "vscp-ble-test.h"
+
+#define LOAD_BUSY  1000 // Adverts/s well above the busy load
+#define LOAD_QUIET 0
+
+static const vscp_ble_adapt_limits_t s_limits = {
+  .m_itvl_min_ms = 20,
+  .m_itvl_max_ms = 1000,
+  .m_repeat_min  = 1,
+  .m_repeat_max  = 5,
+  .m_load_low    = 50,
+  .m_load_high   = 200,
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// test_busy
+//
+// A busy channel backs off to the longest interval and fewest repeats,
+// and stays there.
+//
+
+static void
+test_busy(void)
+{
+  vscp_ble_adapt_t adapt;
+  uint16_t last;
+
+  vscp_ble_adapt_init(&adapt, &s_limits);
+  TEST_CHECK_EQ(adapt.m_itvl_ms, s_limits.m_itvl_min_ms);
+  TEST_CHECK_EQ(adapt.m_repeat, s_limits.m_repeat_max);
+
+  last = adapt.m_itvl_ms;
+  for (int i = 0; i < 50; i++) {
+    vscp_ble_adapt_update(&adapt, &s_limits, LOAD_BUSY);
+    TEST_CHECK(adapt.m_itvl_ms >= last);
+    TEST_CHECK(adapt.m_itvl_ms <= s_limits.m_itvl_max_ms);
+    TEST_CHECK(adapt.m_repeat >= s_limits.m_repeat_min);
+    last = adapt.m_itvl_ms;
+  }
+  TEST_CHECK_EQ(adapt.m_itvl_ms, s_limits.m_itvl_max_ms);
+  TEST_CHECK_EQ(adapt.m_repeat, s_limits.m_repeat_min);
+  TEST_CHECK_EQ(vscp_ble_adapt_update(&adapt, &s_limits, LOAD_BUSY), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_quiet
+//
+// A quiet channel brings the interval and repeats back.
+//
+
+static void
+test_quiet(void)
+{
+  vscp_ble_adapt_t adapt;
+
+  vscp_ble_adapt_init(&adapt, &s_limits);
+  for (int i = 0; i < 50; i++) {
+    vscp_ble_adapt_update(&adapt, &s_limits, LOAD_BUSY);
+  }
+
+  for (int i = 0; i < 200; i++) {
+    vscp_ble_adapt_update(&adapt, &s_limits, LOAD_QUIET);
+    TEST_CHECK(adapt.m_itvl_ms >= s_limits.m_itvl_min_ms);
+    TEST_CHECK(adapt.m_repeat <= s_limits.m_repeat_max);
+  }
+  TEST_CHECK_EQ(adapt.m_itvl_ms, s_limits.m_itvl_min_ms);
+  TEST_CHECK_EQ(adapt.m_repeat, s_limits.m_repeat_max);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_hysteresis
+//
+// A load between the quiet and busy loads leaves the settings alone.
+//
+
+static void
+test_hysteresis(void)
+{
+  vscp_ble_adapt_t adapt;
+  uint16_t load = (s_limits.m_load_low + s_limits.m_load_high) / 2;
+
+  vscp_ble_adapt_init(&adapt, &s_limits);
+  for (int i = 0; i < 6; i++) {
+    vscp_ble_adapt_update(&adapt, &s_limits, LOAD_BUSY);
+  }
+
+  // Let the smoothed load settle in the band
+  for (int i = 0; i < 50; i++) {
+    vscp_ble_adapt_update(&adapt, &s_limits, load);
+  }
+
+  vscp_ble_adapt_t before = adapt;
+  for (int i = 0; i < 50; i++) {
+    TEST_CHECK_EQ(vscp_ble_adapt_update(&adapt, &s_limits, load), 0);
+  }
+  TEST_CHECK_EQ(adapt.m_itvl_ms, before.m_itvl_ms);
+  TEST_CHECK_EQ(adapt.m_repeat, before.m_repeat);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_single_repeat
+//
+// With equal repeat limits the count never moves.
+//
+
+static void
+test_single_repeat(void)
+{
+  vscp_ble_adapt_limits_t limits = s_limits;
+  vscp_ble_adapt_t adapt;
+
+  limits.m_repeat_min = 3;
+  limits.m_repeat_max = 3;
+  vscp_ble_adapt_init(&adapt, &limits);
+  for (int i = 0; i < 20; i++) {
+    vscp_ble_adapt_update(&adapt, &limits, (i < 10) ? LOAD_BUSY : LOAD_QUIET);
+    TEST_CHECK_EQ(adapt.m_repeat, 3);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_busy();
+  test_quiet();
+  test_hysteresis();
+  test_single_repeat();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,257 @@
+/*!
+  @file test-adv.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-adv.h"
+#include "vscp-ble-test.h"
+#include "vscp-ble.h"
+
+#define ADV_FLAGS 0x06 // BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP, as main.c
+
+///////////////////////////////////////////////////////////////////////////////
+// ref_field
+//
+// Appends one AD structure the way ble_hs_adv_set_fields() writes it:
+// length of type and payload, type, payload.
+//
+
+static uint8_t
+ref_field(uint8_t *pbuf, uint8_t pos, uint8_t type, const uint8_t *pdata, uint8_t len)
+{
+  pbuf[pos++] = (uint8_t) (len + 1);
+  pbuf[pos++] = type;
+  memcpy(pbuf + pos, pdata, len);
+  return (uint8_t) (pos + len);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// ref_adv
+//
+// The advertising data ble_hs_adv_set_fields() makes of struct
+// ble_hs_adv_fields with flags, name and mfg_data set. NimBLE writes the
+// flags first and the manufacturer data last.
+//
+
+static uint8_t
+ref_adv(uint8_t *pbuf, const char *name, uint8_t name_type, const uint8_t *pframe, uint8_t framelen)
+{
+  uint8_t flags = ADV_FLAGS;
+  uint8_t pos   = 0;
+
+  pos = ref_field(pbuf, pos, VSCP_BLE_AD_TYPE_FLAGS, &flags, 1);
+  if (NULL != name) {
+    pos = ref_field(pbuf, pos, name_type, (const uint8_t *) name, (uint8_t) strlen(name));
+  }
+  return ref_field(pbuf, pos, VSCP_BLE_AD_TYPE_MFG_DATA, pframe, framelen);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// set_event
+//
+
+static int
+set_event(vscp_ble_adv_t *padv, vscp_ble_ctx_t *pctx, uint8_t *pframe, uint8_t *pframelen)
+{
+  uint8_t data[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  vscpEvent ev    = { 0 };
+  int len;
+
+  ev.head       = 0x08;
+  ev.vscp_class = 10;
+  ev.vscp_type  = 6;
+  ev.sizeData   = 4;
+  ev.pdata      = data;
+
+  len = vscp_ble_ev_to_frame(pctx, pframe, VSCP_BLE_FRAME_MAX_EVENT_SIZE, &ev);
+  TEST_CHECK_EQ(len, VSCP_BLE_FRAME_MIN_SIZE);
+  *pframelen = (uint8_t) len;
+
+  // The template gets the next sequence number, the reference is made
+  // with the same one
+  atomic_fetch_sub(&pctx->m_seq, 1);
+  return vscp_ble_adv_set_event(padv, pctx, &ev);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_template
+//
+// The template is byte for byte what NimBLE would have built from the same
+// fields: the flags, the name and the manufacturer AD header.
+//
+
+static void
+test_template(void)
+{
+  uint8_t guid[16] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0, 0, 1, 2, 3, 4, 0x12, 0x34 };
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t ref[VSCP_BLE_ADV_MAX_SIZE];
+  vscp_ble_ctx_t ctx = { 0 };
+  vscp_ble_adv_t adv;
+  uint8_t framelen;
+  uint8_t reflen;
+  int len;
+
+  ctx.m_manufacturer = 0x02e5;
+  vscp_ble_set_guid(&ctx, guid);
+
+  TEST_CHECK_EQ(vscp_ble_adv_init(NULL, ADV_FLAGS, "VSCP"), VSCP_ERROR_INVALID_POINTER);
+  TEST_CHECK_EQ(vscp_ble_adv_init(&adv, ADV_FLAGS, "VSCP"), VSCP_ERROR_SUCCESS);
+
+  // Before the first event
+  TEST_CHECK_EQ(adv.m_len, 11);
+  TEST_CHECK_EQ(adv.m_frame_pos, 11);
+  TEST_CHECK_EQ(adv.m_buf[0], 2);
+  TEST_CHECK_EQ(adv.m_buf[1], VSCP_BLE_AD_TYPE_FLAGS);
+  TEST_CHECK_EQ(adv.m_buf[2], ADV_FLAGS);
+  TEST_CHECK_EQ(adv.m_buf[3], 5);
+  TEST_CHECK_EQ(adv.m_buf[4], VSCP_BLE_AD_TYPE_NAME_FULL);
+  TEST_CHECK(0 == memcmp(adv.m_buf + 5, "VSCP", 4));
+  TEST_CHECK_EQ(adv.m_buf[9], 1);
+  TEST_CHECK_EQ(adv.m_buf[10], VSCP_BLE_AD_TYPE_MFG_DATA);
+
+  len = set_event(&adv, &ctx, frame, &framelen);
+  TEST_CHECK_EQ(len, 11 + VSCP_BLE_FRAME_MIN_SIZE);
+  TEST_CHECK_EQ(adv.m_len, len);
+  TEST_CHECK_EQ(adv.m_buf[9], VSCP_BLE_FRAME_MIN_SIZE + 1);
+  TEST_CHECK_EQ(adv.m_buf[10], VSCP_BLE_AD_TYPE_MFG_DATA);
+  TEST_CHECK_EQ(adv.m_buf[11 + VSCP_BLE_FRAME_POS_MANUFACTURER], 0xe5);
+  TEST_CHECK_EQ(adv.m_buf[11 + VSCP_BLE_FRAME_POS_MANUFACTURER + 1], 0x02);
+
+  reflen = ref_adv(ref, "VSCP", VSCP_BLE_AD_TYPE_NAME_FULL, frame, framelen);
+  TEST_CHECK_EQ(reflen, len);
+  TEST_CHECK(0 == memcmp(adv.m_buf, ref, reflen));
+
+  // A new event leaves the flags and the name alone
+  len    = set_event(&adv, &ctx, frame, &framelen);
+  reflen = ref_adv(ref, "VSCP", VSCP_BLE_AD_TYPE_NAME_FULL, frame, framelen);
+  TEST_CHECK_EQ(reflen, len);
+  TEST_CHECK(0 == memcmp(adv.m_buf, ref, reflen));
+
+  // A name that does not fit with a full frame is shortened, the payload
+  // then fills the legacy advert
+  TEST_CHECK_EQ(vscp_ble_adv_init(&adv, ADV_FLAGS, "VSCP-NODE"), VSCP_ERROR_SUCCESS);
+  len = set_event(&adv, &ctx, frame, &framelen);
+  TEST_CHECK_EQ(len, VSCP_BLE_ADV_MAX_SIZE);
+  reflen = ref_adv(ref, "VSCP-", VSCP_BLE_AD_TYPE_NAME_SHORT, frame, framelen);
+  TEST_CHECK_EQ(reflen, len);
+  TEST_CHECK(0 == memcmp(adv.m_buf, ref, reflen));
+
+  // No name
+  TEST_CHECK_EQ(vscp_ble_adv_init(&adv, ADV_FLAGS, ""), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(adv.m_frame_pos, 5);
+  len    = set_event(&adv, &ctx, frame, &framelen);
+  reflen = ref_adv(ref, NULL, 0, frame, framelen);
+  TEST_CHECK_EQ(reflen, len);
+  TEST_CHECK(0 == memcmp(adv.m_buf, ref, reflen));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_find_frame
+//
+// The frame is found in a template and in adverts with other AD
+// structures, and data that is cut short or has an AD structure longer
+// than what is left is refused.
+//
+
+static void
+test_find_frame(void)
+{
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t buf[VSCP_BLE_ADV_MAX_SIZE];
+  vscp_ble_ctx_t ctx = { 0 };
+  const uint8_t *pframe;
+  vscp_ble_adv_t adv;
+  uint8_t framelen;
+  uint8_t len;
+
+  vscp_ble_adv_init(&adv, ADV_FLAGS, "VSCP");
+  set_event(&adv, &ctx, frame, &framelen);
+
+  pframe = vscp_ble_adv_find_frame(adv.m_buf, adv.m_len, &len);
+  TEST_CHECK(pframe == adv.m_buf + adv.m_frame_pos);
+  TEST_CHECK_EQ(len, framelen);
+  TEST_CHECK(NULL == vscp_ble_adv_find_frame(NULL, adv.m_len, &len));
+  TEST_CHECK(NULL == vscp_ble_adv_find_frame(adv.m_buf, adv.m_len, NULL));
+
+  // Zero padding after the significant part
+  memset(buf, 0, sizeof(buf));
+  memcpy(buf, adv.m_buf, adv.m_len);
+  pframe = vscp_ble_adv_find_frame(buf, sizeof(buf), &len);
+  TEST_CHECK(pframe == buf + adv.m_frame_pos);
+  TEST_CHECK_EQ(len, framelen);
+
+  // Cut short anywhere
+  for (uint8_t l = 0; l < adv.m_len; l++) {
+    TEST_CHECK(NULL == vscp_ble_adv_find_frame(adv.m_buf, l, &len));
+  }
+
+  // Manufacturer AD longer than the data
+  memcpy(buf, adv.m_buf, adv.m_len);
+  buf[adv.m_frame_pos - 2]++;
+  TEST_CHECK(NULL == vscp_ble_adv_find_frame(buf, adv.m_len, &len));
+  buf[adv.m_frame_pos - 2] = 0xff;
+  TEST_CHECK(NULL == vscp_ble_adv_find_frame(buf, sizeof(buf), &len));
+
+  // Name AD running past the end
+  memcpy(buf, adv.m_buf, adv.m_len);
+  buf[3] = (uint8_t) (adv.m_len - 3);
+  TEST_CHECK(NULL == vscp_ble_adv_find_frame(buf, adv.m_len, &len));
+
+  // A zero length AD ends the significant part, what follows is not read
+  memcpy(buf, (const uint8_t[]) { 0x02, 0x01, ADV_FLAGS, 0x00, 0x03, 0xff, 0x01, 0x02 }, 8);
+  TEST_CHECK(NULL == vscp_ble_adv_find_frame(buf, 8, &len));
+
+  // No manufacturer AD
+  memcpy(buf, adv.m_buf, adv.m_len);
+  buf[adv.m_frame_pos - 1] = 0x16; // Service data
+  TEST_CHECK(NULL == vscp_ble_adv_find_frame(buf, adv.m_len, &len));
+
+  // Other AD structures before it are skipped (TX power, 16 bit UUIDs)
+  memcpy(buf, (const uint8_t[]) { 0x02, 0x0a, 0x00, 0x03, 0x03, 0xaa, 0xfe, 0x03, 0xff, 0x01, 0x02 }, 11);
+  pframe = vscp_ble_adv_find_frame(buf, 11, &len);
+  TEST_CHECK(pframe == buf + 9);
+  TEST_CHECK_EQ(len, 2);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_template();
+  test_find_frame();
+
+  return TEST_RESULT();
+}
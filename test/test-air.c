@@ -0,0 +1,578 @@
+/*!
+  @file test-air.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-adv.h"
+#include "vscp-ble-test.h"
+#include "vscp-ble.h"
+
+/*
+  Discrete-event simulation of many nodes advertising to one gateway.
+
+  Each node runs the timing of eventGenerator() and std_advertise(): an
+  update every 1000 ms plus up to 10% jitter in 10 ms ticks, a burst of
+  advertising events per update ending after repeat * (interval + 5) ms,
+  or continuous advertising with a repeat count of zero. The controller
+  adds advDelay (0-10 ms) to each event and sends the advert on channels
+  37, 38 and 39 in turn. Adverts are encoded with the real encoder.
+
+  Two adverts on the same channel that overlap in time are both lost. The
+  scanner listens for a window at the start of each scan interval and
+  moves to the next channel each interval. A received advert is decoded
+  with the real decoder. An update is delivered when any of its adverts
+  is received.
+
+    test-air                                 runs the checks
+    test-air nodes itvl repeat duty [jitter] prints one configuration
+*/
+
+#define PERIOD_MS        1000 // Update period of eventGenerator()
+#define JITTER_MS        100  // Largest update jitter
+#define TICK_MS          10   // FreeRTOS tick, the jitter is in whole ticks
+#define ADV_DELAY_US     10000
+#define CHANNELS         3
+#define CHANNEL_GAP_US   150  // From the end of an advert to the next channel
+#define SCAN_ITVL_MS     100
+#define RUN_MS           30000
+#define ADV_OVERHEAD     16 // Preamble, access address, header, AdvA, CRC
+
+// One configuration
+typedef struct air_cfg {
+  uint16_t m_nodes;       // Nodes in range of the gateway
+  uint16_t m_itvl_ms;     // Advertising interval (register 0x00)
+  uint8_t m_repeat;       // Advertising events per update (register 0x05)
+  uint8_t m_duty_pct;     // Scan window in percent of the scan interval
+  bool m_bJitter;         // Update period jitter
+  bool m_bPowerTogether;  // All nodes start at the same time
+} air_cfg_t;
+
+// Results of one configuration
+typedef struct air_result {
+  double m_delivery;       // Updates delivered / updates sent
+  double m_node_min;       // Delivery of the worst node
+  double m_latency_avg_ms; // Update to first reception
+  double m_latency_p95_ms;
+  double m_events_per_burst; // Advertising events per update
+  uint32_t m_decode_errors;
+} air_result_t;
+
+// An update, the sample taken and the advert it was encoded into
+typedef struct air_update {
+  uint16_t m_node;
+  uint32_t m_counter;
+  int64_t m_start_us;
+  int64_t m_rx_us; // First reception, -1 if not received
+  uint8_t m_adv[VSCP_BLE_ADV_MAX_SIZE];
+  uint8_t m_len;
+} air_update_t;
+
+// An advert on one channel
+typedef struct air_packet {
+  int64_t m_start_us;
+  int64_t m_end_us;
+  uint32_t m_update; // Index into the update table
+  uint8_t m_channel; // 0-2 for channel 37-39
+  bool m_bCollided;
+} air_packet_t;
+
+static uint64_t s_rand = 0x2545f4914f6cdd1dULL;
+
+static air_update_t *s_updates;
+static uint32_t s_nupdates;
+static uint32_t s_maxupdates;
+static air_packet_t *s_packets;
+static uint32_t s_npackets;
+static uint32_t s_maxpackets;
+
+///////////////////////////////////////////////////////////////////////////////
+// air_random
+//
+
+static uint32_t
+air_random(void)
+{
+  s_rand ^= s_rand >> 12;
+  s_rand ^= s_rand << 25;
+  s_rand ^= s_rand >> 27;
+  return (uint32_t) ((s_rand * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// packet_add
+//
+
+static void
+packet_add(int64_t start_us, int64_t airtime_us, uint32_t update, uint8_t channel)
+{
+  if (s_npackets == s_maxpackets) {
+    s_maxpackets = s_maxpackets ? (2 * s_maxpackets) : 65536;
+    s_packets    = realloc(s_packets, s_maxpackets * sizeof(air_packet_t));
+  }
+
+  s_packets[s_npackets].m_start_us  = start_us;
+  s_packets[s_npackets].m_end_us    = start_us + airtime_us;
+  s_packets[s_npackets].m_update    = update;
+  s_packets[s_npackets].m_channel   = channel;
+  s_packets[s_npackets].m_bCollided = false;
+  s_npackets++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// update_add
+//
+// Takes a sample and encodes it like take_sample() and
+// update_advertising_data() do.
+//
+
+static uint32_t
+update_add(vscp_ble_ctx_t *ctx, vscp_ble_adv_t *padv, uint16_t node, uint32_t counter, int64_t start_us)
+{
+  air_update_t *pup;
+  uint8_t sample[5] = { 0x60, counter >> 24, counter >> 16, counter >> 8, counter };
+  vscpEvent ev      = { 0 };
+  int len;
+
+  if (s_nupdates == s_maxupdates) {
+    s_maxupdates = s_maxupdates ? (2 * s_maxupdates) : 4096;
+    s_updates    = realloc(s_updates, s_maxupdates * sizeof(air_update_t));
+  }
+
+  ev.head       = VSCP_PRIORITY_NORMAL;
+  ev.vscp_class = 15;
+  ev.vscp_type  = 1;
+  ev.sizeData   = sizeof(sample);
+  ev.pdata      = sample;
+  len           = vscp_ble_adv_set_event(padv, ctx, &ev);
+  TEST_CHECK(len > 0);
+
+  pup             = &s_updates[s_nupdates];
+  pup->m_node     = node;
+  pup->m_counter  = counter;
+  pup->m_start_us = start_us;
+  pup->m_rx_us    = -1;
+  pup->m_len      = (len > 0) ? (uint8_t) len : 0;
+  memcpy(pup->m_adv, padv->m_buf, pup->m_len);
+
+  return s_nupdates++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// node_run
+//
+// Generates the updates and adverts of one node.
+//
+
+static uint32_t
+node_run(const air_cfg_t *pcfg, uint16_t node)
+{
+  vscp_ble_ctx_t ctx = { 0 };
+  vscp_ble_adv_t adv;
+  uint8_t guid[16]   = { 0 };
+  uint32_t events    = 0;
+  uint32_t counter   = 0;
+  int64_t itvl_us    = pcfg->m_itvl_ms * 1000LL;
+  int64_t update_us  = pcfg->m_bPowerTogether ? 0 : (int64_t) (air_random() % (PERIOD_MS * 1000));
+  int64_t next_us;
+  int64_t end_us;
+  int64_t ev_us;
+  int64_t airtime_us;
+  uint32_t period_ms;
+  uint32_t update;
+
+  guid[14] = (uint8_t) ((node + 1) >> 8);
+  guid[15] = (uint8_t) (node + 1);
+  vscp_ble_set_guid(&ctx, guid);
+  vscp_ble_adv_init(&adv, 0x06, "VSCP");
+
+  while (update_us < (RUN_MS * 1000LL)) {
+    period_ms = PERIOD_MS;
+    if (pcfg->m_bJitter) {
+      period_ms = ((PERIOD_MS + (air_random() % JITTER_MS)) / TICK_MS) * TICK_MS;
+    }
+    next_us = update_us + (period_ms * 1000LL);
+
+    update     = update_add(&ctx, &adv, node, ++counter, update_us);
+    airtime_us = (ADV_OVERHEAD + s_updates[update].m_len) * 8;
+
+    // The burst ends at its duration, continuous advertising at the next update
+    end_us = next_us;
+    if (pcfg->m_repeat) {
+      end_us = update_us + pcfg->m_repeat * ((pcfg->m_itvl_ms + 5) * 1000LL);
+      if (end_us > next_us) {
+        end_us = next_us;
+      }
+    }
+
+    ev_us = update_us + (air_random() % (ADV_DELAY_US + 1));
+    while (ev_us < end_us) {
+      for (uint8_t ch = 0; ch < CHANNELS; ch++) {
+        packet_add(ev_us + ch * (airtime_us + CHANNEL_GAP_US), airtime_us, update, ch);
+      }
+      events++;
+      ev_us += itvl_us + (air_random() % (ADV_DELAY_US + 1));
+    }
+
+    update_us = next_us;
+  }
+
+  return events;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// packet_cmp
+//
+
+static int
+packet_cmp(const void *a, const void *b)
+{
+  const air_packet_t *pa = a;
+  const air_packet_t *pb = b;
+
+  if (pa->m_start_us != pb->m_start_us) {
+    return (pa->m_start_us < pb->m_start_us) ? -1 : 1;
+  }
+
+  return (int) pa->m_channel - (int) pb->m_channel;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// int64_cmp
+//
+
+static int
+int64_cmp(const void *a, const void *b)
+{
+  int64_t va = *(const int64_t *) a;
+  int64_t vb = *(const int64_t *) b;
+
+  return (va < vb) ? -1 : (va > vb);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// scanner_hears
+//
+// The scanner listens on channel 37 + (n % 3) during the window at the
+// start of scan interval n.
+//
+
+static bool
+scanner_hears(const air_cfg_t *pcfg, const air_packet_t *ppkt)
+{
+  int64_t scan_itvl_us = SCAN_ITVL_MS * 1000LL;
+  int64_t window_us    = (scan_itvl_us * pcfg->m_duty_pct) / 100;
+  int64_t n            = ppkt->m_start_us / scan_itvl_us;
+  int64_t offset_us    = ppkt->m_start_us - (n * scan_itvl_us);
+
+  return ((n % CHANNELS) == ppkt->m_channel) && ((offset_us + (ppkt->m_end_us - ppkt->m_start_us)) <= window_us);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// air_run
+//
+
+static void
+air_run(const air_cfg_t *pcfg, air_result_t *pres)
+{
+  int64_t max_end_us[CHANNELS];
+  int64_t max_idx[CHANNELS];
+  uint32_t *pdelivered;
+  uint32_t *psent;
+  int64_t *platency;
+  uint32_t nlatency  = 0;
+  uint32_t events    = 0;
+  uint32_t delivered = 0;
+  double latency_sum = 0.0;
+
+  memset(pres, 0, sizeof(air_result_t));
+  s_nupdates = 0;
+  s_npackets = 0;
+
+  for (uint16_t node = 0; node < pcfg->m_nodes; node++) {
+    events += node_run(pcfg, node);
+  }
+
+  // Overlapping adverts on a channel are lost. An advert that starts
+  // before the latest end seen so far overlaps the advert with that end.
+  qsort(s_packets, s_npackets, sizeof(air_packet_t), packet_cmp);
+  for (int ch = 0; ch < CHANNELS; ch++) {
+    max_end_us[ch] = -1;
+    max_idx[ch]    = -1;
+  }
+  for (uint32_t i = 0; i < s_npackets; i++) {
+    air_packet_t *ppkt = &s_packets[i];
+    uint8_t ch         = ppkt->m_channel;
+
+    if ((max_idx[ch] >= 0) && (ppkt->m_start_us < max_end_us[ch])) {
+      ppkt->m_bCollided                  = true;
+      s_packets[max_idx[ch]].m_bCollided = true;
+    }
+    if (ppkt->m_end_us > max_end_us[ch]) {
+      max_end_us[ch] = ppkt->m_end_us;
+      max_idx[ch]    = i;
+    }
+  }
+
+  // Gateway side, decode what the scanner hears
+  for (uint32_t i = 0; i < s_npackets; i++) {
+    air_packet_t *ppkt = &s_packets[i];
+    air_update_t *pup  = &s_updates[ppkt->m_update];
+    vscp_ble_ctx_t ctx = { 0 };
+    vscpEventEx ex;
+    uint8_t frame[VSCP_BLE_ADV_MAX_SIZE];
+    const uint8_t *pframe;
+    uint8_t frame_len;
+    uint32_t counter;
+
+    if (ppkt->m_bCollided || !scanner_hears(pcfg, ppkt) || (pup->m_rx_us >= 0)) {
+      continue;
+    }
+
+    pframe = vscp_ble_adv_find_frame(pup->m_adv, pup->m_len, &frame_len);
+    if (NULL == pframe) {
+      pres->m_decode_errors++;
+      continue;
+    }
+    memcpy(frame, pframe, frame_len);
+    if (vscp_ble_frame_to_ex(&ctx, &ex, frame, frame_len) < 0) {
+      pres->m_decode_errors++;
+      continue;
+    }
+
+    counter = ((uint32_t) ex.data[1] << 24) | ((uint32_t) ex.data[2] << 16) | ((uint32_t) ex.data[3] << 8) | ex.data[4];
+    if ((counter != pup->m_counter) || (((ex.GUID[14] << 8) | ex.GUID[15]) != (pup->m_node + 1))) {
+      pres->m_decode_errors++;
+      continue;
+    }
+
+    pup->m_rx_us = ppkt->m_end_us;
+  }
+
+  // Per node delivery and latency
+  pdelivered = calloc(pcfg->m_nodes, sizeof(uint32_t));
+  psent      = calloc(pcfg->m_nodes, sizeof(uint32_t));
+  platency   = malloc((s_nupdates + 1) * sizeof(int64_t));
+  for (uint32_t i = 0; i < s_nupdates; i++) {
+    psent[s_updates[i].m_node]++;
+    if (s_updates[i].m_rx_us >= 0) {
+      pdelivered[s_updates[i].m_node]++;
+      delivered++;
+      platency[nlatency++] = s_updates[i].m_rx_us - s_updates[i].m_start_us;
+      latency_sum += (double) (s_updates[i].m_rx_us - s_updates[i].m_start_us);
+    }
+  }
+
+  pres->m_node_min = 1.0;
+  for (uint16_t node = 0; node < pcfg->m_nodes; node++) {
+    double p = psent[node] ? ((double) pdelivered[node] / psent[node]) : 1.0;
+    if (p < pres->m_node_min) {
+      pres->m_node_min = p;
+    }
+  }
+
+  qsort(platency, nlatency, sizeof(int64_t), int64_cmp);
+  pres->m_delivery         = s_nupdates ? ((double) delivered / s_nupdates) : 0.0;
+  pres->m_latency_avg_ms   = nlatency ? (latency_sum / nlatency) / 1000.0 : 0.0;
+  pres->m_latency_p95_ms   = nlatency ? (double) platency[(nlatency * 95) / 100] / 1000.0 : 0.0;
+  pres->m_events_per_burst = s_nupdates ? ((double) events / s_nupdates) : 0.0;
+
+  free(pdelivered);
+  free(psent);
+  free(platency);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// air_report
+//
+
+static void
+air_report(const char *name, const air_cfg_t *pcfg, const air_result_t *pres)
+{
+  char label[64];
+
+  printf("%s: nodes=%u itvl=%u ms repeat=%u duty=%u%% jitter=%d delivery=%.3f worst node=%.3f "
+         "latency avg=%.1f p95=%.1f ms events/update=%.2f\n",
+         name,
+         pcfg->m_nodes,
+         pcfg->m_itvl_ms,
+         pcfg->m_repeat,
+         pcfg->m_duty_pct,
+         pcfg->m_bJitter,
+         pres->m_delivery,
+         pres->m_node_min,
+         pres->m_latency_avg_ms,
+         pres->m_latency_p95_ms,
+         pres->m_events_per_burst);
+
+  snprintf(label, sizeof(label), "air_%s_delivery", name);
+  test_bench(label, pres->m_delivery * 100.0, "%");
+  snprintf(label, sizeof(label), "air_%s_latency_p95", name);
+  test_bench(label, pres->m_latency_p95_ms, "ms");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_single
+//
+// One node and a scanner that is always on, every update arrives within
+// advDelay and the adverts on all three channels.
+//
+
+static void
+test_single(void)
+{
+  air_cfg_t cfg = { .m_nodes = 1, .m_itvl_ms = 20, .m_repeat = 1, .m_duty_pct = 100, .m_bJitter = true };
+  air_result_t res;
+
+  air_run(&cfg, &res);
+  air_report("single", &cfg, &res);
+  TEST_CHECK_EQ(res.m_decode_errors, 0);
+  TEST_CHECK(res.m_delivery > 0.999);
+  TEST_CHECK(res.m_latency_p95_ms <=
+             (ADV_DELAY_US + (CHANNELS * (ADV_OVERHEAD + VSCP_BLE_ADV_MAX_SIZE) * 8) + ((CHANNELS - 1) * CHANNEL_GAP_US)) /
+               1000.0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_repeat
+//
+// A burst is about repeat advertising events long, and on a busy channel
+// more repetitions deliver more updates.
+//
+
+static void
+test_repeat(void)
+{
+  static const uint8_t repeats[] = { 1, 2, 3, 5 };
+  air_cfg_t cfg                  = { .m_nodes = 200, .m_itvl_ms = 20, .m_duty_pct = 100, .m_bJitter = true };
+  air_result_t res;
+  double last = 0.0;
+  char name[16];
+
+  for (size_t i = 0; i < sizeof(repeats); i++) {
+    cfg.m_repeat = repeats[i];
+    air_run(&cfg, &res);
+    snprintf(name, sizeof(name), "repeat%u", repeats[i]);
+    air_report(name, &cfg, &res);
+
+    TEST_CHECK_EQ(res.m_decode_errors, 0);
+    TEST_CHECK(res.m_events_per_burst > (repeats[i] - 0.5));
+    TEST_CHECK(res.m_events_per_burst < (repeats[i] + 0.5));
+    TEST_CHECK(res.m_delivery > last);
+    last = res.m_delivery;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_jitter
+//
+// Nodes powered up together stay in lock step without the update jitter
+// and keep colliding.
+//
+
+static void
+test_jitter(void)
+{
+  air_cfg_t cfg = { .m_nodes = 100, .m_itvl_ms = 20, .m_repeat = 1, .m_duty_pct = 100, .m_bPowerTogether = true };
+  air_result_t fixed;
+  air_result_t jitter;
+
+  air_run(&cfg, &fixed);
+  air_report("lockstep", &cfg, &fixed);
+
+  cfg.m_bJitter = true;
+  air_run(&cfg, &jitter);
+  air_report("jitter", &cfg, &jitter);
+
+  TEST_CHECK(jitter.m_delivery > (fixed.m_delivery + 0.1));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_duty
+//
+// A scanner that listens part time misses single adverts, repetitions
+// make up for it.
+//
+
+static void
+test_duty(void)
+{
+  air_cfg_t cfg = { .m_nodes = 50, .m_itvl_ms = 20, .m_repeat = 1, .m_duty_pct = 30, .m_bJitter = true };
+  air_result_t once;
+  air_result_t repeated;
+
+  air_run(&cfg, &once);
+  air_report("duty30_repeat1", &cfg, &once);
+
+  cfg.m_repeat = 5;
+  air_run(&cfg, &repeated);
+  air_report("duty30_repeat5", &cfg, &repeated);
+
+  TEST_CHECK(once.m_delivery < 0.5);
+  TEST_CHECK(repeated.m_delivery > (once.m_delivery + 0.2));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(int argc, char *argv[])
+{
+  air_result_t res;
+  air_cfg_t cfg = { .m_bJitter = true };
+
+  if (argc >= 5) {
+    cfg.m_nodes    = (uint16_t) atoi(argv[1]);
+    cfg.m_itvl_ms  = (uint16_t) atoi(argv[2]);
+    cfg.m_repeat   = (uint8_t) atoi(argv[3]);
+    cfg.m_duty_pct = (uint8_t) atoi(argv[4]);
+    if (argc >= 6) {
+      cfg.m_bJitter = (0 != atoi(argv[5]));
+    }
+    air_run(&cfg, &res);
+    air_report("custom", &cfg, &res);
+  }
+  else {
+    test_single();
+    test_repeat();
+    test_jitter();
+    test_duty();
+  }
+
+  free(s_updates);
+  free(s_packets);
+
+  return TEST_RESULT();
+}
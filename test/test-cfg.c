@@ -0,0 +1,349 @@
+/*!
+  @file test-cfg.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+#include "sdkconfig.h"
+#include "nvs.h"
+#include "stubs.h"
+#include "vscp-ble-cfg.h"
+#include "vscp-ble-test.h"
+
+#define MS 1000LL // Microseconds per millisecond
+
+///////////////////////////////////////////////////////////////////////////////
+// test_defaults
+//
+// Nothing stored gives the defaults and no flash write.
+//
+
+static void
+test_defaults(void)
+{
+  stub_nvs_stats_t stats;
+
+  stub_nvs_erase();
+  TEST_CHECK_EQ(vscp_ble_cfg_init(), VSCP_ERROR_SUCCESS);
+
+  TEST_CHECK_EQ(vscp_ble_cfg_get_adv_itvl(), VSCP_BLE_CFG_DEFAULT_ADV_ITVL);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_manufacturer(), VSCP_BLE_CFG_DEFAULT_MANUFACTURER);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_adv_repeat(), VSCP_BLE_CFG_DEFAULT_ADV_REPEAT);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_zone(), VSCP_BLE_CFG_DEFAULT_ZONE);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_subzone(), VSCP_BLE_CFG_DEFAULT_ZONE);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_encryption(), 0);
+
+  TEST_CHECK_EQ(vscp_ble_cfg_poll(), VSCP_ERROR_SUCCESS);
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_sets, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_persist
+//
+// A write is flushed after the idle time and survives a reboot.
+//
+
+static void
+test_persist(void)
+{
+  const uint8_t guid[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+  uint8_t buf[16];
+  stub_nvs_stats_t stats;
+
+  stub_nvs_erase();
+  stub_time_set(0);
+  vscp_ble_cfg_init();
+
+  TEST_CHECK_EQ(vscp_ble_cfg_write_reg(0, VSCP_BLE_REG_ADV_ITVL, 0x01), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_cfg_write_reg(0, VSCP_BLE_REG_ADV_ITVL + 1, 0x2c), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_cfg_set_guid(guid), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_adv_itvl(), 300);
+
+  // Not due yet
+  stub_time_advance(CONFIG_VSCP_BLE_CFG_FLUSH_IDLE_MS * MS - 1);
+  vscp_ble_cfg_poll();
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_commits, 0);
+
+  // Idle time passed
+  stub_time_advance(1);
+  TEST_CHECK_EQ(vscp_ble_cfg_poll(), VSCP_ERROR_SUCCESS);
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_commits, 1);
+  TEST_CHECK_EQ(stats.m_bytes_written, sizeof(vscp_ble_cfg_data_t));
+
+  // Nothing more to write
+  stub_time_advance(CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS * MS);
+  vscp_ble_cfg_poll();
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_commits, 1);
+
+  // Reboot
+  vscp_ble_cfg_init();
+  TEST_CHECK_EQ(vscp_ble_cfg_get_adv_itvl(), 300);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_guid(buf), VSCP_ERROR_SUCCESS);
+  TEST_CHECK(!memcmp(buf, guid, 16));
+  TEST_CHECK_EQ(vscp_ble_cfg_read_reg(0, VSCP_BLE_STDREG_GUID + 15), 16);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_upgrade
+//
+// A version 1 blob keeps its page 0 registers and GUID, the registers
+// added in version 2 get their defaults and the upgrade is written back.
+//
+
+static void
+test_upgrade(void)
+{
+  const uint8_t guid[16] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+  vscp_ble_cfg_data_t v1 = { 0 };
+  size_t len             = offsetof(vscp_ble_cfg_data_t, m_regs[1]);
+  nvs_handle_t handle;
+  stub_nvs_stats_t stats;
+  uint8_t buf[16];
+
+  v1.m_version                                = 1;
+  v1.m_regs[0][VSCP_BLE_REG_ADV_ITVL]         = 0x01;
+  v1.m_regs[0][VSCP_BLE_REG_ADV_ITVL + 1]     = 0x2c;
+  v1.m_regs[0][VSCP_BLE_REG_MANUFACTURER]     = 0x12;
+  v1.m_regs[0][VSCP_BLE_REG_MANUFACTURER + 1] = 0x34;
+  v1.m_regs[0][VSCP_BLE_REG_ADV_REPEAT]       = 3;
+  memcpy(v1.m_guid, guid, sizeof(guid));
+
+  stub_nvs_erase();
+  stub_time_set(0);
+  TEST_CHECK_EQ(nvs_open(VSCP_BLE_CFG_NVS_NAMESPACE, NVS_READWRITE, &handle), ESP_OK);
+  TEST_CHECK_EQ(nvs_set_blob(handle, VSCP_BLE_CFG_NVS_KEY, &v1, len), ESP_OK);
+  TEST_CHECK_EQ(nvs_commit(handle), ESP_OK);
+  nvs_close(handle);
+
+  TEST_CHECK_EQ(vscp_ble_cfg_init(), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_adv_itvl(), 300);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_manufacturer(), 0x1234);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_adv_repeat(), 3);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_zone(), VSCP_BLE_CFG_DEFAULT_ZONE);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_subzone(), VSCP_BLE_CFG_DEFAULT_ZONE);
+  TEST_CHECK_EQ(vscp_ble_cfg_read_reg(VSCP_BLE_CFG_PAGE_DM, 0), 0);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_guid(buf), VSCP_ERROR_SUCCESS);
+  TEST_CHECK(!memcmp(buf, guid, 16));
+
+  // The upgraded blob is written back
+  stub_time_advance(CONFIG_VSCP_BLE_CFG_FLUSH_IDLE_MS * MS);
+  TEST_CHECK_EQ(vscp_ble_cfg_poll(), VSCP_ERROR_SUCCESS);
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_bytes_written, len + sizeof(vscp_ble_cfg_data_t));
+
+  // Reboot, now a version 2 blob
+  TEST_CHECK_EQ(vscp_ble_cfg_init(), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_adv_itvl(), 300);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_zone(), VSCP_BLE_CFG_DEFAULT_ZONE);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_subzone(), VSCP_BLE_CFG_DEFAULT_ZONE);
+  vscp_ble_cfg_poll();
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_bytes_written, len + sizeof(vscp_ble_cfg_data_t));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_coalescing
+//
+// A steady stream of writes is flushed on the deadline, not per write.
+//
+
+static void
+test_coalescing(void)
+{
+  const int writes    = 1000;
+  const int period_ms = 100; // Shorter than the idle time
+  stub_nvs_stats_t stats;
+
+  stub_nvs_erase();
+  stub_time_set(0);
+  vscp_ble_cfg_init();
+
+  for (int i = 0; i < writes; i++) {
+    vscp_ble_cfg_write_reg(1, (uint8_t) (i % VSCP_BLE_CFG_PAGE_SIZE), (uint8_t) (i + 1));
+    stub_time_advance(period_ms * MS);
+    vscp_ble_cfg_poll();
+  }
+
+  // One flush per deadline while writes keep coming
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_commits, (writes * period_ms) / CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS);
+  test_bench("cfg_flash_writes_per_1000_reg_writes", stats.m_commits, "writes");
+
+  // The tail is flushed once the writes stop
+  stub_time_advance(CONFIG_VSCP_BLE_CFG_FLUSH_IDLE_MS * MS);
+  vscp_ble_cfg_poll();
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_commits, (writes * period_ms) / CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS + 1);
+
+  vscp_ble_cfg_init();
+  TEST_CHECK_EQ(vscp_ble_cfg_read_reg(1, (writes - 1) % VSCP_BLE_CFG_PAGE_SIZE), (uint8_t) writes);
+
+  // Writing the value already there is not a change
+  vscp_ble_cfg_write_reg(1, (writes - 1) % VSCP_BLE_CFG_PAGE_SIZE, (uint8_t) writes);
+  stub_time_advance(CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS * MS);
+  vscp_ble_cfg_poll();
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_commits, (writes * period_ms) / CONFIG_VSCP_BLE_CFG_FLUSH_MAX_MS + 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_flush_error
+//
+// A failed flash write is retried on the next poll.
+//
+
+static void
+test_flush_error(void)
+{
+  stub_nvs_stats_t stats;
+
+  stub_nvs_erase();
+  stub_time_set(0);
+  vscp_ble_cfg_init();
+
+  vscp_ble_cfg_write_reg(0, VSCP_BLE_REG_FLAGS, VSCP_BLE_REG_FLAG_ENCRYPTION);
+  stub_nvs_fail(1, ESP_FAIL);
+  TEST_CHECK(VSCP_ERROR_SUCCESS != vscp_ble_cfg_flush());
+
+  stub_time_advance(CONFIG_VSCP_BLE_CFG_FLUSH_IDLE_MS * MS);
+  TEST_CHECK_EQ(vscp_ble_cfg_poll(), VSCP_ERROR_SUCCESS);
+  stub_nvs_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_commits, 1);
+
+  vscp_ble_cfg_init();
+  TEST_CHECK_EQ(vscp_ble_cfg_get_encryption(), 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_registers
+//
+// Register map edges, pages and blocks.
+//
+
+static void
+test_registers(void)
+{
+  uint8_t buf[256];
+  uint8_t rd[256];
+  uint16_t written;
+
+  stub_nvs_erase();
+  vscp_ble_cfg_init();
+
+  // Page select
+  TEST_CHECK_EQ(vscp_ble_cfg_write_reg(0, VSCP_BLE_STDREG_PAGE_MSB, 0x00), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_cfg_write_reg(0, VSCP_BLE_STDREG_PAGE_LSB, 0x03), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_cfg_get_page(), 3);
+
+  // Pages past the shadow
+  TEST_CHECK_EQ(vscp_ble_cfg_write_reg(VSCP_BLE_CFG_PAGES, 0, 1), VSCP_ERROR_INDEX_OOB);
+  TEST_CHECK_EQ(vscp_ble_cfg_read_reg(VSCP_BLE_CFG_PAGES, 0), 0);
+
+  // Standard registers other than page select are read only
+  TEST_CHECK_EQ(vscp_ble_cfg_write_reg(0, VSCP_BLE_STDREG_GUID, 1), VSCP_ERROR_NOT_SUPPORTED);
+
+  // A block writes the paged part in one go and stops at the first read
+  // only standard register
+  for (int i = 0; i < 256; i++) {
+    buf[i] = (uint8_t) (0xA0 ^ i);
+  }
+  TEST_CHECK_EQ(vscp_ble_cfg_write_block(2, 0x70, buf, 0x10, &written), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(written, 0x10);
+  TEST_CHECK_EQ(vscp_ble_cfg_write_block(2, 0x70, buf, 0x20, &written), VSCP_ERROR_NOT_SUPPORTED);
+  TEST_CHECK_EQ(written, 0x10);
+
+  TEST_CHECK_EQ(vscp_ble_cfg_read_block(2, 0x70, rd, 0x10), VSCP_ERROR_SUCCESS);
+  TEST_CHECK(!memcmp(rd, buf, 0x10));
+
+  // Runs may not pass 0xFF
+  TEST_CHECK_EQ(vscp_ble_cfg_read_block(0, 0xF0, rd, 0x11), VSCP_ERROR_INVALID_PARAMETER);
+  TEST_CHECK_EQ(vscp_ble_cfg_read_block(0, 0x00, rd, 0x100), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_cfg_write_block(0, 0x00, buf, 0, &written), VSCP_ERROR_INVALID_PARAMETER);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bench_access
+//
+// Cost of shadow reads and writes.
+//
+
+static void
+bench_access(void)
+{
+  const int loops = 1000000;
+  volatile uint8_t sink = 0;
+  uint64_t start;
+
+  stub_nvs_erase();
+  vscp_ble_cfg_init();
+
+  start = test_now_ns();
+  for (int i = 0; i < loops; i++) {
+    sink += vscp_ble_cfg_read_reg(0, (uint8_t) (i & 0x7f));
+  }
+  test_bench("cfg_read_reg", (double) (test_now_ns() - start) / loops, "ns");
+
+  start = test_now_ns();
+  for (int i = 0; i < loops; i++) {
+    vscp_ble_cfg_write_reg(1, (uint8_t) (i & 0x7f), (uint8_t) i);
+  }
+  test_bench("cfg_write_reg", (double) (test_now_ns() - start) / loops, "ns");
+
+  start = test_now_ns();
+  for (int i = 0; i < 1000; i++) {
+    vscp_ble_cfg_write_reg(1, 0, (uint8_t) i);
+    vscp_ble_cfg_flush();
+  }
+  test_bench("cfg_flush", (double) (test_now_ns() - start) / 1000, "ns");
+  (void) sink;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_defaults();
+  test_persist();
+  test_upgrade();
+  test_coalescing();
+  test_flush_error();
+  test_registers();
+  bench_access();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,506 @@
+/*!
+  @file test-dm.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#include "vscp-ble-dm.h"
+#include "vscp-ble-test.h"
+
+#define BENCH_EVENTS 256     // Distinct events in the benchmark
+#define BENCH_ROUNDS 1000000 // Events matched in the benchmark
+
+#define FLAGS_ON VSCP_BLE_DM_FLAG_ENABLED
+
+static vscp_ble_dm_t s_dm;
+
+// Rows seen by the action callback, in call order
+static struct {
+  int m_cnt;
+  uint8_t m_rows[VSCP_BLE_DM_MAX_ROWS];
+} s_hits;
+
+///////////////////////////////////////////////////////////////////////////////
+// hit_cb
+//
+
+static void
+hit_cb(const uint8_t *prow, const vscpEvent *pev, void *arg)
+{
+  if (s_hits.m_cnt < VSCP_BLE_DM_MAX_ROWS) {
+    s_hits.m_rows[s_hits.m_cnt] = (uint8_t) ((prow - s_dm.m_rows[0]) / VSCP_BLE_DM_ROW_SIZE);
+  }
+  s_hits.m_cnt++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// set_row
+//
+
+static void
+set_row(uint8_t *prow,
+        uint8_t oaddr,
+        uint8_t flags,
+        uint8_t class_mask,
+        uint8_t class_filter,
+        uint8_t type_mask,
+        uint8_t type_filter)
+{
+  prow[VSCP_BLE_DM_POS_OADDR]        = oaddr;
+  prow[VSCP_BLE_DM_POS_FLAGS]        = flags;
+  prow[VSCP_BLE_DM_POS_CLASS_MASK]   = class_mask;
+  prow[VSCP_BLE_DM_POS_CLASS_FILTER] = class_filter;
+  prow[VSCP_BLE_DM_POS_TYPE_MASK]    = type_mask;
+  prow[VSCP_BLE_DM_POS_TYPE_FILTER]  = type_filter;
+  prow[VSCP_BLE_DM_POS_ACTION]       = 1;
+  prow[VSCP_BLE_DM_POS_ACTION_PARAM] = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// set_event
+//
+
+static void
+set_event(vscpEvent *pev, uint8_t *pdata, uint16_t vscp_class, uint16_t vscp_type, uint8_t oaddr)
+{
+  memset(pev, 0, sizeof(vscpEvent));
+  pev->vscp_class = vscp_class;
+  pev->vscp_type  = vscp_type;
+  pev->GUID[15]   = oaddr;
+  pev->pdata      = pdata;
+  pev->sizeData   = 3;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// match
+//
+
+static int
+match(const vscpEvent *pev, uint8_t zone, uint8_t subzone)
+{
+  s_hits.m_cnt = 0;
+  return vscp_ble_dm_match(&s_dm, pev, zone, subzone, hit_cb, NULL);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// linear_match
+//
+// Row by row evaluation of the decision matrix, as a Level I node without
+// the compiled bitmaps does it. Reference for the compiled match and the
+// baseline of the benchmark.
+//
+
+static int
+linear_match(const uint8_t *prows, uint8_t cnt, const vscpEvent *pev, uint8_t zone, uint8_t subzone)
+{
+  int matches = 0;
+
+  if ((pev->vscp_class >= VSCP_BLE_DM_CLASSES) || (pev->vscp_type >= VSCP_BLE_DM_TYPES)) {
+    return 0;
+  }
+
+  for (uint8_t i = 0; i < cnt; i++) {
+    const uint8_t *prow = prows + (i * VSCP_BLE_DM_ROW_SIZE);
+    uint8_t flags       = prow[VSCP_BLE_DM_POS_FLAGS];
+    uint16_t mask       = prow[VSCP_BLE_DM_POS_CLASS_MASK];
+    uint16_t filter     = prow[VSCP_BLE_DM_POS_CLASS_FILTER];
+
+    if (!(flags & VSCP_BLE_DM_FLAG_ENABLED)) {
+      continue;
+    }
+    if (flags & VSCP_BLE_DM_FLAG_CLASS_MASK_BIT8) {
+      mask |= 0x100;
+    }
+    if (flags & VSCP_BLE_DM_FLAG_CLASS_FILTER_BIT8) {
+      filter |= 0x100;
+    }
+    if ((pev->vscp_class ^ filter) & mask) {
+      continue;
+    }
+    if ((pev->vscp_type ^ prow[VSCP_BLE_DM_POS_TYPE_FILTER]) & prow[VSCP_BLE_DM_POS_TYPE_MASK]) {
+      continue;
+    }
+    if ((flags & VSCP_BLE_DM_FLAG_OADDR) && (prow[VSCP_BLE_DM_POS_OADDR] != pev->GUID[15])) {
+      continue;
+    }
+    if ((flags & VSCP_BLE_DM_FLAG_ZONE) &&
+        ((pev->sizeData < 2) || ((VSCP_BLE_DM_ZONE_ALL != zone) && (VSCP_BLE_DM_ZONE_ALL != pev->pdata[1]) &&
+                                 (zone != pev->pdata[1])))) {
+      continue;
+    }
+    if ((flags & VSCP_BLE_DM_FLAG_SUBZONE) &&
+        ((pev->sizeData < 3) || ((VSCP_BLE_DM_ZONE_ALL != subzone) && (VSCP_BLE_DM_ZONE_ALL != pev->pdata[2]) &&
+                                 (subzone != pev->pdata[2])))) {
+      continue;
+    }
+    matches++;
+  }
+
+  return matches;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_class_bit8
+//
+// Bit 8 of the class mask and filter sits in the flags byte and selects
+// between a class and the same class plus 256.
+//
+
+static void
+test_class_bit8(void)
+{
+  uint8_t rows[4][VSCP_BLE_DM_ROW_SIZE];
+  uint8_t data[3] = { 0 };
+  vscpEvent ev;
+
+  // Class 10 only, class 266 only, both, and anything of type 6
+  set_row(rows[0], 0, FLAGS_ON | VSCP_BLE_DM_FLAG_CLASS_MASK_BIT8, 0xff, 10, 0xff, 6);
+  set_row(rows[1],
+          0,
+          FLAGS_ON | VSCP_BLE_DM_FLAG_CLASS_MASK_BIT8 | VSCP_BLE_DM_FLAG_CLASS_FILTER_BIT8,
+          0xff,
+          10,
+          0xff,
+          6);
+  set_row(rows[2], 0, FLAGS_ON, 0xff, 10, 0xff, 6);
+  set_row(rows[3], 0, FLAGS_ON, 0x00, 0x00, 0xff, 6);
+  vscp_ble_dm_compile(&s_dm, rows[0], 4);
+  TEST_CHECK_EQ(s_dm.m_cnt, 4);
+
+  set_event(&ev, data, 10, 6, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 3);
+  TEST_CHECK_EQ(s_hits.m_rows[0], 0);
+  TEST_CHECK_EQ(s_hits.m_rows[1], 2);
+  TEST_CHECK_EQ(s_hits.m_rows[2], 3);
+
+  set_event(&ev, data, 256 + 10, 6, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 3);
+  TEST_CHECK_EQ(s_hits.m_rows[0], 1);
+  TEST_CHECK_EQ(s_hits.m_rows[1], 2);
+  TEST_CHECK_EQ(s_hits.m_rows[2], 3);
+
+  // Wrong type, and Level II classes never match
+  set_event(&ev, data, 10, 7, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 0);
+  set_event(&ev, data, 512 + 10, 6, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 0);
+  set_event(&ev, data, 10, 256 + 6, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_disabled
+//
+// Rows without the enabled flag never match and come back when enabled and
+// compiled again.
+//
+
+static void
+test_disabled(void)
+{
+  uint8_t rows[2][VSCP_BLE_DM_ROW_SIZE];
+  uint8_t data[3] = { 0 };
+  vscpEvent ev;
+
+  set_row(rows[0], 0, 0, 0x00, 0x00, 0x00, 0x00);
+  set_row(rows[1], 0, VSCP_BLE_DM_FLAG_OADDR | VSCP_BLE_DM_FLAG_ZONE, 0x00, 0x00, 0x00, 0x00);
+  vscp_ble_dm_compile(&s_dm, rows[0], 2);
+
+  set_event(&ev, data, 20, 3, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 0);
+  for (int c = 0; c < VSCP_BLE_DM_CLASSES; c++) {
+    TEST_CHECK_EQ(s_dm.m_class[c], 0);
+  }
+
+  rows[0][VSCP_BLE_DM_POS_FLAGS] |= FLAGS_ON;
+  vscp_ble_dm_compile(&s_dm, rows[0], 2);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 1);
+  TEST_CHECK_EQ(s_hits.m_rows[0], 0);
+
+  // No rows
+  vscp_ble_dm_compile(&s_dm, NULL, 0);
+  TEST_CHECK_EQ(s_dm.m_cnt, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 0);
+  TEST_CHECK_EQ(vscp_ble_dm_match(NULL, &ev, 0, 0, NULL, NULL), 0);
+  TEST_CHECK_EQ(vscp_ble_dm_match(&s_dm, NULL, 0, 0, NULL, NULL), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_oaddr_zone
+//
+// Originating address, zone and sub-zone filters. A zone of 0xff on either
+// side matches all zones.
+//
+
+static void
+test_oaddr_zone(void)
+{
+  uint8_t rows[3][VSCP_BLE_DM_ROW_SIZE];
+  uint8_t data[3] = { 0 };
+  vscpEvent ev;
+
+  set_row(rows[0], 0x42, FLAGS_ON | VSCP_BLE_DM_FLAG_OADDR, 0xff, 20, 0xff, 3);
+  set_row(rows[1], 0x00, FLAGS_ON | VSCP_BLE_DM_FLAG_ZONE, 0xff, 20, 0xff, 4);
+  set_row(rows[2], 0x00, FLAGS_ON | VSCP_BLE_DM_FLAG_ZONE | VSCP_BLE_DM_FLAG_SUBZONE, 0xff, 20, 0xff, 5);
+  vscp_ble_dm_compile(&s_dm, rows[0], 3);
+
+  // Originating address is the last GUID byte
+  set_event(&ev, data, 20, 3, 0x42);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 1);
+  ev.GUID[15] = 0x43;
+  TEST_CHECK_EQ(match(&ev, 0, 0), 0);
+  ev.GUID[14] = 0x42;
+  TEST_CHECK_EQ(match(&ev, 0, 0), 0);
+
+  // Zone is data byte 1
+  set_event(&ev, data, 20, 4, 0);
+  data[1] = 7;
+  TEST_CHECK_EQ(match(&ev, 7, 0), 1);
+  TEST_CHECK_EQ(match(&ev, 8, 0), 0);
+  TEST_CHECK_EQ(match(&ev, VSCP_BLE_DM_ZONE_ALL, 0), 1);
+  data[1] = VSCP_BLE_DM_ZONE_ALL;
+  TEST_CHECK_EQ(match(&ev, 8, 0), 1);
+  ev.sizeData = 1;
+  TEST_CHECK_EQ(match(&ev, 8, 0), 0);
+  ev.sizeData = 2;
+  ev.pdata    = NULL;
+  TEST_CHECK_EQ(match(&ev, 8, 0), 0);
+
+  // Sub-zone is data byte 2, checked with the zone
+  set_event(&ev, data, 20, 5, 0);
+  data[1] = 7;
+  data[2] = 9;
+  TEST_CHECK_EQ(match(&ev, 7, 9), 1);
+  TEST_CHECK_EQ(match(&ev, 7, 10), 0);
+  TEST_CHECK_EQ(match(&ev, 8, 9), 0);
+  TEST_CHECK_EQ(match(&ev, 7, VSCP_BLE_DM_ZONE_ALL), 1);
+  data[2] = VSCP_BLE_DM_ZONE_ALL;
+  TEST_CHECK_EQ(match(&ev, 7, 10), 1);
+  ev.sizeData = 2;
+  TEST_CHECK_EQ(match(&ev, 7, 10), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_full
+//
+// All 64 rows, so that every bit of the bitmaps is used. Rows past the
+// maximum are left out.
+//
+
+static void
+test_full(void)
+{
+  uint8_t rows[VSCP_BLE_DM_MAX_ROWS + 8][VSCP_BLE_DM_ROW_SIZE];
+  uint8_t data[3] = { 0 };
+  vscpEvent ev;
+
+  // Row i matches type i of class 30
+  for (int i = 0; i < VSCP_BLE_DM_MAX_ROWS + 8; i++) {
+    set_row(rows[i], 0, FLAGS_ON, 0xff, 30, 0xff, (uint8_t) i);
+  }
+  vscp_ble_dm_compile(&s_dm, rows[0], VSCP_BLE_DM_MAX_ROWS + 8);
+  TEST_CHECK_EQ(s_dm.m_cnt, VSCP_BLE_DM_MAX_ROWS);
+
+  for (int i = 0; i < VSCP_BLE_DM_MAX_ROWS; i++) {
+    set_event(&ev, data, 30, (uint16_t) i, 0);
+    TEST_CHECK_EQ(match(&ev, 0, 0), 1);
+    TEST_CHECK_EQ(s_hits.m_rows[0], i);
+  }
+  TEST_CHECK_EQ(s_dm.m_type[63], (uint64_t) 1 << 63);
+  set_event(&ev, data, 30, VSCP_BLE_DM_MAX_ROWS, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), 0);
+
+  // Every row matches, called in row order
+  for (int i = 0; i < VSCP_BLE_DM_MAX_ROWS; i++) {
+    rows[i][VSCP_BLE_DM_POS_TYPE_MASK] = 0;
+  }
+  vscp_ble_dm_compile(&s_dm, rows[0], VSCP_BLE_DM_MAX_ROWS);
+  set_event(&ev, data, 30, 200, 0);
+  TEST_CHECK_EQ(match(&ev, 0, 0), VSCP_BLE_DM_MAX_ROWS);
+  for (int i = 0; i < VSCP_BLE_DM_MAX_ROWS; i++) {
+    TEST_CHECK_EQ(s_hits.m_rows[i], i);
+  }
+  TEST_CHECK_EQ(s_dm.m_class[30], UINT64_MAX);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// make_rows
+//
+// 64 rows of the kind a node is configured with: most pick one class and
+// type, some a range of types, some check the origin or zone and a few are
+// disabled.
+//
+
+static void
+make_rows(uint8_t *prows, uint32_t *prnd)
+{
+  for (int i = 0; i < VSCP_BLE_DM_MAX_ROWS; i++) {
+    uint32_t rnd = *prnd;
+    uint8_t flags;
+
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    *prnd = rnd;
+
+    flags = FLAGS_ON | (uint8_t) (rnd & (VSCP_BLE_DM_FLAG_OADDR | VSCP_BLE_DM_FLAG_ZONE | VSCP_BLE_DM_FLAG_SUBZONE |
+                                         VSCP_BLE_DM_FLAG_CLASS_MASK_BIT8 | VSCP_BLE_DM_FLAG_CLASS_FILTER_BIT8));
+    if (0 == ((rnd >> 8) & 0x0f)) {
+      flags &= (uint8_t) ~VSCP_BLE_DM_FLAG_ENABLED;
+    }
+    set_row(prows + (i * VSCP_BLE_DM_ROW_SIZE),
+            (uint8_t) ((rnd >> 12) & 0x03),
+            flags,
+            ((rnd >> 14) & 0x03) ? 0xff : 0xf0,
+            (uint8_t) ((rnd >> 16) & 0x1f),
+            ((rnd >> 21) & 0x03) ? 0xff : 0xf8,
+            (uint8_t) ((rnd >> 23) & 0x1f));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// make_events
+//
+
+static void
+make_events(vscpEvent *pevs, uint8_t (*pdata)[3], int cnt, uint32_t *prnd)
+{
+  for (int i = 0; i < cnt; i++) {
+    uint32_t rnd = *prnd;
+
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    *prnd = rnd;
+
+    pdata[i][0] = 0;
+    pdata[i][1] = (uint8_t) ((rnd >> 18) & 0x03);
+    pdata[i][2] = (uint8_t) ((rnd >> 20) & 0x03);
+    if (0 == ((rnd >> 22) & 0x07)) {
+      pdata[i][1] = VSCP_BLE_DM_ZONE_ALL;
+    }
+    set_event(&pevs[i],
+              pdata[i],
+              (uint16_t) (rnd & 0x11f),
+              (uint16_t) ((rnd >> 9) & 0x1f),
+              (uint8_t) ((rnd >> 14) & 0x03));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_random
+//
+// The compiled matrix agrees with the row by row evaluation on random rows
+// and events.
+//
+
+static void
+test_random(void)
+{
+  static vscpEvent evs[BENCH_EVENTS];
+  static uint8_t data[BENCH_EVENTS][3];
+  uint8_t rows[VSCP_BLE_DM_MAX_ROWS][VSCP_BLE_DM_ROW_SIZE];
+  uint32_t rnd = 1;
+  int total    = 0;
+
+  for (int round = 0; round < 32; round++) {
+    make_rows(rows[0], &rnd);
+    make_events(evs, data, BENCH_EVENTS, &rnd);
+    vscp_ble_dm_compile(&s_dm, rows[0], VSCP_BLE_DM_MAX_ROWS);
+
+    for (int i = 0; i < BENCH_EVENTS; i++) {
+      uint8_t zone    = (uint8_t) (i & 0x03);
+      uint8_t subzone = (uint8_t) ((i >> 2) & 0x03);
+      int cnt         = linear_match(rows[0], VSCP_BLE_DM_MAX_ROWS, &evs[i], zone, subzone);
+
+      TEST_CHECK_EQ(match(&evs[i], zone, subzone), cnt);
+      total += cnt;
+    }
+  }
+
+  // The rows and events are close enough to match now and then
+  TEST_CHECK(total > 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bench_dm
+//
+// 64 rows, events from the same narrow range of classes and types, matched
+// with the compiled bitmaps and row by row.
+//
+
+static void
+bench_dm(void)
+{
+  static vscpEvent evs[BENCH_EVENTS];
+  static uint8_t data[BENCH_EVENTS][3];
+  uint8_t rows[VSCP_BLE_DM_MAX_ROWS][VSCP_BLE_DM_ROW_SIZE];
+  uint32_t rnd      = 7;
+  uint64_t compiled = 0;
+  uint64_t linear   = 0;
+  uint64_t start;
+
+  make_rows(rows[0], &rnd);
+  make_events(evs, data, BENCH_EVENTS, &rnd);
+
+  start = test_now_ns();
+  vscp_ble_dm_compile(&s_dm, rows[0], VSCP_BLE_DM_MAX_ROWS);
+  test_bench("dm_compile_64", (double) (test_now_ns() - start) / 1000, "us");
+
+  start = test_now_ns();
+  for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+    compiled += (uint64_t) vscp_ble_dm_match(&s_dm, &evs[i % BENCH_EVENTS], 1, 2, NULL, NULL);
+  }
+  test_bench("dm_match_64", (double) (test_now_ns() - start) / BENCH_ROUNDS, "ns");
+
+  start = test_now_ns();
+  for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+    linear += (uint64_t) linear_match(rows[0], VSCP_BLE_DM_MAX_ROWS, &evs[i % BENCH_EVENTS], 1, 2);
+  }
+  test_bench("dm_linear_64", (double) (test_now_ns() - start) / BENCH_ROUNDS, "ns");
+
+  TEST_CHECK_EQ(compiled, linear);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_class_bit8();
+  test_disabled();
+  test_oaddr_zone();
+  test_full();
+  test_random();
+  bench_dm();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,576 @@
+/*!
+  @file test-frame.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-test.h"
+#include "vscp-ble.h"
+
+#define ROUNDS        10000   // Random events per property
+#define BENCH_FRAMES  200000  // Frames in the throughput measurement
+#define MIN_FRAMES_S  100000  // Slowest acceptable rate, sanitizer builds included
+#define TIME_BASE_MS  1700000000000ULL
+#define HEARD_US      ((1ULL << 32) + 5000000) // Clock past the 32 bit event timestamp wrap
+
+///////////////////////////////////////////////////////////////////////////////
+// test_random
+//
+
+static uint32_t
+test_random(void)
+{
+  static uint32_t state = 0x9e3779b9;
+
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// random_event
+//
+// Random event with 0 to VSCP_BLE_FRAME_MAX_DATA_SIZE data bytes.
+//
+
+static void
+random_event(vscpEventEx *pex)
+{
+  memset(pex, 0, sizeof(vscpEventEx));
+  pex->head       = (uint16_t) test_random();
+  pex->vscp_class = (uint16_t) test_random();
+  pex->vscp_type  = (uint16_t) test_random();
+  pex->sizeData   = test_random() % (VSCP_BLE_FRAME_MAX_DATA_SIZE + 1);
+  for (int i = 0; i < pex->sizeData; i++) {
+    pex->data[i] = (uint8_t) test_random();
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_roundtrip
+//
+// Decoding an encoded event gives the event back: head bit 3 and the
+// rolling index, class, type, data, the sender node id and, with a time
+// base, the capture time.
+//
+
+static void
+test_roundtrip(void)
+{
+  uint8_t guid[16] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0, 0, 1, 2, 3, 4, 0x56, 0x78 };
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  vscp_ble_ctx_t node = { 0 };
+  vscp_ble_ctx_t gw   = { 0 };
+  vscpEventEx ex;
+  vscpEventEx out;
+  uint64_t time_ms;
+  uint32_t delta_ms;
+  uint8_t id;
+  int len;
+
+  vscp_ble_set_guid(&node, guid);
+  memset(guid + 14, 0, 2);
+  vscp_ble_set_guid(&gw, guid);
+
+  for (int i = 0; i < ROUNDS; i++) {
+    uint32_t seq = vscp_ble_get_sequence(&node);
+    bool bTime   = i & 1;
+
+    random_event(&ex);
+    delta_ms = test_random() % (VSCP_BLE_TIMESTAMP_MAX_MS + 1);
+    if (bTime) {
+      // The gateway sends a time base, the node stamps against it
+      len = vscp_ble_time_to_frame(&gw, frame, sizeof(frame), TIME_BASE_MS + i);
+      TEST_CHECK_EQ(len, VSCP_BLE_TIME_FRAME_SIZE);
+      TEST_CHECK_EQ(vscp_ble_frame_to_time(&id, &time_ms, frame, (uint8_t) len), VSCP_ERROR_SUCCESS);
+      vscp_ble_set_time_base(&node, id, time_ms, 1000);
+      ex.timestamp = 1000 + (delta_ms * 1000);
+    }
+
+    len = vscp_ble_ex_to_frame(&node, frame, sizeof(frame), &ex, 0xffff);
+    TEST_CHECK(len >= VSCP_BLE_FRAME_MIN_SIZE);
+    TEST_CHECK_EQ(frame[VSCP_BLE_FRAME_POS_MANUFACTURER], 0xff);
+    TEST_CHECK_EQ(!!(frame[VSCP_BLE_FRAME_POS_FLAGS] & VSCP_BLE_FRAME_FLAG_TIMESTAMP), bTime);
+
+    TEST_CHECK_EQ(vscp_ble_frame_to_ex(&gw, &out, frame, (uint8_t) len), len);
+    TEST_CHECK_EQ(out.head, (ex.head & 0x08) | (seq & 0x07));
+    TEST_CHECK_EQ(out.vscp_class, ex.vscp_class);
+    TEST_CHECK_EQ(out.vscp_type, ex.vscp_type);
+    TEST_CHECK_EQ(out.sizeData, ex.sizeData);
+    TEST_CHECK(0 == memcmp(out.data, ex.data, ex.sizeData));
+    TEST_CHECK_EQ(out.GUID[14], 0x56);
+    TEST_CHECK_EQ(out.GUID[15], 0x78);
+
+    if (bTime) {
+      TEST_CHECK_EQ(vscp_ble_frame_time(&gw, frame, (uint8_t) len, &time_ms), VSCP_ERROR_SUCCESS);
+      TEST_CHECK_EQ(time_ms, TIME_BASE_MS + i + delta_ms);
+    }
+
+    // A longer buffer (trailing advert bytes) decodes to the same frame
+    TEST_CHECK_EQ(vscp_ble_frame_to_ex(&gw, &out, frame, sizeof(frame)), len);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_guid_from_addr
+//
+// The GUID of a node without a provisioned one is the identity address
+// most significant byte first, and the frames carry its last two bytes as
+// the node id.
+//
+
+static void
+test_guid_from_addr(void)
+{
+  // a5 a4 a3 a2 a1 a0 in NimBLE byte order
+  const uint8_t addr[6]  = { 0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5 };
+  const uint8_t guid[16] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+                             0x00, 0x00, 0xa5, 0xa4, 0xa3, 0xa2, 0xa1, 0xa0 };
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t out[16];
+  vscp_ble_ctx_t ctx = { 0 };
+  vscpEventEx ex;
+  int len;
+
+  TEST_CHECK_EQ(vscp_ble_guid_from_addr(NULL, addr), VSCP_ERROR_INVALID_POINTER);
+  TEST_CHECK_EQ(vscp_ble_guid_from_addr(out, NULL), VSCP_ERROR_INVALID_POINTER);
+
+  memset(out, 0x55, sizeof(out));
+  TEST_CHECK_EQ(vscp_ble_guid_from_addr(out, addr), VSCP_ERROR_SUCCESS);
+  for (int i = 0; i < 16; i++) {
+    TEST_CHECK_EQ(out[i], guid[i]);
+  }
+
+  TEST_CHECK_EQ(vscp_ble_set_guid(&ctx, out), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(ctx.m_nodeid, 0xa1a0);
+
+  random_event(&ex);
+  len = vscp_ble_ex_to_frame(&ctx, frame, sizeof(frame), &ex, 0xffff);
+  TEST_CHECK(len >= VSCP_BLE_FRAME_MIN_SIZE);
+  TEST_CHECK_EQ(frame[VSCP_BLE_FRAME_POS_NODEID], out[14]);
+  TEST_CHECK_EQ(frame[VSCP_BLE_FRAME_POS_NODEID + 1], out[15]);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_truncated
+//
+// Every frame cut short of its length is refused.
+//
+
+static void
+test_truncated(void)
+{
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  vscp_ble_ctx_t ctx = { 0 };
+  vscpEventEx ex;
+  vscpEventEx out;
+  int len;
+
+  for (int i = 0; i < ROUNDS / 10; i++) {
+    random_event(&ex);
+    if (i & 1) {
+      vscp_ble_set_time_base(&ctx, (uint8_t) i, TIME_BASE_MS, 0);
+    }
+    len = vscp_ble_ex_to_frame(&ctx, frame, sizeof(frame), &ex, 0);
+    TEST_CHECK(len > 0);
+    for (int cut = 0; cut < len; cut++) {
+      TEST_CHECK_EQ(vscp_ble_frame_to_ex(&ctx, &out, frame, (uint8_t) cut), -1);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_malformed
+//
+// Data sizes beyond the frame or the limit, a missing marker bit and
+// other frame types are refused.
+//
+
+static void
+test_malformed(void)
+{
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE + 8];
+  uint8_t data[VSCP_BLE_FRAME_MAX_DATA_SIZE];
+  vscp_ble_ctx_t ctx = { 0 };
+  vscpEventEx ex     = { 0 };
+  vscpEvent ev       = { 0 };
+  int len;
+
+  ex.sizeData = 8;
+  len         = vscp_ble_ex_to_frame(&ctx, frame, sizeof(frame), &ex, 0);
+  TEST_CHECK_EQ(len, VSCP_BLE_FRAME_MIN_SIZE);
+
+  // Every size byte past what the buffer holds, and past the limit
+  for (int size = 0; size < 256; size++) {
+    frame[VSCP_BLE_FRAME_POS_SIZE_DATA] = (uint8_t) size;
+    for (int buflen = VSCP_BLE_FRAME_MIN_SIZE; buflen <= (int) sizeof(frame); buflen++) {
+      bool bOk = (size <= VSCP_BLE_FRAME_MAX_DATA_SIZE) && (buflen >= (VSCP_BLE_FRAME_POS_DATA + size));
+      TEST_CHECK_EQ(vscp_ble_frame_to_ex(&ctx, &ex, frame, (uint8_t) buflen) >= 0, bOk);
+    }
+  }
+  frame[VSCP_BLE_FRAME_POS_SIZE_DATA] = 8;
+
+  // Timestamp flag with no room for the timestamp
+  ex.sizeData = VSCP_BLE_FRAME_MAX_DATA_SIZE;
+  len         = vscp_ble_ex_to_frame(&ctx, frame, sizeof(frame), &ex, 0);
+  frame[VSCP_BLE_FRAME_POS_FLAGS] |= VSCP_BLE_FRAME_FLAG_TIMESTAMP;
+  TEST_CHECK_EQ(vscp_ble_frame_to_ex(&ctx, &ex, frame, (uint8_t) len), -1);
+  TEST_CHECK_EQ(vscp_ble_frame_to_ex(&ctx, &ex, frame, (uint8_t) (len + VSCP_BLE_TIMESTAMP_SIZE)),
+                len + VSCP_BLE_TIMESTAMP_SIZE);
+
+  // Marker bit and frame type
+  frame[VSCP_BLE_FRAME_POS_FLAGS] = VSCP_BLE_FRAME_TYPE_EVENT;
+  frame[VSCP_BLE_FRAME_POS_HEAD] &= ~0x10;
+  TEST_CHECK_EQ(vscp_ble_frame_to_ex(&ctx, &ex, frame, (uint8_t) len), -1);
+  frame[VSCP_BLE_FRAME_POS_HEAD] |= 0x10;
+  for (int type = 1; type <= VSCP_BLE_FRAME_TYPE_MASK; type++) {
+    frame[VSCP_BLE_FRAME_POS_FLAGS] = (uint8_t) type;
+    TEST_CHECK_EQ(vscp_ble_frame_to_ex(&ctx, &ex, frame, (uint8_t) len), -1);
+  }
+  frame[VSCP_BLE_FRAME_POS_FLAGS] = VSCP_BLE_FRAME_TYPE_EVENT;
+
+  // Data with nowhere to put it
+  TEST_CHECK_EQ(vscp_ble_frame_to_ev(&ctx, &ev, frame, (uint8_t) len), -1);
+  ev.pdata = data;
+  TEST_CHECK_EQ(vscp_ble_frame_to_ev(&ctx, &ev, frame, (uint8_t) len), len);
+
+  // Encoder: too small a buffer, data without a pointer
+  ev.sizeData = 4;
+  ev.pdata    = NULL;
+  TEST_CHECK_EQ(vscp_ble_ev_to_frame(&ctx, frame, sizeof(frame), &ev), -1);
+  ev.pdata = data;
+  TEST_CHECK_EQ(vscp_ble_ev_to_frame(&ctx, frame, VSCP_BLE_FRAME_MIN_SIZE - 1, &ev), -1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_ack
+//
+// A gateway marks the frames it hears and broadcasts them, the node ends
+// its repeat burst only on an entry for its own node id and rolling index
+// from a gateway using its manufacturer code.
+//
+
+static void
+test_ack(void)
+{
+  uint8_t guid[16] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0, 0, 1, 2, 3, 4, 0x12, 0x34 };
+  uint8_t frame[VSCP_BLE_ACK_FRAME_SIZE(8)];
+  vscp_ble_ack_t acks[7];
+  vscp_ble_ack_t out[7];
+  vscp_ble_ctx_t node  = { 0 };
+  vscp_ble_ctx_t other = { 0 };
+  vscp_ble_ctx_t gw    = { 0 };
+  uint8_t cnt          = 0;
+  int len;
+
+  node.m_manufacturer = 0x02e5;
+  gw.m_manufacturer   = 0x02e5;
+  vscp_ble_set_guid(&node, guid);
+
+  // Indexes wrap after eight frames
+  TEST_CHECK_EQ(vscp_ble_ack_mark(acks, &cnt, 7, 0x1234, 3), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_ack_mark(acks, &cnt, 7, 0x1235, 5), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_ack_mark(acks, &cnt, 7, 0x1234, 8), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_ack_mark(acks, &cnt, 7, 0x1234, 11), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(cnt, 2);
+  TEST_CHECK_EQ(acks[0].m_bitmap, 0x09);
+  TEST_CHECK_EQ(acks[1].m_bitmap, 0x20);
+  for (uint16_t id = 0x2000; cnt < 7; id++) {
+    TEST_CHECK_EQ(vscp_ble_ack_mark(acks, &cnt, 7, id, 1), VSCP_ERROR_SUCCESS);
+  }
+  TEST_CHECK_EQ(vscp_ble_ack_mark(acks, &cnt, 7, 0x3000, 1), VSCP_ERROR_BUFFER_TO_SMALL);
+  TEST_CHECK_EQ(vscp_ble_ack_mark(acks, &cnt, 7, 0x1235, 6), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(acks[1].m_bitmap, 0x60);
+
+  // Encode and decode
+  TEST_CHECK_EQ(vscp_ble_ack_to_frame(&gw, frame, VSCP_BLE_ACK_FRAME_SIZE(7) - 1, acks, 7), -1);
+  len = vscp_ble_ack_to_frame(&gw, frame, sizeof(frame), acks, 7);
+  TEST_CHECK_EQ(len, VSCP_BLE_ACK_FRAME_SIZE(7));
+  TEST_CHECK_EQ(frame[VSCP_BLE_FRAME_POS_MANUFACTURER], 0xe5);
+  TEST_CHECK_EQ(frame[VSCP_BLE_FRAME_POS_MANUFACTURER + 1], 0x02);
+  TEST_CHECK_EQ(frame[VSCP_BLE_FRAME_POS_FLAGS], VSCP_BLE_FRAME_TYPE_ACK);
+  TEST_CHECK_EQ(frame[VSCP_BLE_ACK_POS_COUNT], 7);
+  TEST_CHECK_EQ(frame[VSCP_BLE_ACK_POS_ENTRIES], 0x12);
+  TEST_CHECK_EQ(frame[VSCP_BLE_ACK_POS_ENTRIES + 1], 0x34);
+  TEST_CHECK_EQ(frame[VSCP_BLE_ACK_POS_ENTRIES + 2], 0x09);
+
+  memset(out, 0, sizeof(out));
+  TEST_CHECK_EQ(vscp_ble_frame_to_ack(out, 7, frame, (uint8_t) len), 7);
+  for (int i = 0; i < 7; i++) {
+    TEST_CHECK_EQ(out[i].m_nodeid, acks[i].m_nodeid);
+    TEST_CHECK_EQ(out[i].m_bitmap, acks[i].m_bitmap);
+  }
+  TEST_CHECK_EQ(vscp_ble_frame_to_ack(out, 6, frame, (uint8_t) len), -1);
+  TEST_CHECK_EQ(vscp_ble_frame_to_ack(out, 7, frame, sizeof(frame)), 7);
+  TEST_CHECK_EQ(vscp_ble_ack_find(frame, (uint8_t) len, 0x1235), 0x60);
+  TEST_CHECK_EQ(vscp_ble_ack_find(frame, (uint8_t) len, 0x3412), 0);
+
+  // Cut short of its entries
+  for (int l = 0; l < len; l++) {
+    TEST_CHECK_EQ(vscp_ble_frame_to_ack(out, 7, frame, (uint8_t) l), -1);
+    TEST_CHECK_EQ(vscp_ble_ack_find(frame, (uint8_t) l, 0x1234), -1);
+    TEST_CHECK_EQ(vscp_ble_ack_check(&node, frame, (uint8_t) l, 3), -1);
+  }
+
+  // Ends the burst of rolling index 0 and 3 only
+  for (uint8_t index = 0; index < 16; index++) {
+    TEST_CHECK_EQ(vscp_ble_ack_check(&node, frame, (uint8_t) len, index), (0x09 >> (index & 0x07)) & 1);
+  }
+
+  // Not for this node, byte swapped node id included
+  guid[14] = 0x34;
+  guid[15] = 0x12;
+  other    = node;
+  vscp_ble_set_guid(&other, guid);
+  TEST_CHECK_EQ(vscp_ble_ack_check(&other, frame, (uint8_t) len, 3), 0);
+  other.m_nodeid = 0x1236;
+  TEST_CHECK_EQ(vscp_ble_ack_check(&other, frame, (uint8_t) len, 3), 0);
+  other.m_nodeid = 0x5534;
+  TEST_CHECK_EQ(vscp_ble_ack_check(&other, frame, (uint8_t) len, 3), 0);
+
+  // Another manufacturer, byte swapped included
+  other                = node;
+  other.m_manufacturer = 0x02e6;
+  TEST_CHECK_EQ(vscp_ble_ack_check(&other, frame, (uint8_t) len, 3), -1);
+  other.m_manufacturer = 0xe502;
+  TEST_CHECK_EQ(vscp_ble_ack_check(&other, frame, (uint8_t) len, 3), -1);
+
+  // Not an acknowledgement frame
+  frame[VSCP_BLE_FRAME_POS_FLAGS] = VSCP_BLE_FRAME_TYPE_ACK + 1;
+  TEST_CHECK_EQ(vscp_ble_frame_to_ack(out, 7, frame, (uint8_t) len), -1);
+  TEST_CHECK_EQ(vscp_ble_ack_check(&node, frame, (uint8_t) len, 3), -1);
+  TEST_CHECK_EQ(vscp_ble_ack_check(NULL, frame, (uint8_t) len, 3), -1);
+  TEST_CHECK_EQ(vscp_ble_ack_check(&node, NULL, (uint8_t) len, 3), -1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stamp
+//
+// Encode an event captured at now (us) the way a node does. Returns true
+// when it was stamped, the decoded capture time goes to *ptime_ms.
+//
+
+static bool
+stamp(vscp_ble_ctx_t *pctx, uint64_t now, uint64_t *ptime_ms)
+{
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  vscpEventEx ex;
+  int len;
+
+  random_event(&ex);
+  ex.timestamp = (uint32_t) now;
+  vscp_ble_expire_time_base(pctx, now);
+  len = vscp_ble_ex_to_frame(pctx, frame, sizeof(frame), &ex, 0xffff);
+  TEST_CHECK(len >= VSCP_BLE_FRAME_MIN_SIZE);
+
+  *ptime_ms = 0;
+  if (!(frame[VSCP_BLE_FRAME_POS_FLAGS] & VSCP_BLE_FRAME_FLAG_TIMESTAMP)) {
+    return false;
+  }
+
+  TEST_CHECK_EQ(len, VSCP_BLE_FRAME_POS_DATA + ((ex.sizeData > 5) ? ex.sizeData + VSCP_BLE_TIMESTAMP_SIZE : 8));
+  TEST_CHECK_EQ(vscp_ble_frame_time(pctx, frame, (uint8_t) len, ptime_ms), VSCP_ERROR_SUCCESS);
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_time_base_age
+//
+// Event timestamps are 32 bits of a 64 bit clock. A time base heard
+// before the wrap still stamps right after it, and one older than the
+// timestamp field can express is dropped rather than giving a delta
+// taken modulo 2^32.
+//
+
+static void
+test_time_base_age(void)
+{
+  vscp_ble_ctx_t ctx = { 0 };
+  uint64_t max_us    = VSCP_BLE_TIMESTAMP_MAX_MS * 1000ULL;
+  uint64_t heard     = (1ULL << 32) - 1000000; // One second before the wrap
+  uint64_t time_ms;
+
+  vscp_ble_set_time_base(&ctx, 3, TIME_BASE_MS, heard);
+
+  // Across the wrap of the low 32 bits
+  TEST_CHECK(stamp(&ctx, heard + 2000000, &time_ms));
+  TEST_CHECK_EQ(time_ms, TIME_BASE_MS + 2000);
+  TEST_CHECK(stamp(&ctx, heard + max_us, &time_ms));
+  TEST_CHECK_EQ(time_ms, TIME_BASE_MS + VSCP_BLE_TIMESTAMP_MAX_MS);
+
+  // Captured before the time base was heard
+  TEST_CHECK(!stamp(&ctx, heard - 1000, &time_ms));
+  TEST_CHECK(atomic_load(&ctx.m_time_ref) & VSCP_BLE_TIME_VALID);
+
+  // A full wrap later the low 32 bits look two seconds old
+  TEST_CHECK(!stamp(&ctx, heard + (1ULL << 32) + 2000000, &time_ms));
+  TEST_CHECK_EQ(atomic_load(&ctx.m_time_ref), 0);
+  TEST_CHECK(!stamp(&ctx, heard + (1ULL << 32) + 3000000, &time_ms));
+
+  // Just past the field range is dropped too
+  vscp_ble_set_time_base(&ctx, 4, TIME_BASE_MS, HEARD_US);
+  vscp_ble_expire_time_base(&ctx, HEARD_US + max_us);
+  TEST_CHECK(atomic_load(&ctx.m_time_ref) & VSCP_BLE_TIME_VALID);
+  TEST_CHECK(!stamp(&ctx, HEARD_US + max_us + 1, &time_ms));
+
+  // The next time base stamps again, the old one still decodes
+  vscp_ble_set_time_base(&ctx, 5, TIME_BASE_MS + 100000, HEARD_US + max_us + 10);
+  TEST_CHECK(stamp(&ctx, HEARD_US + max_us + 1000010, &time_ms));
+  TEST_CHECK_EQ(time_ms, TIME_BASE_MS + 101000);
+  TEST_CHECK_EQ(VSCP_BLE_TIME_ID(atomic_load(&ctx.m_time_base[0])), 4);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// time_base_setter
+//
+// Announce time bases as fast as possible. Time base id n is n seconds
+// past TIME_BASE_MS, so a decoder can tell a torn read.
+//
+
+static atomic_bool s_bStop;
+
+static void *
+time_base_setter(void *parg)
+{
+  vscp_ble_ctx_t *pctx = (vscp_ble_ctx_t *) parg;
+
+  for (uint32_t i = 0; !atomic_load(&s_bStop); i++) {
+    vscp_ble_set_time_base(pctx, (uint8_t) i, TIME_BASE_MS + (uint8_t) i * 1000ULL, HEARD_US);
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_time_base_race
+//
+// Frames decode while time bases change under them. A resolved capture
+// time always belongs to the id in the frame, never to a half updated slot.
+//
+
+static void
+test_time_base_race(void)
+{
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  vscp_ble_ctx_t node = { 0 };
+  vscp_ble_ctx_t gw   = { 0 };
+  vscpEventEx ex;
+  pthread_t thread;
+  uint64_t time_ms;
+  uint32_t resolved = 0;
+  int len;
+
+  random_event(&ex);
+  ex.sizeData  = 0;
+  ex.timestamp = (uint32_t) HEARD_US + 7000;
+
+  atomic_store(&s_bStop, false);
+  TEST_CHECK_EQ(pthread_create(&thread, NULL, time_base_setter, &gw), 0);
+
+  for (int i = 0; i < ROUNDS * 10; i++) {
+    uint8_t id = (uint8_t) test_random();
+
+    vscp_ble_set_time_base(&node, id, 0, HEARD_US);
+    len = vscp_ble_ex_to_frame(&node, frame, sizeof(frame), &ex, 0xffff);
+    if (VSCP_ERROR_SUCCESS == vscp_ble_frame_time(&gw, frame, (uint8_t) len, &time_ms)) {
+      TEST_CHECK_EQ(time_ms, TIME_BASE_MS + id * 1000ULL + 7);
+      resolved++;
+    }
+  }
+
+  atomic_store(&s_bStop, true);
+  pthread_join(thread, NULL);
+  TEST_CHECK(resolved > 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_throughput
+//
+// Encode and decode rates, the gateway decodes every advert it hears.
+//
+
+static void
+test_throughput(void)
+{
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  vscp_ble_ctx_t ctx = { 0 };
+  vscpEventEx ex;
+  vscpEventEx out;
+  uint64_t enc_ns = 0;
+  uint64_t dec_ns = 0;
+  uint64_t start;
+  int len;
+
+  vscp_ble_set_time_base(&ctx, 1, TIME_BASE_MS, 0);
+  random_event(&ex);
+  ex.sizeData = 8;
+
+  for (int i = 0; i < BENCH_FRAMES; i++) {
+    ex.data[0]   = (uint8_t) i;
+    ex.timestamp = (uint32_t) (i % 60000) * 1000;
+
+    start = test_now_ns();
+    len   = vscp_ble_ex_to_frame(&ctx, frame, sizeof(frame), &ex, 0xffff);
+    enc_ns += test_now_ns() - start;
+
+    start = test_now_ns();
+    TEST_CHECK_EQ(vscp_ble_frame_to_ex(&ctx, &out, frame, (uint8_t) len), len);
+    dec_ns += test_now_ns() - start;
+  }
+
+  test_bench("frame_encode", (double) BENCH_FRAMES * 1e9 / (double) enc_ns, "frames/s");
+  test_bench("frame_decode", (double) BENCH_FRAMES * 1e9 / (double) dec_ns, "frames/s");
+  TEST_CHECK(((uint64_t) BENCH_FRAMES * 1000000000ULL / enc_ns) >= MIN_FRAMES_S);
+  TEST_CHECK(((uint64_t) BENCH_FRAMES * 1000000000ULL / dec_ns) >= MIN_FRAMES_S);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_roundtrip();
+  test_guid_from_addr();
+  test_truncated();
+  test_malformed();
+  test_ack();
+  test_time_base_age();
+  test_time_base_race();
+  test_throughput();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,384 @@
+/*!
+  @file test-keys.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vscp.h>
+
+#include "mbedtls/aes.h"
+
+#include "vscp-ble-keys.h"
+#include "vscp-ble-test.h"
+
+#define KEYS         1000   // Nodes in the key file, and the FIPS node
+#define KEY_NODE(n)  ((uint16_t) (0x0100 + (n) * 61)) // Node id of key n
+#define FIPS_NODE    0x1234 // Node with the FIPS-197 example key, not a KEY_NODE()
+#define SMALL_CACHE  4      // Entries in the LRU test
+#define BENCH_CACHE  64     // Entries in the small benchmark cache
+#define BENCH_LOOKUP 1000000
+
+static vscp_ble_keys_file_t s_file;
+static char s_path[64];
+
+///////////////////////////////////////////////////////////////////////////////
+// test_random
+//
+
+static uint32_t
+test_random(void)
+{
+  static uint32_t state = 0x2545f491;
+
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// node_key
+//
+// The key of node n in the key file.
+//
+
+static void
+node_key(uint8_t *pkey, uint16_t nodeid)
+{
+  for (int i = 0; i < VSCP_BLE_KEYS_KEY_SIZE; i++) {
+    pkey[i] = (FIPS_NODE == nodeid) ? (uint8_t) i : (uint8_t) ((nodeid * 31) + (i * 7) + (nodeid >> 8));
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// write_file
+//
+// Writes lines to a new temporary key file. Returns zero on failure.
+//
+
+static int
+write_file(const char *plines)
+{
+  FILE *fp;
+  int fd;
+
+  strcpy(s_path, "/tmp/test-keys-XXXXXX");
+  fd = mkstemp(s_path);
+  if (fd < 0) {
+    return 0;
+  }
+
+  fp = fdopen(fd, "w");
+  if (NULL == fp) {
+    close(fd);
+    return 0;
+  }
+  fputs(plines, fp);
+  fclose(fp);
+
+  return 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// write_keys
+//
+// Key file with KEYS nodes, comments, blank lines and mixed case hex.
+//
+
+static int
+write_keys(void)
+{
+  static char lines[KEYS * 96 + 256];
+  uint8_t key[VSCP_BLE_KEYS_KEY_SIZE];
+  char *p = lines;
+
+  p += sprintf(p, "# Gateway keys\n\n");
+  for (int n = 0; n <= KEYS; n++) {
+    uint16_t nodeid = (n < KEYS) ? KEY_NODE(n) : FIPS_NODE;
+
+    node_key(key, nodeid);
+    p += sprintf(p, (n & 1) ? "  ff:ff:ff:ff:ff:ff:ff:fe:00:00:a5:a4:a3:a2:%02x:%02x\t" :
+                              "FF:FF:FF:FF:FF:FF:FF:FE:00:00:A5:A4:A3:A2:%02X:%02X ",
+                 nodeid >> 8, nodeid & 0xff);
+    for (int i = 0; i < VSCP_BLE_KEYS_KEY_SIZE; i++) {
+      p += sprintf(p, (n & 1) ? "%02x" : "%02X", key[i]);
+    }
+    p += sprintf(p, (n % 100) ? "\n" : "\n# Next hundred\n");
+  }
+
+  return write_file(lines);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// same_key
+//
+// Non zero if an expanded key encrypts like the key of the node.
+//
+
+static int
+same_key(const mbedtls_aes_context *paes, uint16_t nodeid)
+{
+  uint8_t key[VSCP_BLE_KEYS_KEY_SIZE];
+  uint8_t block[16] = { 0 };
+  uint8_t out[16];
+  uint8_t want[16];
+  mbedtls_aes_context aes;
+
+  block[0] = (uint8_t) nodeid;
+  node_key(key, nodeid);
+  mbedtls_aes_init(&aes);
+  mbedtls_aes_setkey_enc(&aes, key, 128);
+  mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, block, want);
+  mbedtls_aes_free(&aes);
+
+  mbedtls_aes_crypt_ecb((mbedtls_aes_context *) paes, MBEDTLS_AES_ENCRYPT, block, out);
+  return 0 == memcmp(out, want, sizeof(out));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_open
+//
+// Bad files are refused, a good one is indexed.
+//
+
+static void
+test_open(void)
+{
+  const char *pbad[] = {
+    "FF:FF:FF:FF:FF:FF:FF:FE:00:00:A5:A4:A3:A2:12:34 00112233445566778899AABBCCDDEEF\n",
+    "FF:FF:FF:FF:FF:FF:FF:FE:00:00:A5:A4:A3:A2:12:34 00112233445566778899AABBCCDDEEFG\n",
+    "FF:FF:FF:FF:FF:FF:FF:FE:00:00:A5:A4:A3:A2:1234 00112233445566778899AABBCCDDEEFF\n",
+    "FF:FF:FF:FF:FF:FF:FF:FE:00:00:A5:A4:A3:A2:12:34\n",
+    "FF:FF:FF:FF:FF:FF:FF:FE:00:00:A5:A4:A3:A2:12:34 00112233445566778899AABBCCDDEEFF\n"
+    "FF:FF:FF:FF:FF:FF:FF:FE:00:00:A5:A4:A3:A2:12:34 FFEEDDCCBBAA99887766554433221100\n",
+  };
+
+  TEST_CHECK_EQ(vscp_ble_keys_open(&s_file, "/nonexistent/keys"), VSCP_ERROR_ERROR);
+  TEST_CHECK_EQ(vscp_ble_keys_open(NULL, "/nonexistent/keys"), VSCP_ERROR_INVALID_POINTER);
+
+  for (size_t i = 0; i < (sizeof(pbad) / sizeof(pbad[0])); i++) {
+    TEST_CHECK(write_file(pbad[i]));
+    TEST_CHECK_EQ(vscp_ble_keys_open(&s_file, s_path), VSCP_ERROR_INVALID_PARAMETER);
+    TEST_CHECK_EQ(s_file.m_fd, -1);
+    unlink(s_path);
+  }
+
+  TEST_CHECK(write_file("# No keys\n\n   \n"));
+  TEST_CHECK_EQ(vscp_ble_keys_open(&s_file, s_path), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(s_file.m_cnt, 0);
+  vscp_ble_keys_close(&s_file);
+  unlink(s_path);
+
+  TEST_CHECK(write_keys());
+  TEST_CHECK_EQ(vscp_ble_keys_open(&s_file, s_path), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(s_file.m_cnt, KEYS + 1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_lookup
+//
+// Every node gets its own key, nodes without one get NULL. The FIPS-197
+// example checks the key bytes are read in order.
+//
+
+static void
+test_lookup(void)
+{
+  static vscp_ble_keys_cache_t cache;
+  static vscp_ble_keys_entry_t entries[KEYS + 1];
+  const uint8_t plain[16]  = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                               0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+  const uint8_t cipher[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+                               0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+  const mbedtls_aes_context *paes;
+  uint8_t out[16];
+
+  TEST_CHECK_EQ(vscp_ble_keys_cache_init(&cache, &s_file, entries, 0), VSCP_ERROR_INVALID_PARAMETER);
+  TEST_CHECK_EQ(vscp_ble_keys_cache_init(&cache, &s_file, entries, KEYS + 1), VSCP_ERROR_SUCCESS);
+
+  paes = vscp_ble_keys_get(&cache, FIPS_NODE);
+  TEST_CHECK(NULL != paes);
+  if (NULL != paes) {
+    mbedtls_aes_crypt_ecb((mbedtls_aes_context *) paes, MBEDTLS_AES_ENCRYPT, plain, out);
+    TEST_CHECK(0 == memcmp(out, cipher, sizeof(out)));
+  }
+
+  for (int round = 0; round < 2; round++) {
+    for (int n = 0; n < KEYS; n++) {
+      paes = vscp_ble_keys_get(&cache, KEY_NODE(n));
+      TEST_CHECK((NULL != paes) && same_key(paes, KEY_NODE(n)));
+    }
+  }
+
+  TEST_CHECK(NULL == vscp_ble_keys_get(&cache, KEY_NODE(0) + 1));
+  TEST_CHECK(NULL == vscp_ble_keys_get(&cache, 0xffff));
+  TEST_CHECK_EQ(cache.m_stats.m_loads, KEYS + 1);
+  TEST_CHECK_EQ(cache.m_stats.m_hits, KEYS);
+  TEST_CHECK_EQ(cache.m_stats.m_evictions, 0);
+  TEST_CHECK_EQ(cache.m_stats.m_unknown, 2);
+  vscp_ble_keys_cache_free(&cache);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_lru
+//
+// A full cache drops the key used least recently.
+//
+
+static void
+test_lru(void)
+{
+  vscp_ble_keys_cache_t *pcache = malloc(sizeof(vscp_ble_keys_cache_t));
+  vscp_ble_keys_entry_t entries[SMALL_CACHE];
+  const mbedtls_aes_context *paes;
+
+  if (NULL == pcache) {
+    TEST_CHECK(!"out of memory");
+    return;
+  }
+
+  TEST_CHECK_EQ(vscp_ble_keys_cache_init(pcache, &s_file, entries, SMALL_CACHE), VSCP_ERROR_SUCCESS);
+
+  // 0 1 2 3 fill the cache, 0 is used again so 1 is the oldest
+  for (int n = 0; n < SMALL_CACHE; n++) {
+    TEST_CHECK(NULL != vscp_ble_keys_get(pcache, KEY_NODE(n)));
+  }
+  TEST_CHECK(NULL != vscp_ble_keys_get(pcache, KEY_NODE(0)));
+  TEST_CHECK_EQ(pcache->m_stats.m_loads, SMALL_CACHE);
+  TEST_CHECK_EQ(pcache->m_stats.m_hits, 1);
+
+  paes = vscp_ble_keys_get(pcache, KEY_NODE(SMALL_CACHE));
+  TEST_CHECK((NULL != paes) && same_key(paes, KEY_NODE(SMALL_CACHE)));
+  TEST_CHECK_EQ(pcache->m_stats.m_evictions, 1);
+  TEST_CHECK_EQ(pcache->m_slot[KEY_NODE(1)], VSCP_BLE_KEYS_NONE);
+
+  // 0 2 3 and the new one are still there
+  TEST_CHECK(NULL != vscp_ble_keys_get(pcache, KEY_NODE(0)));
+  TEST_CHECK(NULL != vscp_ble_keys_get(pcache, KEY_NODE(2)));
+  TEST_CHECK(NULL != vscp_ble_keys_get(pcache, KEY_NODE(3)));
+  TEST_CHECK(NULL != vscp_ble_keys_get(pcache, KEY_NODE(SMALL_CACHE)));
+  TEST_CHECK_EQ(pcache->m_stats.m_loads, SMALL_CACHE + 1);
+  TEST_CHECK_EQ(pcache->m_stats.m_hits, 5);
+
+  // 1 comes back in place of 0, the oldest now
+  paes = vscp_ble_keys_get(pcache, KEY_NODE(1));
+  TEST_CHECK((NULL != paes) && same_key(paes, KEY_NODE(1)));
+  TEST_CHECK_EQ(pcache->m_slot[KEY_NODE(0)], VSCP_BLE_KEYS_NONE);
+  TEST_CHECK_EQ(pcache->m_stats.m_evictions, 2);
+
+  // Unknown nodes take no entry
+  TEST_CHECK(NULL == vscp_ble_keys_get(pcache, 1));
+  TEST_CHECK(NULL != vscp_ble_keys_get(pcache, KEY_NODE(2)));
+  TEST_CHECK_EQ(pcache->m_stats.m_evictions, 2);
+
+  // A cycle longer than the cache misses every time and stays consistent
+  for (int round = 0; round < 3; round++) {
+    for (int n = 0; n <= SMALL_CACHE; n++) {
+      paes = vscp_ble_keys_get(pcache, KEY_NODE(n + 10));
+      TEST_CHECK((NULL != paes) && same_key(paes, KEY_NODE(n + 10)));
+    }
+  }
+  TEST_CHECK_EQ(pcache->m_stats.m_hits, 6);
+
+  vscp_ble_keys_cache_free(pcache);
+  free(pcache);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bench_lookup
+//
+// Lookups per second over the 1k keys, with a cache that holds them all
+// and with one that holds BENCH_CACHE of them. Node ids are picked at
+// random, a worst case for the small cache.
+//
+
+static void
+bench_lookup(uint16_t size, const char *name)
+{
+  vscp_ble_keys_cache_t *pcache   = malloc(sizeof(vscp_ble_keys_cache_t));
+  vscp_ble_keys_entry_t *pentries = malloc(size * sizeof(vscp_ble_keys_entry_t));
+  uint16_t *pnodes                = malloc(BENCH_LOOKUP * sizeof(uint16_t));
+  uint32_t found                  = 0;
+  char hits[48];
+  uint64_t start;
+  double rate;
+
+  if ((NULL == pcache) || (NULL == pentries) || (NULL == pnodes)) {
+    TEST_CHECK(!"out of memory");
+    free(pcache);
+    free(pentries);
+    free(pnodes);
+    return;
+  }
+
+  for (uint32_t i = 0; i < BENCH_LOOKUP; i++) {
+    pnodes[i] = KEY_NODE(test_random() % KEYS);
+  }
+
+  TEST_CHECK_EQ(vscp_ble_keys_cache_init(pcache, &s_file, pentries, size), VSCP_ERROR_SUCCESS);
+  start = test_now_ns();
+  for (uint32_t i = 0; i < BENCH_LOOKUP; i++) {
+    found += (NULL != vscp_ble_keys_get(pcache, pnodes[i]));
+  }
+  rate = (double) BENCH_LOOKUP * 1e9 / (double) (test_now_ns() - start);
+
+  TEST_CHECK_EQ(found, BENCH_LOOKUP);
+  TEST_CHECK_EQ(pcache->m_stats.m_hits + pcache->m_stats.m_loads, BENCH_LOOKUP);
+  TEST_CHECK_EQ(pcache->m_stats.m_loads - pcache->m_stats.m_evictions, (size < KEYS) ? size : KEYS);
+  test_bench(name, rate, "lookups/s");
+  snprintf(hits, sizeof(hits), "%s_hits", name);
+  test_bench(hits, 100.0 * pcache->m_stats.m_hits / BENCH_LOOKUP, "%");
+
+  vscp_ble_keys_cache_free(pcache);
+  free(pcache);
+  free(pentries);
+  free(pnodes);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_open();
+  test_lookup();
+  test_lru();
+  bench_lookup(KEYS, "keys_1k_cache_1k");
+  bench_lookup(BENCH_CACHE, "keys_1k_cache_64");
+
+  vscp_ble_keys_close(&s_file);
+  unlink(s_path);
+
+  return TEST_RESULT();
+}
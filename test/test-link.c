@@ -0,0 +1,670 @@
+/*!
+  @file test-link.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-link.h"
+#include "vscp-ble-test.h"
+
+/*
+  Tests of the link against stand-in VSCP daemons on the loopback
+  interface. The tcp/ip link server sends a welcome banner, answers user
+  and pass with +OK and each SEND with +OK, or -OK for a refused class.
+  It can drop the connection once, without a reply, when a given number
+  of SEND commands have come in. The UDP server checks the frame CRC.
+  Events carry their number in obid (TCP) and timestamp (UDP).
+*/
+
+#define SERVER_MAX_IDS  65536
+#define SERVER_POLL_MS  50   // Socket timeout the server threads wake on
+#define RING_SIZE       256
+#define BENCH_EVENTS    20000
+#define TEST_CLASS      10
+#define TEST_CLASS_DENY 20
+
+// Stand-in server
+typedef struct link_server {
+  int m_sock; // Listening (TCP) or bound (UDP) socket
+  uint16_t m_port;
+  bool m_bUdp;
+  pthread_t m_thread;
+  pthread_mutex_t m_mutex;
+  volatile bool m_bStop;
+  uint32_t m_close_at;  // Drop the connection at this SEND (1 = first), 0 for never
+  uint32_t m_sends;     // SEND commands or UDP frames received
+  uint32_t m_logins;    // user and pass commands
+  uint32_t m_connects;  // Connections accepted
+  uint32_t m_bad;       // Lines or frames that did not parse
+  uint8_t m_seen[SERVER_MAX_IDS]; // Times each event number arrived
+} link_server_t;
+
+static uint32_t s_now_ms = 1;
+
+///////////////////////////////////////////////////////////////////////////////
+// crc16
+//
+// CRC-16/CCITT, written out again to check the link's frames
+//
+
+static uint16_t
+crc16(const uint8_t *pbuf, size_t len)
+{
+  uint16_t crc = 0xffff;
+
+  while (len--) {
+    crc ^= (uint16_t) *pbuf++ << 8;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (uint16_t) ((crc << 1) ^ 0x1021) : (uint16_t) (crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// server_seen
+//
+
+static void
+server_seen(link_server_t *psrv, uint32_t id)
+{
+  if ((id < SERVER_MAX_IDS) && (psrv->m_seen[id] < 0xff)) {
+    psrv->m_seen[id]++;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// server_line
+//
+// Handles one tcp/ip link command line. Returns the reply, NULL to drop
+// the connection.
+//
+
+static const char *
+server_line(link_server_t *psrv, const char *pline)
+{
+  unsigned head;
+  unsigned vscp_class;
+  unsigned vscp_type;
+  unsigned obid;
+
+  if ((0 == strncmp(pline, "user ", 5)) || (0 == strncmp(pline, "pass ", 5))) {
+    psrv->m_logins++;
+    return "+OK - Success.\r\n";
+  }
+
+  if (0 != strncmp(pline, "SEND ", 5)) {
+    return "-OK - Unknown command.\r\n";
+  }
+
+  if (4 != sscanf(pline + 5, "%u,%u,%u,%u,", &head, &vscp_class, &vscp_type, &obid)) {
+    psrv->m_bad++;
+    return "-OK - Invalid event.\r\n";
+  }
+
+  psrv->m_sends++;
+  if (psrv->m_sends == psrv->m_close_at) {
+    return NULL;
+  }
+
+  server_seen(psrv, obid);
+  return (TEST_CLASS_DENY == vscp_class) ? "-OK - Not allowed.\r\n" : "+OK - Success.\r\n";
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// server_tcp_conn
+//
+
+static void
+server_tcp_conn(link_server_t *psrv, int conn)
+{
+  static const char banner[] = "Welcome to the VSCP daemon.\r\n+OK - Success.\r\n";
+  char buf[4096];
+  char rsp[4096];
+  size_t len = 0;
+
+  send(conn, banner, sizeof(banner) - 1, MSG_NOSIGNAL);
+
+  while (!psrv->m_bStop) {
+    ssize_t n     = recv(conn, buf + len, sizeof(buf) - 1 - len, 0);
+    char *pline   = buf;
+    size_t rsplen = 0;
+    char *peol;
+
+    if (0 == n) {
+      return;
+    }
+    if (n < 0) {
+      continue; // Timeout, look at the stop flag
+    }
+    len += (size_t) n;
+    buf[len] = '\0';
+
+    // The replies to all lines that came in go out in one write
+    while (NULL != (peol = strstr(pline, "\r\n"))) {
+      const char *prsp;
+
+      *peol = '\0';
+      pthread_mutex_lock(&psrv->m_mutex);
+      prsp = server_line(psrv, pline);
+      pthread_mutex_unlock(&psrv->m_mutex);
+      if (NULL == prsp) {
+        send(conn, rsp, rsplen, MSG_NOSIGNAL);
+        return;
+      }
+      memcpy(rsp + rsplen, prsp, strlen(prsp));
+      rsplen += strlen(prsp);
+      pline = peol + 2;
+    }
+    send(conn, rsp, rsplen, MSG_NOSIGNAL);
+
+    len -= (size_t) (pline - buf);
+    memmove(buf, pline, len);
+    if (len == (sizeof(buf) - 1)) {
+      len = 0; // No line is this long
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// server_udp_frame
+//
+
+static void
+server_udp_frame(link_server_t *psrv, const uint8_t *pframe, size_t len)
+{
+  uint16_t size;
+  uint32_t id;
+
+  if (len < VSCP_BLE_LINK_UDP_FRAME_SIZE(0)) {
+    psrv->m_bad++;
+    return;
+  }
+
+  size = (uint16_t) ((pframe[VSCP_BLE_LINK_UDP_POS_SIZE] << 8) | pframe[VSCP_BLE_LINK_UDP_POS_SIZE + 1]);
+  if (((size_t) VSCP_BLE_LINK_UDP_FRAME_SIZE(size) != len) ||
+      (crc16(pframe + VSCP_BLE_LINK_UDP_POS_HEAD, len - 3) != ((pframe[len - 2] << 8) | pframe[len - 1]))) {
+    psrv->m_bad++;
+    return;
+  }
+
+  id = ((uint32_t) pframe[VSCP_BLE_LINK_UDP_POS_TIMESTAMP] << 24) |
+       ((uint32_t) pframe[VSCP_BLE_LINK_UDP_POS_TIMESTAMP + 1] << 16) |
+       ((uint32_t) pframe[VSCP_BLE_LINK_UDP_POS_TIMESTAMP + 2] << 8) | pframe[VSCP_BLE_LINK_UDP_POS_TIMESTAMP + 3];
+  psrv->m_sends++;
+  server_seen(psrv, id);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// server_thread
+//
+
+static void *
+server_thread(void *arg)
+{
+  link_server_t *psrv = arg;
+  uint8_t frame[VSCP_BLE_LINK_UDP_FRAME_SIZE(VSCP_MAX_DATA) + 1];
+
+  while (!psrv->m_bStop) {
+    if (psrv->m_bUdp) {
+      ssize_t n = recv(psrv->m_sock, frame, sizeof(frame), 0);
+      if (n > 0) {
+        pthread_mutex_lock(&psrv->m_mutex);
+        server_udp_frame(psrv, frame, (size_t) n);
+        pthread_mutex_unlock(&psrv->m_mutex);
+      }
+      continue;
+    }
+
+    int conn = accept(psrv->m_sock, NULL, NULL);
+    if (conn < 0) {
+      continue; // Timeout, look at the stop flag
+    }
+
+    struct timeval tv = { .tv_sec = 0, .tv_usec = SERVER_POLL_MS * 1000 };
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    pthread_mutex_lock(&psrv->m_mutex);
+    psrv->m_connects++;
+    pthread_mutex_unlock(&psrv->m_mutex);
+
+    server_tcp_conn(psrv, conn);
+    close(conn);
+  }
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// server_start
+//
+
+static link_server_t *
+server_start(bool bUdp, uint32_t close_at)
+{
+  link_server_t *psrv     = calloc(1, sizeof(link_server_t));
+  struct sockaddr_in addr = { 0 };
+  socklen_t addrlen       = sizeof(addr);
+  struct timeval tv       = { .tv_sec = 0, .tv_usec = SERVER_POLL_MS * 1000 };
+  int rcvbuf              = 4 * 1024 * 1024;
+
+  psrv->m_bUdp     = bUdp;
+  psrv->m_close_at = close_at;
+  pthread_mutex_init(&psrv->m_mutex, NULL);
+
+  psrv->m_sock = socket(AF_INET, bUdp ? SOCK_DGRAM : SOCK_STREAM, 0);
+  TEST_CHECK(psrv->m_sock >= 0);
+  setsockopt(psrv->m_sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(psrv->m_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  // Any free port on the loopback interface
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_CHECK_EQ(bind(psrv->m_sock, (struct sockaddr *) &addr, sizeof(addr)), 0);
+  TEST_CHECK_EQ(getsockname(psrv->m_sock, (struct sockaddr *) &addr, &addrlen), 0);
+  psrv->m_port = ntohs(addr.sin_port);
+  if (!bUdp) {
+    TEST_CHECK_EQ(listen(psrv->m_sock, 4), 0);
+  }
+
+  TEST_CHECK_EQ(pthread_create(&psrv->m_thread, NULL, server_thread, psrv), 0);
+  return psrv;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// server_stop
+//
+
+static void
+server_stop(link_server_t *psrv)
+{
+  psrv->m_bStop = true;
+  pthread_join(psrv->m_thread, NULL);
+  close(psrv->m_sock);
+  pthread_mutex_destroy(&psrv->m_mutex);
+  free(psrv);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// server_wait
+//
+// Waits for the UDP server to have taken in a number of frames.
+//
+
+static uint32_t
+server_wait(link_server_t *psrv, uint32_t sends)
+{
+  uint32_t n = 0;
+
+  for (int i = 0; i < 100; i++) {
+    pthread_mutex_lock(&psrv->m_mutex);
+    n = psrv->m_sends;
+    pthread_mutex_unlock(&psrv->m_mutex);
+    if (n >= sends) {
+      break;
+    }
+    usleep(10000);
+  }
+
+  return n;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// event_set
+//
+
+static const vscpEventEx *
+event_set(vscpEventEx *pex, uint32_t id, uint16_t vscp_class, uint16_t size)
+{
+  memset(pex, 0, sizeof(vscpEventEx));
+  pex->head       = VSCP_PRIORITY_NORMAL;
+  pex->vscp_class = vscp_class;
+  pex->vscp_type  = 6;
+  pex->obid       = id;
+  pex->timestamp  = id;
+  pex->sizeData   = size;
+  pex->GUID[15]   = (uint8_t) id;
+  // Largest values give the longest SEND lines
+  memset(pex->data, 0xff, size);
+
+  return pex;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// link_drain
+//
+// Flushes until the buffer is empty, one second of link time per call.
+// Returns the number of flush calls.
+//
+
+static int
+link_drain(vscp_ble_link_t *plink, int max_calls)
+{
+  int calls = 0;
+
+  while (plink->m_count && (calls < max_calls)) {
+    vscp_ble_link_flush(plink, s_now_ms);
+    s_now_ms += 1000;
+    calls++;
+  }
+
+  return calls;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_tcp_batch
+//
+// Events go out in batches after a login, each is answered and counted
+// once.
+//
+
+static void
+test_tcp_batch(void)
+{
+  static vscpEventEx ring[RING_SIZE];
+  link_server_t *psrv = server_start(false, 0);
+  vscp_ble_link_t link;
+  vscpEventEx ex;
+
+  TEST_CHECK_EQ(vscp_ble_link_init(&link, VSCP_BLE_LINK_TCP, "127.0.0.1", psrv->m_port, ring, RING_SIZE, 16),
+                VSCP_ERROR_SUCCESS);
+  vscp_ble_link_set_login(&link, "admin", "secret");
+
+  for (uint32_t i = 0; i < 40; i++) {
+    TEST_CHECK_EQ(vscp_ble_link_put(&link, event_set(&ex, i, TEST_CLASS, 3)), VSCP_ERROR_SUCCESS);
+  }
+
+  TEST_CHECK_EQ(vscp_ble_link_flush(&link, s_now_ms), 16);
+  TEST_CHECK_EQ(link_drain(&link, 10), 2);
+  vscp_ble_link_close(&link);
+
+  TEST_CHECK_EQ(link.m_stats.m_sent, 40);
+  TEST_CHECK_EQ(link.m_stats.m_refused, 0);
+  TEST_CHECK_EQ(link.m_stats.m_connects, 1);
+  TEST_CHECK_EQ(link.m_stats.m_failures, 0);
+
+  server_stop(psrv);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_tcp_long
+//
+// A SEND command that does not fit behind the commands before it goes out
+// in the next segment. Only a command longer than a segment is dropped.
+//
+
+static void
+test_tcp_long(void)
+{
+  static vscpEventEx ring[RING_SIZE];
+  static const uint16_t sizes[] = { 100, 300, 8, VSCP_MAX_DATA, 8 };
+  link_server_t *psrv           = server_start(false, 0);
+  vscp_ble_link_t link;
+  vscpEventEx ex;
+  char line[4096];
+
+  // The first two do not fit one segment together, the fourth fits none
+  TEST_CHECK(vscp_ble_link_tcp_line(line, sizeof(line), event_set(&ex, 0, TEST_CLASS, sizes[0])) +
+               vscp_ble_link_tcp_line(line, sizeof(line), event_set(&ex, 1, TEST_CLASS, sizes[1])) >
+             1460);
+  TEST_CHECK(vscp_ble_link_tcp_line(line, sizeof(line), event_set(&ex, 3, TEST_CLASS, sizes[3])) > 1460);
+
+  vscp_ble_link_init(&link, VSCP_BLE_LINK_TCP, "127.0.0.1", psrv->m_port, ring, RING_SIZE, 8);
+  for (uint32_t i = 0; i < 5; i++) {
+    vscp_ble_link_put(&link, event_set(&ex, i, TEST_CLASS, sizes[i]));
+  }
+
+  // The batch stops at the event that can not be sent, which is dropped
+  TEST_CHECK_EQ(vscp_ble_link_flush(&link, s_now_ms), 4);
+  TEST_CHECK_EQ(vscp_ble_link_flush(&link, s_now_ms), 1);
+  vscp_ble_link_close(&link);
+
+  TEST_CHECK_EQ(link.m_stats.m_sent, 4);
+  TEST_CHECK_EQ(link.m_stats.m_refused, 1);
+  TEST_CHECK_EQ(link.m_count, 0);
+
+  server_stop(psrv);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_tcp_refused
+//
+// Events the server answers with -OK are dropped and counted.
+//
+
+static void
+test_tcp_refused(void)
+{
+  static vscpEventEx ring[RING_SIZE];
+  link_server_t *psrv = server_start(false, 0);
+  vscp_ble_link_t link;
+  vscpEventEx ex;
+
+  vscp_ble_link_init(&link, VSCP_BLE_LINK_TCP, "127.0.0.1", psrv->m_port, ring, RING_SIZE, 32);
+  for (uint32_t i = 0; i < 20; i++) {
+    vscp_ble_link_put(&link, event_set(&ex, i, (i & 1) ? TEST_CLASS_DENY : TEST_CLASS, 2));
+  }
+  link_drain(&link, 10);
+  vscp_ble_link_close(&link);
+
+  TEST_CHECK_EQ(link.m_stats.m_sent, 10);
+  TEST_CHECK_EQ(link.m_stats.m_refused, 10);
+
+  server_stop(psrv);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_tcp_reconnect
+//
+// A connection lost in the middle of a batch is made again after the back
+// off. The events without a reply are sent again, none is lost.
+//
+
+static void
+test_tcp_reconnect(void)
+{
+  static vscpEventEx ring[RING_SIZE];
+  link_server_t *psrv = server_start(false, 10);
+  vscp_ble_link_t link;
+  vscpEventEx ex;
+
+  vscp_ble_link_init(&link, VSCP_BLE_LINK_TCP, "127.0.0.1", psrv->m_port, ring, RING_SIZE, 16);
+  for (uint32_t i = 0; i < 30; i++) {
+    vscp_ble_link_put(&link, event_set(&ex, i, TEST_CLASS, 4));
+  }
+
+  // Nine replies came before the connection was dropped
+  TEST_CHECK_EQ(vscp_ble_link_flush(&link, s_now_ms), 9);
+  TEST_CHECK(link.m_sock < 0);
+  TEST_CHECK_EQ(link.m_backoff_ms, VSCP_BLE_LINK_BACKOFF_MIN_MS);
+
+  // Still backing off
+  TEST_CHECK_EQ(vscp_ble_link_flush(&link, s_now_ms + VSCP_BLE_LINK_BACKOFF_MIN_MS - 1), 0);
+
+  link_drain(&link, 10);
+  vscp_ble_link_close(&link);
+
+  TEST_CHECK_EQ(link.m_stats.m_sent, 30);
+  TEST_CHECK_EQ(link.m_stats.m_failures, 1);
+  TEST_CHECK_EQ(link.m_stats.m_connects, 2);
+  TEST_CHECK_EQ(link.m_backoff_ms, 0);
+
+  pthread_mutex_lock(&psrv->m_mutex);
+  for (uint32_t i = 0; i < 30; i++) {
+    TEST_CHECK(psrv->m_seen[i] >= 1);
+  }
+  pthread_mutex_unlock(&psrv->m_mutex);
+
+  server_stop(psrv);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_no_server
+//
+// Nothing listening: the events are kept and the back off doubles up to
+// its limit.
+//
+
+static void
+test_no_server(void)
+{
+  static vscpEventEx ring[RING_SIZE];
+  link_server_t *psrv = server_start(false, 0);
+  uint16_t port       = psrv->m_port;
+  vscp_ble_link_t link;
+  vscpEventEx ex;
+  uint32_t backoff = VSCP_BLE_LINK_BACKOFF_MIN_MS;
+
+  // The port is free again once the server is gone
+  server_stop(psrv);
+
+  vscp_ble_link_init(&link, VSCP_BLE_LINK_TCP, "127.0.0.1", port, ring, RING_SIZE, 16);
+  vscp_ble_link_put(&link, event_set(&ex, 0, TEST_CLASS, 1));
+
+  for (int i = 0; i < 8; i++) {
+    TEST_CHECK(vscp_ble_link_flush(&link, s_now_ms) < 0);
+    TEST_CHECK_EQ(link.m_backoff_ms, backoff);
+    s_now_ms += link.m_backoff_ms;
+    backoff = (2 * backoff < VSCP_BLE_LINK_BACKOFF_MAX_MS) ? (2 * backoff) : VSCP_BLE_LINK_BACKOFF_MAX_MS;
+  }
+
+  TEST_CHECK_EQ(link.m_count, 1);
+  TEST_CHECK_EQ(link.m_stats.m_failures, 8);
+  TEST_CHECK_EQ(link.m_stats.m_connects, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_udp
+//
+// Each event is one frame with a valid CRC.
+//
+
+static void
+test_udp(void)
+{
+  static vscpEventEx ring[RING_SIZE];
+  link_server_t *psrv = server_start(true, 0);
+  vscp_ble_link_t link;
+  vscpEventEx ex;
+
+  vscp_ble_link_init(&link, VSCP_BLE_LINK_UDP, "127.0.0.1", psrv->m_port, ring, RING_SIZE, 16);
+  for (uint32_t i = 0; i < 40; i++) {
+    vscp_ble_link_put(&link, event_set(&ex, i, TEST_CLASS, (uint16_t) (i * 13)));
+  }
+  link_drain(&link, 10);
+  vscp_ble_link_close(&link);
+
+  TEST_CHECK_EQ(link.m_stats.m_sent, 40);
+  TEST_CHECK_EQ(server_wait(psrv, 40), 40);
+
+  pthread_mutex_lock(&psrv->m_mutex);
+  TEST_CHECK_EQ(psrv->m_bad, 0);
+  for (uint32_t i = 0; i < 40; i++) {
+    TEST_CHECK_EQ(psrv->m_seen[i], 1);
+  }
+  pthread_mutex_unlock(&psrv->m_mutex);
+
+  server_stop(psrv);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bench_link
+//
+// Events per second through the link to a loopback server, with the
+// buffer kept full.
+//
+
+static void
+bench_link(vscp_ble_link_proto_t proto, uint16_t batch, const char *name)
+{
+  static vscpEventEx ring[RING_SIZE];
+  link_server_t *psrv = server_start(VSCP_BLE_LINK_UDP == proto, 0);
+  vscp_ble_link_t link;
+  vscpEventEx ex;
+  uint32_t put = 0;
+  uint64_t start;
+  double secs;
+
+  vscp_ble_link_init(&link, proto, "127.0.0.1", psrv->m_port, ring, RING_SIZE, batch);
+
+  start = test_now_ns();
+  while (link.m_stats.m_sent < BENCH_EVENTS) {
+    while ((put < BENCH_EVENTS) && vscp_ble_link_space(&link)) {
+      vscp_ble_link_put(&link, event_set(&ex, put++, TEST_CLASS, 8));
+    }
+    if (vscp_ble_link_flush(&link, s_now_ms) < 0) {
+      break;
+    }
+  }
+  secs = (double) (test_now_ns() - start) / 1e9;
+  vscp_ble_link_close(&link);
+
+  TEST_CHECK_EQ(link.m_stats.m_sent, BENCH_EVENTS);
+  TEST_CHECK_EQ(link.m_stats.m_failures, 0);
+  if (VSCP_BLE_LINK_TCP == proto) {
+    pthread_mutex_lock(&psrv->m_mutex);
+    TEST_CHECK_EQ(psrv->m_sends, BENCH_EVENTS);
+    pthread_mutex_unlock(&psrv->m_mutex);
+  }
+  test_bench(name, BENCH_EVENTS / secs, "events/s");
+
+  server_stop(psrv);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_tcp_batch();
+  test_tcp_long();
+  test_tcp_refused();
+  test_tcp_reconnect();
+  test_no_server();
+  test_udp();
+  bench_link(VSCP_BLE_LINK_TCP, 1, "link_tcp_batch_1");
+  bench_link(VSCP_BLE_LINK_TCP, 64, "link_tcp_batch_64");
+  bench_link(VSCP_BLE_LINK_UDP, 64, "link_udp");
+
+  return TEST_RESULT();
+}
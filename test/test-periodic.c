@@ -0,0 +1,529 @@
+/*!
+  @file test-periodic.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-adv.h"
+#include "vscp-ble-periodic.h"
+#include "vscp-ble-test.h"
+#include "vscp-ble.h"
+
+/*
+  Slot planning simulation of nodes sending periodic trains to one gateway.
+
+  Each node sends a train every interval at its own offset in the
+  interval and runs the rotation of main.c: samples taken at a steady
+  rate with some jitter are encoded with the real encoder and added with
+  the configured repeat count, the payload is built when the train is
+  due. The gateway gives each node a listen slot
+  of the train air time plus the window widening on both sides and
+  follows one node at a time, so the slots of all nodes must fit in the
+  interval without overlap. A train is lost with a given probability.
+  Received trains are split into AD structures and decoded with the real
+  decoder. A sample is delivered when any train carries it.
+
+    test-periodic                                     runs the checks
+    test-periodic nodes itvl repeat samples/min loss%   prints one configuration
+*/
+
+#define ITVL_MS     1000
+#define WIDENING_US (32 + (ITVL_MS / 10)) // Same as PERIODIC_WIDENING_US in main.c
+#define TRAIN_SIZE  251                   // CONFIG_BT_NIMBLE_EXT_ADV_MAX_SIZE in sdkconfig.defaults
+#define SLOT_GAP_US 150                   // Between the slots of two nodes
+#define RUN_MS      60000
+#define MAX_SAMPLES 65536
+
+// One configuration
+typedef struct periodic_cfg {
+  uint16_t m_nodes;     // Nodes in the plan
+  uint16_t m_itvl_ms;   // Periodic advertising interval
+  uint16_t m_size;      // Train payload size
+  uint8_t m_repeat;     // Trains per frame
+  uint16_t m_rate_pm;   // Samples per node and minute
+  uint8_t m_loss_pct;   // Trains the gateway misses
+} periodic_cfg_t;
+
+// Results of one configuration
+typedef struct periodic_result {
+  double m_delivery;         // Samples delivered / samples taken
+  double m_frames_per_train; // Frames carried per non-empty train
+  double m_latency_avg_ms;   // Sample to first reception
+  uint16_t m_listen_permille; // Gateway listen time for all nodes
+  uint16_t m_slots;           // Nodes that fit in one interval
+  uint32_t m_decode_errors;
+} periodic_result_t;
+
+static uint64_t s_rand = 0x2545f4914f6cdd1dULL;
+
+// Time a sample was taken and first received, -1 if not received
+static int64_t s_taken_us[MAX_SAMPLES];
+static int64_t s_rx_us[MAX_SAMPLES];
+
+///////////////////////////////////////////////////////////////////////////////
+// periodic_random
+//
+
+static uint32_t
+periodic_random(void)
+{
+  s_rand ^= s_rand >> 12;
+  s_rand ^= s_rand << 25;
+  s_rand ^= s_rand >> 27;
+  return (uint32_t) ((s_rand * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// periodic_slot_us
+//
+// Gateway listen slot of one node.
+//
+
+static uint32_t
+periodic_slot_us(uint16_t size)
+{
+  return vscp_ble_periodic_train_us(size) + (2 * WIDENING_US) + SLOT_GAP_US;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sample_frame
+//
+// Encodes sample number id of a node like take_sample() does.
+//
+
+static uint8_t
+sample_frame(vscp_ble_ctx_t *ctx, uint8_t *pbuf, uint32_t id)
+{
+  uint8_t sample[5] = { 0x60, id >> 24, id >> 16, id >> 8, id };
+  vscpEvent ev      = { 0 };
+  int len;
+
+  ev.head       = VSCP_PRIORITY_NORMAL;
+  ev.vscp_class = 15;
+  ev.vscp_type  = 1;
+  ev.sizeData   = sizeof(sample);
+  ev.pdata      = sample;
+  len           = vscp_ble_ev_to_frame(ctx, pbuf, VSCP_BLE_PERIODIC_FRAME_MAX_SIZE, &ev);
+  TEST_CHECK(len > 0);
+
+  return (len > 0) ? (uint8_t) len : 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// train_receive
+//
+// Splits a train into frames and marks the samples it carries. Returns
+// the number of frames.
+//
+
+static uint32_t
+train_receive(periodic_result_t *pres, const uint8_t *ptrain, uint16_t len, int64_t rx_us)
+{
+  uint32_t frames = 0;
+  uint16_t pos    = 0;
+
+  while (pos < len) {
+    vscp_ble_ctx_t ctx = { 0 };
+    vscpEventEx ex;
+    uint8_t frame[VSCP_BLE_PERIODIC_FRAME_MAX_SIZE];
+    uint8_t ad_len = ptrain[pos];
+    uint32_t id;
+
+    if ((ad_len < 2) || ((pos + 1 + ad_len) > len) || (VSCP_BLE_AD_TYPE_MFG_DATA != ptrain[pos + 1]) ||
+        ((ad_len - 1) > (int) sizeof(frame))) {
+      pres->m_decode_errors++;
+      break;
+    }
+
+    memcpy(frame, ptrain + pos + 2, ad_len - 1);
+    pos += 1 + ad_len;
+    frames++;
+
+    if (vscp_ble_frame_to_ex(&ctx, &ex, frame, ad_len - 1) < 0) {
+      pres->m_decode_errors++;
+      continue;
+    }
+
+    id = ((uint32_t) ex.data[1] << 24) | ((uint32_t) ex.data[2] << 16) | ((uint32_t) ex.data[3] << 8) | ex.data[4];
+    if ((id >= MAX_SAMPLES) || (s_taken_us[id] < 0) || (s_taken_us[id] > rx_us)) {
+      pres->m_decode_errors++;
+      continue;
+    }
+
+    if (s_rx_us[id] < 0) {
+      s_rx_us[id] = rx_us;
+    }
+  }
+
+  return frames;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// periodic_run
+//
+
+static void
+periodic_run(const periodic_cfg_t *pcfg, periodic_result_t *pres)
+{
+  vscp_ble_periodic_t *pnodes = calloc(pcfg->m_nodes, sizeof(vscp_ble_periodic_t));
+  vscp_ble_ctx_t *pctx        = calloc(pcfg->m_nodes, sizeof(vscp_ble_ctx_t));
+  int64_t *pnext_us           = calloc(pcfg->m_nodes, sizeof(int64_t));
+  int64_t *psample_us         = calloc(pcfg->m_nodes, sizeof(int64_t));
+  int64_t itvl_us             = pcfg->m_itvl_ms * 1000LL;
+  int64_t sample_us           = pcfg->m_rate_pm ? (60000000LL / pcfg->m_rate_pm) : INT64_MAX;
+  uint32_t slot_us            = periodic_slot_us(pcfg->m_size);
+  uint8_t frame[VSCP_BLE_PERIODIC_FRAME_MAX_SIZE];
+  uint8_t train[TRAIN_SIZE];
+  uint32_t samples   = 0;
+  uint32_t delivered = 0;
+  uint32_t trains    = 0;
+  uint32_t frames    = 0;
+  double latency_ms  = 0;
+
+  memset(pres, 0, sizeof(periodic_result_t));
+  TEST_CHECK(pcfg->m_size <= sizeof(train));
+
+  pres->m_slots           = (uint16_t) (itvl_us / slot_us);
+  TEST_CHECK(pcfg->m_nodes <= pres->m_slots);
+  pres->m_listen_permille = (uint16_t) ((pcfg->m_nodes * (uint64_t) slot_us * 1000 + itvl_us - 1) / itvl_us);
+
+  for (uint16_t n = 0; n < pcfg->m_nodes; n++) {
+    uint8_t guid[16] = { 0 };
+
+    guid[14] = (uint8_t) ((n + 1) >> 8);
+    guid[15] = (uint8_t) (n + 1);
+    vscp_ble_set_guid(&pctx[n], guid);
+    vscp_ble_periodic_init(&pnodes[n]);
+    // The node's slot in the plan, the train sits after the leading widening
+    pnext_us[n] = (int64_t) n * slot_us + WIDENING_US;
+    // Samples every 60 / rate s with 5% jitter like eventGenerator()
+    psample_us[n] = pcfg->m_rate_pm ? (int64_t) (periodic_random() % sample_us) : INT64_MAX;
+  }
+
+  for (;;) {
+    int64_t due_us = INT64_MAX;
+    uint16_t node  = 0;
+
+    // The next train of any node
+    for (uint16_t n = 0; n < pcfg->m_nodes; n++) {
+      if (pnext_us[n] < due_us) {
+        due_us = pnext_us[n];
+        node   = n;
+      }
+    }
+    if (due_us >= (RUN_MS * 1000LL)) {
+      break;
+    }
+
+    // Samples the node took since its last train. The last interval is
+    // left for the trains to carry the samples before it.
+    while ((psample_us[node] < due_us) && (psample_us[node] < ((RUN_MS - pcfg->m_itvl_ms) * 1000LL)) &&
+           (samples < MAX_SAMPLES)) {
+      uint8_t len = sample_frame(&pctx[node], frame, samples);
+      TEST_CHECK_EQ(vscp_ble_periodic_add(&pnodes[node], frame, len, pcfg->m_repeat), VSCP_ERROR_SUCCESS);
+      s_taken_us[samples] = psample_us[node];
+      s_rx_us[samples]    = -1;
+      samples++;
+      psample_us[node] += sample_us - (sample_us / 20) + (periodic_random() % ((sample_us / 10) + 1));
+    }
+
+    uint16_t len = vscp_ble_periodic_build(&pnodes[node], train, pcfg->m_size);
+    TEST_CHECK(len <= pcfg->m_size);
+    if (len && ((periodic_random() % 100) >= pcfg->m_loss_pct)) {
+      frames += train_receive(pres, train, len, due_us + vscp_ble_periodic_train_us(len));
+      trains++;
+    }
+    pnext_us[node] += itvl_us;
+  }
+
+  for (uint32_t id = 0; id < samples; id++) {
+    if (s_rx_us[id] >= 0) {
+      delivered++;
+      latency_ms += (s_rx_us[id] - s_taken_us[id]) / 1000.0;
+    }
+  }
+
+  pres->m_delivery         = samples ? ((double) delivered / samples) : 1.0;
+  pres->m_frames_per_train = trains ? ((double) frames / trains) : 0;
+  pres->m_latency_avg_ms   = delivered ? (latency_ms / delivered) : 0;
+
+  free(pnodes);
+  free(pctx);
+  free(pnext_us);
+  free(psample_us);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// periodic_report
+//
+
+static void
+periodic_report(const char *name, const periodic_cfg_t *pcfg, const periodic_result_t *pres)
+{
+  printf("%s: nodes %u itvl %u ms size %u repeat %u samples %u/min loss %u%%: delivery %.4f, "
+         "%.2f frames/train, latency %.0f ms, listen %u.%u%%, %u slots\n",
+         name,
+         pcfg->m_nodes,
+         pcfg->m_itvl_ms,
+         pcfg->m_size,
+         pcfg->m_repeat,
+         pcfg->m_rate_pm,
+         pcfg->m_loss_pct,
+         pres->m_delivery,
+         pres->m_frames_per_train,
+         pres->m_latency_avg_ms,
+         pres->m_listen_permille / 10,
+         pres->m_listen_permille % 10,
+         pres->m_slots);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_rotation
+//
+// Frames go out newest first, each in as many trains as its repeat count.
+//
+
+static void
+test_rotation(void)
+{
+  vscp_ble_periodic_t rot;
+  vscp_ble_ctx_t ctx = { 0 };
+  uint8_t frame[VSCP_BLE_PERIODIC_FRAME_MAX_SIZE];
+  uint8_t train[TRAIN_SIZE];
+  uint8_t len       = 0;
+  uint16_t seen[3]  = { 0 };
+  uint16_t total;
+
+  vscp_ble_periodic_init(&rot);
+  for (uint32_t id = 0; id < 3; id++) {
+    len = sample_frame(&ctx, frame, id);
+    TEST_CHECK_EQ(vscp_ble_periodic_add(&rot, frame, len, 2), VSCP_ERROR_SUCCESS);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    total = vscp_ble_periodic_build(&rot, train, sizeof(train));
+    if (i < 2) {
+      TEST_CHECK_EQ(total, 3 * (len + 2));
+      // Newest first
+      TEST_CHECK_EQ(train[2 + VSCP_BLE_FRAME_POS_DATA + 4], 2);
+      TEST_CHECK_EQ(train[(2 * (len + 2)) + 2 + VSCP_BLE_FRAME_POS_DATA + 4], 0);
+      for (uint8_t f = 0; f < 3; f++) {
+        seen[train[(f * (len + 2)) + 2 + VSCP_BLE_FRAME_POS_DATA + 4]]++;
+      }
+    }
+    else {
+      TEST_CHECK_EQ(total, 0);
+    }
+  }
+
+  for (int i = 0; i < 3; i++) {
+    TEST_CHECK_EQ(seen[i], 2);
+  }
+
+  // A ring overrun drops the oldest frames
+  vscp_ble_periodic_init(&rot);
+  for (uint32_t id = 0; id < VSCP_BLE_PERIODIC_MAX_FRAMES + 2; id++) {
+    len = sample_frame(&ctx, frame, id);
+    vscp_ble_periodic_add(&rot, frame, len, 1);
+  }
+  total = vscp_ble_periodic_build(&rot, train, sizeof(train));
+  TEST_CHECK_EQ(total, VSCP_BLE_PERIODIC_MAX_FRAMES * (len + 2));
+  TEST_CHECK_EQ(train[(total - (len + 2)) + 2 + VSCP_BLE_FRAME_POS_DATA + 4], 2);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_size
+//
+// The payload never exceeds the buffer. The smallest buffer main.c
+// accepts still carries the largest frame.
+//
+
+static void
+test_size(void)
+{
+  vscp_ble_periodic_t rot;
+  uint8_t frame[VSCP_BLE_PERIODIC_FRAME_MAX_SIZE];
+  uint8_t train[TRAIN_SIZE];
+  uint16_t size = VSCP_BLE_PERIODIC_FRAME_MAX_SIZE + 2;
+
+  TEST_CHECK(VSCP_BLE_PERIODIC_MAX_SIZE <= TRAIN_SIZE);
+
+  memset(frame, 0x55, sizeof(frame));
+  vscp_ble_periodic_init(&rot);
+  for (int i = 0; i < 3; i++) {
+    vscp_ble_periodic_add(&rot, frame, sizeof(frame), 1);
+  }
+
+  // One frame fits, the older ones did not make it behind it and are dropped
+  TEST_CHECK_EQ(vscp_ble_periodic_build(&rot, train, size), size);
+  TEST_CHECK_EQ(vscp_ble_periodic_build(&rot, train, size), 0);
+
+  // A full train holds as many whole frames as fit
+  vscp_ble_periodic_init(&rot);
+  for (int i = 0; i < VSCP_BLE_PERIODIC_MAX_FRAMES; i++) {
+    vscp_ble_periodic_add(&rot, frame, sizeof(frame), 1);
+  }
+  TEST_CHECK_EQ(vscp_ble_periodic_build(&rot, train, VSCP_BLE_PERIODIC_MAX_SIZE),
+                (VSCP_BLE_PERIODIC_MAX_SIZE / size) * size);
+
+  // The default host limit of 31 bytes can not carry a frame at all
+  vscp_ble_periodic_init(&rot);
+  vscp_ble_periodic_add(&rot, frame, sizeof(frame), 1);
+  TEST_CHECK_EQ(vscp_ble_periodic_build(&rot, train, 31), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_plan
+//
+// A full slot plan at a sample rate the trains can carry delivers every
+// sample. With lost trains the repeats fill the gaps.
+//
+
+static void
+test_plan(void)
+{
+  periodic_cfg_t cfg = {
+    .m_nodes = 0, .m_itvl_ms = ITVL_MS, .m_size = VSCP_BLE_PERIODIC_MAX_SIZE, .m_repeat = 3, .m_rate_pm = 120,
+  };
+  periodic_result_t res;
+
+  // As many nodes as have a slot
+  cfg.m_nodes = (uint16_t) ((ITVL_MS * 1000) / periodic_slot_us(cfg.m_size));
+  TEST_CHECK(cfg.m_nodes >= 100);
+
+  periodic_run(&cfg, &res);
+  periodic_report("plan", &cfg, &res);
+  TEST_CHECK(res.m_listen_permille <= 1000);
+  TEST_CHECK_EQ(res.m_decode_errors, 0);
+  TEST_CHECK(res.m_delivery > 0.9999);
+  // Two samples a second with three trains each keep about six frames in a train
+  TEST_CHECK(res.m_frames_per_train > 4.0);
+  TEST_CHECK(res.m_latency_avg_ms < ITVL_MS);
+
+  test_bench("periodic nodes per gateway", res.m_slots, "nodes");
+  test_bench("periodic frames per train", res.m_frames_per_train, "frames");
+
+  cfg.m_loss_pct = 10;
+  periodic_run(&cfg, &res);
+  periodic_report("loss", &cfg, &res);
+  TEST_CHECK_EQ(res.m_decode_errors, 0);
+  TEST_CHECK(res.m_delivery > 0.99);
+
+  cfg.m_repeat = 1;
+  periodic_run(&cfg, &res);
+  periodic_report("loss", &cfg, &res);
+  TEST_CHECK(res.m_delivery < 0.95);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_listen
+//
+// One synchronised node costs the gateway a small share of the time,
+// matching vscp_ble_periodic_listen_permille().
+//
+
+static void
+test_listen(void)
+{
+  periodic_cfg_t cfg = {
+    .m_nodes = 1, .m_itvl_ms = ITVL_MS, .m_size = VSCP_BLE_PERIODIC_MAX_SIZE, .m_repeat = 3, .m_rate_pm = 60,
+  };
+  periodic_result_t res;
+  uint16_t permille = vscp_ble_periodic_listen_permille(ITVL_MS, VSCP_BLE_PERIODIC_MAX_SIZE, WIDENING_US);
+
+  periodic_run(&cfg, &res);
+  TEST_CHECK(res.m_delivery > 0.9999);
+  TEST_CHECK(permille <= 3);
+  TEST_CHECK(res.m_listen_permille >= permille);
+  TEST_CHECK(res.m_listen_permille <= (permille + 1));
+
+  test_bench("periodic listen per node", permille / 10.0, "%");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_overload
+//
+// More samples than the trains can carry lose the excess, never decode
+// garbage.
+//
+
+static void
+test_overload(void)
+{
+  periodic_cfg_t cfg = {
+    .m_nodes = 4, .m_itvl_ms = ITVL_MS, .m_size = VSCP_BLE_PERIODIC_MAX_SIZE, .m_repeat = 3, .m_rate_pm = 1200,
+  };
+  periodic_result_t res;
+
+  periodic_run(&cfg, &res);
+  periodic_report("overload", &cfg, &res);
+  TEST_CHECK_EQ(res.m_decode_errors, 0);
+  TEST_CHECK(res.m_delivery < 0.9);
+  TEST_CHECK(res.m_frames_per_train > 6.0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(int argc, char *argv[])
+{
+  if (6 == argc) {
+    periodic_cfg_t cfg = { 0 };
+    periodic_result_t res;
+
+    cfg.m_nodes    = (uint16_t) atoi(argv[1]);
+    cfg.m_itvl_ms  = (uint16_t) atoi(argv[2]);
+    cfg.m_repeat   = (uint8_t) atoi(argv[3]);
+    cfg.m_rate_pm  = (uint16_t) atoi(argv[4]);
+    cfg.m_loss_pct = (uint8_t) atoi(argv[5]);
+    cfg.m_size     = VSCP_BLE_PERIODIC_MAX_SIZE;
+    if ((0 == cfg.m_nodes) || (0 == cfg.m_itvl_ms) || (0 == cfg.m_repeat)) {
+      fprintf(stderr, "usage: %s nodes itvl repeat samples/min loss%%\n", argv[0]);
+      return 2;
+    }
+    periodic_run(&cfg, &res);
+    periodic_report("run", &cfg, &res);
+    return 0;
+  }
+
+  test_rotation();
+  test_size();
+  test_plan();
+  test_listen();
+  test_overload();
+
+  return TEST_RESULT();
+}
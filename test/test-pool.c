@@ -0,0 +1,220 @@
+/*!
+  @file test-pool.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "vscp-ble-pool.h"
+#include "vscp-ble-test.h"
+
+#define POOL_SIZE    16     // Blocks in the test pool
+#define BENCH_LIVE   12     // Events alive at the same time in the benchmark
+#define BENCH_ROUNDS 200000 // Allocations in the benchmark
+
+///////////////////////////////////////////////////////////////////////////////
+// test_alloc
+//
+// Blocks are handed out until the pool is empty, the statistics follow
+// and released blocks can be used again.
+//
+
+static void
+test_alloc(void)
+{
+  vscp_ble_pool_block_t blocks[POOL_SIZE];
+  vscpEvent *evs[POOL_SIZE];
+  vscp_ble_pool_t pool;
+  const uint8_t data[VSCP_BLE_FRAME_MAX_DATA_SIZE] = { 1, 2, 3 };
+
+  TEST_CHECK_EQ(vscp_ble_pool_init(&pool, blocks, 0), VSCP_ERROR_INVALID_PARAMETER);
+  TEST_CHECK_EQ(vscp_ble_pool_init(&pool, blocks, POOL_SIZE), VSCP_ERROR_SUCCESS);
+
+  for (int i = 0; i < POOL_SIZE; i++) {
+    evs[i] = vscp_ble_pool_new_event(&pool, VSCP_PRIORITY_NORMAL, 15, 1, data, 5);
+    TEST_CHECK(NULL != evs[i]);
+    TEST_CHECK_EQ(evs[i]->sizeData, 5);
+    TEST_CHECK_EQ(memcmp(evs[i]->pdata, data, 5), 0);
+  }
+  TEST_CHECK(NULL == vscp_ble_pool_alloc(&pool));
+  TEST_CHECK_EQ(pool.m_used, POOL_SIZE);
+  TEST_CHECK_EQ(pool.m_high_water, POOL_SIZE);
+  TEST_CHECK_EQ(pool.m_allocs, POOL_SIZE);
+  TEST_CHECK_EQ(pool.m_failures, 1);
+
+  // Data that does not fit a block is refused
+  TEST_CHECK(NULL == vscp_ble_pool_new_event(&pool, 0, 15, 1, data, VSCP_BLE_FRAME_MAX_DATA_SIZE + 1));
+
+  TEST_CHECK_EQ(vscp_ble_pool_release(&pool, evs[3]), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(pool.m_used, POOL_SIZE - 1);
+  TEST_CHECK(evs[3] == vscp_ble_pool_alloc(&pool));
+  TEST_CHECK_EQ(evs[3]->sizeData, 0);
+
+  for (int i = 0; i < POOL_SIZE; i++) {
+    TEST_CHECK_EQ(vscp_ble_pool_release(&pool, evs[i]), VSCP_ERROR_SUCCESS);
+  }
+  TEST_CHECK_EQ(pool.m_used, 0);
+  TEST_CHECK_EQ(pool.m_high_water, POOL_SIZE);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_release
+//
+// Foreign events, pointers into a block and double releases are refused
+// and leave the pool intact.
+//
+
+static void
+test_release(void)
+{
+  vscp_ble_pool_block_t blocks[POOL_SIZE];
+  vscp_ble_pool_t pool;
+  vscpEvent foreign;
+  vscpEvent *pev;
+
+  vscp_ble_pool_init(&pool, blocks, POOL_SIZE);
+  pev = vscp_ble_pool_alloc(&pool);
+
+  TEST_CHECK_EQ(vscp_ble_pool_release(&pool, NULL), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_pool_release(&pool, &foreign), VSCP_ERROR_INVALID_PARAMETER);
+  TEST_CHECK_EQ(vscp_ble_pool_release(&pool, (vscpEvent *) blocks[0].m_data), VSCP_ERROR_INVALID_PARAMETER);
+  TEST_CHECK_EQ(vscp_ble_pool_release(&pool, pev), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_pool_release(&pool, pev), VSCP_ERROR_INVALID_PARAMETER);
+  TEST_CHECK_EQ(pool.m_used, 0);
+
+  // The free list is still whole
+  for (int i = 0; i < POOL_SIZE; i++) {
+    TEST_CHECK(NULL != vscp_ble_pool_alloc(&pool));
+  }
+  TEST_CHECK(NULL == vscp_ble_pool_alloc(&pool));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bench_pool
+//
+// The producer pattern of main.c: a few events alive at the same time,
+// released in a different order than they were built.
+//
+
+static void
+bench_pool(void)
+{
+  vscp_ble_pool_block_t blocks[POOL_SIZE];
+  vscpEvent *live[BENCH_LIVE] = { NULL };
+  vscp_ble_pool_t pool;
+  uint8_t data[5] = { 0 };
+  uint32_t rnd    = 1;
+  uint64_t start;
+
+  vscp_ble_pool_init(&pool, blocks, POOL_SIZE);
+
+  start = test_now_ns();
+  for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    vscp_ble_pool_release(&pool, live[rnd % BENCH_LIVE]);
+    data[4]                = (uint8_t) i;
+    live[rnd % BENCH_LIVE]   = vscp_ble_pool_new_event(&pool, VSCP_PRIORITY_NORMAL, 15, 1, data, sizeof(data));
+  }
+  test_bench("pool_alloc_release", (double) (test_now_ns() - start) / BENCH_ROUNDS, "ns");
+
+  TEST_CHECK_EQ(pool.m_failures, 0);
+  TEST_CHECK(pool.m_high_water <= BENCH_LIVE);
+  test_bench("pool_high_water", pool.m_high_water, "blocks");
+
+  for (int i = 0; i < BENCH_LIVE; i++) {
+    vscp_ble_pool_release(&pool, live[i]);
+  }
+  TEST_CHECK_EQ(pool.m_used, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bench_malloc
+//
+// The same pattern with the calloc/malloc/free event_new() main.c used
+// before the pool.
+//
+
+static void
+bench_malloc(void)
+{
+  vscpEvent *live[BENCH_LIVE] = { NULL };
+  uint8_t data[5] = { 0 };
+  uint32_t rnd    = 1;
+  uint64_t start;
+  vscpEvent *pev;
+
+  start = test_now_ns();
+  for (uint32_t i = 0; i < BENCH_ROUNDS; i++) {
+    rnd ^= rnd << 13;
+    rnd ^= rnd >> 17;
+    rnd ^= rnd << 5;
+    pev = live[rnd % BENCH_LIVE];
+    if (NULL != pev) {
+      free(pev->pdata);
+      free(pev);
+    }
+
+    pev = calloc(1, sizeof(vscpEvent));
+    TEST_CHECK(NULL != pev);
+    pev->pdata = malloc(sizeof(data));
+    TEST_CHECK(NULL != pev->pdata);
+    data[4]         = (uint8_t) i;
+    pev->head       = VSCP_PRIORITY_NORMAL;
+    pev->vscp_class = 15;
+    pev->vscp_type  = 1;
+    pev->sizeData   = sizeof(data);
+    memcpy(pev->pdata, data, sizeof(data));
+    live[rnd % BENCH_LIVE] = pev;
+  }
+  test_bench("malloc_alloc_release", (double) (test_now_ns() - start) / BENCH_ROUNDS, "ns");
+
+  for (int i = 0; i < BENCH_LIVE; i++) {
+    if (NULL != live[i]) {
+      free(live[i]->pdata);
+      free(live[i]);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_alloc();
+  test_release();
+  bench_pool();
+  bench_malloc();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,219 @@
+/*!
+  @file test-prof.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-prof.h"
+#include "vscp-ble-test.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// put_u32
+//
+
+static void
+put_u32(uint8_t *p, uint32_t val)
+{
+  p[0] = (val >> 24) & 0xff;
+  p[1] = (val >> 16) & 0xff;
+  p[2] = (val >> 8) & 0xff;
+  p[3] = val & 0xff;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// make_record
+//
+// Builds a record the way vscp_ble_prof_sample() lays it out.
+//
+
+static size_t
+make_record(uint8_t *prec, uint8_t ntasks)
+{
+  uint8_t *p = prec + VSCP_BLE_PROF_POS_ENTRIES;
+
+  prec[VSCP_BLE_PROF_POS_VERSION] = VSCP_BLE_PROF_VERSION;
+  prec[VSCP_BLE_PROF_POS_TASKS]   = ntasks;
+  put_u32(prec + VSCP_BLE_PROF_POS_UPTIME, 3600);
+  put_u32(prec + VSCP_BLE_PROF_POS_FREE, 200000);
+  put_u32(prec + VSCP_BLE_PROF_POS_MIN_FREE, 150000);
+  put_u32(prec + VSCP_BLE_PROF_POS_LARGEST, 100000);
+  put_u32(prec + VSCP_BLE_PROF_POS_RUN_TIME, 0x12345678);
+
+  for (uint8_t i = 0; i < ntasks; i++) {
+    memset(p, 0, VSCP_BLE_PROF_TASK_NAME_LEN);
+    snprintf((char *) p, VSCP_BLE_PROF_TASK_NAME_LEN, "task%u", i);
+    p[8]  = 0x01;
+    p[9]  = i;
+    p[10] = 5 + i;
+    p[11] = 2;
+    put_u32(p + 12, 1000u * i);
+    p += VSCP_BLE_PROF_ENTRY_SIZE;
+  }
+
+  return p - prec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_decode
+//
+
+static void
+test_decode(void)
+{
+  uint8_t rec[VSCP_BLE_PROF_RECORD_MAX_SIZE];
+  vscp_ble_prof_task_t tasks[4];
+  vscp_ble_prof_info_t info;
+  size_t len = make_record(rec, 3);
+
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, len, &info, tasks, 4), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(info.m_version, VSCP_BLE_PROF_VERSION);
+  TEST_CHECK_EQ(info.m_ntasks, 3);
+  TEST_CHECK_EQ(info.m_uptime_s, 3600);
+  TEST_CHECK_EQ(info.m_free, 200000);
+  TEST_CHECK_EQ(info.m_min_free, 150000);
+  TEST_CHECK_EQ(info.m_largest, 100000);
+  TEST_CHECK_EQ(info.m_run_time, 0x12345678);
+  TEST_CHECK(0 == strcmp(tasks[2].m_name, "task2"));
+  TEST_CHECK_EQ(tasks[2].m_stack_hwm, 0x0102);
+  TEST_CHECK_EQ(tasks[2].m_priority, 7);
+  TEST_CHECK_EQ(tasks[2].m_state, 2);
+  TEST_CHECK_EQ(tasks[2].m_run_time, 2000);
+
+  // A full eight character name has no terminator in the record
+  memcpy(rec + VSCP_BLE_PROF_POS_ENTRIES, "abcdefgh", VSCP_BLE_PROF_TASK_NAME_LEN);
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, len, &info, tasks, 4), VSCP_ERROR_SUCCESS);
+  TEST_CHECK(0 == strcmp(tasks[0].m_name, "abcdefgh"));
+
+  // Entries beyond the array are skipped
+  memset(tasks, 0xaa, sizeof(tasks));
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, len, &info, tasks, 1), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(info.m_ntasks, 3);
+  TEST_CHECK_EQ(tasks[1].m_priority, 0xaa);
+
+  // No task entries, header only
+  len = make_record(rec, 0);
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, len, &info, NULL, 0), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(info.m_ntasks, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_malformed
+//
+// Short, truncated, overlong and unknown records are refused.
+//
+
+static void
+test_malformed(void)
+{
+  uint8_t rec[VSCP_BLE_PROF_RECORD_MAX_SIZE + 1];
+  vscp_ble_prof_task_t tasks[4];
+  vscp_ble_prof_info_t info;
+  size_t len = make_record(rec, 3);
+
+  TEST_CHECK_EQ(vscp_ble_prof_decode(NULL, len, &info, tasks, 4), VSCP_ERROR_INVALID_POINTER);
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, len, NULL, tasks, 4), VSCP_ERROR_INVALID_POINTER);
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, len, &info, NULL, 4), VSCP_ERROR_INVALID_POINTER);
+
+  for (size_t i = 0; i < len; i++) {
+    TEST_CHECK_EQ(vscp_ble_prof_decode(rec, i, &info, tasks, 4), VSCP_ERROR_INVALID_PARAMETER);
+  }
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, len + 1, &info, tasks, 4), VSCP_ERROR_INVALID_PARAMETER);
+
+  rec[VSCP_BLE_PROF_POS_VERSION] = VSCP_BLE_PROF_VERSION + 1;
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, len, &info, tasks, 4), VSCP_ERROR_NOT_SUPPORTED);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// print_record
+//
+// Decodes a record given as hex and prints it.
+//
+
+static int
+print_record(const char *phex)
+{
+  static const char *states[] = { "running", "ready", "blocked", "suspended", "deleted", "invalid" };
+  uint8_t rec[VSCP_BLE_PROF_RECORD_MAX_SIZE];
+  vscp_ble_prof_task_t tasks[255];
+  vscp_ble_prof_info_t info;
+  size_t len = 0;
+  unsigned int byte;
+  int rv;
+
+  while ((len < sizeof(rec)) && (1 == sscanf(phex, "%2x", &byte))) {
+    rec[len++] = (uint8_t) byte;
+    phex += 2;
+  }
+
+  rv = vscp_ble_prof_decode(rec, len, &info, tasks, 255);
+  if (VSCP_ERROR_SUCCESS != rv) {
+    fprintf(stderr, "not a profile record (%d)\n", rv);
+    return 1;
+  }
+
+  printf("uptime %" PRIu32 " s, heap free %" PRIu32 " min %" PRIu32 " largest %" PRIu32 "\n",
+         info.m_uptime_s,
+         info.m_free,
+         info.m_min_free,
+         info.m_largest);
+  for (uint8_t i = 0; i < info.m_ntasks; i++) {
+    printf("%-8s prio %2u %-9s stack free %5u cpu %5.1f%%\n",
+           tasks[i].m_name,
+           tasks[i].m_priority,
+           (tasks[i].m_state < 6) ? states[tasks[i].m_state] : "?",
+           tasks[i].m_stack_hwm,
+           info.m_run_time ? (100.0 * tasks[i].m_run_time) / info.m_run_time : 0.0);
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+// With a hex record as the argument the record is decoded and printed.
+//
+
+int
+main(int argc, char *argv[])
+{
+  if (argc >= 2) {
+    return print_record(argv[1]);
+  }
+
+  test_decode();
+  test_malformed();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,323 @@
+/*!
+  @file test-queue.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-queue.h"
+#include "vscp-ble-test.h"
+
+#define QUEUE_SIZE    16 // Firmware default
+#define QUEUE_RESERVE 4
+#define STRESS_EVENTS 200000
+#define STRESS_TICKS  100000
+
+// Event with its own data and the time it was queued
+typedef struct test_event {
+  vscpEvent m_ev;
+  uint8_t m_data[8];
+  uint32_t m_push_tick;
+} test_event_t;
+
+static uint64_t s_rand = 0x853c49e6748fea9bULL;
+
+///////////////////////////////////////////////////////////////////////////////
+// test_random
+//
+
+static uint32_t
+test_random(void)
+{
+  s_rand ^= s_rand >> 12;
+  s_rand ^= s_rand << 25;
+  s_rand ^= s_rand >> 27;
+  return (uint32_t) ((s_rand * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// event_set
+//
+// priority 0-7, or -1 for an alarm.
+//
+
+static vscpEvent *
+event_set(test_event_t *pte, int priority, uint16_t vscp_class, uint8_t index)
+{
+  memset(pte, 0, sizeof(test_event_t));
+  pte->m_ev.head       = (priority < 0) ? 0 : (uint16_t) (priority << 5);
+  pte->m_ev.vscp_class = (priority < 0) ? VSCP_BLE_QUEUE_CLASS_ALARM : vscp_class;
+  pte->m_ev.vscp_type  = 6;
+  pte->m_ev.sizeData   = 2;
+  pte->m_ev.pdata      = pte->m_data;
+  pte->m_data[0]       = index;
+
+  return &pte->m_ev;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_order
+//
+// Highest priority first, oldest first within a priority.
+//
+
+static void
+test_order(void)
+{
+  vscp_ble_queue_item_t items[QUEUE_SIZE];
+  vscp_ble_queue_t q;
+  test_event_t evs[8];
+  vscpEvent *pshed;
+  static const int prio[] = { 7, 3, 3, -1, 0, 7, -1, 5 };
+  static const int order[] = { 3, 6, 4, 1, 2, 7, 0, 5 };
+
+  TEST_CHECK_EQ(vscp_ble_queue_init(&q, items, QUEUE_SIZE, QUEUE_RESERVE), VSCP_ERROR_SUCCESS);
+  for (int i = 0; i < 8; i++) {
+    // Not a measurement class, nothing coalesces
+    TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[i], prio[i], 20, 0), &pshed), VSCP_ERROR_SUCCESS);
+    TEST_CHECK(NULL == pshed);
+  }
+
+  for (int i = 0; i < 8; i++) {
+    TEST_CHECK(vscp_ble_queue_pop(&q) == &evs[order[i]].m_ev);
+  }
+  TEST_CHECK(NULL == vscp_ble_queue_pop(&q));
+  TEST_CHECK_EQ(vscp_ble_queue_count(&q), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_pressure
+//
+// A full queue sheds the oldest event of the lowest priority, keeps the
+// reserve for alarms and never drops an alarm for anything else.
+//
+
+static void
+test_pressure(void)
+{
+  vscp_ble_queue_item_t items[QUEUE_SIZE];
+  vscp_ble_queue_t q;
+  test_event_t evs[3 * QUEUE_SIZE];
+  vscpEvent *pshed;
+  int n = 0;
+
+  vscp_ble_queue_init(&q, items, QUEUE_SIZE, QUEUE_RESERVE);
+
+  // Everything but the reserve
+  for (int i = 0; i < (QUEUE_SIZE - QUEUE_RESERVE); i++, n++) {
+    TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[n], 2, 20, 0), &pshed), VSCP_ERROR_SUCCESS);
+  }
+
+  // Lower priority is rejected, the same or higher sheds the oldest
+  TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[n++], 7, 20, 0), &pshed), VSCP_ERROR_FIFO_FULL);
+  TEST_CHECK(NULL == pshed);
+  TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[n++], 2, 20, 0), &pshed), VSCP_ERROR_SUCCESS);
+  TEST_CHECK(pshed == &evs[0].m_ev);
+  TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[n++], 0, 20, 0), &pshed), VSCP_ERROR_SUCCESS);
+  TEST_CHECK(pshed == &evs[1].m_ev);
+
+  // Alarms use the reserve, then shed
+  for (int i = 0; i < QUEUE_RESERVE; i++, n++) {
+    TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[n], -1, 0, 0), &pshed), VSCP_ERROR_SUCCESS);
+    TEST_CHECK(NULL == pshed);
+  }
+  TEST_CHECK_EQ(vscp_ble_queue_count(&q), QUEUE_SIZE);
+  for (int i = 0; i < (QUEUE_SIZE - QUEUE_RESERVE); i++, n++) {
+    TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[n], -1, 0, 0), &pshed), VSCP_ERROR_SUCCESS);
+    TEST_CHECK((NULL != pshed) && (VSCP_BLE_QUEUE_CLASS_ALARM != pshed->vscp_class));
+  }
+
+  // Full of alarms, nothing is dropped for a new one
+  TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[n++], -1, 0, 0), &pshed), VSCP_ERROR_FIFO_FULL);
+  TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[n++], 0, 20, 0), &pshed), VSCP_ERROR_FIFO_FULL);
+  TEST_CHECK_EQ(q.m_stats[VSCP_BLE_QUEUE_LEVEL_ALARM].m_shed, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_coalesce
+//
+// A newer value of the same measurement replaces the queued one.
+//
+
+static void
+test_coalesce(void)
+{
+  vscp_ble_queue_item_t items[QUEUE_SIZE];
+  vscp_ble_queue_t q;
+  test_event_t evs[4];
+  vscpEvent *pshed;
+
+  vscp_ble_queue_init(&q, items, QUEUE_SIZE, QUEUE_RESERVE);
+  vscp_ble_queue_push(&q, event_set(&evs[0], 3, 10, 1), &pshed);
+  vscp_ble_queue_push(&q, event_set(&evs[1], 3, 10, 2), &pshed);
+  TEST_CHECK_EQ(vscp_ble_queue_push(&q, event_set(&evs[2], 3, 10, 1), &pshed), VSCP_ERROR_SUCCESS);
+  TEST_CHECK(pshed == &evs[0].m_ev);
+  TEST_CHECK_EQ(vscp_ble_queue_count(&q), 2);
+
+  // Keeps the place of the value it replaced
+  TEST_CHECK(vscp_ble_queue_pop(&q) == &evs[2].m_ev);
+  TEST_CHECK(vscp_ble_queue_pop(&q) == &evs[1].m_ev);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// percentile
+//
+
+static uint32_t
+percentile(uint32_t *pv, uint32_t n, uint32_t pct)
+{
+  if (0 == n) {
+    return 0;
+  }
+
+  return pv[((uint64_t) (n - 1) * pct) / 100];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// u32_cmp
+//
+
+static int
+u32_cmp(const void *a, const void *b)
+{
+  uint32_t va = *(const uint32_t *) a;
+  uint32_t vb = *(const uint32_t *) b;
+
+  return (va < vb) ? -1 : (va > vb);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_stress
+//
+// Producers queue faster than the advert updates take events out. Each
+// tick queues up to three events and one is taken. Alarms must get
+// through with a latency of a few ticks while bulk is shed.
+//
+
+static void
+test_stress(void)
+{
+  vscp_ble_queue_item_t items[QUEUE_SIZE];
+  vscp_ble_queue_t q;
+  test_event_t *pevs = calloc(STRESS_EVENTS, sizeof(test_event_t));
+  uint32_t *plat[2];
+  uint32_t nlat[2]   = { 0 };
+  uint32_t lost[2]   = { 0 };
+  uint32_t queued[2] = { 0 };
+  uint32_t next      = 0;
+  uint64_t ops       = 0;
+  uint64_t start;
+  vscpEvent *pshed;
+  vscpEvent *pev;
+  char label[48];
+
+  plat[0] = malloc(STRESS_EVENTS * sizeof(uint32_t));
+  plat[1] = malloc(STRESS_EVENTS * sizeof(uint32_t));
+
+  vscp_ble_queue_init(&q, items, QUEUE_SIZE, QUEUE_RESERVE);
+
+  start = test_now_ns();
+  for (uint32_t tick = 0; (tick < STRESS_TICKS) && (next < STRESS_EVENTS); tick++) {
+    uint32_t arrivals = test_random() % 4;
+
+    for (uint32_t i = 0; (i < arrivals) && (next < STRESS_EVENTS); i++) {
+      uint32_t r        = test_random();
+      bool bAlarm       = (0 == (r % 50));
+      test_event_t *pte = &pevs[next++];
+
+      // Bulk: measurements on eight sensors with random priorities
+      event_set(pte, bAlarm ? -1 : (int) ((r >> 8) % 8), (r & 0x100) ? 10 : 20, (uint8_t) ((r >> 12) & 0x07));
+      pte->m_push_tick = tick;
+      queued[!bAlarm]++;
+
+      ops++;
+      if (VSCP_ERROR_SUCCESS != vscp_ble_queue_push(&q, &pte->m_ev, &pshed)) {
+        lost[!bAlarm]++;
+      }
+      if (NULL != pshed) {
+        lost[VSCP_BLE_QUEUE_CLASS_ALARM != pshed->vscp_class]++;
+      }
+    }
+
+    ops++;
+    pev = vscp_ble_queue_pop(&q);
+    if (NULL != pev) {
+      test_event_t *pte = (test_event_t *) pev;
+      bool bBulk        = (VSCP_BLE_QUEUE_CLASS_ALARM != pev->vscp_class);
+      plat[bBulk][nlat[bBulk]++] = tick - pte->m_push_tick;
+    }
+  }
+  test_bench("queue_op", (double) (test_now_ns() - start) / ops, "ns");
+
+  // Never an alarm lost
+  TEST_CHECK(queued[0] > 0);
+  TEST_CHECK_EQ(lost[0], 0);
+  TEST_CHECK(lost[1] > 0);
+  TEST_CHECK(q.m_high_water <= QUEUE_SIZE);
+
+  for (int b = 0; b < 2; b++) {
+    const char *name = b ? "bulk" : "alarm";
+
+    qsort(plat[b], nlat[b], sizeof(uint32_t), u32_cmp);
+    snprintf(label, sizeof(label), "queue_%s_latency_p50", name);
+    test_bench(label, percentile(plat[b], nlat[b], 50), "ticks");
+    snprintf(label, sizeof(label), "queue_%s_latency_p99", name);
+    test_bench(label, percentile(plat[b], nlat[b], 99), "ticks");
+    snprintf(label, sizeof(label), "queue_%s_latency_max", name);
+    test_bench(label, nlat[b] ? plat[b][nlat[b] - 1] : 0, "ticks");
+    snprintf(label, sizeof(label), "queue_%s_dropped", name);
+    test_bench(label, queued[b] ? (100.0 * lost[b]) / queued[b] : 0.0, "%");
+  }
+
+  // Alarms wait only for alarms queued before them
+  TEST_CHECK(nlat[0] > 0);
+  TEST_CHECK(plat[0][nlat[0] - 1] <= 3);
+
+  free(plat[0]);
+  free(plat[1]);
+  free(pevs);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_order();
+  test_pressure();
+  test_coalesce();
+  test_stress();
+
+  return TEST_RESULT();
+}
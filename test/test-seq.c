@@ -0,0 +1,208 @@
+/*!
+  @file test-seq.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-test.h"
+#include "vscp-ble.h"
+
+#define THREADS        8
+#define FRAMES         100000 // Frames per thread
+#define ROLLING_VALUES 8      // The rolling index is the low three bits
+
+// One encoding thread
+typedef struct seq_thread {
+  pthread_t m_thread;
+  vscp_ble_ctx_t *m_ctx;                // Shared context
+  uint32_t m_counts[ROLLING_VALUES];    // Frames per rolling index
+  uint32_t m_outside;                   // Rolling index not taken while encoding
+  uint64_t m_ns;                        // Time spent
+} seq_thread_t;
+
+static pthread_barrier_t s_start;
+
+///////////////////////////////////////////////////////////////////////////////
+// encode_thread
+//
+// Encodes frames with the shared context. The sequence read before and
+// after each encode bounds the number the frame got, so its rolling
+// index must be one of the numbers taken in between.
+//
+
+static void *
+encode_thread(void *arg)
+{
+  seq_thread_t *pt = arg;
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t data[8] = { 0 };
+  vscpEvent ev    = { 0 };
+  uint32_t before;
+  uint32_t after;
+  uint8_t index;
+  uint64_t start;
+
+  ev.vscp_class = 10;
+  ev.vscp_type  = 6;
+  ev.pdata      = data;
+  ev.sizeData   = sizeof(data);
+
+  pthread_barrier_wait(&s_start);
+  start = test_now_ns();
+  for (uint32_t i = 0; i < FRAMES; i++) {
+    before = vscp_ble_get_sequence(pt->m_ctx);
+    if (vscp_ble_ev_to_frame(pt->m_ctx, frame, sizeof(frame), &ev) < 0) {
+      pt->m_outside++;
+      continue;
+    }
+    after = vscp_ble_get_sequence(pt->m_ctx);
+
+    index = frame[VSCP_BLE_FRAME_POS_HEAD] & 0x07;
+    pt->m_counts[index]++;
+    if (((after - before) < ROLLING_VALUES) && (((index - before) & 0x07) >= (after - before))) {
+      pt->m_outside++;
+    }
+  }
+  pt->m_ns = test_now_ns() - start;
+
+  return NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// run_threads
+//
+// Encodes FRAMES frames on each of n threads, returns the frames per
+// second of all threads together.
+//
+
+static double
+run_threads(vscp_ble_ctx_t *ctx, int n, uint32_t counts[ROLLING_VALUES], uint32_t *poutside)
+{
+  seq_thread_t threads[THREADS];
+  uint64_t ns = 0;
+
+  memset(threads, 0, sizeof(threads));
+  pthread_barrier_init(&s_start, NULL, (unsigned) n);
+  for (int i = 0; i < n; i++) {
+    threads[i].m_ctx = ctx;
+    pthread_create(&threads[i].m_thread, NULL, encode_thread, &threads[i]);
+  }
+  for (int i = 0; i < n; i++) {
+    pthread_join(threads[i].m_thread, NULL);
+    for (int j = 0; j < ROLLING_VALUES; j++) {
+      counts[j] += threads[i].m_counts[j];
+    }
+    *poutside += threads[i].m_outside;
+    if (threads[i].m_ns > ns) {
+      ns = threads[i].m_ns;
+    }
+  }
+  pthread_barrier_destroy(&s_start);
+
+  return ns ? ((double) n * FRAMES * 1e9) / (double) ns : 0.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_unique
+//
+// Frames encoded by several threads at once get unique sequence numbers:
+// none is lost or given twice, so every rolling index is used equally
+// often and the sequence ends at the number of frames.
+//
+
+static void
+test_unique(void)
+{
+  vscp_ble_ctx_t ctx                = { 0 };
+  uint32_t counts[ROLLING_VALUES]   = { 0 };
+  uint32_t counts_1[ROLLING_VALUES] = { 0 };
+  uint32_t outside                  = 0;
+  double rate_1;
+  double rate_n;
+
+  rate_1 = run_threads(&ctx, 1, counts_1, &outside);
+  TEST_CHECK_EQ(vscp_ble_get_sequence(&ctx), FRAMES);
+
+  vscp_ble_set_sequence(&ctx, 0);
+  rate_n = run_threads(&ctx, THREADS, counts, &outside);
+  TEST_CHECK_EQ(vscp_ble_get_sequence(&ctx), (uint32_t) THREADS * FRAMES);
+  for (int i = 0; i < ROLLING_VALUES; i++) {
+    TEST_CHECK_EQ(counts[i], (THREADS * FRAMES) / ROLLING_VALUES);
+  }
+  TEST_CHECK_EQ(outside, 0);
+
+  test_bench("seq_encode_1_thread", rate_1, "frames/s");
+  test_bench("seq_encode_8_threads", rate_n, "frames/s");
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_wrap
+//
+// The rolling index keeps counting across the 32 bit wrap of the
+// sequence and after a restore (deep sleep).
+//
+
+static void
+test_wrap(void)
+{
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  vscp_ble_ctx_t ctx = { 0 };
+  vscpEvent ev       = { 0 };
+  uint8_t last;
+
+  vscp_ble_set_sequence(&ctx, UINT32_MAX - 20);
+  TEST_CHECK(vscp_ble_ev_to_frame(&ctx, frame, sizeof(frame), &ev) > 0);
+  last = frame[VSCP_BLE_FRAME_POS_HEAD] & 0x07;
+  for (int i = 0; i < 40; i++) {
+    TEST_CHECK(vscp_ble_ev_to_frame(&ctx, frame, sizeof(frame), &ev) > 0);
+    TEST_CHECK_EQ(frame[VSCP_BLE_FRAME_POS_HEAD] & 0x07, (last + 1) & 0x07);
+    last = frame[VSCP_BLE_FRAME_POS_HEAD] & 0x07;
+  }
+  TEST_CHECK_EQ(vscp_ble_get_sequence(&ctx), 20);
+
+  // A failed encode does not use a number
+  TEST_CHECK_EQ(vscp_ble_ev_to_frame(&ctx, frame, VSCP_BLE_FRAME_MIN_SIZE - 1, &ev), -1);
+  TEST_CHECK_EQ(vscp_ble_get_sequence(&ctx), 20);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_unique();
+  test_wrap();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,575 @@
+/*!
+  @file test-shard.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vscp.h>
+
+#include "vscp-ble-shard.h"
+#include "vscp-ble-test.h"
+#include "vscp-ble.h"
+
+#define NODES        50      // Nodes in the order test
+#define EVENTS       20      // Events per node, well above eight per VSCP_BLE_SHARD_DUP_MS
+#define SINK_MAX     2048    // Events the sink keeps
+#define STALL_FRAMES 100     // Frames put while the sink refuses
+#define BENCH_NODES  1024    // Nodes in the scaling benchmark
+#define BENCH_FRAMES 100000  // Frames per scaling run
+#define CHECK_ROUNDS 32      // Hash rounds in the benchmark check, stands in for decryption
+#define TIMEOUT_NS   5000000000ULL
+
+static vscp_ble_shard_pipe_t s_pipe;
+static vscp_ble_ctx_t s_ctx;
+
+static uint32_t s_sink_values[SINK_MAX];
+static uint32_t s_sink_cnt;
+static bool s_bRefuse;
+
+static atomic_uint s_check_calls[VSCP_BLE_SHARD_MAX];
+static atomic_uint s_check_wrong;
+
+///////////////////////////////////////////////////////////////////////////////
+// node_init
+//
+// Encoder context of a node.
+//
+
+static void
+node_init(vscp_ble_ctx_t *pctx, uint16_t nodeid)
+{
+  uint8_t guid[16] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0, 0, 1, 2, 3, 4 };
+
+  guid[14] = (uint8_t) (nodeid >> 8);
+  guid[15] = (uint8_t) nodeid;
+  memset(pctx, 0, sizeof(vscp_ble_ctx_t));
+  vscp_ble_set_guid(pctx, guid);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// node_frame
+//
+// Next frame of a node, an event that carries value.
+//
+
+static uint8_t
+node_frame(vscp_ble_ctx_t *pctx, uint8_t *pframe, uint32_t value)
+{
+  vscpEventEx ex;
+  int len;
+
+  memset(&ex, 0, sizeof(ex));
+  ex.vscp_class = 10; // Measurement, temperature
+  ex.vscp_type  = 6;
+  ex.sizeData   = 4;
+  ex.data[0]    = (uint8_t) (value >> 24);
+  ex.data[1]    = (uint8_t) (value >> 16);
+  ex.data[2]    = (uint8_t) (value >> 8);
+  ex.data[3]    = (uint8_t) value;
+
+  len = vscp_ble_ex_to_frame(pctx, pframe, VSCP_BLE_FRAME_MAX_EVENT_SIZE, &ex, 0xffff);
+  TEST_CHECK(len > 0);
+  return (uint8_t) len;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sink
+//
+// Keeps the values of the events in the order they come.
+//
+
+static int
+sink(const vscpEventEx *pex, uint32_t rx_ms, void *arg)
+{
+  (void) rx_ms;
+  (void) arg;
+
+  if (s_bRefuse) {
+    return VSCP_ERROR_FIFO_FULL;
+  }
+
+  if (s_sink_cnt < SINK_MAX) {
+    s_sink_values[s_sink_cnt] =
+      ((uint32_t) pex->data[0] << 24) | ((uint32_t) pex->data[1] << 16) | ((uint32_t) pex->data[2] << 8) | pex->data[3];
+  }
+  s_sink_cnt++;
+
+  return VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// check
+//
+// Counts the frames of each shard and the ones given the wrong shard.
+// Frames from nodes with an odd id are refused.
+//
+
+static int
+check(uint8_t *pframe, uint8_t *plen, uint16_t nodeid, uint8_t shard, void *arg)
+{
+  vscp_ble_shard_pipe_t *ppipe = (vscp_ble_shard_pipe_t *) arg;
+
+  (void) pframe;
+  (void) plen;
+
+  // Per shard state, only this shard touches it
+  atomic_fetch_add_explicit(&s_check_calls[shard], 1, memory_order_relaxed);
+  if ((shard >= ppipe->m_cnt) || ((nodeid % ppipe->m_cnt) != shard)) {
+    atomic_fetch_add(&s_check_wrong, 1);
+  }
+
+  return (nodeid & 1) ? VSCP_ERROR_INVALID_PARAMETER : VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// check_work
+//
+// Accepts every frame after some work per frame, like a decrypting check.
+//
+
+static int
+check_work(uint8_t *pframe, uint8_t *plen, uint16_t nodeid, uint8_t shard, void *arg)
+{
+  uint32_t hash = nodeid;
+
+  (void) shard;
+  (void) arg;
+
+  for (int r = 0; r < CHECK_ROUNDS; r++) {
+    for (uint8_t i = 0; i < *plen; i++) {
+      hash = (hash ^ pframe[i]) * 16777619u;
+    }
+  }
+
+  return (0xffffffff == hash) ? VSCP_ERROR_ERROR : VSCP_ERROR_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// put
+//
+// Puts a frame, merging while the pipeline is full.
+//
+
+static void
+put(const uint8_t *pframe, uint8_t len, uint32_t rx_ms)
+{
+  uint64_t start = test_now_ns();
+  int rv;
+
+  while (VSCP_ERROR_FIFO_FULL == (rv = vscp_ble_shard_put(&s_pipe, pframe, len, rx_ms))) {
+    vscp_ble_shard_merge(&s_pipe, UINT32_MAX);
+    if ((test_now_ns() - start) > TIMEOUT_NS) {
+      break;
+    }
+  }
+  TEST_CHECK_EQ(rv, VSCP_ERROR_SUCCESS);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// drain
+//
+// Merges until nothing is in flight.
+//
+
+static void
+drain(void)
+{
+  uint64_t start = test_now_ns();
+
+  while (atomic_load(&s_pipe.m_order_head) != atomic_load(&s_pipe.m_order_tail)) {
+    vscp_ble_shard_merge(&s_pipe, UINT32_MAX);
+    if ((test_now_ns() - start) > TIMEOUT_NS) {
+      TEST_CHECK(!"merge timed out");
+      return;
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// stats
+//
+// Statistics of all shards added up.
+//
+
+static vscp_ble_shard_stats_t
+stats(void)
+{
+  vscp_ble_shard_stats_t sum = { 0 };
+
+  for (uint8_t i = 0; i < s_pipe.m_cnt; i++) {
+    sum.m_frames += s_pipe.m_shards[i].m_stats.m_frames;
+    sum.m_repeats += s_pipe.m_shards[i].m_stats.m_repeats;
+    sum.m_rejected += s_pipe.m_shards[i].m_stats.m_rejected;
+    sum.m_invalid += s_pipe.m_shards[i].m_stats.m_invalid;
+    sum.m_evicted += s_pipe.m_shards[i].m_stats.m_evicted;
+    sum.m_stalls += s_pipe.m_shards[i].m_stats.m_stalls;
+  }
+
+  return sum;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// start
+//
+
+static void
+start(uint8_t cnt, vscp_ble_shard_check_cb_t pcheck)
+{
+  s_sink_cnt = 0;
+  s_bRefuse  = false;
+  TEST_CHECK_EQ(vscp_ble_shard_start(&s_pipe, cnt, &s_ctx, pcheck, sink, &s_pipe), VSCP_ERROR_SUCCESS);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_order
+//
+// Nodes send more than eight events within VSCP_BLE_SHARD_DUP_MS, so
+// rolling indexes come round again inside the window. Every frame is
+// heard three times and the one before it once more (adverts rotate).
+// Each event reaches the sink once, in capture order.
+//
+
+static void
+test_order(void)
+{
+  static vscp_ble_ctx_t nodes[NODES];
+  uint8_t frames[NODES][2][VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t lens[NODES][2] = { { 0 } };
+  uint32_t value         = 0;
+  uint32_t puts          = 0;
+  vscp_ble_shard_stats_t sum;
+
+  for (uint16_t n = 0; n < NODES; n++) {
+    node_init(&nodes[n], 0x100 + n);
+  }
+
+  start(3, NULL);
+  // All within half the window
+  for (int e = 0; e < EVENTS; e++) {
+    uint32_t rx_ms = 1000 + e * (VSCP_BLE_SHARD_DUP_MS / 2 / EVENTS);
+    uint8_t cur    = e & 1;
+
+    for (uint16_t n = 0; n < NODES; n++) {
+      lens[n][cur] = node_frame(&nodes[n], frames[n][cur], value++);
+      for (int r = 0; r < 3; r++) {
+        put(frames[n][cur], lens[n][cur], rx_ms);
+        puts++;
+      }
+      if (e) {
+        put(frames[n][!cur], lens[n][!cur], rx_ms);
+        puts++;
+      }
+    }
+  }
+  drain();
+
+  TEST_CHECK_EQ(s_sink_cnt, NODES * EVENTS);
+  for (uint32_t i = 0; (i < s_sink_cnt) && (i < SINK_MAX); i++) {
+    TEST_CHECK_EQ(s_sink_values[i], i);
+  }
+
+  sum = stats();
+  TEST_CHECK_EQ(sum.m_frames, puts);
+  TEST_CHECK_EQ(sum.m_repeats, sum.m_frames - (NODES * EVENTS));
+  TEST_CHECK_EQ(sum.m_evicted, 0);
+  vscp_ble_shard_stop(&s_pipe);
+
+  // The same frame later than the window is new
+  start(1, NULL);
+  put(frames[0][0], lens[0][0], 1000);
+  put(frames[0][0], lens[0][0], 1000 + VSCP_BLE_SHARD_DUP_MS - 1);
+  put(frames[0][0], lens[0][0], 1000 + VSCP_BLE_SHARD_DUP_MS * 2);
+  drain();
+  TEST_CHECK_EQ(s_sink_cnt, 2);
+  vscp_ble_shard_stop(&s_pipe);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_evict
+//
+// With all probe slots of a home taken a new node takes the slot of the
+// node heard least recently. A busy node that owns the home slot keeps
+// its repeat state.
+//
+
+static void
+test_evict(void)
+{
+  static vscp_ble_ctx_t nodes[VSCP_BLE_SHARD_NODE_PROBE + 1];
+  uint8_t busy[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t busy_len;
+  uint8_t len;
+
+  // Same home slot for all of them
+  for (uint16_t n = 0; n <= VSCP_BLE_SHARD_NODE_PROBE; n++) {
+    node_init(&nodes[n], 5 + n * VSCP_BLE_SHARD_NODES);
+  }
+
+  start(1, NULL);
+  for (uint16_t n = 0; n < VSCP_BLE_SHARD_NODE_PROBE; n++) {
+    len = node_frame(&nodes[n], frame, n);
+    put(frame, len, 100 + n);
+  }
+
+  busy_len = node_frame(&nodes[0], busy, 100);
+  put(busy, busy_len, 200);
+
+  len = node_frame(&nodes[VSCP_BLE_SHARD_NODE_PROBE], frame, 200);
+  put(frame, len, 201);
+  put(busy, busy_len, 202);
+  drain();
+
+  TEST_CHECK_EQ(s_sink_cnt, VSCP_BLE_SHARD_NODE_PROBE + 2);
+  TEST_CHECK_EQ(stats().m_repeats, 1);
+  TEST_CHECK_EQ(stats().m_evicted, 1);
+
+  // The evicted node (heard least recently) starts over
+  len = node_frame(&nodes[1], frame, 300);
+  put(frame, len, 300);
+  drain();
+  TEST_CHECK_EQ(s_sink_cnt, VSCP_BLE_SHARD_NODE_PROBE + 3);
+  TEST_CHECK_EQ(stats().m_evicted, 2);
+  vscp_ble_shard_stop(&s_pipe);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_check
+//
+// The check callback is told the shard of each frame, and a node always
+// goes to the same one. Refused frames do not reach the sink.
+//
+
+static void
+test_check(void)
+{
+  static vscp_ble_ctx_t nodes[64];
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint32_t calls = 0;
+  uint8_t len;
+
+  for (int i = 0; i < VSCP_BLE_SHARD_MAX; i++) {
+    atomic_init(&s_check_calls[i], 0);
+  }
+  atomic_init(&s_check_wrong, 0);
+
+  for (uint16_t n = 0; n < 64; n++) {
+    node_init(&nodes[n], n * 7);
+  }
+
+  start(4, check);
+  for (int e = 0; e < 4; e++) {
+    for (uint16_t n = 0; n < 64; n++) {
+      len = node_frame(&nodes[n], frame, (uint32_t) e);
+      put(frame, len, (uint32_t) (e * 64 + n));
+    }
+  }
+  drain();
+
+  for (int i = 0; i < 4; i++) {
+    TEST_CHECK(atomic_load(&s_check_calls[i]) > 0);
+    calls += atomic_load(&s_check_calls[i]);
+  }
+  TEST_CHECK_EQ(calls, 4 * 64);
+  TEST_CHECK_EQ(atomic_load(&s_check_wrong), 0);
+  TEST_CHECK_EQ(s_sink_cnt, 4 * 32);
+  TEST_CHECK_EQ(stats().m_rejected, 4 * 32);
+  vscp_ble_shard_stop(&s_pipe);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// cpu_ns
+//
+// Processor time used by the process.
+//
+
+static uint64_t
+cpu_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// wait_stall
+//
+// Waits for the worker of a one shard pipeline to block on a full out
+// ring, merging so the capture side moves.
+//
+
+static void
+wait_stall(void)
+{
+  uint64_t start = test_now_ns();
+
+  while (atomic_load(&s_pipe.m_shards[0].m_bWaiting) == false) {
+    vscp_ble_shard_merge(&s_pipe, UINT32_MAX);
+    if ((test_now_ns() - start) > TIMEOUT_NS) {
+      TEST_CHECK(!"worker did not stall");
+      return;
+    }
+    usleep(1000);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_stall
+//
+// A worker whose merge does not keep up sleeps instead of spinning, wakes
+// when the merge makes room and stops when the pipeline does.
+//
+
+static void
+test_stall(void)
+{
+  vscp_ble_ctx_t node;
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  struct timespec ts = { 0, 200000000 };
+  uint64_t cpu;
+  uint8_t len;
+
+  node_init(&node, 42);
+  start(1, NULL);
+  s_bRefuse = true;
+  for (uint32_t i = 0; i < STALL_FRAMES; i++) {
+    len = node_frame(&node, frame, i);
+    put(frame, len, i);
+  }
+  wait_stall();
+
+  cpu = cpu_ns();
+  nanosleep(&ts, NULL);
+  cpu = cpu_ns() - cpu;
+  TEST_CHECK(cpu < 20000000); // Not spinning
+
+  s_bRefuse = false;
+  drain();
+  TEST_CHECK_EQ(s_sink_cnt, STALL_FRAMES);
+  for (uint32_t i = 0; i < STALL_FRAMES; i++) {
+    TEST_CHECK_EQ(s_sink_values[i], i);
+  }
+  TEST_CHECK(stats().m_stalls > 0);
+
+  // Stopping a stalled worker
+  s_bRefuse = true;
+  for (uint32_t i = 0; i < STALL_FRAMES; i++) {
+    len = node_frame(&node, frame, STALL_FRAMES + i);
+    put(frame, len, 1000 + i);
+  }
+  wait_stall();
+  vscp_ble_shard_stop(&s_pipe);
+  TEST_CHECK_EQ(s_pipe.m_cnt, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bench_scaling
+//
+// Frames per second through 1, 2, 4 and 8 shards with a check callback
+// that costs about as much as a decryption. The capture and merge run on
+// the calling thread. Shards only pay off with cores to run them on.
+//
+
+static void
+bench_scaling(void)
+{
+  static vscp_ble_ctx_t nodes[BENCH_NODES];
+  uint8_t (*pframes)[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t *plens;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  double rate[4];
+  char name[32];
+
+  pframes = malloc(BENCH_FRAMES * sizeof(*pframes));
+  plens   = malloc(BENCH_FRAMES);
+  if ((NULL == pframes) || (NULL == plens)) {
+    TEST_CHECK(!"out of memory");
+    free(pframes);
+    free(plens);
+    return;
+  }
+
+  for (uint16_t n = 0; n < BENCH_NODES; n++) {
+    node_init(&nodes[n], n);
+  }
+  for (uint32_t i = 0; i < BENCH_FRAMES; i++) {
+    plens[i] = node_frame(&nodes[(i * 7919) % BENCH_NODES], pframes[i], i);
+  }
+
+  for (int k = 0; k < 4; k++) {
+    uint8_t cnt = (uint8_t) (1 << k);
+    uint64_t start_ns;
+
+    start(cnt, check_work);
+    start_ns = test_now_ns();
+    for (uint32_t i = 0; i < BENCH_FRAMES; i++) {
+      put(pframes[i], plens[i], i / 100);
+    }
+    drain();
+    rate[k] = (double) BENCH_FRAMES * 1e9 / (double) (test_now_ns() - start_ns);
+    TEST_CHECK_EQ(s_sink_cnt, BENCH_FRAMES);
+    vscp_ble_shard_stop(&s_pipe);
+
+    snprintf(name, sizeof(name), "shard_scaling_%u", cnt);
+    test_bench(name, rate[k], "frames/s");
+  }
+
+  test_bench("shard_scaling_cores", (double) cores, "cores");
+  test_bench("shard_scaling_speedup_4", rate[2] / rate[0], "x");
+
+  // Two workers on top of capture and merge need three cores
+  if (cores >= 3) {
+    TEST_CHECK(rate[1] > (rate[0] * 1.2));
+  }
+
+  free(pframes);
+  free(plens);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_order();
+  test_evict();
+  test_check();
+  test_stall();
+  bench_scaling();
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,446 @@
+/*!
+  @file test-sim.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "host/ble_hs.h"
+
+#include "sim.h"
+#include "stubs.h"
+#include "vscp-ble-adv.h"
+#include "vscp-ble-cfg.h"
+#include "vscp-ble-prof.h"
+#include "vscp-ble-queue.h"
+#include "vscp-ble-test.h"
+#include "vscp-ble.h"
+
+#define SAMPLES_MAX     1024    // Samples tracked, indexed by counter
+#define ADV_DELAY_US    10000   // Largest advDelay
+#define PHASE_QUIET_US  60000000LL
+#define PHASE_BUSY_US   120000000LL
+#define PHASE_CENTRAL_US 130000000LL
+#define BUSY_RATE       500     // Adverts/s heard by the node on a busy channel
+#define REG_READ_COUNT  64      // Registers in the long read
+#define REG_HDR_SIZE    4       // Register request header
+#define PROF_PART_MS    700     // Between the parts of a profile read, longer than a sample period
+
+// Firmware entry point in main.c
+void
+app_main(void);
+
+int
+__real_vscp_ble_queue_push(vscp_ble_queue_t *pq, vscpEvent *pev, vscpEvent **ppshed);
+
+// Latency of one phase
+typedef struct latency {
+  uint32_t m_count;   // Samples seen on air
+  int64_t m_sum_us;   // Total event to air latency
+  int64_t m_max_us;   // Worst case event to air latency
+} latency_t;
+
+static int64_t s_push_us[SAMPLES_MAX]; // Time each sample was queued
+static bool s_bPushed[SAMPLES_MAX];    // Sample queued
+static bool s_bOnAir[SAMPLES_MAX];     // Sample seen on air
+static bool s_bNotified[SAMPLES_MAX];  // Sample notified to the central
+static uint32_t s_pushed;              // Samples queued
+static latency_t s_air;                // Event to air, current phase
+static latency_t s_notify;             // Event to central
+static uint32_t s_decode_errors;       // Adverts on air without a valid frame
+static bool s_bCentralDone;
+
+static const ble_uuid128_t s_ev_uuid =
+  BLE_UUID128_INIT(0x01, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11, 0x22, 0x22, 0x22, 0x22, 0x33, 0x33, 0x33, 0x33);
+static const ble_uuid128_t s_reg_uuid =
+  BLE_UUID128_INIT(0x03, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11, 0x22, 0x22, 0x22, 0x22, 0x33, 0x33, 0x33, 0x33);
+static const ble_uuid128_t s_prof_uuid =
+  BLE_UUID128_INIT(0x02, 0x00, 0x00, 0x00, 0x11, 0x11, 0x11, 0x11, 0x22, 0x22, 0x22, 0x22, 0x33, 0x33, 0x33, 0x33);
+
+///////////////////////////////////////////////////////////////////////////////
+// sample_counter
+//
+// Counter of a demo sample (CLASS1.DATA, I/O value), -1 for other events.
+//
+
+static int32_t
+sample_counter(uint16_t vscp_class, uint16_t vscp_type, const uint8_t *pdata, uint16_t size)
+{
+  if ((15 != vscp_class) || (1 != vscp_type) || (size < 5)) {
+    return -1;
+  }
+
+  return (int32_t) ((((uint32_t) pdata[1] << 24) | ((uint32_t) pdata[2] << 16) | ((uint32_t) pdata[3] << 8) | pdata[4]) %
+                    SAMPLES_MAX);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// __wrap_vscp_ble_queue_push
+//
+// Time stamps each sample as the firmware queues it.
+//
+
+int
+__wrap_vscp_ble_queue_push(vscp_ble_queue_t *pq, vscpEvent *pev, vscpEvent **ppshed)
+{
+  int32_t counter = sample_counter(pev->vscp_class, pev->vscp_type, pev->pdata, pev->sizeData);
+
+  if (counter >= 0) {
+    s_push_us[counter]   = esp_timer_get_time();
+    s_bPushed[counter]   = true;
+    s_bOnAir[counter]    = false;
+    s_bNotified[counter] = false;
+    s_pushed++;
+  }
+
+  return __real_vscp_ble_queue_push(pq, pev, ppshed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// latency_add
+//
+
+static void
+latency_add(latency_t *plat, int64_t us)
+{
+  plat->m_count++;
+  plat->m_sum_us += us;
+  if (us > plat->m_max_us) {
+    plat->m_max_us = us;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// air_cb
+//
+// Decodes each advertising event like a gateway would.
+//
+
+static void
+air_cb(const uint8_t *pdata, uint8_t len, void *arg)
+{
+  vscp_ble_ctx_t ctx = { 0 };
+  vscpEventEx ex;
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  uint8_t frame_len;
+  const uint8_t *pframe;
+  int32_t counter;
+
+  pframe = vscp_ble_adv_find_frame(pdata, len, &frame_len);
+  if ((NULL == pframe) || (frame_len > sizeof(frame))) {
+    s_decode_errors++;
+    return;
+  }
+
+  memcpy(frame, pframe, frame_len);
+  if (vscp_ble_frame_to_ex(&ctx, &ex, frame, frame_len) < 0) {
+    s_decode_errors++;
+    return;
+  }
+
+  counter = sample_counter(ex.vscp_class, ex.vscp_type, ex.data, ex.sizeData);
+  if ((counter >= 0) && !s_bOnAir[counter] && s_bPushed[counter]) {
+    s_bOnAir[counter] = true;
+    latency_add(&s_air, esp_timer_get_time() - s_push_us[counter]);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// notify_cb
+//
+
+static void
+notify_cb(uint16_t conn_handle, uint16_t attr_handle, const uint8_t *pdata, uint16_t len, int64_t rx_us, void *arg)
+{
+  vscp_ble_ctx_t ctx = { 0 };
+  vscpEventEx ex;
+  uint8_t frame[VSCP_BLE_FRAME_MAX_EVENT_SIZE];
+  int32_t counter;
+
+  if (len > sizeof(frame)) {
+    s_decode_errors++;
+    return;
+  }
+
+  memcpy(frame, pdata, len);
+  if (vscp_ble_frame_to_ex(&ctx, &ex, frame, (uint8_t) len) < 0) {
+    s_decode_errors++;
+    return;
+  }
+
+  counter = sample_counter(ex.vscp_class, ex.vscp_type, ex.data, ex.sizeData);
+  if ((counter >= 0) && !s_bNotified[counter] && s_bPushed[counter]) {
+    s_bNotified[counter] = true;
+    latency_add(&s_notify, rx_us - s_push_us[counter]);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main_task
+//
+// Runs app_main() like the ESP-IDF startup task does.
+//
+
+static void
+main_task(void *param)
+{
+  app_main();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// read_profile
+//
+// Long read of the profiler record with new samples taken between the
+// parts. The record must be one sample: the task run times add up to the
+// total in the header. A read given up after two parts comes first, the
+// read that follows starts over at offset zero and gets a sample of its
+// own.
+//
+
+static void
+read_profile(uint16_t conn, uint16_t prof_handle)
+{
+  uint8_t rec[VSCP_BLE_PROF_RECORD_MAX_SIZE];
+  vscp_ble_prof_task_t tasks[CONFIG_VSCP_BLE_PROFILER_MAX_TASKS];
+  vscp_ble_prof_info_t info;
+  uint16_t offset = 0;
+  uint16_t parts  = 0;
+  uint32_t sum    = 0;
+  uint16_t len;
+
+  TEST_CHECK_EQ(sim_central_read(conn, prof_handle, 0, rec, sizeof(rec), &len), 0);
+  TEST_CHECK_EQ(sim_central_read(conn, prof_handle, len, rec + len, sizeof(rec) - len, &len), 0);
+  vTaskDelay(pdMS_TO_TICKS(PROF_PART_MS));
+
+  do {
+    if (parts) {
+      vTaskDelay(pdMS_TO_TICKS(PROF_PART_MS));
+    }
+    TEST_CHECK_EQ(sim_central_read(conn, prof_handle, offset, rec + offset, sizeof(rec) - offset, &len), 0);
+    offset += len;
+    parts++;
+  } while ((len == (BLE_ATT_MTU_DFLT - 1)) && (offset < sizeof(rec)));
+
+  TEST_CHECK(parts > 2);
+  TEST_CHECK_EQ(vscp_ble_prof_decode(rec, offset, &info, tasks, CONFIG_VSCP_BLE_PROFILER_MAX_TASKS),
+                VSCP_ERROR_SUCCESS);
+  TEST_CHECK(info.m_ntasks >= 3);
+  TEST_CHECK(info.m_min_free <= info.m_free);
+  for (uint8_t i = 0; i < info.m_ntasks; i++) {
+    sum += tasks[i].m_run_time;
+  }
+  TEST_CHECK_EQ(sum, info.m_run_time);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// central_task
+//
+// Connects, subscribes to events, reads a register block and the profile
+// record in parts.
+//
+
+static void
+central_task(void *param)
+{
+  uint8_t req[5] = { 0x01, 0x00, 0x00, 0x00, REG_READ_COUNT };
+  uint8_t rsp[6 + REG_READ_COUNT];
+  uint8_t regs[REG_READ_COUNT];
+  uint8_t req2[REG_HDR_SIZE + 0x100] = { 0x01, 0x00, 0x00, 0x00 };
+  uint8_t rsp2[6 + 0xff];
+  uint16_t ev_handle   = sim_gatts_find_chr(&s_ev_uuid.u);
+  uint16_t reg_handle  = sim_gatts_find_chr(&s_reg_uuid.u);
+  uint16_t prof_handle = sim_gatts_find_chr(&s_prof_uuid.u);
+  uint16_t conn;
+  uint16_t conn2;
+  uint16_t len;
+  uint16_t parts;
+
+  TEST_CHECK(0 != ev_handle);
+  TEST_CHECK(0 != reg_handle);
+  TEST_CHECK(0 != prof_handle);
+
+  conn = sim_central_connect();
+  TEST_CHECK(BLE_HS_CONN_HANDLE_NONE != conn);
+  TEST_CHECK_EQ(sim_central_subscribe(conn, ev_handle), 0);
+
+  // Frames are notified as they are sent
+  vTaskDelay(pdMS_TO_TICKS(5000));
+  TEST_CHECK(s_notify.m_count >= 4);
+
+  // Register block read, longer than one ATT_MTU
+  TEST_CHECK_EQ(sim_central_write(conn, reg_handle, req, sizeof(req)), 0);
+  TEST_CHECK_EQ(sim_central_read_long(conn, reg_handle, rsp, sizeof(rsp), &len, &parts), 0);
+  TEST_CHECK_EQ(len, sizeof(rsp));
+  TEST_CHECK(parts > 1);
+  TEST_CHECK_EQ(rsp[0], 0x01);
+  TEST_CHECK_EQ(rsp[1], VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(rsp[5], REG_READ_COUNT);
+  TEST_CHECK_EQ(vscp_ble_cfg_read_block(0, 0, regs, REG_READ_COUNT), VSCP_ERROR_SUCCESS);
+  TEST_CHECK(0 == memcmp(rsp + 6, regs, REG_READ_COUNT));
+
+  // A second central gets the result of its own request, the first one
+  // still reads its own
+  conn2 = sim_central_connect();
+  TEST_CHECK(BLE_HS_CONN_HANDLE_NONE != conn2);
+  req2[REG_HDR_SIZE] = 1;
+  TEST_CHECK_EQ(sim_central_write(conn2, reg_handle, req2, REG_HDR_SIZE + 1), 0);
+  TEST_CHECK_EQ(sim_central_read_long(conn2, reg_handle, rsp2, sizeof(rsp2), &len, &parts), 0);
+  TEST_CHECK_EQ(len, 6 + 1);
+  TEST_CHECK_EQ(rsp2[1], VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(rsp2[5], 1);
+  TEST_CHECK_EQ(sim_central_read_long(conn, reg_handle, rsp, sizeof(rsp), &len, &parts), 0);
+  TEST_CHECK_EQ(len, sizeof(rsp));
+  TEST_CHECK_EQ(rsp[5], REG_READ_COUNT);
+
+  // The whole of register space in one read
+  req2[REG_HDR_SIZE] = 0xff;
+  TEST_CHECK_EQ(sim_central_write(conn2, reg_handle, req2, REG_HDR_SIZE + 1), 0);
+  TEST_CHECK_EQ(sim_central_read_long(conn2, reg_handle, rsp2, sizeof(rsp2), &len, &parts), 0);
+  TEST_CHECK_EQ(len, sizeof(rsp2));
+  TEST_CHECK_EQ(rsp2[5], 0xff);
+
+  // A block write of 256 registers does not fit the one byte count
+  req2[0] = 0x02;
+  memset(req2 + REG_HDR_SIZE, 0, sizeof(req2) - REG_HDR_SIZE);
+  TEST_CHECK_EQ(sim_central_write(conn2, reg_handle, req2, sizeof(req2)), BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN);
+  TEST_CHECK_EQ(sim_central_disconnect(conn2), 0);
+
+  // Unknown request
+  req[0] = 0x7f;
+  TEST_CHECK_EQ(sim_central_write(conn, reg_handle, req, sizeof(req)), BLE_ATT_ERR_REQ_NOT_SUPPORTED);
+
+  read_profile(conn, prof_handle);
+
+  TEST_CHECK_EQ(sim_central_disconnect(conn), 0);
+  s_bCentralDone = true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// report_phase
+//
+// Checks that every sample of the phase reached the air within an
+// advertising interval plus advDelay and prints the measurements. Samples
+// queued too close to the end of the phase may still be on their way.
+//
+
+static void
+report_phase(const char *name, int64_t start_us, int64_t end_us, int64_t itvl_max_ms)
+{
+  int64_t limit_us  = (itvl_max_ms * 1000) + ADV_DELAY_US;
+  uint32_t expected = 0;
+  uint32_t lost     = 0;
+  char label[48];
+
+  for (int i = 0; i < SAMPLES_MAX; i++) {
+    if (s_bPushed[i] && (s_push_us[i] >= start_us) && (s_push_us[i] < (end_us - limit_us))) {
+      expected++;
+      lost += !s_bOnAir[i];
+    }
+  }
+
+  TEST_CHECK(expected > 0);
+  TEST_CHECK_EQ(lost, 0);
+  TEST_CHECK(s_air.m_max_us <= limit_us);
+
+  snprintf(label, sizeof(label), "sim_%s_latency_avg", name);
+  test_bench(label, s_air.m_count ? ((double) s_air.m_sum_us / s_air.m_count) / 1000.0 : 0.0, "ms");
+  snprintf(label, sizeof(label), "sim_%s_latency_max", name);
+  test_bench(label, (double) s_air.m_max_us / 1000.0, "ms");
+
+  memset(&s_air, 0, sizeof(s_air));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  static const uint8_t busy_adv[] = { 0x02, 0x01, 0x06, 0x03, 0xff, 0x59, 0x00 };
+  sim_nimble_stats_t stats;
+  sim_task_stats_t main_stats;
+  sim_task_stats_t host_stats;
+  uint32_t set_data;
+
+  sim_seed(1);
+  stub_nvs_erase();
+  sim_nimble_set_air_cb(air_cb, NULL);
+  sim_central_set_notify_cb(notify_cb, NULL);
+  xTaskCreate(main_task, "main", 4096, NULL, 1, NULL);
+
+  // Quiet channel, shortest interval
+  sim_run(PHASE_QUIET_US);
+  sim_nimble_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_itvl_ms, VSCP_BLE_CFG_DEFAULT_ADV_ITVL);
+  TEST_CHECK_EQ(stats.m_conn_mode, BLE_GAP_CONN_MODE_UND);
+  report_phase("quiet", 0, PHASE_QUIET_US, VSCP_BLE_CFG_DEFAULT_ADV_ITVL);
+  set_data = stats.m_set_data;
+  test_bench("sim_quiet_updates", stats.m_set_data, "updates");
+  test_bench("sim_quiet_adv_events", stats.m_adv_events, "events");
+
+  // Busy channel, the interval grows
+  sim_nimble_set_scan_load(BUSY_RATE, busy_adv, sizeof(busy_adv));
+  sim_run(PHASE_BUSY_US);
+  sim_nimble_get_stats(&stats);
+  TEST_CHECK(stats.m_itvl_ms > VSCP_BLE_CFG_DEFAULT_ADV_ITVL);
+  report_phase("busy", PHASE_QUIET_US, PHASE_BUSY_US, CONFIG_VSCP_BLE_ADAPTIVE_ITVL_MAX_MS);
+  test_bench("sim_busy_itvl", stats.m_itvl_ms, "ms");
+  test_bench("sim_busy_updates", stats.m_set_data - set_data, "updates");
+
+  // A central subscribes and reads registers
+  sim_nimble_set_scan_load(0, busy_adv, sizeof(busy_adv));
+  xTaskCreate(central_task, "central", 4096, NULL, 1, NULL);
+  sim_run(PHASE_CENTRAL_US);
+  TEST_CHECK(s_bCentralDone);
+  test_bench("sim_notify_latency_avg",
+             s_notify.m_count ? ((double) s_notify.m_sum_us / s_notify.m_count) / 1000.0 : 0.0,
+             "ms");
+  test_bench("sim_notify_latency_max", (double) s_notify.m_max_us / 1000.0, "ms");
+
+  sim_nimble_get_stats(&stats);
+  TEST_CHECK_EQ(stats.m_host_drops, 0);
+  TEST_CHECK_EQ(s_decode_errors, 0);
+
+  // Firmware CPU time per sample, host time (sanitizer builds are slower)
+  TEST_CHECK(sim_task_get_stats("main Task", &main_stats));
+  TEST_CHECK(sim_task_get_stats("nimble_host", &host_stats));
+  test_bench("sim_cpu_per_event",
+             s_pushed ? ((double) (main_stats.m_cpu_ns + host_stats.m_cpu_ns) / s_pushed) / 1000.0 : 0.0,
+             "us");
+
+  return TEST_RESULT();
+}
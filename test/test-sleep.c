@@ -0,0 +1,160 @@
+/*!
+  @file test-sleep.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "vscp-ble-sleep.h"
+#include "vscp-ble-test.h"
+
+#define STATES 4 // Number of duty cycle states
+#define EVENTS 4 // Number of duty cycle events
+
+///////////////////////////////////////////////////////////////////////////////
+// test_transitions
+//
+// Every state and event against the expected transition table.
+//
+
+static void
+test_transitions(void)
+{
+  // Expected next state, [state][event]
+  static const vscp_ble_sleep_state_t expected[STATES][EVENTS] = {
+    // SYNC, SAMPLE_DONE, ADV_DONE, TIMEOUT
+    { VSCP_BLE_SLEEP_STATE_SAMPLE,
+      VSCP_BLE_SLEEP_STATE_BOOT,
+      VSCP_BLE_SLEEP_STATE_BOOT,
+      VSCP_BLE_SLEEP_STATE_SLEEP }, // BOOT
+    { VSCP_BLE_SLEEP_STATE_SAMPLE,
+      VSCP_BLE_SLEEP_STATE_ADVERTISE,
+      VSCP_BLE_SLEEP_STATE_SAMPLE,
+      VSCP_BLE_SLEEP_STATE_SLEEP }, // SAMPLE
+    { VSCP_BLE_SLEEP_STATE_ADVERTISE,
+      VSCP_BLE_SLEEP_STATE_ADVERTISE,
+      VSCP_BLE_SLEEP_STATE_SLEEP,
+      VSCP_BLE_SLEEP_STATE_SLEEP }, // ADVERTISE
+    { VSCP_BLE_SLEEP_STATE_SLEEP,
+      VSCP_BLE_SLEEP_STATE_SLEEP,
+      VSCP_BLE_SLEEP_STATE_SLEEP,
+      VSCP_BLE_SLEEP_STATE_SLEEP }, // SLEEP
+  };
+
+  for (int state = 0; state < STATES; state++) {
+    for (int ev = 0; ev < EVENTS; ev++) {
+      TEST_CHECK_EQ(vscp_ble_sleep_next((vscp_ble_sleep_state_t) state, (vscp_ble_sleep_event_t) ev),
+                    expected[state][ev]);
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_cycle
+//
+// A normal cycle and a cycle cut short by the budget both end in SLEEP,
+// and SLEEP is entered once whatever arrives after it.
+//
+
+static void
+test_cycle(void)
+{
+  vscp_ble_sleep_state_t state = VSCP_BLE_SLEEP_STATE_BOOT;
+  int entered                  = 0;
+
+  static const vscp_ble_sleep_event_t evs[] = {
+    VSCP_BLE_SLEEP_EV_SYNC,    VSCP_BLE_SLEEP_EV_SAMPLE_DONE, VSCP_BLE_SLEEP_EV_ADV_DONE,
+    VSCP_BLE_SLEEP_EV_TIMEOUT, VSCP_BLE_SLEEP_EV_ADV_DONE,    VSCP_BLE_SLEEP_EV_SYNC,
+  };
+
+  for (size_t i = 0; i < sizeof(evs) / sizeof(evs[0]); i++) {
+    vscp_ble_sleep_state_t next = vscp_ble_sleep_next(state, evs[i]);
+    if ((next != state) && (VSCP_BLE_SLEEP_STATE_SLEEP == next)) {
+      entered++;
+    }
+    state = next;
+  }
+  TEST_CHECK_EQ(state, VSCP_BLE_SLEEP_STATE_SLEEP);
+  TEST_CHECK_EQ(entered, 1);
+
+  // Budget exceeded while advertising
+  state = vscp_ble_sleep_next(VSCP_BLE_SLEEP_STATE_BOOT, VSCP_BLE_SLEEP_EV_SYNC);
+  state = vscp_ble_sleep_next(state, VSCP_BLE_SLEEP_EV_SAMPLE_DONE);
+  TEST_CHECK_EQ(state, VSCP_BLE_SLEEP_STATE_ADVERTISE);
+  TEST_CHECK_EQ(vscp_ble_sleep_next(state, VSCP_BLE_SLEEP_EV_TIMEOUT), VSCP_BLE_SLEEP_STATE_SLEEP);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_retained
+//
+// Power on resets the retained state, a wakeup keeps it.
+//
+
+static void
+test_retained(void)
+{
+  vscp_ble_sleep_retained_t ret;
+
+  // Power on, memory content is garbage
+  memset(&ret, 0xA5, sizeof(ret));
+  TEST_CHECK_EQ(vscp_ble_sleep_retained_init(&ret), 0);
+  TEST_CHECK_EQ(ret.m_magic, VSCP_BLE_SLEEP_MAGIC);
+  TEST_CHECK_EQ(ret.m_wake_count, 0);
+  TEST_CHECK_EQ(ret.m_frame_seq, 0);
+
+  // Cycles
+  for (uint32_t i = 1; i <= 3; i++) {
+    ret.m_frame_seq = i * 10;
+    vscp_ble_sleep_record_startup(&ret, 1000 * i);
+    TEST_CHECK_EQ(vscp_ble_sleep_retained_init(&ret), 1);
+    TEST_CHECK_EQ(ret.m_wake_count, i);
+    TEST_CHECK_EQ(ret.m_frame_seq, i * 10);
+  }
+
+  // Last and worst case startup time
+  vscp_ble_sleep_record_startup(&ret, 500);
+  TEST_CHECK_EQ(ret.m_wake_to_adv_us, 500);
+  TEST_CHECK_EQ(ret.m_wake_to_adv_max_us, 3000);
+
+  TEST_CHECK_EQ(vscp_ble_sleep_retained_init(NULL), 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  test_transitions();
+  test_cycle();
+  test_retained();
+
+  return TEST_RESULT();
+}
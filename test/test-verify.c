@@ -0,0 +1,408 @@
+/*!
+  @file test-verify.c
+
+  @note This file is part of the VSCP (https://www.vscp.org)
+
+  @license  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project
+  <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vscp.h>
+
+#include "mbedtls/bignum.h"
+#include "mbedtls/ecdsa.h"
+#include "mbedtls/sha256.h"
+#include "mbedtls/version.h"
+
+#include "vscp-ble-test.h"
+#include "vscp-ble-verify.h"
+
+// As in vscp-ble-verify.c
+#if MBEDTLS_VERSION_MAJOR < 3
+#define mbedtls_sha256 mbedtls_sha256_ret
+#endif
+
+#define NODES        4   // Nodes with a key
+#define NODE_ID(n)   ((uint16_t) (0x0200 + (n)))
+#define ITEMS        256 // Batch size
+#define RESULTS_MAX  512 // Results the callback keeps
+#define BENCH_ITEMS  200 // Payloads per benchmark batch
+
+/*!
+  Key pair of a test node
+*/
+typedef struct test_node {
+  mbedtls_mpi m_d;
+  mbedtls_ecp_point m_q;
+} test_node_t;
+
+/*!
+  Result as the callback got it
+*/
+typedef struct test_result {
+  uint16_t m_nodeid;
+  uint32_t m_ts;
+  vscp_ble_verify_result_t m_result;
+} test_result_t;
+
+static mbedtls_ecp_group s_grp;
+static test_node_t s_nodes[NODES];
+static vscp_ble_verify_node_t s_vnodes[NODES];
+static vscp_ble_verify_item_t s_items[ITEMS];
+static vscp_ble_verify_t s_verify;
+
+static test_result_t s_results[RESULTS_MAX];
+static uint32_t s_results_cnt;
+
+///////////////////////////////////////////////////////////////////////////////
+// test_rng
+//
+// Deterministic random numbers for key generation and signing.
+//
+
+static int
+test_rng(void *arg, unsigned char *pbuf, size_t len)
+{
+  static uint64_t state = 0x9e3779b97f4a7c15ULL;
+
+  (void) arg;
+  for (size_t i = 0; i < len; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    pbuf[i] = (unsigned char) (state >> 24);
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// sign
+//
+// Payload of a node as the node firmware makes it (create_signed_payload()).
+//
+
+static secure_payload_t
+sign(int n, uint32_t ts)
+{
+  secure_payload_t payload;
+  unsigned char hash[32];
+  mbedtls_mpi r;
+  mbedtls_mpi s;
+
+  memset(&payload, 0, sizeof(payload));
+  payload.timestamp = ts;
+
+  mbedtls_mpi_init(&r);
+  mbedtls_mpi_init(&s);
+  TEST_CHECK_EQ(mbedtls_sha256((const unsigned char *) &payload.timestamp, sizeof(payload.timestamp), hash, 0), 0);
+  TEST_CHECK_EQ(mbedtls_ecdsa_sign(&s_grp, &r, &s, &s_nodes[n].m_d, hash, sizeof(hash), test_rng, NULL), 0);
+  TEST_CHECK_EQ(mbedtls_mpi_write_binary(&r, payload.signature, 32), 0);
+  TEST_CHECK_EQ(mbedtls_mpi_write_binary(&s, payload.signature + 32, 32), 0);
+  mbedtls_mpi_free(&r);
+  mbedtls_mpi_free(&s);
+
+  return payload;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// result_cb
+//
+
+static void
+result_cb(uint16_t nodeid, uint32_t timestamp, vscp_ble_verify_result_t result, void *arg)
+{
+  (void) arg;
+
+  if (s_results_cnt < RESULTS_MAX) {
+    s_results[s_results_cnt].m_nodeid = nodeid;
+    s_results[s_results_cnt].m_ts     = timestamp;
+    s_results[s_results_cnt].m_result = result;
+  }
+  s_results_cnt++;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// put
+//
+// Queues a payload signed by node n, returns what vscp_ble_verify_put() did.
+//
+
+static int
+put(int n, uint32_t ts)
+{
+  secure_payload_t payload = sign(n, ts);
+
+  return vscp_ble_verify_put(&s_verify, NODE_ID(n), &payload);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// count_ok
+//
+// Results reported valid for a node and timestamp.
+//
+
+static uint32_t
+count_ok(int n, uint32_t ts)
+{
+  uint32_t cnt = 0;
+
+  for (uint32_t i = 0; (i < s_results_cnt) && (i < RESULTS_MAX); i++) {
+    cnt += (s_results[i].m_nodeid == NODE_ID(n)) && (s_results[i].m_ts == ts) &&
+           (VSCP_BLE_VERIFY_OK == s_results[i].m_result);
+  }
+
+  return cnt;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// start
+//
+// Verifier with the public keys of all test nodes.
+//
+
+static void
+start(uint8_t threads)
+{
+  unsigned char key[65];
+  size_t len;
+
+  s_results_cnt = 0;
+  TEST_CHECK_EQ(vscp_ble_verify_init(&s_verify, s_vnodes, NODES, s_items, ITEMS, threads, result_cb, NULL),
+                VSCP_ERROR_SUCCESS);
+  for (int n = 0; n < NODES; n++) {
+    TEST_CHECK_EQ(
+      mbedtls_ecp_point_write_binary(&s_grp, &s_nodes[n].m_q, MBEDTLS_ECP_PF_UNCOMPRESSED, &len, key, sizeof(key)),
+      0);
+    TEST_CHECK_EQ(len, sizeof(key));
+    TEST_CHECK_EQ(vscp_ble_verify_add_key(&s_verify, NODE_ID(n), key, len), VSCP_ERROR_SUCCESS);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_signatures
+//
+// Real signatures verify, changed ones and ones by another node do not.
+// Keys that are not points on the curve are refused.
+//
+
+static void
+test_signatures(void)
+{
+  secure_payload_t payload;
+  unsigned char key[65] = { 0x04 };
+
+  start(1);
+  TEST_CHECK_EQ(put(0, 1), VSCP_ERROR_SUCCESS);
+
+  payload = sign(1, 1);
+  payload.signature[40] ^= 0x01;
+  TEST_CHECK_EQ(vscp_ble_verify_put(&s_verify, NODE_ID(1), &payload), VSCP_ERROR_SUCCESS);
+
+  payload = sign(3, 7);
+  TEST_CHECK_EQ(vscp_ble_verify_put(&s_verify, NODE_ID(2), &payload), VSCP_ERROR_SUCCESS);
+
+  // Signed timestamp 8, sent as 9
+  payload           = sign(3, 8);
+  payload.timestamp = 9;
+  TEST_CHECK_EQ(vscp_ble_verify_put(&s_verify, NODE_ID(3), &payload), VSCP_ERROR_SUCCESS);
+
+  TEST_CHECK_EQ(vscp_ble_verify_put(&s_verify, 0x7777, &payload), VSCP_ERROR_NOT_SUPPORTED);
+  TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), 1);
+
+  TEST_CHECK_EQ(s_results_cnt, 4);
+  TEST_CHECK_EQ(s_results[0].m_result, VSCP_BLE_VERIFY_OK);
+  TEST_CHECK_EQ(s_results[1].m_result, VSCP_BLE_VERIFY_BAD);
+  TEST_CHECK_EQ(s_results[2].m_result, VSCP_BLE_VERIFY_BAD);
+  TEST_CHECK_EQ(s_results[3].m_result, VSCP_BLE_VERIFY_BAD);
+  TEST_CHECK_EQ(s_verify.m_stats.m_verified, 1);
+  TEST_CHECK_EQ(s_verify.m_stats.m_bad, 3);
+  TEST_CHECK_EQ(s_verify.m_stats.m_no_key, 1);
+
+  // A bad signature does not use up the timestamp
+  TEST_CHECK_EQ(put(1, 1), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), 1);
+
+  key[1] = 1;
+  TEST_CHECK_EQ(vscp_ble_verify_add_key(&s_verify, NODE_ID(0), key, sizeof(key)), VSCP_ERROR_INVALID_PARAMETER);
+  TEST_CHECK_EQ(vscp_ble_verify_add_key(&s_verify, NODE_ID(0), key, 33), VSCP_ERROR_INVALID_PARAMETER);
+  vscp_ble_verify_free(&s_verify);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_copies
+//
+// Copies of a payload in one batch are verified and reported once, also
+// when another timestamp of the node is queued between them.
+//
+
+static void
+test_copies(void)
+{
+  start(1);
+
+  TEST_CHECK_EQ(put(0, 5), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(put(0, 6), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(put(0, 5), VSCP_ERROR_ALREADY_DEFINED);
+  TEST_CHECK_EQ(put(1, 5), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(put(0, 6), VSCP_ERROR_ALREADY_DEFINED);
+  TEST_CHECK_EQ(put(0, 4), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(s_verify.m_items_cnt, 4);
+  TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), 4);
+  TEST_CHECK_EQ(count_ok(0, 5), 1);
+  TEST_CHECK_EQ(count_ok(0, 6), 1);
+  TEST_CHECK_EQ(count_ok(0, 4), 1);
+  TEST_CHECK_EQ(count_ok(1, 5), 1);
+
+  // Verified ones are replays from now on, the queued state is gone
+  TEST_CHECK_EQ(put(0, 5), VSCP_ERROR_ALREADY_DEFINED);
+  TEST_CHECK_EQ(put(0, 3), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(put(0, 7), VSCP_ERROR_SUCCESS);
+
+  // Far below the newest queued one, let in and dropped by the run
+  TEST_CHECK_EQ(put(2, 10), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(put(2, 10 + VSCP_BLE_VERIFY_WINDOW), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(put(2, 10), VSCP_ERROR_SUCCESS);
+  s_results_cnt = 0;
+  TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), 4);
+  TEST_CHECK_EQ(s_results_cnt, 4);
+  TEST_CHECK_EQ(count_ok(2, 10), 1);
+  TEST_CHECK_EQ(s_verify.m_stats.m_seen, 4);
+  vscp_ble_verify_free(&s_verify);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_window
+//
+// Timestamps in the window below the newest are accepted once, older
+// ones are replays. A forged high timestamp in a batch does not keep a
+// real lower one out.
+//
+
+static void
+test_window(void)
+{
+  secure_payload_t payload;
+
+  start(2);
+
+  payload = sign(0, 1000);
+  payload.signature[0] ^= 0x80;
+  TEST_CHECK_EQ(vscp_ble_verify_put(&s_verify, NODE_ID(0), &payload), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(put(0, 100), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), 1);
+  TEST_CHECK_EQ(count_ok(0, 100), 1);
+
+  TEST_CHECK_EQ(put(0, 100 - VSCP_BLE_VERIFY_WINDOW + 1), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(put(0, 100 - VSCP_BLE_VERIFY_WINDOW), VSCP_ERROR_ALREADY_DEFINED);
+  TEST_CHECK_EQ(put(0, 99), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), 2);
+  TEST_CHECK_EQ(put(0, 99), VSCP_ERROR_ALREADY_DEFINED);
+
+  // Moving the window up drops what fell out of it
+  TEST_CHECK_EQ(put(0, 100 + VSCP_BLE_VERIFY_WINDOW), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), 1);
+  TEST_CHECK_EQ(put(0, 100), VSCP_ERROR_ALREADY_DEFINED);
+  TEST_CHECK_EQ(put(0, 101), VSCP_ERROR_SUCCESS);
+  TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), 1);
+  vscp_ble_verify_free(&s_verify);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// bench_verify
+//
+// Verifications per second over a batch, by one thread and by four.
+// Results must not depend on the thread count.
+//
+
+static void
+bench_verify(void)
+{
+  static secure_payload_t payloads[BENCH_ITEMS];
+  static uint8_t results[BENCH_ITEMS];
+  uint8_t threads[2] = { 1, 4 };
+  char name[32];
+
+  for (int i = 0; i < BENCH_ITEMS; i++) {
+    payloads[i] = sign(i % NODES, 1000 + (uint32_t) i);
+    if (0 == (i % 17)) {
+      payloads[i].signature[63] ^= 0x01;
+    }
+  }
+
+  for (int k = 0; k < 2; k++) {
+    start(threads[k]);
+    for (int i = 0; i < BENCH_ITEMS; i++) {
+      TEST_CHECK_EQ(vscp_ble_verify_put(&s_verify, NODE_ID(i % NODES), &payloads[i]), VSCP_ERROR_SUCCESS);
+    }
+    TEST_CHECK_EQ(vscp_ble_verify_run(&s_verify), BENCH_ITEMS - ((BENCH_ITEMS + 16) / 17));
+    TEST_CHECK_EQ(s_results_cnt, BENCH_ITEMS);
+    for (int i = 0; (i < BENCH_ITEMS) && (i < RESULTS_MAX); i++) {
+      if (0 == k) {
+        results[i] = (uint8_t) s_results[i].m_result;
+      }
+      TEST_CHECK_EQ(s_results[i].m_result, results[i]);
+      TEST_CHECK_EQ(s_results[i].m_ts, 1000 + i);
+    }
+
+    snprintf(name, sizeof(name), "verify_threads_%u", threads[k]);
+    test_bench(name,
+               (double) (s_verify.m_stats.m_verified + s_verify.m_stats.m_bad) * 1e6 /
+                 (double) s_verify.m_stats.m_busy_us,
+               "verifications/s");
+    vscp_ble_verify_free(&s_verify);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// main
+//
+
+int
+main(void)
+{
+  mbedtls_ecp_group_init(&s_grp);
+  TEST_CHECK_EQ(mbedtls_ecp_group_load(&s_grp, MBEDTLS_ECP_DP_SECP256R1), 0);
+  for (int n = 0; n < NODES; n++) {
+    mbedtls_mpi_init(&s_nodes[n].m_d);
+    mbedtls_ecp_point_init(&s_nodes[n].m_q);
+    TEST_CHECK_EQ(mbedtls_ecp_gen_keypair(&s_grp, &s_nodes[n].m_d, &s_nodes[n].m_q, test_rng, NULL), 0);
+  }
+
+  test_signatures();
+  test_copies();
+  test_window();
+  bench_verify();
+
+  for (int n = 0; n < NODES; n++) {
+    mbedtls_mpi_free(&s_nodes[n].m_d);
+    mbedtls_ecp_point_free(&s_nodes[n].m_q);
+  }
+  mbedtls_ecp_group_free(&s_grp);
+
+  return TEST_RESULT();
+}
@@ -0,0 +1,116 @@
+
+/*!
+  @file vscp-ble-test.h
+  @brief Minimal check helpers for the host tests.
+
+  Each test program checks one module and exits non zero if any check
+  failed. Measurements are printed as "bench: <name> <value> <unit>"
+  lines so they can be compared between runs.
+
+  @note This file is part of the VSCP project.
+  @note For more information, visit https://www.vscp.org
+
+  The MIT License (MIT)
+
+  @copyright  Copyright (C) 2000-2025 Ake Hedman, the VSCP project <info@vscp.org>
+
+  Permission is hereby granted, free of charge, to any person obtaining a copy
+  of this software and associated documentation files (the "Software"), to deal
+  in the Software without restriction, including without limitation the rights
+  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+  copies of the Software, and to permit persons to whom the Software is
+  furnished to do so, subject to the following conditions:
+
+  The above copyright notice and this permission notice shall be included in all
+  copies or substantial portions of the Software.
+
+  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+  SOFTWARE.
+*/
+
+#ifndef VSCP_BLE_TEST_H
+#define VSCP_BLE_TEST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+static int s_test_failures;
+
+/*!
+  Check a condition, report and count it if it does not hold
+*/
+#define TEST_CHECK(cond)                                                                                               \
+  do {                                                                                                                 \
+    if (!(cond)) {                                                                                                     \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);                                         \
+      s_test_failures++;                                                                                               \
+    }                                                                                                                  \
+  } while (0)
+
+/*!
+  Check that two integer expressions are equal
+*/
+#define TEST_CHECK_EQ(a, b)                                                                                            \
+  do {                                                                                                                 \
+    long long test_a_ = (long long) (a);                                                                               \
+    long long test_b_ = (long long) (b);                                                                               \
+    if (test_a_ != test_b_) {                                                                                          \
+      fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, test_a_, test_b_); \
+      s_test_failures++;                                                                                               \
+    }                                                                                                                  \
+  } while (0)
+
+/*!
+  Report the result, use as the return value of main()
+*/
+#define TEST_RESULT() test_result(__FILE__)
+
+///////////////////////////////////////////////////////////////////////////////
+// test_result
+//
+
+static inline int
+test_result(const char *name)
+{
+  if (s_test_failures) {
+    fprintf(stderr, "%s: %d check(s) failed\n", name, s_test_failures);
+    return 1;
+  }
+
+  return 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_now_ns
+//
+// Monotonic wall clock in nanoseconds for measurements.
+//
+
+static inline uint64_t
+test_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// test_bench
+//
+// Print a measurement.
+//
+
+static inline void
+test_bench(const char *name, double value, const char *unit)
+{
+  printf("bench: %s %.1f %s\n", name, value, unit);
+}
+
+#endif // VSCP_BLE_TEST_H